@@ -0,0 +1,139 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <assert.h>
+
+#include "diff/diff.h"
+#include "diff/diff_batch.h"
+#include "diff/diff_cmd_args.h"
+#include "diff/diff_create.h"
+#include "diff/diff_var_table.h"
+
+#include "graph_dump/html_builder.h"
+
+#include "tree/tree.h"
+
+
+const size_t BENCH_STEP_COUNT = 32;
+
+
+static const size_t BENCH_TREE_SIZES[] = {171, 3001, 20001};
+
+
+typedef struct {
+    const char* name;
+    DiagnosticsLevel level;
+    size_t node_limit;
+} BenchLevel;
+
+
+static const BenchLevel BENCH_LEVELS[] = {
+    {"off",            DIAGNOSTICS_OFF,     DEFAULT_DUMP_NODE_LIMIT},
+    {"verify",         DIAGNOSTICS_VERIFY,  DEFAULT_DUMP_NODE_LIMIT},
+    {"sampled",        DIAGNOSTICS_SAMPLED, DEFAULT_DUMP_NODE_LIMIT},
+    {"full",           DIAGNOSTICS_FULL,    DEFAULT_DUMP_NODE_LIMIT},
+    {"full, no limit", DIAGNOSTICS_FULL,    0}
+};
+
+
+static double measureLevel(Differentiator* diff, const BenchLevel* level);
+static OperationStatus verifyStep(Differentiator* diff);
+static TreeNode* createBenchTree(size_t node_count, size_t* counter);
+
+
+int main()
+{
+    const char* argv[] = {"bench_diagnostics"};
+    Differentiator diff = {};
+    OperationStatus status = parseArgs(&diff, 1, argv);
+    if (status == STATUS_OK)
+        status = diffContextConstructor(&diff);
+    size_t var_idx = 0;
+    if (status == STATUS_OK)
+        status = addVariable(&diff, &var_idx, "x", 1);
+    if (status != STATUS_OK) {
+        printErrorStatus(status);
+        return 1;
+    }
+
+    openGraphDumpFile(&diff);
+    TREE_CREATE(&diff.forest.trees[0]);
+    diff.forest.count = 1;
+
+    printf("%-12s", "tree");
+    for (size_t index = 0; index < sizeof(BENCH_LEVELS) / sizeof(*BENCH_LEVELS); index++)
+        printf("%16s", BENCH_LEVELS[index].name);
+    printf("\n");
+
+// Корень бинарный, поэтому treeVerify обходит все дерево
+    for (size_t size_idx = 0; size_idx < sizeof(BENCH_TREE_SIZES) / sizeof(*BENCH_TREE_SIZES); size_idx++) {
+        size_t counter = 0;
+        diff.forest.trees[0].root = createBenchTree(BENCH_TREE_SIZES[size_idx], &counter);
+        assert(diff.forest.trees[0].root);
+
+        char label[BUFFER_SIZE] = "";
+        snprintf(label, BUFFER_SIZE, "%zu nodes", BENCH_TREE_SIZES[size_idx]);
+        printf("%-12s", label);
+        for (size_t index = 0; index < sizeof(BENCH_LEVELS) / sizeof(*BENCH_LEVELS); index++)
+            printf("%13.1f us", measureLevel(&diff, &BENCH_LEVELS[index]));
+        printf("\n");
+
+        deleteBranch(diff.forest.trees[0].root);
+        diff.forest.trees[0].root = NULL;
+    }
+
+    diff.forest.count = 0;
+    diffContextDestructor(&diff);
+    fclose(diff.graph_dump.file);
+    return 0;
+}
+
+
+static double measureLevel(Differentiator* diff, const BenchLevel* level)
+{
+    assert(diff); assert(level);
+
+    diff->args.diagnostics_info.level = level->level;
+    diff->args.diagnostics_info.node_limit = level->node_limit;
+    diff->graph_dump.call_counter = 0;
+
+    struct timespec start = {};
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (size_t index = 0; index < BENCH_STEP_COUNT; index++) {
+        OperationStatus status = verifyStep(diff);
+        assert(status == STATUS_OK);
+        (void)status;
+    }
+
+    return getElapsedTime(&start) * 1000 / BENCH_STEP_COUNT;
+}
+
+
+static OperationStatus verifyStep(Differentiator* diff)
+{
+    assert(diff);
+
+    TREE_VERIFY(diff, 0, "benchmark step");
+    return STATUS_OK;
+}
+
+
+static TreeNode* createBenchTree(size_t node_count, size_t* counter)
+{
+    assert(node_count % 2 == 1); assert(counter);
+
+// Сбалансированное полное дерево из сложений и умножений над x и константами
+    if (node_count == 1) {
+        (*counter)++;
+        return *counter % 2 == 0 ? createVar(0) : createNum((double)(*counter % 10));
+    }
+
+    size_t left_count = (node_count - 1) / 2;
+    if (left_count % 2 == 0)
+        left_count--;
+    TreeNode* left = createBenchTree(left_count, counter);
+    TreeNode* right = createBenchTree(node_count - 1 - left_count, counter);
+
+    return createOp(*counter % 3 == 0 ? OP_MUL : OP_ADD, left, right);
+}
@@ -0,0 +1,16 @@
+#!/bin/sh
+# Измеряет стоимость одного шага TREE_VERIFY на каждом уровне --diagnostics.
+# Собирается с -O2 и без санитайзеров, дампы пишутся во временный каталог.
+set -e
+
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+BENCH_DIR="$ROOT/build/bench"
+SOURCES=$(find "$ROOT/source" -name '*.cpp' ! -name main.cpp ! -name client_main.cpp)
+
+mkdir -p "$BENCH_DIR"
+g++ -O2 -std=c++17 -pthread -I"$ROOT/include" $SOURCES "$ROOT/bench/bench_diagnostics.cpp" \
+    -o "$BENCH_DIR/bench_diagnostics"
+
+cd "$BENCH_DIR"
+./bench_diagnostics
+rm -rf images
@@ -13,10 +13,19 @@ void printErrorStatus(OperationStatus status);
 OperationStatus diffCalculateDerivative(Differentiator* diff, size_t tree_idx);
 
 
+OperationStatus diffForestReserve(Differentiator* diff, size_t tree_count);
+
+
 OperationStatus diffConstructor(Differentiator* diff, const int argc, const char** argv);
 
 
 void diffDestructor(Differentiator* diff);
 
 
+OperationStatus diffContextConstructor(Differentiator* diff);
+
+
+void diffContextDestructor(Differentiator* diff);
+
+
 #endif // DIFF_H_
\ No newline at end of file
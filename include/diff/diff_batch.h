@@ -0,0 +1,18 @@
+#ifndef DIFF_BATCH_H_
+#define DIFF_BATCH_H_
+
+
+#include <time.h>
+
+#include "diff/diff_defs.h"
+
+#include "status.h"
+
+
+OperationStatus diffRunBatch(const CmdArgs* args);
+
+
+double getElapsedTime(const struct timespec* start);
+
+
+#endif // DIFF_BATCH_H_
@@ -0,0 +1,32 @@
+#ifndef DIFF_CACHE_H_
+#define DIFF_CACHE_H_
+
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "diff/diff_defs.h"
+
+#include "status.h"
+
+
+const size_t DEFAULT_CACHE_SIZE_LIMIT = 256 << 20;
+const uint64_t HASH_OFFSET_BASIS = 0xCBF29CE484222325ULL;
+
+
+OperationStatus diffCacheLookup(Differentiator* diff, size_t order, size_t* cached_count);
+
+
+OperationStatus diffCacheStore(Differentiator* diff, size_t cached_count);
+
+
+void diffCachePrintStats(FILE* output);
+
+
+uint64_t diffCacheHashBytes(uint64_t hash, const void* data, size_t size);
+
+
+void diffCacheEvict(const char* directory, const char* suffix, size_t size_limit);
+
+
+#endif // DIFF_CACHE_H_
@@ -7,6 +7,11 @@
 
 const size_t START_ELEMENT_COUNT = 4;
 const double EPS = 1e-7;
+const size_t DEFAULT_DUMP_SAMPLE_PERIOD = 16;
+const size_t DEFAULT_DUMP_NODE_LIMIT = 2000;
+const size_t DEFAULT_TEX_NODE_LIMIT = 1000;
+const size_t DEFAULT_TEX_DEPTH_LIMIT = 24;
+const size_t DEFAULT_TEX_DEFINITION_LIMIT = 8;
 
 
 #define TEX_FILE diff->tex_dump.file
@@ -16,6 +21,7 @@ typedef struct {
     FILE* file;
     char directory[BUFFER_SIZE];
     size_t image_counter;
+    size_t call_counter;
 } GraphDumpState;
 
 
@@ -42,10 +48,22 @@ typedef struct {
 } Variable;
 
 
+typedef struct {
+    char** blocks;
+    size_t block_count;
+    size_t block_capacity;
+    size_t used;
+    size_t block_size;
+} NameArena;
+
+
 typedef struct {
     Variable* variables;
     size_t capacity;
     size_t count; 
+    size_t* slots;
+    size_t slot_count;
+    NameArena names;
 } VarTable;
 
 
@@ -63,12 +81,75 @@ typedef struct {
 } TaylorInfo;
 
 
+typedef struct {
+    const char* batch_file;
+    const char* output_file;
+} BatchInfo;
+
+
+typedef struct {
+    const char* region;
+    int event_fd;
+} SharedInfo;
+
+
+typedef struct {
+    const char* load_file;
+    const char* save_file;
+} ForestInfo;
+
+
+typedef struct {
+    const char* directory;
+    size_t size_limit;
+} CacheInfo;
+
+
+typedef enum {
+    DIAGNOSTICS_OFF,
+    DIAGNOSTICS_VERIFY,
+    DIAGNOSTICS_SAMPLED,
+    DIAGNOSTICS_FULL
+} DiagnosticsLevel;
+
+
+typedef struct {
+    DiagnosticsLevel level;
+    size_t sample_period;
+    size_t node_limit;
+} DiagnosticsInfo;
+
+
+typedef struct {
+    size_t node_limit;
+    size_t depth_limit;
+    size_t definition_limit;
+} TexLimitInfo;
+
+
+typedef enum {
+    OUTPUT_TEX,
+    OUTPUT_JSON,
+    OUTPUT_CSV
+} OutputFormat;
+
+
 typedef struct {
     const char* input_file;
     bool infix_input;
     DerivativeInfo derivative_info;
     TaylorInfo taylor_info;
+    BatchInfo batch_info;
+    SharedInfo shared_info;
+    ForestInfo forest_info;
+    CacheInfo cache_info;
+    DiagnosticsInfo diagnostics_info;
+    TexLimitInfo tex_limit_info;
+    OutputFormat output_format;
+    const char* socket_path;
+    size_t thread_count;
     bool simple_graph;
+    bool use_graphviz;
 } CmdArgs;
 
 
@@ -79,6 +160,21 @@ typedef struct {
 } Forest;
 
 
+typedef struct RenderPipeline RenderPipeline;
+
+
+typedef struct OutputBackend OutputBackend;
+
+
+typedef struct {
+    const OutputBackend* backend;
+    FILE* file;
+    size_t record_count;
+    double value;
+    bool has_value;
+} OutputState;
+
+
 typedef struct {
     Forest forest;
     VarTable var_table;
@@ -86,6 +182,8 @@ typedef struct {
     GraphDumpState graph_dump;
     TexDumpState tex_dump;
     const TreeNode* highlight_node;
+    RenderPipeline* render;
+    OutputState output;
 } Differentiator;
 
 
@@ -9,5 +9,8 @@ void diffEvaluate(Differentiator* diff, size_t tree_idx);
 
 double evaluateNode(Differentiator* diff, const TreeNode* node);
 
+void evaluateOperationBlock(OpType op, const double* left_args, const double* right_args,
+                            double* results, size_t count);
+
 
 #endif // DIFF_EVALUATE_H_
\ No newline at end of file
@@ -0,0 +1,25 @@
+#ifndef DIFF_OUTPUT_H_
+#define DIFF_OUTPUT_H_
+
+
+#include "diff/diff_defs.h"
+
+#include "status.h"
+
+
+// Все, что программа сообщает о выражении и производных, проходит через выбранную реализацию
+struct OutputBackend {
+    OperationStatus (*open)(Differentiator* diff);
+    void (*introduction)(Differentiator* diff);
+    void (*derivative)(Differentiator* diff, size_t tree_idx, bool is_cached);
+    void (*value)(Differentiator* diff, size_t tree_idx, double value);
+    void (*result)(Differentiator* diff, size_t tree_idx, double elapsed);
+    OperationStatus (*taylor)(Differentiator* diff, size_t tree_idx);
+    OperationStatus (*close)(Differentiator* diff);
+};
+
+
+const OutputBackend* getOutputBackend(OutputFormat format);
+
+
+#endif // DIFF_OUTPUT_H_
@@ -0,0 +1,57 @@
+#ifndef DIFF_PROGRAM_H_
+#define DIFF_PROGRAM_H_
+
+
+#include "diff/diff_defs.h"
+
+#include "status.h"
+
+
+typedef enum {
+    PROGRAM_NUMBER = 0,
+    PROGRAM_VARIABLE,
+    PROGRAM_OPERATION
+} ProgramCommandType;
+
+
+typedef struct {
+    ProgramCommandType type;
+    OpType op;
+    bool is_unary;
+    size_t var_idx;
+    double number;
+} ProgramCommand;
+
+
+typedef struct {
+    ProgramCommand* commands;
+    size_t count;
+    size_t stack_depth;
+} EvalProgram;
+
+
+typedef struct {
+    double* scratch;
+    const double** operands;
+    size_t block_size;
+    size_t stack_depth;
+} ProgramWorkspace;
+
+
+OperationStatus programCompile(EvalProgram* program, const TreeNode* root);
+
+
+void programDestroy(EvalProgram* program);
+
+
+OperationStatus programWorkspaceInit(ProgramWorkspace* workspace, size_t stack_depth);
+
+
+void programWorkspaceDestroy(ProgramWorkspace* workspace);
+
+
+void programEvaluate(const EvalProgram* program, ProgramWorkspace* workspace,
+                     const double* const* columns, size_t count, double* output);
+
+
+#endif // DIFF_PROGRAM_H_
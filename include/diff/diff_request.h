@@ -0,0 +1,25 @@
+#ifndef DIFF_REQUEST_H_
+#define DIFF_REQUEST_H_
+
+
+#include <stdio.h>
+
+#include "diff/diff_defs.h"
+
+#include "status.h"
+
+
+typedef struct {
+    const char* expression;
+    size_t expression_length;
+    const char* diff_var;
+    size_t order;
+    const char* points;
+    size_t points_length;
+} DiffRequest;
+
+
+OperationStatus diffProcessRequest(const CmdArgs* args, const DiffRequest* request, FILE* output);
+
+
+#endif // DIFF_REQUEST_H_
@@ -0,0 +1,58 @@
+#ifndef DIFF_SCHEDULER_H_
+#define DIFF_SCHEDULER_H_
+
+
+#include <stddef.h>
+#include <pthread.h>
+
+#include "status.h"
+
+
+typedef struct TaskWorker TaskWorker;
+typedef struct TaskScheduler TaskScheduler;
+
+typedef void (*TaskFunc)(TaskWorker* worker, void* argument);
+
+
+typedef struct {
+    TaskFunc function;
+    void* argument;
+    int is_done;
+} Task;
+
+
+typedef struct {
+    Task** tasks;
+    size_t head;
+    size_t tail;
+    size_t capacity;
+    pthread_mutex_t mutex;
+} TaskDeque;
+
+
+// Свои задачи поток берет с хвоста своей очереди, чужие крадет с головы
+struct TaskWorker {
+    TaskScheduler* scheduler;
+    TaskDeque deque;
+    size_t index;
+    size_t victim;
+};
+
+
+struct TaskScheduler {
+    TaskWorker* workers;
+    size_t worker_count;
+    int is_stopping;
+};
+
+
+OperationStatus schedulerRun(size_t thread_count, TaskFunc function, void* argument);
+
+
+void schedulerSpawn(TaskWorker* worker, Task* task);
+
+
+void schedulerJoin(TaskWorker* worker, Task* task);
+
+
+#endif // DIFF_SCHEDULER_H_
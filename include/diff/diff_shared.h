@@ -0,0 +1,48 @@
+#ifndef DIFF_SHARED_H_
+#define DIFF_SHARED_H_
+
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "diff/diff_defs.h"
+
+#include "status.h"
+
+
+const uint32_t SHARED_EVAL_MAGIC = 0x46464944;
+const size_t SHARED_EVAL_MAX_COLUMNS = 16;
+const size_t SHARED_EVAL_NAME_SIZE = 32;
+// Ограничение не зависит от размера области: производные строятся и при point_count == 0
+const uint64_t SHARED_EVAL_MAX_ORDER = 64;
+
+
+typedef enum {
+    SHARED_EVAL_PENDING = 0,
+    SHARED_EVAL_DONE,
+    SHARED_EVAL_FAILED
+} SharedEvalState;
+
+
+// Заголовок области: за ним по смещениям лежат входные столбцы переменных
+// и выходные столбцы значений производных порядков 0..order, по point_count чисел double
+typedef struct {
+    uint32_t magic;
+    uint32_t state;
+    uint32_t status;
+    uint32_t column_count;
+    uint64_t point_count;
+    uint64_t order;
+    uint64_t input_offset;
+    uint64_t output_offset;
+    char column_names[SHARED_EVAL_MAX_COLUMNS][SHARED_EVAL_NAME_SIZE];
+} SharedEvalHeader;
+
+
+OperationStatus diffEvaluateShared(Differentiator* diff, void* region, size_t region_size);
+
+
+OperationStatus diffRunShared(Differentiator* diff);
+
+
+#endif // DIFF_SHARED_H_
@@ -6,6 +6,12 @@
 #include "status.h"
 
 
+OperationStatus variableTableInit(VarTable* table);
+
+
+void variableTableDestroy(VarTable* table);
+
+
 void setVariableValue(Differentiator* diff, size_t var_idx, double value);
 
 
@@ -2,10 +2,27 @@
 #define GRAPH_GENERATOR_H_
 
 
+#include <stddef.h>
+
 #include "diff/diff_defs.h"
 
 
+typedef struct {
+    const char* fill;
+    const char* stroke;
+} NodeColors;
+
+
 void generateGraph(Differentiator* diff, size_t tree_idx, const char* graph_filename);
 
 
-#endif // GRAPH_GENERATOR_H_
\ No newline at end of file
+NodeColors getNodeColors(const TreeNode* node);
+
+
+int formatNodeData(Differentiator* diff, const TreeNode* node, char* buffer, size_t size);
+
+
+const char* nodeTypeToString(NodeType type);
+
+
+#endif // GRAPH_GENERATOR_H_
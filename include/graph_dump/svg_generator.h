@@ -0,0 +1,15 @@
+#ifndef SVG_GENERATOR_H_
+#define SVG_GENERATOR_H_
+
+
+#include <stdio.h>
+
+#include "diff/diff_defs.h"
+
+#include "status.h"
+
+
+OperationStatus generateSvg(Differentiator* diff, size_t tree_idx, FILE* svg_file);
+
+
+#endif // SVG_GENERATOR_H_
@@ -0,0 +1,13 @@
+#ifndef DIFF_SERVER_H_
+#define DIFF_SERVER_H_
+
+
+#include "diff/diff_defs.h"
+
+#include "status.h"
+
+
+OperationStatus diffRunServer(const CmdArgs* args);
+
+
+#endif // DIFF_SERVER_H_
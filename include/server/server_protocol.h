@@ -0,0 +1,24 @@
+#ifndef SERVER_PROTOCOL_H_
+#define SERVER_PROTOCOL_H_
+
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "status.h"
+
+
+// Кадр: длина полезной нагрузки (4 байта, сетевой порядок) и сама нагрузка.
+// Запрос: "выражение\nпеременная\nпорядок\nточка\nточка...", точка имеет вид "x=1, y=2".
+const uint32_t SERVER_MAX_FRAME_SIZE = 1 << 24;
+// Порядок выше этого отклоняется: размер производных растет с порядком, а прервать запрос нельзя
+const size_t SERVER_MAX_ORDER = 64;
+
+
+OperationStatus serverReadFrame(int fd, char** buffer, size_t* capacity, size_t* length, bool* is_closed);
+
+
+OperationStatus serverWriteFrame(int fd, const char* data, size_t length);
+
+
+#endif // SERVER_PROTOCOL_H_
@@ -19,6 +19,7 @@ typedef enum {
     STATUS_SYSTEM_CALL_ERROR,
 // Command Line Argument Errors
     STATUS_CLI_UNKNOWN_OPTION,
+    STATUS_CLI_CONFLICTING_OPTIONS,
 // Syntax Errors
     STATUS_PARSER_INVALID_IDENTIFIER,
 // I/O Errors
@@ -26,6 +27,7 @@ typedef enum {
     STATUS_IO_FILE_OPEN_ERROR,
     STATUS_IO_FILE_EMPTY,
     STATUS_IO_FILE_READ_ERROR,
+    STATUS_IO_FILE_WRITE_ERROR,
     STATUS_IO_FILE_CLOSE_ERROR
 } OperationStatus;
 
@@ -9,11 +9,12 @@
 
 extern const char* GNUPLOT_OUTPUT_FILENAME;
 extern const char* GNUPLOT_IMAGES_DIRECTORY;
-extern const char* GNUPLOT_DATA_FILENAME;
-extern const char* GNUPLOT_SCRIPT_FILENAME;
 
 
 OperationStatus generatePlot(Differentiator* diff, const char* output_filename, size_t tree_count, ...);
 
 
+OperationStatus finishPlotting();
+
+
 #endif // PLOT_GENERATOR_H_
\ No newline at end of file
@@ -0,0 +1,56 @@
+#ifndef RENDER_CACHE_H_
+#define RENDER_CACHE_H_
+
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "tree/tree_defs.h"
+
+#include "status.h"
+
+
+// Потоковое состояние SHA-256: 64-битный хеш не годится в имя файла, коллизия подставила бы чужой результат
+typedef struct {
+    uint32_t state[8];
+    uint64_t length;
+    uint8_t block[64];
+    size_t block_length;
+} RenderDigest;
+
+
+// Артефакт отрисовки: ключ — хеш всех входных данных инструмента, путь — куда инструмент пишет результат
+typedef struct {
+    RenderDigest key;
+    char path[BUFFER_SIZE * 2];
+} RenderArtifact;
+
+
+void renderCacheOpen(const char* directory, size_t size_limit);
+
+
+bool renderCacheIsEnabled();
+
+
+void renderCacheKeyInit(RenderArtifact* artifact);
+
+
+void renderCacheKeyAdd(RenderArtifact* artifact, const void* data, size_t size);
+
+
+bool renderCacheHashFile(RenderArtifact* artifact, const char* path);
+
+
+bool renderCacheHashDirectory(RenderArtifact* artifact, const char* directory);
+
+
+bool renderCacheFetch(const RenderArtifact* artifact);
+
+
+void renderCacheStore(const RenderArtifact* artifact);
+
+
+void renderCachePrintStats(FILE* output);
+
+
+#endif // RENDER_CACHE_H_
@@ -0,0 +1,47 @@
+#ifndef RENDER_JOBS_H_
+#define RENDER_JOBS_H_
+
+
+#include <stdio.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+#include "tex_dump/render_cache.h"
+
+#include "status.h"
+
+
+const size_t MAX_RENDER_JOBS = 64;
+const size_t MAX_CLEANUP_FILES = 4;
+
+
+// Долгоживущий процесс, которому команды передаются через стандартный ввод
+typedef struct {
+    pid_t pid;
+    FILE* input;
+} RenderCoprocess;
+
+
+void renderJobsSetLimit(size_t limit);
+
+
+OperationStatus renderJobSubmit(const char* const* argv, const char* const* cleanup_files,
+                                size_t cleanup_count, const RenderArtifact* artifact, bool is_quiet);
+
+
+OperationStatus renderJobsWait();
+
+
+OperationStatus renderCoprocessStart(const char* const* argv, RenderCoprocess* coprocess);
+
+
+OperationStatus renderCoprocessFinish(RenderCoprocess* coprocess);
+
+
+OperationStatus makeDirectory(const char* path);
+
+
+OperationStatus removeDirectory(const char* path);
+
+
+#endif // RENDER_JOBS_H_
@@ -0,0 +1,17 @@
+#ifndef RENDER_PIPELINE_H_
+#define RENDER_PIPELINE_H_
+
+
+#include "diff/diff_defs.h"
+
+
+void renderPipelineStart(Differentiator* diff);
+
+
+void renderPipelineFinish(Differentiator* diff);
+
+
+void renderPlot(Differentiator* diff, const char* output_filename, size_t tree_idx);
+
+
+#endif // RENDER_PIPELINE_H_
@@ -0,0 +1,35 @@
+#ifndef TEX_ELISION_H_
+#define TEX_ELISION_H_
+
+
+#include <stddef.h>
+
+#include "tree/tree_defs.h"
+
+#include "status.h"
+
+
+// Поддерево, которое в формуле заменяется обозначением A_number; номер 0 — еще не напечатано
+typedef struct {
+    const TreeNode* node;
+    size_t number;
+} TexPlaceholder;
+
+
+typedef struct {
+    TexPlaceholder* items;
+    size_t count;
+    size_t capacity;
+} TexElision;
+
+
+OperationStatus texElisionBuild(TexElision* elision, const TreeNode* root, size_t node_limit, size_t depth_limit);
+
+
+TexPlaceholder* texElisionFind(TexElision* elision, const TreeNode* node);
+
+
+void texElisionDestroy(TexElision* elision);
+
+
+#endif // TEX_ELISION_H_
@@ -15,13 +15,15 @@
     treeDump(diff ,tree_idx, _status, __FILE__, __func__, __LINE__, format, ##__VA_ARGS__)
 
 
-#define TREE_VERIFY(diff, tree_idx, format, ...)                              \
-    do {                                                                      \
-        OperationStatus _status = treeVerify(&diff->forest.trees[tree_idx]);  \
-        TREE_DUMP(diff, tree_idx, _status, format, ##__VA_ARGS__);            \
-        if (_status != STATUS_OK) {                                           \
-            return _status;                                                   \
-        }                                                                     \
+#define TREE_VERIFY(diff, tree_idx, format, ...)                                      \
+    do {                                                                              \
+        if (diff->args.diagnostics_info.level == DIAGNOSTICS_OFF)                     \
+            break;                                                                    \
+        OperationStatus _status = treeVerify(&diff->forest.trees[tree_idx]);          \
+        TREE_DUMP(diff, tree_idx, _status, format, ##__VA_ARGS__);                    \
+        if (_status != STATUS_OK) {                                                   \
+            return _status;                                                           \
+        }                                                                             \
     } while (0)
 
 
@@ -35,6 +37,12 @@ OperationStatus treeConstructor(BinaryTree* tree, const char* name,
                                 const char* file, const char* function, int line);
 
 
+void treeUpdateVersion(BinaryTree* tree);
+
+
+OperationStatus treeCollectStats(const TreeNode* root, TreeStats* stats);
+
+
 void deleteBranch(TreeNode* node);
 
 
@@ -0,0 +1,37 @@
+#ifndef TREE_BINARY_H_
+#define TREE_BINARY_H_
+
+
+#include <stdint.h>
+
+#include "diff/diff_defs.h"
+#include "status.h"
+
+
+const uint32_t FOREST_FILE_MAGIC = 0x53524644;
+const uint32_t FOREST_FILE_VERSION = 1;
+
+
+// Заголовок файла леса: таблица констант выровнена и читается прямо из отображения,
+// имена переменных и деревья в обратном порядке обхода закодированы varint
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t tree_count;
+    uint32_t variable_count;
+    uint32_t constant_count;
+    uint32_t diff_var_idx;
+    uint64_t constants_offset;
+    uint64_t names_offset;
+    uint64_t trees_offset;
+    uint64_t file_size;
+} ForestFileHeader;
+
+
+OperationStatus diffSaveForest(const Differentiator* diff, const char* filename);
+
+
+OperationStatus diffLoadForest(Differentiator* diff, const char* filename);
+
+
+#endif // TREE_BINARY_H_
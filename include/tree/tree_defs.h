@@ -58,7 +58,7 @@ typedef struct {
 #define OP_INFO_ITEM(ENUM, SYMBOL) {ENUM, #ENUM, SYMBOL}
 
 
-const OpInfo OP_TABLE[] = {
+constexpr OpInfo OP_TABLE[] = {
     OP_INFO_ITEM(OP_ADD, "+"),
     OP_INFO_ITEM(OP_SUB, "-"),
     OP_INFO_ITEM(OP_MUL, "*"),
@@ -118,10 +118,19 @@ struct TreeNode {
 };
 
 
+// Версия меняется при каждом изменении дерева, 0 означает неизвестное содержимое
 typedef struct {
     TreeNode* root;
     CreationInfo origin;
+    size_t version;
 } BinaryTree;
 
 
+typedef struct {
+    size_t node_count;
+    size_t depth;
+    size_t type_counts[NODE_NUM + 1];
+} TreeStats;
+
+
 #endif // TREE_DEFS_H_
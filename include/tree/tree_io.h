@@ -9,4 +9,7 @@
 OperationStatus diffLoadExpression(Differentiator* diff);
 
 
+OperationStatus diffParseExpression(Differentiator* diff, const char* text, size_t length);
+
+
 #endif // TREE_IO_H_
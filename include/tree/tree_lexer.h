@@ -0,0 +1,68 @@
+#ifndef TREE_LEXER_H_
+#define TREE_LEXER_H_
+
+
+#include "tree/tree_defs.h"
+#include "tree/tree_source.h"
+
+#include "status.h"
+
+
+typedef enum {
+    LEXER_INFIX = 0,
+    LEXER_PREFIX
+} LexerMode;
+
+
+typedef enum {
+    TOKEN_END = 0,
+    TOKEN_NUMBER,
+    TOKEN_IDENTIFIER,
+    TOKEN_OPERATOR,
+    TOKEN_SYMBOL,
+    TOKEN_INVALID
+} TokenType;
+
+
+typedef struct {
+    TokenType type;
+    const char* text;
+    size_t length;
+    double number;
+    OpType op;
+} Token;
+
+
+typedef struct {
+    SourceStream* stream;
+    LexerMode mode;
+    Token token;
+    bool has_token;
+    char* word;
+    size_t word_capacity;
+    OperationStatus status;
+} Lexer;
+
+
+void lexerInit(Lexer* lexer, SourceStream* stream, LexerMode mode);
+
+
+void lexerDestroy(Lexer* lexer);
+
+
+const Token* lexerPeek(Lexer* lexer);
+
+
+void lexerConsume(Lexer* lexer);
+
+
+bool lexerIsSymbol(Lexer* lexer, char symbol);
+
+
+OpType lexerFindOperator(const char* word, size_t length);
+
+
+size_t lexerParseNumber(const char* text, size_t length, double* value);
+
+
+#endif // TREE_LEXER_H_
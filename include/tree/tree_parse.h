@@ -3,30 +3,10 @@
 
 
 #include "diff/diff_defs.h"
+#include "tree/tree_lexer.h"
 
 
-TreeNode* getTree(Differentiator* diff, char** buffer);
-
-
-TreeNode* getExpression(Differentiator* diff, char** buffer);
-
-
-TreeNode* getTerm(Differentiator* diff, char** buffer);
-
-
-TreeNode* getPower(Differentiator* diff, char** buffer);
-
-
-TreeNode* getPrimary(Differentiator* diff, char** buffer) ;
-
-
-TreeNode* getVariable(Differentiator* diff, char** buffer);
-
-
-TreeNode* getFunction(Differentiator* diff, char** buffer);
-
-
-TreeNode* getNumber(Differentiator* diff, char** buffer);
+TreeNode* getTree(Differentiator* diff, Lexer* lexer);
 
 
 #endif // TREE_PARSE_H_
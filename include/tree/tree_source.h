@@ -0,0 +1,45 @@
+#ifndef TREE_SOURCE_H_
+#define TREE_SOURCE_H_
+
+
+#include <stdio.h>
+
+#include "status.h"
+
+
+typedef struct {
+    char* data;
+    size_t size;
+    bool is_mapped;
+} SourceBuffer;
+
+
+typedef struct {
+    FILE* file;
+    const char* chunk;
+    char* chunk_storage;
+    size_t chunk_size;
+    size_t position;
+    bool error;
+} SourceStream;
+
+
+OperationStatus sourceBufferLoad(SourceBuffer* source, FILE* input_file);
+
+
+void sourceBufferRelease(SourceBuffer* source);
+
+
+OperationStatus sourceStreamOpen(SourceStream* stream, FILE* input_file);
+
+
+void sourceStreamOpenMemory(SourceStream* stream, const char* data, size_t size);
+
+
+void sourceStreamClose(SourceStream* stream);
+
+
+bool sourceStreamRefill(SourceStream* stream);
+
+
+#endif // TREE_SOURCE_H_
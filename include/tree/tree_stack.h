@@ -0,0 +1,33 @@
+#ifndef TREE_STACK_H_
+#define TREE_STACK_H_
+
+
+#include <stddef.h>
+
+#include "status.h"
+
+
+typedef struct {
+    char* data;
+    size_t element_size;
+    size_t count;
+    size_t capacity;
+} WorkStack;
+
+
+void workStackInit(WorkStack* stack, size_t element_size);
+
+
+void workStackDestroy(WorkStack* stack);
+
+
+OperationStatus workStackPush(WorkStack* stack, const void* element);
+
+
+bool workStackPop(WorkStack* stack, void* element);
+
+
+void* workStackTop(WorkStack* stack);
+
+
+#endif // TREE_STACK_H_
@@ -0,0 +1,24 @@
+#ifndef TREE_WRITE_H_
+#define TREE_WRITE_H_
+
+
+#include <stdio.h>
+
+#include "diff/diff_defs.h"
+#include "status.h"
+
+
+// Хватает на знак, 17 значащих цифр, точку и порядок
+const size_t NUMBER_TEXT_SIZE = 32;
+
+
+OperationStatus treeWritePrefix(Differentiator* diff, const TreeNode* root, FILE* output);
+
+
+OperationStatus treeWriteInfix(Differentiator* diff, const TreeNode* root, FILE* output);
+
+
+size_t treeFormatNumber(double number, char* text);
+
+
+#endif // TREE_WRITE_H_
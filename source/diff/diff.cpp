@@ -9,6 +9,8 @@
 #include "diff/diff_optimize.h"
 #include "diff/diff_taylor.h"
 #include "diff/diff_cmd_args.h"
+#include "diff/diff_var_table.h"
+#include "diff/diff_output.h"
 
 #include "status.h"
 
@@ -16,6 +18,7 @@
 
 #include "tex_dump/tex_struct.h"
 #include "tex_dump/plot_generator.h"
+#include "tex_dump/render_pipeline.h"
 
 #include "tree/tree.h"
 #include "tree/tree_io.h"
@@ -42,6 +45,7 @@ const ErrorInfo ErrorTable[ERROR_COUNT] = {
     CREATE_ERROR_INFO(STATUS_SYSTEM_CALL_ERROR,       "Error during execution of a system call."),
 // Command Line Argument Errors
     CREATE_ERROR_INFO(STATUS_CLI_UNKNOWN_OPTION,      "An unknown command-line option was provided."),
+    CREATE_ERROR_INFO(STATUS_CLI_CONFLICTING_OPTIONS, "The given command-line options cannot be used together."),
 // Syntax Errors
     CREATE_ERROR_INFO(STATUS_PARSER_INVALID_IDENTIFIER, "An invalid identifier was encountered by the parser."),
 // I/O Errors
@@ -49,6 +53,7 @@ const ErrorInfo ErrorTable[ERROR_COUNT] = {
     CREATE_ERROR_INFO(STATUS_IO_FILE_OPEN_ERROR,      "Failed to open the specified file."),
     CREATE_ERROR_INFO(STATUS_IO_FILE_EMPTY,           "The file is empty (0 bytes)."),
     CREATE_ERROR_INFO(STATUS_IO_FILE_READ_ERROR,      "An error occurred while reading the file."),
+    CREATE_ERROR_INFO(STATUS_IO_FILE_WRITE_ERROR,     "An error occurred while writing the file."),
     CREATE_ERROR_INFO(STATUS_IO_FILE_CLOSE_ERROR,     "Error during file closing operation.")
 };
 
@@ -90,6 +95,26 @@ OperationStatus diffCalculateDerivative(Differentiator* diff, size_t tree_idx)
 }
 
 
+OperationStatus diffForestReserve(Differentiator* diff, size_t tree_count)
+{
+    assert(diff); assert(diff->forest.trees); assert(diff->forest.capacity != 0);
+
+    size_t capacity = diff->forest.capacity;
+    while (capacity <= tree_count)
+        capacity *= 2;
+    if (capacity == diff->forest.capacity)
+        return STATUS_OK;
+
+    void* temp_ptr = realloc(diff->forest.trees, capacity * sizeof(BinaryTree));
+    if (temp_ptr == NULL)
+        return STATUS_SYSTEM_OUT_OF_MEMORY;
+
+    diff->forest.trees = (BinaryTree*)temp_ptr;
+    diff->forest.capacity = capacity;
+    return STATUS_OK;
+}
+
+
 static OperationStatus diffForestResize(Differentiator* diff)
 {
     assert(diff); assert(diff->forest.trees); assert(diff->forest.capacity != 0);
@@ -112,10 +137,39 @@ OperationStatus diffConstructor(Differentiator* diff, const int argc, const char
     OperationStatus status = parseArgs(diff, argc, argv);
     RETURN_IF_STATUS_NOT_OK(status);
 
+    status = diffContextConstructor(diff);
+    RETURN_IF_STATUS_NOT_OK(status);
+
+// В пакетном, серверном и разделяемом режимах отчет и дамп не ведутся
+    if (diff->args.batch_info.batch_file == NULL && diff->args.socket_path == NULL &&
+        diff->args.shared_info.region == NULL) {
+        status = diff->output.backend->open(diff);
+        if (status != STATUS_OK) {
+            diffContextDestructor(diff);
+            return status;
+        }
+    }
+
+    return STATUS_OK;
+}
+
+
+OperationStatus diffContextConstructor(Differentiator* diff)
+{
+    assert(diff);
+
     diff->forest.capacity = START_ELEMENT_COUNT;
     diff->forest.count = 0;
     diff->highlight_node = NULL;
+    diff->render = NULL;
+    diff->output.backend = getOutputBackend(diff->args.output_format);
+    diff->output.file = NULL;
+    diff->output.record_count = 0;
+    diff->output.has_value = false;
     diff->graph_dump.file = NULL;
+    diff->graph_dump.call_counter = 0;
+    diff->tex_dump.file = NULL;
+    diff->tex_dump.function_name = NULL;
     diff->tex_dump.print_steps = true;
     diff->tex_dump.range.x_min = -5;
     diff->tex_dump.range.x_max = 5;
@@ -126,23 +180,32 @@ OperationStatus diffConstructor(Differentiator* diff, const int argc, const char
     if (diff->forest.trees == NULL)
         return STATUS_SYSTEM_OUT_OF_MEMORY;
 
-    diff->var_table.capacity = START_ELEMENT_COUNT;
-    diff->var_table.count = 0;
-
-    diff->var_table.variables = (Variable*)calloc(START_ELEMENT_COUNT, sizeof(Variable));
-    if (diff->var_table.variables == NULL) {
+    if (variableTableInit(&diff->var_table) != STATUS_OK) {
         free(diff->forest.trees);
+        diff->forest.trees = NULL;
         return STATUS_SYSTEM_OUT_OF_MEMORY;
     }
 
-    openGraphDumpFile(diff);
-    texInit(diff);
-
     return STATUS_OK;
 }
 
 
 void diffDestructor(Differentiator* diff)
+{
+    assert(diff);
+
+// Отложенные графики ссылаются на деревья, поэтому дожидаются их до освобождения
+    renderPipelineFinish(diff);
+    diffContextDestructor(diff);
+
+    OperationStatus status = diff->output.backend->close(diff);
+    if (status != STATUS_OK) {
+        printErrorStatus(status);
+    }
+}
+
+
+void diffContextDestructor(Differentiator* diff)
 {
     assert(diff);
 
@@ -150,20 +213,10 @@ void diffDestructor(Differentiator* diff)
         treeDestructor(&diff->forest.trees[index]);
     free(diff->forest.trees);
     diff->forest.trees = NULL;
+    diff->forest.count = 0;
 
     free(diff->tex_dump.function_name);
+    diff->tex_dump.function_name = NULL;
 
-    for (size_t index = 0; index < diff->var_table.count; index++)
-        free(diff->var_table.variables[index].name);
-    free(diff->var_table.variables);
-    diff->var_table.variables = NULL;
-
-    assert(fclose(diff->graph_dump.file) == 0);
-
-    OperationStatus status = texClose(diff);
-    if (status != STATUS_OK) {
-        printErrorStatus(status);
-    }
-
-    diff->graph_dump.file = NULL;
+    variableTableDestroy(&diff->var_table);
 }
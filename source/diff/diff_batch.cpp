@@ -0,0 +1,275 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include <pthread.h>
+#include <assert.h>
+
+#include "diff/diff_batch.h"
+#include "diff/diff_defs.h"
+#include "diff/diff_request.h"
+#include "diff/diff_cache.h"
+
+#include "tree/tree_source.h"
+
+#include "status.h"
+
+
+typedef struct {
+    const char* text;
+    size_t length;
+    size_t line_number;
+    char* result;
+    size_t result_size;
+    bool is_done;
+} BatchJob;
+
+
+typedef struct {
+    const CmdArgs* args;
+    BatchJob* jobs;
+    size_t job_count;
+    size_t next_job;
+    pthread_mutex_t mutex;
+    pthread_cond_t job_done;
+} BatchQueue;
+
+
+static OperationStatus splitBatchLines(BatchQueue* queue, const char* data, size_t size);
+static bool isBlankLine(const char* text, size_t length);
+static size_t getThreadCount(const CmdArgs* args, size_t job_count);
+
+static void* batchWorker(void* argument);
+static OperationStatus writeBatchResults(BatchQueue* queue, FILE* output_file);
+
+static void processBatchJob(const CmdArgs* args, BatchJob* job);
+
+
+OperationStatus diffRunBatch(const CmdArgs* args)
+{
+    assert(args); assert(args->batch_info.batch_file);
+
+    bool is_stdin = strcmp(args->batch_info.batch_file, "-") == 0;
+    FILE* batch_file = is_stdin ? stdin : fopen(args->batch_info.batch_file, "r");
+    if (batch_file == NULL)
+        return STATUS_IO_FILE_OPEN_ERROR;
+
+    SourceBuffer source = {};
+    OperationStatus status = sourceBufferLoad(&source, batch_file);
+    if (!is_stdin)
+        fclose(batch_file);
+    RETURN_IF_STATUS_NOT_OK(status);
+
+    BatchQueue queue = {};
+    queue.args = args;
+    status = splitBatchLines(&queue, source.data, source.size);
+    if (status != STATUS_OK) {
+        sourceBufferRelease(&source);
+        return status;
+    }
+
+    const char* output_name = args->batch_info.output_file;
+    bool is_stdout = output_name == NULL || strcmp(output_name, "-") == 0;
+    FILE* output_file = is_stdout ? stdout : fopen(output_name, "w");
+    if (output_file == NULL) {
+        free(queue.jobs);
+        sourceBufferRelease(&source);
+        return STATUS_IO_FILE_OPEN_ERROR;
+    }
+
+    struct timespec start = {};
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    pthread_mutex_init(&queue.mutex, NULL);
+    pthread_cond_init(&queue.job_done, NULL);
+
+    size_t thread_count = getThreadCount(args, queue.job_count);
+    pthread_t* threads = (pthread_t*)calloc(thread_count, sizeof(pthread_t));
+    size_t started_count = 0;
+    while (threads != NULL && started_count < thread_count &&
+           pthread_create(&threads[started_count], NULL, batchWorker, &queue) == 0) {
+        started_count++;
+    }
+// Если ни один поток не запустился, задания выполняются в текущем
+    if (started_count == 0)
+        batchWorker(&queue);
+
+    status = writeBatchResults(&queue, output_file);
+
+    for (size_t index = 0; index < started_count; index++)
+        pthread_join(threads[index], NULL);
+    free(threads);
+
+    pthread_cond_destroy(&queue.job_done);
+    pthread_mutex_destroy(&queue.mutex);
+
+    fprintf(stderr, "Processed %zu expressions on %zu threads in %.3f s\n",
+        queue.job_count, started_count, getElapsedTime(&start) / 1000);
+    if (args->cache_info.directory != NULL)
+        diffCachePrintStats(stderr);
+
+    if (!is_stdout && fclose(output_file) != 0 && status == STATUS_OK)
+        status = STATUS_IO_FILE_CLOSE_ERROR;
+    free(queue.jobs);
+    sourceBufferRelease(&source);
+
+    return status;
+}
+
+
+static OperationStatus splitBatchLines(BatchQueue* queue, const char* data, size_t size)
+{
+    assert(queue); assert(data);
+
+    size_t line_count = 1;
+    for (const char* newline = (const char*)memchr(data, '\n', size); newline != NULL;
+         newline = (const char*)memchr(newline + 1, '\n', size - (size_t)(newline + 1 - data))) {
+        line_count++;
+    }
+
+    queue->jobs = (BatchJob*)calloc(line_count, sizeof(BatchJob));
+    if (queue->jobs == NULL)
+        return STATUS_SYSTEM_OUT_OF_MEMORY;
+
+    const char* line = data;
+    const char* end = data + size;
+    for (size_t line_number = 1; line < end; line_number++) {
+        const char* newline = (const char*)memchr(line, '\n', (size_t)(end - line));
+        size_t length = (size_t)((newline != NULL ? newline : end) - line);
+        if (length != 0 && line[length - 1] == '\r')
+            length--;
+
+// Пустые строки пропускаются, но нумерация строк сохраняется
+        if (!isBlankLine(line, length)) {
+            queue->jobs[queue->job_count] = (BatchJob){line, length, line_number, NULL, 0, false};
+            queue->job_count++;
+        }
+
+        line = newline != NULL ? newline + 1 : end;
+    }
+
+    return STATUS_OK;
+}
+
+
+static bool isBlankLine(const char* text, size_t length)
+{
+    assert(text);
+
+    for (size_t index = 0; index < length; index++) {
+        if (!isspace((unsigned char)text[index]))
+            return false;
+    }
+
+    return true;
+}
+
+
+static size_t getThreadCount(const CmdArgs* args, size_t job_count)
+{
+    assert(args);
+
+    return args->thread_count < job_count ? args->thread_count : job_count;
+}
+
+
+static void* batchWorker(void* argument)
+{
+    assert(argument);
+
+    BatchQueue* queue = (BatchQueue*)argument;
+    while (true) {
+        pthread_mutex_lock(&queue->mutex);
+        size_t job_idx = queue->next_job;
+        if (job_idx < queue->job_count)
+            queue->next_job++;
+        pthread_mutex_unlock(&queue->mutex);
+
+        if (job_idx >= queue->job_count)
+            break;
+
+        processBatchJob(queue->args, &queue->jobs[job_idx]);
+
+        pthread_mutex_lock(&queue->mutex);
+        queue->jobs[job_idx].is_done = true;
+        pthread_cond_broadcast(&queue->job_done);
+        pthread_mutex_unlock(&queue->mutex);
+    }
+
+    return NULL;
+}
+
+
+static OperationStatus writeBatchResults(BatchQueue* queue, FILE* output_file)
+{
+    assert(queue); assert(output_file);
+
+// Результаты пишутся в порядке строк входного файла по мере готовности
+    OperationStatus status = STATUS_OK;
+    for (size_t index = 0; index < queue->job_count; index++) {
+        BatchJob* job = &queue->jobs[index];
+
+        pthread_mutex_lock(&queue->mutex);
+        while (!job->is_done)
+            pthread_cond_wait(&queue->job_done, &queue->mutex);
+        pthread_mutex_unlock(&queue->mutex);
+
+        if (job->result != NULL) {
+            if (fwrite(job->result, 1, job->result_size, output_file) != job->result_size)
+                status = STATUS_IO_FILE_WRITE_ERROR;
+        } else {
+            fprintf(output_file, "expression %zu: %.*s\nerror: [%s] %s\n\n", job->line_number,
+                (int)job->length, job->text, ErrorTable[STATUS_SYSTEM_OUT_OF_MEMORY].status_string,
+                ErrorTable[STATUS_SYSTEM_OUT_OF_MEMORY].error_message);
+        }
+
+        free(job->result);
+        job->result = NULL;
+    }
+
+    return status;
+}
+
+
+static void processBatchJob(const CmdArgs* args, BatchJob* job)
+{
+    assert(args); assert(job);
+
+    FILE* output = open_memstream(&job->result, &job->result_size);
+    if (output == NULL)
+        return;
+
+    struct timespec start = {};
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    fprintf(output, "expression %zu: %.*s\n", job->line_number, (int)job->length, job->text);
+
+// Точки вычисления записываются после ';': "sin(x) * y ; x=1, y=2 ; x=0, y=1"
+    const char* separator = (const char*)memchr(job->text, ';', job->length);
+    size_t expression_length = separator != NULL ? (size_t)(separator - job->text) : job->length;
+
+    DiffRequest request = {job->text, expression_length, args->derivative_info.diff_var_s,
+        args->derivative_info.order, NULL, 0};
+    if (separator != NULL) {
+        request.points = separator + 1;
+        request.points_length = job->length - expression_length - 1;
+    } else if (args->derivative_info.compute) {
+        request.points = job->text + job->length;
+    }
+
+    diffProcessRequest(args, &request, output);
+    fprintf(output, "time: %.3f ms\n\n", getElapsedTime(&start));
+
+    fclose(output);
+}
+
+
+double getElapsedTime(const struct timespec* start)
+{
+    assert(start);
+
+    struct timespec end = {};
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    return (double)(end.tv_sec - start->tv_sec) * 1000 + (double)(end.tv_nsec - start->tv_nsec) / 1e6;
+}
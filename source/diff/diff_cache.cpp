@@ -0,0 +1,386 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <assert.h>
+
+#include "diff/diff_cache.h"
+#include "diff/diff_defs.h"
+#include "diff/diff.h"
+#include "diff/diff_var_table.h"
+
+#include "tree/tree.h"
+#include "tree/tree_binary.h"
+#include "tree/tree_stack.h"
+
+#include "status.h"
+
+
+const uint64_t HASH_PRIME = 0x100000001B3ULL;
+const char CACHE_ENTRY_SUFFIX[] = ".forest";
+
+
+typedef struct {
+    const TreeNode* first;
+    const TreeNode* second;
+} NodePair;
+
+
+typedef struct {
+    char* path;
+    off_t size;
+    struct timespec access_time;
+} CacheEntry;
+
+
+static size_t cache_hits = 0;
+static size_t cache_misses = 0;
+static size_t temp_counter = 0;
+
+
+static bool getCachePath(const Differentiator* diff, char* path, size_t size);
+static uint64_t hashExpression(const Differentiator* diff);
+static const char* getDiffVariableName(const Differentiator* diff);
+
+static bool isSameExpression(const Differentiator* diff, const Differentiator* cached);
+static bool isSameNode(const Differentiator* diff, const TreeNode* node,
+                       const Differentiator* cached, const TreeNode* cached_node);
+static OperationStatus moveCachedTree(Differentiator* diff, Differentiator* cached, size_t tree_idx);
+
+static OperationStatus collectCacheEntries(const char* directory, const char* suffix,
+                                           CacheEntry** entries, size_t* count);
+static int compareCacheEntries(const void* first, const void* second);
+
+
+OperationStatus diffCacheLookup(Differentiator* diff, size_t order, size_t* cached_count)
+{
+    assert(diff); assert(diff->forest.count == 1); assert(diff->var_table.count != 0);
+    assert(diff->args.cache_info.directory); assert(cached_count);
+
+    *cached_count = 0;
+    char path[2 * BUFFER_SIZE] = "";
+    if (order == 0 || !getCachePath(diff, path, sizeof(path))) {
+        __atomic_fetch_add(&cache_misses, order, __ATOMIC_RELAXED);
+        return STATUS_OK;
+    }
+
+    Differentiator cached = {};
+    cached.args = diff->args;
+    OperationStatus status = diffContextConstructor(&cached);
+    RETURN_IF_STATUS_NOT_OK(status);
+
+// Поврежденная или чужая запись не ошибка, производные просто считаются заново
+    size_t count = 0;
+    if (diffLoadForest(&cached, path) == STATUS_OK && isSameExpression(diff, &cached)) {
+        count = cached.forest.count - 1 < order ? cached.forest.count - 1 : order;
+        status = diffForestReserve(diff, count + 1);
+    }
+
+    for (size_t index = 1; index <= count && status == STATUS_OK; index++) {
+        status = moveCachedTree(diff, &cached, index);
+        if (status == STATUS_OK)
+            diff->forest.count++;
+    }
+    diffContextDestructor(&cached);
+
+    if (status == STATUS_OK && count != 0) {
+        *cached_count = count;
+        utimensat(AT_FDCWD, path, NULL, 0);
+    }
+
+    __atomic_fetch_add(&cache_hits, *cached_count, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&cache_misses, order - *cached_count, __ATOMIC_RELAXED);
+    return status;
+}
+
+
+OperationStatus diffCacheStore(Differentiator* diff, size_t cached_count)
+{
+    assert(diff); assert(diff->forest.count != 0); assert(diff->args.cache_info.directory);
+
+    char path[2 * BUFFER_SIZE] = "";
+    if (diff->forest.count - 1 <= cached_count || !getCachePath(diff, path, sizeof(path)))
+        return STATUS_OK;
+
+    const char* directory = diff->args.cache_info.directory;
+    if (mkdir(directory, 0755) != 0 && errno != EEXIST)
+        return STATUS_IO_FILE_OPEN_ERROR;
+
+// Запись сначала пишется во временный файл и появляется в каталоге атомарным переименованием
+    char temp_path[2 * BUFFER_SIZE + 64] = "";
+    snprintf(temp_path, sizeof(temp_path), "%s.%d.%zu.tmp", path, getpid(),
+        __atomic_fetch_add(&temp_counter, 1, __ATOMIC_RELAXED));
+
+    OperationStatus status = diffSaveForest(diff, temp_path);
+    if (status == STATUS_OK && rename(temp_path, path) != 0)
+        status = STATUS_IO_FILE_WRITE_ERROR;
+    if (status != STATUS_OK) {
+        unlink(temp_path);
+        return status;
+    }
+
+    diffCacheEvict(directory, CACHE_ENTRY_SUFFIX, diff->args.cache_info.size_limit);
+    return STATUS_OK;
+}
+
+
+void diffCachePrintStats(FILE* output)
+{
+    assert(output);
+
+    fprintf(output, "Derivative cache: %zu hits, %zu misses\n",
+        __atomic_load_n(&cache_hits, __ATOMIC_RELAXED), __atomic_load_n(&cache_misses, __ATOMIC_RELAXED));
+}
+
+
+uint64_t diffCacheHashBytes(uint64_t hash, const void* data, size_t size)
+{
+    assert(data);
+
+    const uint8_t* bytes = (const uint8_t*)data;
+    for (size_t index = 0; index < size; index++) {
+        hash ^= bytes[index];
+        hash *= HASH_PRIME;
+    }
+
+    return hash;
+}
+
+
+void diffCacheEvict(const char* directory, const char* suffix, size_t size_limit)
+{
+    assert(directory); assert(suffix);
+
+    CacheEntry* entries = NULL;
+    size_t count = 0;
+    if (collectCacheEntries(directory, suffix, &entries, &count) != STATUS_OK)
+        return;
+
+    size_t total_size = 0;
+    for (size_t index = 0; index < count; index++)
+        total_size += (size_t)entries[index].size;
+
+// Время доступа обновляется при каждом попадании, поэтому удаляются давно не использованные записи
+    qsort(entries, count, sizeof(CacheEntry), compareCacheEntries);
+    for (size_t index = 0; index < count && total_size > size_limit; index++) {
+        if (unlink(entries[index].path) == 0 || errno == ENOENT)
+            total_size -= (size_t)entries[index].size;
+    }
+
+    for (size_t index = 0; index < count; index++)
+        free(entries[index].path);
+    free(entries);
+}
+
+
+static bool getCachePath(const Differentiator* diff, char* path, size_t size)
+{
+    assert(diff); assert(path);
+
+    int length = snprintf(path, size, "%s/%016llx%s", diff->args.cache_info.directory,
+        (unsigned long long)hashExpression(diff), CACHE_ENTRY_SUFFIX);
+
+    return length > 0 && (size_t)length < size;
+}
+
+
+static uint64_t hashExpression(const Differentiator* diff)
+{
+    assert(diff); assert(diff->forest.trees[0].root);
+
+    WorkStack stack = {};
+    workStackInit(&stack, sizeof(const TreeNode*));
+
+// Переменные хешируются по именам, поэтому ключ не зависит от порядка таблицы переменных
+    uint64_t hash = HASH_OFFSET_BASIS;
+    const TreeNode* node = diff->forest.trees[0].root;
+    OperationStatus status = workStackPush(&stack, &node);
+    while (status == STATUS_OK && workStackPop(&stack, &node)) {
+        uint8_t type = node != NULL ? (uint8_t)(node->type + 1) : 0;
+        hash = diffCacheHashBytes(hash, &type, sizeof(type));
+        if (node == NULL)
+            continue;
+
+        switch (node->type) {
+            case NODE_OP:  hash = diffCacheHashBytes(hash, &node->value.op, sizeof(node->value.op)); break;
+            case NODE_NUM: hash = diffCacheHashBytes(hash, &node->value.num_val, sizeof(node->value.num_val)); break;
+            case NODE_VAR: {
+                const char* name = diff->var_table.variables[node->value.var_idx].name;
+                hash = diffCacheHashBytes(hash, name, strlen(name) + 1);
+                break;
+            }
+            default: break;
+        }
+
+        status = workStackPush(&stack, &node->right);
+        if (status == STATUS_OK)
+            status = workStackPush(&stack, &node->left);
+    }
+    workStackDestroy(&stack);
+
+    const char* diff_var = getDiffVariableName(diff);
+    return diffCacheHashBytes(hash, diff_var, strlen(diff_var) + 1);
+}
+
+
+static const char* getDiffVariableName(const Differentiator* diff)
+{
+    assert(diff); assert(diff->args.derivative_info.diff_var_idx < diff->var_table.count);
+
+    return diff->var_table.variables[diff->args.derivative_info.diff_var_idx].name;
+}
+
+
+static bool isSameExpression(const Differentiator* diff, const Differentiator* cached)
+{
+    assert(diff); assert(cached);
+
+    if (cached->var_table.count == 0 || strcmp(getDiffVariableName(diff), getDiffVariableName(cached)) != 0)
+        return false;
+
+    return isSameNode(diff, diff->forest.trees[0].root, cached, cached->forest.trees[0].root);
+}
+
+
+static bool isSameNode(const Differentiator* diff, const TreeNode* node,
+                       const Differentiator* cached, const TreeNode* cached_node)
+{
+    assert(diff); assert(cached);
+
+    WorkStack stack = {};
+    workStackInit(&stack, sizeof(NodePair));
+
+// Совпадение хеша проверяется полным сравнением, коллизия дает промах, а не чужие производные
+    NodePair pair = {node, cached_node};
+    bool is_same = workStackPush(&stack, &pair) == STATUS_OK;
+    while (is_same && workStackPop(&stack, &pair)) {
+        if (pair.first == NULL || pair.second == NULL) {
+            is_same = pair.first == pair.second;
+            continue;
+        }
+        if (pair.first->type != pair.second->type) {
+            is_same = false;
+            continue;
+        }
+
+        switch (pair.first->type) {
+            case NODE_OP:
+                is_same = pair.first->value.op == pair.second->value.op;
+                break;
+            case NODE_NUM:
+                is_same = memcmp(&pair.first->value.num_val, &pair.second->value.num_val, sizeof(double)) == 0;
+                break;
+            case NODE_VAR:
+                is_same = strcmp(diff->var_table.variables[pair.first->value.var_idx].name,
+                                 cached->var_table.variables[pair.second->value.var_idx].name) == 0;
+                break;
+            default:
+                is_same = false;
+                break;
+        }
+
+        NodePair left = {pair.first->left, pair.second->left};
+        NodePair right = {pair.first->right, pair.second->right};
+        if (is_same)
+            is_same = workStackPush(&stack, &left) == STATUS_OK && workStackPush(&stack, &right) == STATUS_OK;
+    }
+
+    workStackDestroy(&stack);
+    return is_same;
+}
+
+
+static OperationStatus moveCachedTree(Differentiator* diff, Differentiator* cached, size_t tree_idx)
+{
+    assert(diff); assert(cached); assert(tree_idx < cached->forest.count);
+
+    WorkStack stack = {};
+    workStackInit(&stack, sizeof(TreeNode*));
+
+// Индексы переменных записи переводятся в индексы текущей таблицы по именам
+    TreeNode* node = cached->forest.trees[tree_idx].root;
+    OperationStatus status = workStackPush(&stack, &node);
+    while (status == STATUS_OK && workStackPop(&stack, &node)) {
+        if (node->type == NODE_VAR) {
+            const char* name = cached->var_table.variables[node->value.var_idx].name;
+            status = addVariable(diff, &node->value.var_idx, name, strlen(name));
+        }
+        if (status == STATUS_OK && node->left != NULL)
+            status = workStackPush(&stack, &node->left);
+        if (status == STATUS_OK && node->right != NULL)
+            status = workStackPush(&stack, &node->right);
+    }
+    workStackDestroy(&stack);
+    RETURN_IF_STATUS_NOT_OK(status);
+
+    TREE_CREATE(&diff->forest.trees[tree_idx]);
+    diff->forest.trees[tree_idx].root = cached->forest.trees[tree_idx].root;
+    cached->forest.trees[tree_idx].root = NULL;
+
+    return STATUS_OK;
+}
+
+
+static OperationStatus collectCacheEntries(const char* directory, const char* suffix,
+                                           CacheEntry** entries, size_t* count)
+{
+    assert(directory); assert(suffix); assert(entries); assert(count);
+
+    DIR* dir = opendir(directory);
+    if (dir == NULL)
+        return STATUS_IO_FILE_OPEN_ERROR;
+
+    size_t capacity = 0;
+    size_t suffix_length = strlen(suffix);
+    OperationStatus status = STATUS_OK;
+    for (struct dirent* item = readdir(dir); item != NULL && status == STATUS_OK; item = readdir(dir)) {
+        size_t name_length = strlen(item->d_name);
+        if (name_length <= suffix_length ||
+            strcmp(item->d_name + name_length - suffix_length, suffix) != 0)
+            continue;
+
+        if (*count == capacity) {
+            capacity = capacity != 0 ? 2 * capacity : START_ELEMENT_COUNT;
+            void* temp_ptr = realloc(*entries, capacity * sizeof(CacheEntry));
+            if (temp_ptr == NULL) {
+                status = STATUS_SYSTEM_OUT_OF_MEMORY;
+                break;
+            }
+            *entries = (CacheEntry*)temp_ptr;
+        }
+
+        size_t path_size = strlen(directory) + name_length + 2;
+        char* path = (char*)calloc(path_size, 1);
+        struct stat info = {};
+        if (path == NULL) {
+            status = STATUS_SYSTEM_OUT_OF_MEMORY;
+        } else if (snprintf(path, path_size, "%s/%s", directory, item->d_name) < 0 || stat(path, &info) != 0) {
+            free(path);
+        } else {
+            (*entries)[(*count)++] = (CacheEntry){path, info.st_size, info.st_mtim};
+        }
+    }
+
+    closedir(dir);
+    return status;
+}
+
+
+static int compareCacheEntries(const void* first, const void* second)
+{
+    assert(first); assert(second);
+
+    const struct timespec* first_time = &((const CacheEntry*)first)->access_time;
+    const struct timespec* second_time = &((const CacheEntry*)second)->access_time;
+    if (first_time->tv_sec != second_time->tv_sec)
+        return first_time->tv_sec < second_time->tv_sec ? -1 : 1;
+    if (first_time->tv_nsec != second_time->tv_nsec)
+        return first_time->tv_nsec < second_time->tv_nsec ? -1 : 1;
+
+    return 0;
+}
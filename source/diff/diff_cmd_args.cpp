@@ -1,10 +1,14 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
+#include <stdint.h>
+#include <unistd.h>
 #include <assert.h>
 
 #include "diff/diff_cmd_args.h"
 #include "diff/diff_defs.h"
+#include "diff/diff_cache.h"
 
 #include "status.h"
 
@@ -14,6 +18,14 @@ static OperationStatus parseInputFile(Differentiator* diff, const int argc, cons
 static OperationStatus parseDerivativeOrder(Differentiator* diff, const int argc, const char** argv, size_t* index);
 static OperationStatus parseTaylorDecomposition(Differentiator* diff, const int argc, const char** argv, size_t* index);
 static OperationStatus parseDiffVariable(Differentiator* diff, const int argc, const char** argv, size_t* index);
+static OperationStatus parseFileOption(const char** file, const int argc, const char** argv, size_t* index);
+static OperationStatus parseThreadCount(Differentiator* diff, const int argc, const char** argv, size_t* index);
+static OperationStatus parseEventFd(Differentiator* diff, const int argc, const char** argv, size_t* index);
+static OperationStatus parseCacheSize(Differentiator* diff, const int argc, const char** argv, size_t* index);
+static OperationStatus parseDiagnosticsLevel(Differentiator* diff, const int argc, const char** argv, size_t* index);
+static OperationStatus parseOutputFormat(Differentiator* diff, const int argc, const char** argv, size_t* index);
+static OperationStatus parseSizeOption(size_t* value, const int argc, const char** argv, size_t* index);
+static size_t getOnlineProcessorCount();
 
 
 OperationStatus parseArgs(Differentiator* diff, const int argc, const char** argv)
@@ -32,8 +44,44 @@ OperationStatus parseArgs(Differentiator* diff, const int argc, const char** arg
             status = parseTaylorDecomposition(diff, argc, argv, &index); 
         } else if (strcmp(argv[index], "--dvar") == 0) {
             status = parseDiffVariable(diff, argc, argv, &index); 
+        } else if (strcmp(argv[index], "--batch") == 0) {
+            status = parseFileOption(&diff->args.batch_info.batch_file, argc, argv, &index);
+        } else if (strcmp(argv[index], "--output") == 0) {
+            status = parseFileOption(&diff->args.batch_info.output_file, argc, argv, &index);
+        } else if (strcmp(argv[index], "--serve") == 0) {
+            status = parseFileOption(&diff->args.socket_path, argc, argv, &index);
+        } else if (strcmp(argv[index], "--load-forest") == 0) {
+            status = parseFileOption(&diff->args.forest_info.load_file, argc, argv, &index);
+        } else if (strcmp(argv[index], "--save-forest") == 0) {
+            status = parseFileOption(&diff->args.forest_info.save_file, argc, argv, &index);
+        } else if (strcmp(argv[index], "--cache") == 0) {
+            status = parseFileOption(&diff->args.cache_info.directory, argc, argv, &index);
+        } else if (strcmp(argv[index], "--cache-size") == 0) {
+            status = parseCacheSize(diff, argc, argv, &index);
+        } else if (strcmp(argv[index], "--diagnostics") == 0) {
+            status = parseDiagnosticsLevel(diff, argc, argv, &index);
+        } else if (strcmp(argv[index], "--dump-every") == 0) {
+            status = parseSizeOption(&diff->args.diagnostics_info.sample_period, argc, argv, &index);
+        } else if (strcmp(argv[index], "--dump-node-limit") == 0) {
+            status = parseSizeOption(&diff->args.diagnostics_info.node_limit, argc, argv, &index);
+        } else if (strcmp(argv[index], "--tex-nodes") == 0) {
+            status = parseSizeOption(&diff->args.tex_limit_info.node_limit, argc, argv, &index);
+        } else if (strcmp(argv[index], "--tex-depth") == 0) {
+            status = parseSizeOption(&diff->args.tex_limit_info.depth_limit, argc, argv, &index);
+        } else if (strcmp(argv[index], "--tex-definitions") == 0) {
+            status = parseSizeOption(&diff->args.tex_limit_info.definition_limit, argc, argv, &index);
+        } else if (strcmp(argv[index], "--format") == 0) {
+            status = parseOutputFormat(diff, argc, argv, &index);
+        } else if (strcmp(argv[index], "--shm") == 0) {
+            status = parseFileOption(&diff->args.shared_info.region, argc, argv, &index);
+        } else if (strcmp(argv[index], "--eventfd") == 0) {
+            status = parseEventFd(diff, argc, argv, &index);
+        } else if (strcmp(argv[index], "--threads") == 0) {
+            status = parseThreadCount(diff, argc, argv, &index);
         } else if (strcmp(argv[index], "--simple_graph") == 0) {
             diff->args.simple_graph = true;
+        } else if (strcmp(argv[index], "--graphviz") == 0) {
+            diff->args.use_graphviz = true;
         } else if (strcmp(argv[index], "--infix") == 0) {
             diff->args.infix_input = true;
         } else if (strcmp(argv[index], "--compute") == 0) {
@@ -43,6 +91,15 @@ OperationStatus parseArgs(Differentiator* diff, const int argc, const char** arg
         }
     }
 
+// Пакетный и серверный режимы отвечают только текстом, поэтому json и csv там не поддерживаются
+    bool is_request_mode = diff->args.batch_info.batch_file != NULL || diff->args.socket_path != NULL;
+    if (status == STATUS_OK && is_request_mode && diff->args.output_format != OUTPUT_TEX)
+        return STATUS_CLI_CONFLICTING_OPTIONS;
+
+// По умолчанию пакетный и серверный режимы занимают все доступные ядра
+    if (diff->args.thread_count == 0)
+        diff->args.thread_count = getOnlineProcessorCount();
+
     return status;
 }
 
@@ -59,7 +116,30 @@ static void setTypicalSettings(Differentiator* diff)
     diff->args.derivative_info.compute = false;
     diff->args.taylor_info.decomposition = false;
     diff->args.taylor_info.center = 0;
+    diff->args.batch_info.batch_file = NULL;
+    diff->args.batch_info.output_file = NULL;
+    diff->args.forest_info.load_file = NULL;
+    diff->args.forest_info.save_file = NULL;
+    diff->args.cache_info.directory = NULL;
+    diff->args.cache_info.size_limit = DEFAULT_CACHE_SIZE_LIMIT;
+// Отладочная сборка по умолчанию пишет все дампы, обычная только проверяет деревья
+#ifdef DEBUG
+    diff->args.diagnostics_info.level = DIAGNOSTICS_FULL;
+#else
+    diff->args.diagnostics_info.level = DIAGNOSTICS_VERIFY;
+#endif
+    diff->args.diagnostics_info.sample_period = DEFAULT_DUMP_SAMPLE_PERIOD;
+    diff->args.diagnostics_info.node_limit = DEFAULT_DUMP_NODE_LIMIT;
+    diff->args.tex_limit_info.node_limit = DEFAULT_TEX_NODE_LIMIT;
+    diff->args.tex_limit_info.depth_limit = DEFAULT_TEX_DEPTH_LIMIT;
+    diff->args.tex_limit_info.definition_limit = DEFAULT_TEX_DEFINITION_LIMIT;
+    diff->args.output_format = OUTPUT_TEX;
+    diff->args.shared_info.region = NULL;
+    diff->args.shared_info.event_fd = -1;
+    diff->args.socket_path = NULL;
+    diff->args.thread_count = 0;
     diff->args.simple_graph = false;
+    diff->args.use_graphviz = false;
 }
 
 
@@ -67,7 +147,8 @@ static OperationStatus parseInputFile(Differentiator* diff, const int argc, cons
 {
     assert(diff); assert(argv); assert(index);
 
-    if (*index + 1 < (size_t)argc && argv[*index + 1][0] != '-') {
+// "-" означает чтение выражения из стандартного ввода
+    if (*index + 1 < (size_t)argc && (argv[*index + 1][0] != '-' || strcmp(argv[*index + 1], "-") == 0)) {
         diff->args.input_file = argv[*index + 1]; (*index)++;
         return STATUS_OK;
     }
@@ -126,4 +207,148 @@ static OperationStatus parseDiffVariable(Differentiator* diff, const int argc, c
     }
 
     return STATUS_CLI_UNKNOWN_OPTION;
-}
\ No newline at end of file
+}
+
+
+static OperationStatus parseFileOption(const char** file, const int argc, const char** argv, size_t* index)
+{
+    assert(file); assert(argv); assert(index);
+
+    if (*index + 1 < (size_t)argc && (argv[*index + 1][0] != '-' || strcmp(argv[*index + 1], "-") == 0)) {
+        *file = argv[*index + 1];
+        (*index)++;
+        return STATUS_OK;
+    }
+
+    return STATUS_CLI_UNKNOWN_OPTION;
+}
+
+
+static OperationStatus parseThreadCount(Differentiator* diff, const int argc, const char** argv, size_t* index)
+{
+    assert(diff); assert(argv); assert(index);
+
+    if (*index + 1 < (size_t)argc && argv[*index + 1][0] != '-') {
+        char* end = NULL;
+        diff->args.thread_count = strtoull(argv[*index + 1], &end, 10);
+        if (*end != '\0') {
+            return STATUS_CLI_UNKNOWN_OPTION;
+        }
+
+        (*index)++;
+        return STATUS_OK;
+    }
+
+    return STATUS_CLI_UNKNOWN_OPTION;
+}
+
+
+static OperationStatus parseEventFd(Differentiator* diff, const int argc, const char** argv, size_t* index)
+{
+    assert(diff); assert(argv); assert(index);
+
+    if (*index + 1 < (size_t)argc && argv[*index + 1][0] != '-') {
+        char* end = NULL;
+        long event_fd = strtol(argv[*index + 1], &end, 10);
+        if (*end != '\0' || event_fd > INT_MAX) {
+            return STATUS_CLI_UNKNOWN_OPTION;
+        }
+
+        diff->args.shared_info.event_fd = (int)event_fd;
+        (*index)++;
+        return STATUS_OK;
+    }
+
+    return STATUS_CLI_UNKNOWN_OPTION;
+}
+
+
+static OperationStatus parseCacheSize(Differentiator* diff, const int argc, const char** argv, size_t* index)
+{
+    assert(diff); assert(argv); assert(index);
+
+// Размер кэша задается в мегабайтах
+    if (*index + 1 < (size_t)argc && argv[*index + 1][0] != '-') {
+        char* end = NULL;
+        size_t size_limit = strtoull(argv[*index + 1], &end, 10);
+        if (*end != '\0' || size_limit > SIZE_MAX >> 20) {
+            return STATUS_CLI_UNKNOWN_OPTION;
+        }
+
+        diff->args.cache_info.size_limit = size_limit << 20;
+        (*index)++;
+        return STATUS_OK;
+    }
+
+    return STATUS_CLI_UNKNOWN_OPTION;
+}
+
+
+static OperationStatus parseDiagnosticsLevel(Differentiator* diff, const int argc, const char** argv, size_t* index)
+{
+    assert(diff); assert(argv); assert(index);
+
+    const char* names[] = {"off", "verify", "sampled", "full"};
+    const DiagnosticsLevel levels[] = {DIAGNOSTICS_OFF, DIAGNOSTICS_VERIFY, DIAGNOSTICS_SAMPLED, DIAGNOSTICS_FULL};
+    if (*index + 1 >= (size_t)argc)
+        return STATUS_CLI_UNKNOWN_OPTION;
+
+    for (size_t level = 0; level < sizeof(levels) / sizeof(*levels); level++) {
+        if (strcmp(argv[*index + 1], names[level]) == 0) {
+            diff->args.diagnostics_info.level = levels[level];
+            (*index)++;
+            return STATUS_OK;
+        }
+    }
+
+    return STATUS_CLI_UNKNOWN_OPTION;
+}
+
+
+static OperationStatus parseOutputFormat(Differentiator* diff, const int argc, const char** argv, size_t* index)
+{
+    assert(diff); assert(argv); assert(index);
+
+// json и csv пишутся в файл --output (или на стандартный вывод) без отчета, дампов и графиков
+    const char* names[] = {"tex", "json", "csv"};
+    const OutputFormat formats[] = {OUTPUT_TEX, OUTPUT_JSON, OUTPUT_CSV};
+    if (*index + 1 >= (size_t)argc)
+        return STATUS_CLI_UNKNOWN_OPTION;
+
+    for (size_t format = 0; format < sizeof(formats) / sizeof(*formats); format++) {
+        if (strcmp(argv[*index + 1], names[format]) == 0) {
+            diff->args.output_format = formats[format];
+            (*index)++;
+            return STATUS_OK;
+        }
+    }
+
+    return STATUS_CLI_UNKNOWN_OPTION;
+}
+
+
+static OperationStatus parseSizeOption(size_t* value, const int argc, const char** argv, size_t* index)
+{
+    assert(value); assert(argv); assert(index);
+
+    if (*index + 1 < (size_t)argc && argv[*index + 1][0] != '-') {
+        char* end = NULL;
+        *value = strtoull(argv[*index + 1], &end, 10);
+        if (*end != '\0') {
+            return STATUS_CLI_UNKNOWN_OPTION;
+        }
+
+        (*index)++;
+        return STATUS_OK;
+    }
+
+    return STATUS_CLI_UNKNOWN_OPTION;
+}
+
+
+static size_t getOnlineProcessorCount()
+{
+    long online_count = sysconf(_SC_NPROCESSORS_ONLN);
+
+    return online_count > 0 ? (size_t)online_count : 1;
+}
@@ -6,6 +6,9 @@
 #include "diff/diff_evaluate.h"
 #include "diff/diff_defs.h"
 #include "diff/diff.h"
+#include "diff/diff_output.h"
+
+#include "tree/tree_stack.h"
 
 #include "status.h"
 
@@ -17,7 +20,9 @@ typedef struct {
 } OpFuncTable;
 
 
-static double diffOp(Differentiator* diff, const TreeNode* node);
+static double evaluateLeaf(Differentiator* diff, const TreeNode* node);
+static bool isOperator(const TreeNode* node);
+static double diffOp(const TreeNode* node, double left_arg, double right_arg);
 
 static double evaluateAdd(double left_arg, double right_arg);
 static double evaluateSub(double left_arg, double right_arg);
@@ -82,48 +87,90 @@ static const OpFuncTable table[] = {
 void diffEvaluate(Differentiator* diff, size_t tree_idx)
 {
     assert(diff); assert(tree_idx < diff->forest.count);
-    assert(diff->forest.trees[tree_idx].root);
-
-    double value = evaluateNode(diff, diff->forest.trees[diff->forest.count - 1].root);
-    if (tree_idx == 0) {
-        if (!isnan(value)) {
-            printf("Value of function: %g\n", value);
-        } else {
-            printf("Value of function is not defined\n");
+    assert(diff->forest.trees[tree_idx].root); assert(diff->output.backend);
+
+    double value = evaluateNode(diff, diff->forest.trees[tree_idx].root);
+    diff->output.backend->value(diff, tree_idx, value);
+}
+
+
+double evaluateNode(Differentiator* diff, const TreeNode* node)
+{
+    assert(diff);
+
+    if (node == NULL) return 0;
+    if (node->type != NODE_OP) return evaluateLeaf(diff, node);
+
+    WorkStack left_values = {};
+    workStackInit(&left_values, sizeof(double));
+
+// Обход идет по ссылкам на родителей, в стеке лежат только значения левых поддеревьев
+    const TreeNode* current = node;
+    double value = 0;
+    bool is_descending = true;
+    OperationStatus status = STATUS_OK;
+    while (status == STATUS_OK) {
+        if (is_descending) {
+            while (isOperator(current->left))
+                current = current->left;
+            value = evaluateLeaf(diff, current->left);
         }
-    } else {
-        if (!isnan(value)) {
-            printf("Value of %zu derivative: %g\n", tree_idx, value);
-        } else {
-            printf("Value of %zu derivative is not defined\n", tree_idx);
+
+// Как и раньше, при неопределенном левом аргументе правое поддерево не вычисляется
+        if (isOperator(current->right) && !isnan(value)) {
+            if (current->left != NULL)
+                status = workStackPush(&left_values, &value);
+            current = current->right;
+            is_descending = true;
+            continue;
         }
+        value = isnan(value) ? NAN : diffOp(current, value, evaluateLeaf(diff, current->right));
+
+        while (current != node && current->parent->left != current) {
+            current = current->parent;
+            double left_value = 0;
+            if (current->left != NULL)
+                workStackPop(&left_values, &left_value);
+            value = diffOp(current, left_value, value);
+        }
+        if (current == node)
+            break;
+
+        current = current->parent;
+        is_descending = false;
     }
-};
+
+    workStackDestroy(&left_values);
+    return status == STATUS_OK ? value : NAN;
+}
 
 
-double evaluateNode(Differentiator* diff, const TreeNode* node)
+static double evaluateLeaf(Differentiator* diff, const TreeNode* node)
 {
     assert(diff);
 
     if (node == NULL) return 0;
 
     switch (node->type) {
-        case NODE_OP:  return diffOp(diff, node);
         case NODE_VAR: return diff->var_table.variables[node->value.var_idx].value;
         case NODE_NUM: return node->value.num_val;
+        case NODE_OP:
         default: fprintf(stderr, "Unknown node type!\n"); return 0;
     }
 }
 
 
-static double diffOp(Differentiator* diff, const TreeNode* node)
+static bool isOperator(const TreeNode* node)
 {
-    assert(diff);
+    return node != NULL && node->type == NODE_OP;
+}
 
-    double left_arg  = evaluateNode(diff, node->left);
-    if (isnan(left_arg)) return NAN;
-    double right_arg = evaluateNode(diff, node->right);
-    if (isnan(right_arg)) return NAN;
+
+static double diffOp(const TreeNode* node, double left_arg, double right_arg)
+{
+    assert(node);
+
+    if (isnan(left_arg) || isnan(right_arg)) return NAN;
 
     if (table[node->value.op].arg_count == 1) {
         return table[node->value.op].function(NAN, right_arg);
@@ -133,6 +180,54 @@ static double diffOp(Differentiator* diff, const TreeNode* node)
 }
 
 
+void evaluateOperationBlock(OpType op, const double* left_args, const double* right_args,
+                            double* results, size_t count)
+{
+    assert(right_args); assert(results); assert(op < OP_NONE);
+    assert(left_args != NULL || table[op].arg_count == 1);
+
+// Арифметика разворачивается в плотные циклы, остальные операции идут через таблицу
+    switch (op) {
+        case OP_ADD:
+            for (size_t index = 0; index < count; index++)
+                results[index] = left_args[index] + right_args[index];
+            return;
+        case OP_SUB:
+            for (size_t index = 0; index < count; index++)
+                results[index] = left_args[index] - right_args[index];
+            return;
+        case OP_MUL:
+            for (size_t index = 0; index < count; index++)
+                results[index] = left_args[index] * right_args[index];
+            return;
+        case OP_DIV:
+            for (size_t index = 0; index < count; index++)
+                results[index] = fabs(right_args[index]) < EPS ? NAN : left_args[index] / right_args[index];
+            return;
+        case OP_POW: case OP_LOG:
+        case OP_SIN: case OP_COS: case OP_TAN: case OP_COT:
+        case OP_ASIN: case OP_ACOS: case OP_ATAN: case OP_ACOT:
+        case OP_SINH: case OP_COSH: case OP_TANH: case OP_COTH:
+        case OP_ASINH: case OP_ACOSH: case OP_ATANH: case OP_ACOTH:
+        case OP_NONE:
+        default:
+            break;
+    }
+
+    double (*function)(double, double) = table[op].function;
+    if (table[op].arg_count == 1) {
+        for (size_t index = 0; index < count; index++)
+            results[index] = isnan(right_args[index]) ? NAN : function(NAN, right_args[index]);
+    } else {
+        for (size_t index = 0; index < count; index++) {
+            double left_arg = left_args[index];
+            double right_arg = right_args[index];
+            results[index] = isnan(left_arg) || isnan(right_arg) ? NAN : function(left_arg, right_arg);
+        }
+    }
+}
+
+
 static double evaluateAdd(double left_arg, double right_arg) { return left_arg + right_arg; }
 static double evaluateSub(double left_arg, double right_arg) { return left_arg - right_arg; }
 static double evaluateMul(double left_arg, double right_arg) { return left_arg * right_arg; }
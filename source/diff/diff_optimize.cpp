@@ -7,8 +7,10 @@
 #include "diff/diff_defs.h"
 #include "diff/diff_evaluate.h"
 #include "diff/diff.h"
+#include "diff/diff_scheduler.h"
 
 #include "tree/tree.h"
+#include "tree/tree_stack.h"
 
 #include "tex_dump/tex_struct.h"
 
@@ -21,6 +23,11 @@
 #define NL node->left
 #define NR node->right
 
+
+const size_t PARALLEL_OPTIMIZE_THRESHOLD = 4096;
+const size_t MAX_SPLIT_DEPTH = 10;
+
+
 typedef enum {
     FOLD_NOT_CONST = 0,
     FOLD_CONST,
@@ -28,10 +35,38 @@ typedef enum {
 } FoldStatus;
 
 
+typedef struct {
+    TreeNode* node;
+    bool is_expanded;
+} OptimizeFrame;
+
+
+typedef struct {
+    Task task;
+    Differentiator* diff;
+    TreeNode* node;
+    size_t tree_idx;
+    size_t depth;
+    FoldStatus fold_status;
+    bool is_changed;
+} OptimizeJob;
+
+
+static bool runOptimizePass(Differentiator* diff, size_t tree_idx);
+static bool hasNodeCount(const TreeNode* node, size_t count);
+static void optimizeRootTask(TaskWorker* worker, void* argument);
+static void foldConstantsTask(TaskWorker* worker, void* argument);
+static void simplifyOperationsTask(TaskWorker* worker, void* argument);
+static bool isSplittable(const OptimizeJob* job);
+
 static FoldStatus foldConstants(Differentiator* diff, TreeNode* node, size_t tree_idx);
+static FoldStatus foldOperation(Differentiator* diff, TreeNode* node, size_t tree_idx, WorkStack* results);
+static FoldStatus foldNode(Differentiator* diff, TreeNode* node, size_t tree_idx,
+                           FoldStatus left_res, FoldStatus right_res);
 
 static bool simplifyOperations(Differentiator* diff, TreeNode* node, size_t tree_idx);
 static bool simplifyDispatcher(Differentiator* diff, TreeNode* node, size_t tree_idx);
+static OperationStatus expandOptimizeFrame(WorkStack* frames, OptimizeFrame* frame);
 
 static bool simplifyAdd(Differentiator* diff, TreeNode* node, size_t tree_idx);
 static bool simplifySub(Differentiator* diff, TreeNode* node, size_t tree_idx);
@@ -62,12 +97,19 @@ void optimizeTree(Differentiator* diff, size_t tree_idx)
     if (diff->tex_dump.print_steps) {
         printTex(diff, "\\subsection{Оптимизация}\n");
     }
-    bool changed = true;
-    while (changed) {
-        FoldStatus status = foldConstants(diff, diff->forest.trees[tree_idx].root, tree_idx);
-        bool simplified = simplifyOperations(diff, diff->forest.trees[tree_idx].root, tree_idx);
-        changed = simplified || status == FOLD_OPTIMIZED;
-    }  
+// Шаги печатают все дерево целиком, поэтому с ними оптимизация идет последовательно
+    TreeNode* root = diff->forest.trees[tree_idx].root;
+    OptimizeJob job = {{optimizeRootTask, NULL, 0}, diff, root, tree_idx, 0, FOLD_NOT_CONST, false};
+    job.task.argument = &job;
+    OperationStatus status = STATUS_DIFF_CALCULATE_ERROR;
+    if (!diff->tex_dump.print_steps && diff->args.thread_count > 1 &&
+        hasNodeCount(root, PARALLEL_OPTIMIZE_THRESHOLD)) {
+        status = schedulerRun(diff->args.thread_count, optimizeRootTask, &job);
+    }
+    if (status != STATUS_OK) {
+        while (runOptimizePass(diff, tree_idx)) {}
+    }
+    treeUpdateVersion(&diff->forest.trees[tree_idx]);
 
     TREE_DUMP(diff, tree_idx, STATUS_OK, "source tree");
 // Если tree_idx == diff->forest.count, то в дереве разложение, а его оптимизацию можно не выводить
@@ -79,6 +121,117 @@ void optimizeTree(Differentiator* diff, size_t tree_idx)
 }
 
 
+static bool runOptimizePass(Differentiator* diff, size_t tree_idx)
+{
+    assert(diff);
+
+    FoldStatus status = foldConstants(diff, diff->forest.trees[tree_idx].root, tree_idx);
+    bool simplified = simplifyOperations(diff, diff->forest.trees[tree_idx].root, tree_idx);
+
+    return simplified || status == FOLD_OPTIMIZED;
+}
+
+
+static bool hasNodeCount(const TreeNode* node, size_t count)
+{
+    if (node == NULL)
+        return count == 0;
+
+    WorkStack stack = {};
+    workStackInit(&stack, sizeof(const TreeNode*));
+
+// Оптимизация только уменьшает дерево, поэтому размер проверяется один раз и с ранним выходом
+    size_t visited = 0;
+    OperationStatus status = workStackPush(&stack, &node);
+    while (visited < count && status == STATUS_OK && workStackPop(&stack, &node)) {
+        visited++;
+        if (NL != NULL)
+            status = workStackPush(&stack, &NL);
+        if (status == STATUS_OK && NR != NULL)
+            status = workStackPush(&stack, &NR);
+    }
+
+    workStackDestroy(&stack);
+    return visited >= count;
+}
+
+
+static void optimizeRootTask(TaskWorker* worker, void* argument)
+{
+    assert(worker); assert(argument);
+
+    OptimizeJob* root_job = (OptimizeJob*)argument;
+    bool changed = true;
+    while (changed) {
+        OptimizeJob fold = *root_job;
+        foldConstantsTask(worker, &fold);
+        OptimizeJob simplify = *root_job;
+        simplifyOperationsTask(worker, &simplify);
+        changed = simplify.is_changed || fold.fold_status == FOLD_OPTIMIZED;
+    }
+}
+
+
+static void foldConstantsTask(TaskWorker* worker, void* argument)
+{
+    assert(worker); assert(argument);
+
+    OptimizeJob* job = (OptimizeJob*)argument;
+    if (!isSplittable(job)) {
+        job->fold_status = foldConstants(job->diff, job->node, job->tree_idx);
+        return;
+    }
+
+// Поддеревья не пересекаются, поэтому потоки синхронизируются только в их корнях
+    TreeNode* node = job->node;
+    OptimizeJob left = {{foldConstantsTask, NULL, 0}, job->diff, NL, job->tree_idx, job->depth + 1,
+                        FOLD_NOT_CONST, false};
+    OptimizeJob right = left;
+    left.task.argument = &left;
+    right.node = NR;
+    schedulerSpawn(worker, &left.task);
+    foldConstantsTask(worker, &right);
+    schedulerJoin(worker, &left.task);
+
+    job->fold_status = foldNode(job->diff, node, job->tree_idx, left.fold_status, right.fold_status);
+}
+
+
+static void simplifyOperationsTask(TaskWorker* worker, void* argument)
+{
+    assert(worker); assert(argument);
+
+    OptimizeJob* job = (OptimizeJob*)argument;
+    if (!isSplittable(job)) {
+        job->is_changed = simplifyOperations(job->diff, job->node, job->tree_idx);
+        return;
+    }
+
+    TreeNode* node = job->node;
+    OptimizeJob left = {{simplifyOperationsTask, NULL, 0}, job->diff, NL, job->tree_idx, job->depth + 1,
+                        FOLD_NOT_CONST, false};
+    OptimizeJob right = left;
+    left.task.argument = &left;
+    right.node = NR;
+    schedulerSpawn(worker, &left.task);
+    simplifyOperationsTask(worker, &right);
+    schedulerJoin(worker, &left.task);
+
+    bool simplified = simplifyDispatcher(job->diff, node, job->tree_idx);
+    job->is_changed = left.is_changed || right.is_changed || simplified;
+}
+
+
+static bool isSplittable(const OptimizeJob* job)
+{
+    assert(job); assert(job->node);
+
+    const TreeNode* node = job->node;
+    return job->depth < MAX_SPLIT_DEPTH && node->type == NODE_OP &&
+           NL != NULL && NL->type == NODE_OP && NR != NULL && NR->type == NODE_OP;
+}
+
+
 static FoldStatus foldConstants(Differentiator* diff, TreeNode* node, size_t tree_idx)
 {
     assert(diff);
@@ -86,22 +239,65 @@ static FoldStatus foldConstants(Differentiator* diff, TreeNode* node, size_t tre
     if (!node)
         return FOLD_CONST;
 
-    switch (node->type) {
-        case NODE_OP: {
-            FoldStatus left_res =  foldConstants(diff, NL, tree_idx);
-            FoldStatus right_res = foldConstants(diff, NR, tree_idx);
-
-            if ((left_res == FOLD_OPTIMIZED || left_res == FOLD_CONST) &&
-                (right_res == FOLD_OPTIMIZED || right_res == FOLD_CONST)) {
-                setNodeToNum(diff, node, tree_idx, evaluateNode(diff, node));
-                return FOLD_OPTIMIZED;
-            } else {
-                return FOLD_NOT_CONST;
-            }
+    WorkStack frames = {};
+    WorkStack results = {};
+    workStackInit(&frames, sizeof(OptimizeFrame));
+    workStackInit(&results, sizeof(FoldStatus));
+
+    OptimizeFrame frame = {node, false};
+    OperationStatus status = workStackPush(&frames, &frame);
+    while (status == STATUS_OK && workStackPop(&frames, &frame)) {
+        TreeNode* current = frame.node;
+        if (current->type == NODE_OP && !frame.is_expanded) {
+            status = expandOptimizeFrame(&frames, &frame);
+            continue;
+        }
+
+        FoldStatus result = FOLD_NOT_CONST;
+        switch (current->type) {
+            case NODE_OP:  result = foldOperation(diff, current, tree_idx, &results); break;
+            case NODE_VAR: result = FOLD_NOT_CONST; break;
+            case NODE_NUM: result = FOLD_CONST; break;
+            default:       result = FOLD_NOT_CONST; break;
         }
-        case NODE_VAR: return FOLD_NOT_CONST;
-        case NODE_NUM: return FOLD_CONST;
-        default:       return FOLD_NOT_CONST;
+        status = workStackPush(&results, &result);
+    }
+
+    FoldStatus result = FOLD_NOT_CONST;
+    if (status == STATUS_OK) {
+        workStackPop(&results, &result);
+    }
+
+    workStackDestroy(&frames);
+    workStackDestroy(&results);
+    return result;
+}
+
+
+static FoldStatus foldOperation(Differentiator* diff, TreeNode* node, size_t tree_idx, WorkStack* results)
+{
+    assert(diff); assert(node); assert(results);
+
+    FoldStatus right_res = FOLD_CONST;
+    FoldStatus left_res = FOLD_CONST;
+    if (NR) workStackPop(results, &right_res);
+    if (NL) workStackPop(results, &left_res);
+
+    return foldNode(diff, node, tree_idx, left_res, right_res);
+}
+
+
+static FoldStatus foldNode(Differentiator* diff, TreeNode* node, size_t tree_idx,
+                           FoldStatus left_res, FoldStatus right_res)
+{
+    assert(diff); assert(node);
+
+    if ((left_res == FOLD_OPTIMIZED || left_res == FOLD_CONST) &&
+        (right_res == FOLD_OPTIMIZED || right_res == FOLD_CONST)) {
+        setNodeToNum(diff, node, tree_idx, evaluateNode(diff, node));
+        return FOLD_OPTIMIZED;
+    } else {
+        return FOLD_NOT_CONST;
     }
 }
 
@@ -114,17 +310,49 @@ static bool simplifyOperations(Differentiator* diff, TreeNode* node, size_t tree
         return false;
     }
 
+    WorkStack frames = {};
+    workStackInit(&frames, sizeof(OptimizeFrame));
+
     bool changed = false;
-    if (simplifyOperations(diff, NL, tree_idx) ||
-        simplifyOperations(diff, NR, tree_idx)) {
-        changed = true;
+    OptimizeFrame frame = {node, false};
+    OperationStatus status = workStackPush(&frames, &frame);
+    while (status == STATUS_OK && workStackPop(&frames, &frame)) {
+        if (frame.node->type != NODE_OP)
+            continue;
+
+        if (!frame.is_expanded) {
+            status = expandOptimizeFrame(&frames, &frame);
+        } else if (simplifyDispatcher(diff, frame.node, tree_idx)) {
+            changed = true;
+        }
+    }
+
+    workStackDestroy(&frames);
+    return changed;
+}
+
+
+static OperationStatus expandOptimizeFrame(WorkStack* frames, OptimizeFrame* frame)
+{
+    assert(frames); assert(frame); assert(!frame->is_expanded);
+
+    TreeNode* node = frame->node;
+    frame->is_expanded = true;
+    OperationStatus status = workStackPush(frames, frame);
+    RETURN_IF_STATUS_NOT_OK(status);
+
+    if (NR) {
+        OptimizeFrame right_frame = {NR, false};
+        status = workStackPush(frames, &right_frame);
+        RETURN_IF_STATUS_NOT_OK(status);
     }
-    if (node->type != NODE_OP) {
-        return changed;
+    if (NL) {
+        OptimizeFrame left_frame = {NL, false};
+        status = workStackPush(frames, &left_frame);
+        RETURN_IF_STATUS_NOT_OK(status);
     }
-    bool curr_changed = simplifyDispatcher(diff, node, tree_idx);    
 
-    return changed || curr_changed;
+    return STATUS_OK;
 }
 
 
@@ -224,8 +452,8 @@ static bool setNodeToChild(Differentiator* diff, TreeNode* node, size_t tree_idx
 {
     assert(diff); assert(node);
 
-    diff->highlight_node = node;
     if (diff->tex_dump.print_steps) {
+        diff->highlight_node = node;
         printTex(diff, "\\begin{dmath*}\n"
             "%n = ", diff->forest.trees[tree_idx].root);
     }
@@ -243,8 +471,8 @@ static bool setNodeToChild(Differentiator* diff, TreeNode* node, size_t tree_idx
     if (diff->tex_dump.print_steps) {
     printTex(diff, "%n\n"
         "\\end{dmath*}\n\n", diff->forest.trees[tree_idx].root);
+        diff->highlight_node = NULL;
     }
-    diff->highlight_node = NULL;
 
     return true;
 }
@@ -269,8 +497,8 @@ static bool setNodeToNum(Differentiator* diff, TreeNode* node, size_t tree_idx,
 {
     assert(diff); assert(node);
 
-    diff->highlight_node = node;
     if (diff->tex_dump.print_steps) {
+        diff->highlight_node = node;
         printTex(diff, "\\begin{dmath*}\n"
             "%n = ", diff->forest.trees[tree_idx].root);
     }
@@ -285,8 +513,8 @@ static bool setNodeToNum(Differentiator* diff, TreeNode* node, size_t tree_idx,
     if (diff->tex_dump.print_steps) {
         printTex(diff, "%n\n"
             "\\end{dmath*}\n\n", diff->forest.trees[tree_idx].root);
+        diff->highlight_node = NULL;
     }
-    diff->highlight_node = NULL;
 
     return true;
 }
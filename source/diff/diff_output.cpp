@@ -0,0 +1,440 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <assert.h>
+
+#include "diff/diff_output.h"
+#include "diff/diff_defs.h"
+#include "diff/diff.h"
+
+#include "graph_dump/html_builder.h"
+
+#include "tex_dump/tex_struct.h"
+#include "tex_dump/plot_generator.h"
+#include "tex_dump/render_pipeline.h"
+#include "tex_dump/render_jobs.h"
+#include "tex_dump/render_cache.h"
+
+#include "tree/tree_write.h"
+
+#include "status.h"
+
+
+static OperationStatus texOutputOpen(Differentiator* diff);
+static void texOutputDerivative(Differentiator* diff, size_t tree_idx, bool is_cached);
+static void texOutputValue(Differentiator* diff, size_t tree_idx, double value);
+static void texOutputResult(Differentiator* diff, size_t tree_idx, double elapsed);
+static OperationStatus texOutputTaylor(Differentiator* diff, size_t tree_idx);
+static OperationStatus texOutputClose(Differentiator* diff);
+
+static OperationStatus jsonOutputOpen(Differentiator* diff);
+static void jsonOutputResult(Differentiator* diff, size_t tree_idx, double elapsed);
+static OperationStatus jsonOutputTaylor(Differentiator* diff, size_t tree_idx);
+static OperationStatus jsonOutputClose(Differentiator* diff);
+static void writeJsonRecord(Differentiator* diff, const char* kind, size_t order, size_t tree_idx,
+                            const double* elapsed);
+
+static OperationStatus csvOutputOpen(Differentiator* diff);
+static void csvOutputResult(Differentiator* diff, size_t tree_idx, double elapsed);
+static OperationStatus csvOutputTaylor(Differentiator* diff, size_t tree_idx);
+static OperationStatus csvOutputClose(Differentiator* diff);
+static void writeCsvRecord(Differentiator* diff, const char* kind, size_t order, size_t tree_idx,
+                           const double* elapsed);
+
+static void writeExpression(Differentiator* diff, const TreeNode* root, bool is_infix, OutputFormat format);
+static bool hasEscapedNames(const Differentiator* diff, OutputFormat format);
+static bool isEscapedChar(char symbol, OutputFormat format);
+static void writeEscaped(FILE* output, const char* text, size_t length, OutputFormat format);
+static void writeValue(Differentiator* diff, const char* missing);
+
+static void skipOutput(Differentiator* diff);
+static void skipDerivative(Differentiator* diff, size_t tree_idx, bool is_cached);
+static void storeValue(Differentiator* diff, size_t tree_idx, double value);
+static OperationStatus openOutputFile(Differentiator* diff);
+static OperationStatus closeOutputFile(Differentiator* diff);
+
+
+// Порядок совпадает с OutputFormat
+static const OutputBackend OUTPUT_BACKENDS[] = {
+    {texOutputOpen, printIntroduction, texOutputDerivative, texOutputValue,
+     texOutputResult, texOutputTaylor, texOutputClose},
+    {jsonOutputOpen, skipOutput, skipDerivative, storeValue,
+     jsonOutputResult, jsonOutputTaylor, jsonOutputClose},
+    {csvOutputOpen, skipOutput, skipDerivative, storeValue,
+     csvOutputResult, csvOutputTaylor, csvOutputClose}
+};
+
+
+const OutputBackend* getOutputBackend(OutputFormat format)
+{
+    assert((size_t)format < sizeof(OUTPUT_BACKENDS) / sizeof(*OUTPUT_BACKENDS));
+
+    return &OUTPUT_BACKENDS[format];
+}
+
+
+static OperationStatus texOutputOpen(Differentiator* diff)
+{
+    assert(diff);
+
+// HTML-дамп открывается только на уровнях диагностики, которые его пишут
+    if (diff->args.diagnostics_info.level >= DIAGNOSTICS_SAMPLED)
+        openGraphDumpFile(diff);
+    texInit(diff);
+    renderJobsSetLimit(diff->args.thread_count);
+    renderCacheOpen(diff->args.cache_info.directory, diff->args.cache_info.size_limit);
+    renderPipelineStart(diff);
+
+    return STATUS_OK;
+}
+
+
+static void texOutputDerivative(Differentiator* diff, size_t tree_idx, bool is_cached)
+{
+    assert(diff);
+
+    printTex(diff, "\\chapter{%zu-я производная}", tree_idx);
+// Вычисляемая производная печатается по ходу дифференцирования, готовая - сразу
+    if (is_cached) {
+        printTex(diff, "\n\\subsection{Результат вычисления}\n");
+        printExpression(diff, tree_idx);
+    }
+}
+
+
+static void texOutputValue(Differentiator* diff, size_t tree_idx, double value)
+{
+    assert(diff);
+
+    if (tree_idx == 0) {
+        if (!isnan(value)) {
+            printf("Value of function: %g\n", value);
+        } else {
+            printf("Value of function is not defined\n");
+        }
+    } else {
+        if (!isnan(value)) {
+            printf("Value of %zu derivative: %g\n", tree_idx, value);
+        } else {
+            printf("Value of %zu derivative is not defined\n", tree_idx);
+        }
+    }
+}
+
+
+static void texOutputResult(Differentiator* diff, size_t tree_idx, double)
+{
+    assert(diff);
+
+// График функции уже есть во введении
+    if (tree_idx > 0)
+        printPlot(diff, tree_idx);
+}
+
+
+static OperationStatus texOutputTaylor(Differentiator* diff, size_t tree_idx)
+{
+    assert(diff);
+
+    char output_filename[BUFFER_SIZE] = "";
+    snprintf(output_filename, BUFFER_SIZE, "%s/%s_%03zu", GNUPLOT_IMAGES_DIRECTORY,
+        GNUPLOT_OUTPUT_FILENAME, tree_idx);
+
+    OperationStatus status = generatePlot(diff, output_filename, 2, 0, tree_idx);
+    if (status == STATUS_OK)
+        printTaylorSeries(diff, output_filename, tree_idx);
+
+    return status;
+}
+
+
+static OperationStatus texOutputClose(Differentiator* diff)
+{
+    assert(diff);
+
+    if (diff->graph_dump.file != NULL) {
+        assert(fclose(diff->graph_dump.file) == 0);
+        diff->graph_dump.file = NULL;
+    }
+
+    if (TEX_FILE == NULL)
+        return STATUS_OK;
+
+    return texClose(diff);
+}
+
+
+static OperationStatus jsonOutputOpen(Differentiator* diff)
+{
+    assert(diff);
+
+    OperationStatus status = openOutputFile(diff);
+    RETURN_IF_STATUS_NOT_OK(status);
+
+    fputs("[", diff->output.file);
+    return STATUS_OK;
+}
+
+
+static void jsonOutputResult(Differentiator* diff, size_t tree_idx, double elapsed)
+{
+    assert(diff);
+
+    writeJsonRecord(diff, "derivative", tree_idx, tree_idx, &elapsed);
+}
+
+
+static OperationStatus jsonOutputTaylor(Differentiator* diff, size_t tree_idx)
+{
+    assert(diff);
+
+    writeJsonRecord(diff, "taylor", diff->args.derivative_info.order, tree_idx, NULL);
+    return STATUS_OK;
+}
+
+
+static OperationStatus jsonOutputClose(Differentiator* diff)
+{
+    assert(diff);
+
+    if (diff->output.file == NULL)
+        return STATUS_OK;
+
+    fputs(diff->output.record_count != 0 ? "\n]\n" : "]\n", diff->output.file);
+    return closeOutputFile(diff);
+}
+
+
+static void writeJsonRecord(Differentiator* diff, const char* kind, size_t order, size_t tree_idx,
+                            const double* elapsed)
+{
+    assert(diff); assert(diff->output.file); assert(kind);
+
+    FILE* output = diff->output.file;
+    const TreeNode* root = diff->forest.trees[tree_idx].root;
+
+    fprintf(output, "%s\n  {\"kind\": \"%s\", \"order\": %zu, \"infix\": \"",
+        diff->output.record_count != 0 ? "," : "", kind, order);
+    writeExpression(diff, root, true, OUTPUT_JSON);
+    fputs("\", \"prefix\": \"", output);
+    writeExpression(diff, root, false, OUTPUT_JSON);
+
+    fputs("\", \"value\": ", output);
+    writeValue(diff, "null");
+
+    fputs(", \"time_ms\": ", output);
+    if (elapsed != NULL)
+        fprintf(output, "%.3f}", *elapsed);
+    else
+        fputs("null}", output);
+
+    diff->output.record_count++;
+    diff->output.has_value = false;
+}
+
+
+static OperationStatus csvOutputOpen(Differentiator* diff)
+{
+    assert(diff);
+
+    OperationStatus status = openOutputFile(diff);
+    RETURN_IF_STATUS_NOT_OK(status);
+
+    fputs("kind,order,infix,prefix,value,time_ms\n", diff->output.file);
+    return STATUS_OK;
+}
+
+
+static void csvOutputResult(Differentiator* diff, size_t tree_idx, double elapsed)
+{
+    assert(diff);
+
+    writeCsvRecord(diff, "derivative", tree_idx, tree_idx, &elapsed);
+}
+
+
+static OperationStatus csvOutputTaylor(Differentiator* diff, size_t tree_idx)
+{
+    assert(diff);
+
+    writeCsvRecord(diff, "taylor", diff->args.derivative_info.order, tree_idx, NULL);
+    return STATUS_OK;
+}
+
+
+static OperationStatus csvOutputClose(Differentiator* diff)
+{
+    assert(diff);
+
+    if (diff->output.file == NULL)
+        return STATUS_OK;
+
+    return closeOutputFile(diff);
+}
+
+
+static void writeCsvRecord(Differentiator* diff, const char* kind, size_t order, size_t tree_idx,
+                           const double* elapsed)
+{
+    assert(diff); assert(diff->output.file); assert(kind);
+
+    FILE* output = diff->output.file;
+    const TreeNode* root = diff->forest.trees[tree_idx].root;
+
+// В инфиксной записи встречаются запятые (log), поэтому выражения берутся в кавычки
+    fprintf(output, "%s,%zu,\"", kind, order);
+    writeExpression(diff, root, true, OUTPUT_CSV);
+    fputs("\",\"", output);
+    writeExpression(diff, root, false, OUTPUT_CSV);
+    fputs("\",", output);
+    writeValue(diff, "");
+    fputc(',', output);
+    if (elapsed != NULL)
+        fprintf(output, "%.3f", *elapsed);
+    fputc('\n', output);
+
+    diff->output.record_count++;
+    diff->output.has_value = false;
+}
+
+
+static void writeExpression(Differentiator* diff, const TreeNode* root, bool is_infix, OutputFormat format)
+{
+    assert(diff); assert(diff->output.file);
+
+    FILE* output = diff->output.file;
+// Экранировать можно только имена переменных, поэтому обычно дерево пишется сразу в файл
+    if (!hasEscapedNames(diff, format)) {
+        if (is_infix)
+            treeWriteInfix(diff, root, output);
+        else
+            treeWritePrefix(diff, root, output);
+        return;
+    }
+
+    char* text = NULL;
+    size_t length = 0;
+    FILE* stream = open_memstream(&text, &length);
+    if (stream == NULL)
+        return;
+
+    if (is_infix)
+        treeWriteInfix(diff, root, stream);
+    else
+        treeWritePrefix(diff, root, stream);
+    if (fclose(stream) == 0)
+        writeEscaped(output, text, length, format);
+    free(text);
+}
+
+
+static bool hasEscapedNames(const Differentiator* diff, OutputFormat format)
+{
+    assert(diff);
+
+    for (size_t index = 0; index < diff->var_table.count; index++) {
+        for (const char* name = diff->var_table.variables[index].name; *name != '\0'; name++) {
+            if (isEscapedChar(*name, format))
+                return true;
+        }
+    }
+
+    return false;
+}
+
+
+static bool isEscapedChar(char symbol, OutputFormat format)
+{
+// В поле CSV в кавычках удваиваются только сами кавычки
+    if (format == OUTPUT_CSV)
+        return symbol == '"';
+
+    return symbol == '"' || symbol == '\\' || (unsigned char)symbol < 0x20;
+}
+
+
+static void writeEscaped(FILE* output, const char* text, size_t length, OutputFormat format)
+{
+    assert(output); assert(text);
+
+    size_t begin = 0;
+    for (size_t index = 0; index < length; index++) {
+        if (!isEscapedChar(text[index], format))
+            continue;
+
+        fwrite(text + begin, 1, index - begin, output);
+        begin = index + 1;
+        if (format == OUTPUT_CSV)
+            fputs("\"\"", output);
+        else if (text[index] == '"' || text[index] == '\\')
+            fprintf(output, "\\%c", text[index]);
+        else
+            fprintf(output, "\\u%04x", (unsigned)(unsigned char)text[index]);
+    }
+    fwrite(text + begin, 1, length - begin, output);
+}
+
+
+static void writeValue(Differentiator* diff, const char* missing)
+{
+    assert(diff); assert(diff->output.file); assert(missing);
+
+// Значение печатается кратчайшей записью, которая читается обратно без потерь
+    if (!diff->output.has_value || !isfinite(diff->output.value)) {
+        fputs(missing, diff->output.file);
+        return;
+    }
+
+    char text[NUMBER_TEXT_SIZE] = {};
+    size_t length = treeFormatNumber(diff->output.value, text);
+    fwrite(text, 1, length, diff->output.file);
+}
+
+
+static void skipOutput(Differentiator* diff)
+{
+    assert(diff);
+}
+
+
+static void skipDerivative(Differentiator* diff, size_t, bool)
+{
+    assert(diff);
+}
+
+
+static void storeValue(Differentiator* diff, size_t, double value)
+{
+    assert(diff);
+
+    diff->output.value = value;
+    diff->output.has_value = true;
+}
+
+
+static OperationStatus openOutputFile(Differentiator* diff)
+{
+    assert(diff); assert(diff->output.file == NULL);
+
+    const char* filename = diff->args.batch_info.output_file;
+    diff->output.file = filename != NULL ? fopen(filename, "w") : stdout;
+    if (diff->output.file == NULL)
+        return STATUS_IO_FILE_OPEN_ERROR;
+
+// Шаги вычисления нужны только отчету, без него их подготовка - лишняя работа
+    diff->tex_dump.print_steps = false;
+    diff->output.record_count = 0;
+
+    return STATUS_OK;
+}
+
+
+static OperationStatus closeOutputFile(Differentiator* diff)
+{
+    assert(diff); assert(diff->output.file);
+
+    bool is_closed = diff->output.file == stdout ? fflush(stdout) == 0 : fclose(diff->output.file) == 0;
+    diff->output.file = NULL;
+
+    return is_closed ? STATUS_OK : STATUS_IO_FILE_CLOSE_ERROR;
+}
@@ -1,5 +1,7 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
 #include <math.h>
 #include <assert.h>
 
@@ -7,64 +9,145 @@
 #include "diff/diff_create.h"
 #include "diff/diff_defs.h"
 #include "diff/diff.h"
+#include "diff/diff_scheduler.h"
 
 #include "tex_dump/tex_struct.h"
+
+#include "tree/tree.h"
+#include "tree/tree_stack.h"
     
 
 #define L node->left
 #define R node->right
 
 
-#define dL diffNode(diff, L)
-#define dR diffNode(diff, R)
-#define cL copyNode(L)
-#define cR copyNode(R)
+#define dL takeDerivative(&derivatives->left)
+#define dR takeDerivative(&derivatives->right)
+#define cL copyBranch(derivatives, L)
+#define cR copyBranch(derivatives, R)
+
+
+const size_t PARALLEL_DIFF_THRESHOLD = 2048;
+const size_t MAX_SPAWN_DEPTH = 48;
+
+
+typedef enum {
+    DERIVATIVE_CONST = 0,
+    DERIVATIVE_RIGHT = 1,
+    DERIVATIVE_LEFT  = 2,
+    DERIVATIVE_BOTH  = DERIVATIVE_LEFT | DERIVATIVE_RIGHT
+} DerivativeCase;
+
+
+// Множество узлов, чьи поддеревья достаточно велики, чтобы делить их работу между потоками
+typedef struct {
+    const TreeNode** nodes;
+    size_t slot_count;
+    size_t count;
+} LargeBranches;
+
+
+typedef struct {
+    Differentiator* diff;
+    LargeBranches large_branches;
+    TreeNode* root;
+    TreeNode* derivative;
+} ParallelDiff;
+
+
+typedef struct {
+    Task task;
+    ParallelDiff* context;
+    TreeNode* node;
+    TreeNode* result;
+    size_t depth;
+} BranchJob;
+
 
+typedef struct {
+    TreeNode* left;
+    TreeNode* right;
+    DerivativeCase derivative_case;
+    TaskWorker* worker;
+    ParallelDiff* context;
+    size_t depth;
+} ChildDerivatives;
 
-#define PRINT_EXPRESSION(printExpression)                                      \
-    do {                                                                       \
-        if (diff->tex_dump.print_steps) {                                      \
-            printTex(diff, "\\begin{dmath*}\n\\left(%n\\right)' = ", node);    \
-            printExpression;                                                   \
-            printTex(diff, "\n\\end{dmath*}\n");                               \
-        }                                                                      \
-    } while (0)
 
+typedef struct {
+    TreeNode* node;
+    DerivativeCase derivative_case;
+    bool is_expanded;
+} DiffFrame;
 
-typedef TreeNode* (*ComputeDerivativeFunc)(Differentiator* diff, TreeNode* node);
 
+typedef struct {
+    const TreeNode* source;
+    TreeNode* copy;
+} CopyFrame;
 
-static TreeNode* diffOp(Differentiator* diff, TreeNode* node);
+
+typedef struct {
+    const TreeNode* node;
+    bool is_expanded;
+} SizeFrame;
+
+
+typedef TreeNode* (*ComputeDerivativeFunc)(Differentiator* diff, TreeNode* node,
+                                           ChildDerivatives* derivatives);
+
+
+static TreeNode* diffBranch(Differentiator* diff, TreeNode* node);
+static void printDerivativeSteps(Differentiator* diff, TreeNode* node);
+
+static OperationStatus diffParallel(Differentiator* diff, TreeNode* node, TreeNode** derivative);
+static OperationStatus collectLargeBranches(LargeBranches* branches, const TreeNode* root);
+static OperationStatus insertLargeBranch(LargeBranches* branches, const TreeNode* node);
+static bool isLargeBranch(const ParallelDiff* context, const TreeNode* node);
+static size_t hashNodePointer(const TreeNode* node);
+static void diffRootTask(TaskWorker* worker, void* argument);
+static void diffBranchTask(TaskWorker* worker, void* argument);
+static void copyBranchTask(TaskWorker* worker, void* argument);
+static TreeNode* diffBranchParallel(TaskWorker* worker, ParallelDiff* context, TreeNode* node, size_t depth);
+static TreeNode* copyBranchParallel(TaskWorker* worker, ParallelDiff* context, TreeNode* node, size_t depth);
+static TreeNode* copyBranch(const ChildDerivatives* derivatives, TreeNode* node);
+
+static TreeNode* diffLeaf(Differentiator* diff, const TreeNode* node);
+static DerivativeCase getDerivativeCase(Differentiator* diff, TreeNode* node);
+static OperationStatus expandDiffFrame(Differentiator* diff, WorkStack* frames, DiffFrame* frame);
+static TreeNode* reduceDiffFrame(Differentiator* diff, WorkStack* results, const DiffFrame* frame);
+static void printDerivativeStep(Differentiator* diff, TreeNode* node, DerivativeCase derivative_case);
+static TreeNode* takeDerivative(TreeNode** derivative);
 static TreeNode* copyNode(const TreeNode* node);
 static TreeNode* nodeDup(const TreeNode* node);
 
 
-static TreeNode* computeAddDerivative(Differentiator* diff, TreeNode* node);
-static TreeNode* computeSubDerivative(Differentiator* diff, TreeNode* node);
-static TreeNode* computeMulDerivative(Differentiator* diff, TreeNode* node);
-static TreeNode* computeDivDerivative(Differentiator* diff, TreeNode* node);
-static TreeNode* computePowDerivative(Differentiator* diff, TreeNode* node);
-static TreeNode* computeLogDerivative(Differentiator* diff, TreeNode* node);
+static TreeNode* computeAddDerivative(Differentiator* diff, TreeNode* node, ChildDerivatives* derivatives);
+static TreeNode* computeSubDerivative(Differentiator* diff, TreeNode* node, ChildDerivatives* derivatives);
+static TreeNode* computeMulDerivative(Differentiator* diff, TreeNode* node, ChildDerivatives* derivatives);
+static TreeNode* computeDivDerivative(Differentiator* diff, TreeNode* node, ChildDerivatives* derivatives);
+static TreeNode* computePowDerivative(Differentiator* diff, TreeNode* node, ChildDerivatives* derivatives);
+static TreeNode* computeLogDerivative(Differentiator* diff, TreeNode* node, ChildDerivatives* derivatives);
 
-static TreeNode* computeSinDerivative(Differentiator* diff, TreeNode* node);
-static TreeNode* computeCosDerivative(Differentiator* diff, TreeNode* node);
-static TreeNode* computeTanDerivative(Differentiator* diff, TreeNode* node);
-static TreeNode* computeCotDerivative(Differentiator* diff, TreeNode* node);
+static TreeNode* computeSinDerivative(Differentiator* diff, TreeNode* node, ChildDerivatives* derivatives);
+static TreeNode* computeCosDerivative(Differentiator* diff, TreeNode* node, ChildDerivatives* derivatives);
+static TreeNode* computeTanDerivative(Differentiator* diff, TreeNode* node, ChildDerivatives* derivatives);
+static TreeNode* computeCotDerivative(Differentiator* diff, TreeNode* node, ChildDerivatives* derivatives);
 
-static TreeNode* computeAsinDerivative(Differentiator* diff, TreeNode* node);
-static TreeNode* computeAcosDerivative(Differentiator* diff, TreeNode* node);
-static TreeNode* computeAtanDerivative(Differentiator* diff, TreeNode* node);
-static TreeNode* computeAcotDerivative(Differentiator* diff, TreeNode* node);
+static TreeNode* computeAsinDerivative(Differentiator* diff, TreeNode* node, ChildDerivatives* derivatives);
+static TreeNode* computeAcosDerivative(Differentiator* diff, TreeNode* node, ChildDerivatives* derivatives);
+static TreeNode* computeAtanDerivative(Differentiator* diff, TreeNode* node, ChildDerivatives* derivatives);
+static TreeNode* computeAcotDerivative(Differentiator* diff, TreeNode* node, ChildDerivatives* derivatives);
 
-static TreeNode* computeSinhDerivative(Differentiator* diff, TreeNode* node);
-static TreeNode* computeCoshDerivative(Differentiator* diff, TreeNode* node);
-static TreeNode* computeTanhDerivative(Differentiator* diff, TreeNode* node);
-static TreeNode* computeCothDerivative(Differentiator* diff, TreeNode* node);
+static TreeNode* computeSinhDerivative(Differentiator* diff, TreeNode* node, ChildDerivatives* derivatives);
+static TreeNode* computeCoshDerivative(Differentiator* diff, TreeNode* node, ChildDerivatives* derivatives);
+static TreeNode* computeTanhDerivative(Differentiator* diff, TreeNode* node, ChildDerivatives* derivatives);
+static TreeNode* computeCothDerivative(Differentiator* diff, TreeNode* node, ChildDerivatives* derivatives);
 
-static TreeNode* computeAsinhDerivative(Differentiator* diff, TreeNode* node);
-static TreeNode* computeAcoshDerivative(Differentiator* diff, TreeNode* node);
-static TreeNode* computeAtanhDerivative(Differentiator* diff, TreeNode* node);
-static TreeNode* computeAcothDerivative(Differentiator* diff, TreeNode* node);
+static TreeNode* computeAsinhDerivative(Differentiator* diff, TreeNode* node, ChildDerivatives* derivatives);
+static TreeNode* computeAcoshDerivative(Differentiator* diff, TreeNode* node, ChildDerivatives* derivatives);
+static TreeNode* computeAtanhDerivative(Differentiator* diff, TreeNode* node, ChildDerivatives* derivatives);
+static TreeNode* computeAcothDerivative(Differentiator* diff, TreeNode* node, ChildDerivatives* derivatives);
 
 
 ComputeDerivativeFunc computeDerivativeTable[OP_MAX_COUNT] = {
@@ -97,9 +180,412 @@ ComputeDerivativeFunc computeDerivativeTable[OP_MAX_COUNT] = {
 };
 
 
+// В шаблонах шагов %l и %r заменяются на левый и правый аргумент узла
+const char* DERIVATIVE_STEPS[OP_MAX_COUNT] = {
+    [OP_ADD] = "\\left(%l\\right)'+\\left(%r\\right)'",
+    [OP_SUB] = "\\left(%l\\right)'-\\left(%r\\right)'",
+    [OP_MUL] = "\\left(%l\\right)'\\cdot\\left(%r\\right)+"
+               "\\left(%l\\right)\\cdot\\left(%r\\right)'",
+    [OP_DIV] = "\\frac{\\left(%l\\right)'\\cdot\\left(%r\\right)-"
+               "\\left(%l\\right)\\cdot\\left(%r\\right)'}{%r}",
+    [OP_POW] = NULL,
+    [OP_LOG] = NULL,
+
+    [OP_SIN] = "\\cos\\left(%r\\right)\\cdot\\left(%r\\right)'",
+    [OP_COS] = "-\\sin\\left(%r\\right)\\cdot\\left(%r\\right)'",
+    [OP_TAN] = "\\frac{1}{\\cos^2\\left(%r\\right)}\\cdot\\left(%r\\right)'",
+    [OP_COT] = "-\\frac{1}{\\sin^2\\left(%r\\right)}\\cdot\\left(%r\\right)'",
+
+    [OP_ASIN] = "\\frac{1}{\\left(1-\\left(%r\\right)^2\\right)^{0.5}}\\cdot\\left(%r\\right)'",
+    [OP_ACOS] = "-\\frac{1}{\\left(1-\\left(%r\\right)^2\\right)^{0.5}}\\cdot\\left(%r\\right)'",
+    [OP_ATAN] = "\\frac{1}{1+\\left(%r\\right)^2}\\cdot\\left(%r\\right)'",
+    [OP_ACOT] = "-\\frac{1}{1+\\left(%r\\right)^2}\\cdot\\left(%r\\right)'",
+
+    [OP_SINH] = "\\cosh\\left(%r\\right)\\cdot\\left(%r\\right)'",
+    [OP_COSH] = "\\sinh\\left(%r\\right)\\cdot\\left(%r\\right)'",
+    [OP_TANH] = "\\frac{1}{\\cosh^2\\left(%r\\right)}\\cdot\\left(%r\\right)'",
+    [OP_COTH] = "-\\frac{1}{\\sinh^2\\left(%r\\right)}\\cdot\\left(%r\\right)'",
+
+    [OP_ASINH] = "\\frac{1}{\\left(\\left(%r\\right)^2+1\\right)^{0.5}}\\cdot\\left(%r\\right)'",
+    [OP_ACOSH] = "\\frac{1}{\\left(\\left(%r\\right)^2-1\\right)^{0.5}}\\cdot\\left(%r\\right)'",
+    [OP_ATANH] = "\\frac{1}{1-\\left(%r\\right)^2}\\cdot\\left(%r\\right)'",
+    [OP_ACOTH] = "\\frac{1}{1-\\left(%r\\right)^2}\\cdot\\left(%r\\right)'",
+};
+
+
+const char* POW_DERIVATIVE_STEPS[] = {
+    [DERIVATIVE_CONST] = "0",
+    [DERIVATIVE_RIGHT] = "\\left(%r\\right)\\cdot\\left(%l\\right)^{%r|\\cdot\\ln\\left(%l\\right)}",
+    [DERIVATIVE_LEFT]  = "\\left(%r\\right)\\cdot\\left(%l\\right)^{%r-1}\\cdot\\left(%l\\right)",
+    [DERIVATIVE_BOTH]  = "\\left(\\left(%r\\right)'\\cdot\\ln\\left(%l\\right)+"
+                         "\\frac{\\left(%r\\right)\\cdot\\left(%l\\right)'}{%l}"
+                         "\\right)\\cdot\\left(%l\\right)^{%r}",
+};
+
+
+const char* LOG_DERIVATIVE_STEPS[] = {
+    [DERIVATIVE_CONST] = "0",
+    [DERIVATIVE_RIGHT] = "\\frac{\\left(%r\\right)'}{%r\\cdot\\ln\\left(%l\\right)}",
+    [DERIVATIVE_LEFT]  = "-\\frac{\\ln\\left(%r\\right)\\cdot\\left(%l\\right)}{\\left(\\ln"
+                         "\\left(%r\\right)\\right)^2\\cdot\\left(%l\\right)}",
+    [DERIVATIVE_BOTH]  = "\\frac{\\frac{\\left(%r\\right)'\\cdot\\ln\\left(%l\\right)}{%r}-"
+                         "\\frac{\\left(%l\\right)'\\cdot\\ln\\left(%r\\right)}{\\left(%l\\right)}"
+                         "{\\left(%l\\right)^2}",
+};
+
+
 TreeNode* diffNode(Differentiator* diff, TreeNode* node)
 {
-    assert(node);
+    assert(diff); assert(node);
+
+// Шаги печатаются отдельным последовательным проходом, поэтому их порядок не зависит от потоков
+    if (diff->tex_dump.print_steps)
+        printDerivativeSteps(diff, node);
+
+    TreeNode* derivative = NULL;
+    if (diff->args.thread_count > 1 && diffParallel(diff, node, &derivative) == STATUS_OK)
+        return derivative;
+
+    return diffBranch(diff, node);
+}
+
+
+static TreeNode* diffBranch(Differentiator* diff, TreeNode* node)
+{
+    assert(diff); assert(node);
+
+    WorkStack frames = {};
+    WorkStack results = {};
+    workStackInit(&frames, sizeof(DiffFrame));
+    workStackInit(&results, sizeof(TreeNode*));
+
+// Узел раскрывается при первом посещении, производная собирается при втором
+    DiffFrame frame = {node, DERIVATIVE_BOTH, false};
+    OperationStatus status = workStackPush(&frames, &frame);
+    while (status == STATUS_OK && workStackPop(&frames, &frame)) {
+        if (frame.node->type == NODE_OP && !frame.is_expanded) {
+            status = expandDiffFrame(diff, &frames, &frame);
+        } else {
+            TreeNode* derivative = frame.node->type == NODE_OP ?
+                reduceDiffFrame(diff, &results, &frame) : diffLeaf(diff, frame.node);
+            status = workStackPush(&results, &derivative);
+            if (status != STATUS_OK && derivative != NULL)
+                deleteBranch(derivative);
+        }
+    }
+
+    TreeNode* derivative = NULL;
+    if (status == STATUS_OK) {
+        workStackPop(&results, &derivative);
+    }
+    TreeNode* unused = NULL;
+    while (workStackPop(&results, &unused)) {
+        if (unused != NULL)
+            deleteBranch(unused);
+    }
+
+    workStackDestroy(&frames);
+    workStackDestroy(&results);
+    return derivative;
+}
+
+
+static void printDerivativeSteps(Differentiator* diff, TreeNode* node)
+{
+    assert(diff); assert(node);
+
+    WorkStack stack = {};
+    workStackInit(&stack, sizeof(TreeNode*));
+
+// Порядок совпадает с порядком раскрытия узлов при дифференцировании: левое поддерево раньше правого
+    OperationStatus status = workStackPush(&stack, &node);
+    while (status == STATUS_OK && workStackPop(&stack, &node)) {
+        if (node->type != NODE_OP)
+            continue;
+
+        DerivativeCase derivative_case = getDerivativeCase(diff, node);
+        printDerivativeStep(diff, node, derivative_case);
+        if (R && (derivative_case & DERIVATIVE_RIGHT))
+            status = workStackPush(&stack, &R);
+        if (status == STATUS_OK && L && (derivative_case & DERIVATIVE_LEFT))
+            status = workStackPush(&stack, &L);
+    }
+
+    workStackDestroy(&stack);
+}
+
+
+static OperationStatus diffParallel(Differentiator* diff, TreeNode* node, TreeNode** derivative)
+{
+    assert(diff); assert(node); assert(derivative);
+
+    ParallelDiff context = {diff, {}, node, NULL};
+    OperationStatus status = collectLargeBranches(&context.large_branches, node);
+    if (status == STATUS_OK && !isLargeBranch(&context, node))
+        status = STATUS_DIFF_CALCULATE_ERROR;
+    if (status == STATUS_OK)
+        status = schedulerRun(diff->args.thread_count, diffRootTask, &context);
+
+    free(context.large_branches.nodes);
+    *derivative = context.derivative;
+    return status;
+}
+
+
+static OperationStatus collectLargeBranches(LargeBranches* branches, const TreeNode* root)
+{
+    assert(branches); assert(root);
+
+    WorkStack frames = {};
+    WorkStack sizes = {};
+    workStackInit(&frames, sizeof(SizeFrame));
+    workStackInit(&sizes, sizeof(size_t));
+
+// Размеры поддеревьев считаются обратным обходом
+    SizeFrame frame = {root, false};
+    OperationStatus status = workStackPush(&frames, &frame);
+    while (status == STATUS_OK && workStackPop(&frames, &frame)) {
+        const TreeNode* node = frame.node;
+        if (!frame.is_expanded) {
+            SizeFrame expanded = {node, true};
+            status = workStackPush(&frames, &expanded);
+            SizeFrame child = {R, false};
+            if (status == STATUS_OK && R != NULL)
+                status = workStackPush(&frames, &child);
+            child.node = L;
+            if (status == STATUS_OK && L != NULL)
+                status = workStackPush(&frames, &child);
+            continue;
+        }
+
+        size_t size = 1;
+        size_t child_size = 0;
+        if (R != NULL && workStackPop(&sizes, &child_size))
+            size += child_size;
+        if (L != NULL && workStackPop(&sizes, &child_size))
+            size += child_size;
+        if (size >= PARALLEL_DIFF_THRESHOLD)
+            status = insertLargeBranch(branches, node);
+        if (status == STATUS_OK)
+            status = workStackPush(&sizes, &size);
+    }
+
+    workStackDestroy(&frames);
+    workStackDestroy(&sizes);
+    return status;
+}
+
+
+static OperationStatus insertLargeBranch(LargeBranches* branches, const TreeNode* node)
+{
+    assert(branches); assert(node);
+
+// Таблица заполняется до запуска потоков, после этого ее только читают
+    if (2 * (branches->count + 1) > branches->slot_count) {
+        size_t slot_count = branches->slot_count != 0 ? 2 * branches->slot_count : 2 * START_ELEMENT_COUNT;
+        const TreeNode** nodes = (const TreeNode**)calloc(slot_count, sizeof(const TreeNode*));
+        if (nodes == NULL)
+            return STATUS_SYSTEM_OUT_OF_MEMORY;
+
+        for (size_t index = 0; index < branches->slot_count; index++) {
+            if (branches->nodes[index] == NULL)
+                continue;
+            size_t slot = hashNodePointer(branches->nodes[index]) & (slot_count - 1);
+            while (nodes[slot] != NULL)
+                slot = (slot + 1) & (slot_count - 1);
+            nodes[slot] = branches->nodes[index];
+        }
+
+        free(branches->nodes);
+        branches->nodes = nodes;
+        branches->slot_count = slot_count;
+    }
+
+    size_t slot = hashNodePointer(node) & (branches->slot_count - 1);
+    while (branches->nodes[slot] != NULL)
+        slot = (slot + 1) & (branches->slot_count - 1);
+    branches->nodes[slot] = node;
+    branches->count++;
+
+    return STATUS_OK;
+}
+
+
+static bool isLargeBranch(const ParallelDiff* context, const TreeNode* node)
+{
+    assert(context);
+
+    const LargeBranches* branches = &context->large_branches;
+    if (node == NULL || branches->slot_count == 0)
+        return false;
+
+    size_t slot = hashNodePointer(node) & (branches->slot_count - 1);
+    while (branches->nodes[slot] != NULL) {
+        if (branches->nodes[slot] == node)
+            return true;
+        slot = (slot + 1) & (branches->slot_count - 1);
+    }
+
+    return false;
+}
+
+
+static size_t hashNodePointer(const TreeNode* node)
+{
+// Младшие биты адреса совпадают из-за выравнивания, поэтому адрес перемешивается
+    size_t value = (uintptr_t)node;
+    value ^= value >> 33;
+    value *= 0xff51afd7ed558ccdu;
+    value ^= value >> 33;
+
+    return value;
+}
+
+
+static void diffRootTask(TaskWorker* worker, void* argument)
+{
+    assert(worker); assert(argument);
+
+    ParallelDiff* context = (ParallelDiff*)argument;
+    context->derivative = diffBranchParallel(worker, context, context->root, 0);
+}
+
+
+static void diffBranchTask(TaskWorker* worker, void* argument)
+{
+    assert(worker); assert(argument);
+
+    BranchJob* job = (BranchJob*)argument;
+    job->result = diffBranchParallel(worker, job->context, job->node, job->depth);
+}
+
+
+static void copyBranchTask(TaskWorker* worker, void* argument)
+{
+    assert(worker); assert(argument);
+
+    BranchJob* job = (BranchJob*)argument;
+    job->result = copyBranchParallel(worker, job->context, job->node, job->depth);
+}
+
+
+static TreeNode* diffBranchParallel(TaskWorker* worker, ParallelDiff* context, TreeNode* node, size_t depth)
+{
+    assert(worker); assert(context); assert(node);
+
+    Differentiator* diff = context->diff;
+    if (node->type != NODE_OP || depth >= MAX_SPAWN_DEPTH || !isLargeBranch(context, node))
+        return diffBranch(diff, node);
+
+    DerivativeCase derivative_case = getDerivativeCase(diff, node);
+    bool is_left_needed = L && (derivative_case & DERIVATIVE_LEFT);
+    bool is_right_needed = R && (derivative_case & DERIVATIVE_RIGHT);
+
+// Левое поддерево может забрать другой поток, правое считается на месте
+    BranchJob job = {{diffBranchTask, NULL, 0}, context, L, NULL, depth + 1};
+    job.task.argument = &job;
+    if (is_left_needed)
+        schedulerSpawn(worker, &job.task);
+
+    ChildDerivatives derivatives = {NULL, NULL, derivative_case, worker, context, depth + 1};
+    if (is_right_needed)
+        derivatives.right = diffBranchParallel(worker, context, R, depth + 1);
+    if (is_left_needed) {
+        schedulerJoin(worker, &job.task);
+        derivatives.left = job.result;
+    }
+
+    TreeNode* derivative = computeDerivativeTable[node->value.op](diff, node, &derivatives);
+
+    if (derivatives.left != NULL)
+        deleteBranch(derivatives.left);
+    if (derivatives.right != NULL)
+        deleteBranch(derivatives.right);
+
+    return derivative;
+}
+
+
+static TreeNode* copyBranchParallel(TaskWorker* worker, ParallelDiff* context, TreeNode* node, size_t depth)
+{
+    assert(worker); assert(context); assert(node);
+
+    if (depth >= MAX_SPAWN_DEPTH || !isLargeBranch(context, node))
+        return copyNode(node);
+
+    TreeNode* copy = nodeDup(node);
+    if (copy == NULL)
+        return NULL;
+
+    BranchJob job = {{copyBranchTask, NULL, 0}, context, L, NULL, depth + 1};
+    job.task.argument = &job;
+    if (L)
+        schedulerSpawn(worker, &job.task);
+    TreeNode* right = R ? copyBranchParallel(worker, context, R, depth + 1) : NULL;
+    if (L)
+        schedulerJoin(worker, &job.task);
+    TreeNode* left = job.result;
+
+    copy->left = left;
+    copy->right = right;
+    if (left != NULL)
+        left->parent = copy;
+    if (right != NULL)
+        right->parent = copy;
+    if ((L && left == NULL) || (R && right == NULL)) {
+        deleteBranch(copy);
+        return NULL;
+    }
+
+    return copy;
+}
+
+
+static TreeNode* copyBranch(const ChildDerivatives* derivatives, TreeNode* node)
+{
+    assert(derivatives);
+
+    if (derivatives->worker != NULL && isLargeBranch(derivatives->context, node))
+        return copyBranchParallel(derivatives->worker, derivatives->context, node, derivatives->depth);
+
+    return copyNode(node);
+}
+
+
+bool containsVariable(TreeNode* node, size_t var_idx)
+{
+    if (node == NULL)
+        return false;
+
+    WorkStack stack = {};
+    workStackInit(&stack, sizeof(TreeNode*));
+
+    bool contains = false;
+    OperationStatus status = workStackPush(&stack, &node);
+    TreeNode* current = NULL;
+    while (!contains && status == STATUS_OK && workStackPop(&stack, &current)) {
+        switch (current->type) {
+            case NODE_OP:
+                if (current->right)
+                    status = workStackPush(&stack, &current->right);
+                if (current->left && status == STATUS_OK)
+                    status = workStackPush(&stack, &current->left);
+                break;
+            case NODE_VAR: contains = current->value.var_idx == var_idx; break;
+            case NODE_NUM: break;
+            default:       break;
+        }
+    }
+
+    workStackDestroy(&stack);
+// При нехватке памяти считаем, что переменная есть: так производная останется верной
+    return contains || status != STATUS_OK;
+}
+
+
+static TreeNode* diffLeaf(Differentiator* diff, const TreeNode* node)
+{
+    assert(diff); assert(node);
 
     switch (node->type) {
         case NODE_NUM: return CNUM(0);
@@ -109,32 +595,112 @@ TreeNode* diffNode(Differentiator* diff, TreeNode* node)
             } else {
                 return CNUM(0);
             }
-        case NODE_OP:  return diffOp(diff, node);
+        case NODE_OP:
         default:       return NULL;
-    }    
+    }
 }
 
 
-bool containsVariable(TreeNode* node, size_t var_idx)
+static DerivativeCase getDerivativeCase(Differentiator* diff, TreeNode* node)
 {
-    if (node == NULL)
-        return false;
+    assert(diff); assert(node); assert(node->type == NODE_OP);
 
-    switch (node->type) {
-        case NODE_OP:  return containsVariable(L, var_idx) || containsVariable(R, var_idx);
-        case NODE_VAR: return node->value.var_idx == var_idx;
-        case NODE_NUM: return false;
-        default:       return false; 
+    if (node->value.op != OP_POW && node->value.op != OP_LOG)
+        return DERIVATIVE_BOTH;
+
+    size_t var_idx = diff->args.derivative_info.diff_var_idx;
+    unsigned derivative_case = DERIVATIVE_CONST;
+    if (containsVariable(L, var_idx))
+        derivative_case |= DERIVATIVE_LEFT;
+    if (containsVariable(R, var_idx))
+        derivative_case |= DERIVATIVE_RIGHT;
+
+    return (DerivativeCase)derivative_case;
+}
+
+
+static OperationStatus expandDiffFrame(Differentiator* diff, WorkStack* frames, DiffFrame* frame)
+{
+    assert(diff); assert(frames); assert(frame); assert(frame->node->type == NODE_OP);
+    assert(frame->node->value.op < OP_MAX_COUNT);
+
+    TreeNode* node = frame->node;
+    frame->derivative_case = getDerivativeCase(diff, node);
+    frame->is_expanded = true;
+
+    OperationStatus status = workStackPush(frames, frame);
+    RETURN_IF_STATUS_NOT_OK(status);
+
+    if (R && (frame->derivative_case & DERIVATIVE_RIGHT)) {
+        DiffFrame right_frame = {R, DERIVATIVE_BOTH, false};
+        status = workStackPush(frames, &right_frame);
+        RETURN_IF_STATUS_NOT_OK(status);
     }
+    if (L && (frame->derivative_case & DERIVATIVE_LEFT)) {
+        DiffFrame left_frame = {L, DERIVATIVE_BOTH, false};
+        status = workStackPush(frames, &left_frame);
+        RETURN_IF_STATUS_NOT_OK(status);
+    }
+
+    return STATUS_OK;
 }
 
 
-static TreeNode* diffOp(Differentiator* diff, TreeNode* node)
+static TreeNode* reduceDiffFrame(Differentiator* diff, WorkStack* results, const DiffFrame* frame)
+{
+    assert(diff); assert(results); assert(frame); assert(frame->is_expanded);
+
+    TreeNode* node = frame->node;
+    ChildDerivatives derivatives = {NULL, NULL, frame->derivative_case, NULL, NULL, 0};
+    if (R && (frame->derivative_case & DERIVATIVE_RIGHT))
+        workStackPop(results, &derivatives.right);
+    if (L && (frame->derivative_case & DERIVATIVE_LEFT))
+        workStackPop(results, &derivatives.left);
+
+    TreeNode* derivative = computeDerivativeTable[node->value.op](diff, node, &derivatives);
+
+    if (derivatives.left != NULL)
+        deleteBranch(derivatives.left);
+    if (derivatives.right != NULL)
+        deleteBranch(derivatives.right);
+
+    return derivative;
+}
+
+
+static void printDerivativeStep(Differentiator* diff, TreeNode* node, DerivativeCase derivative_case)
 {
     assert(diff); assert(node); assert(node->type == NODE_OP);
-    assert(node->value.op < OP_MAX_COUNT);
 
-    return computeDerivativeTable[node->value.op](diff, node);
+    const char* format = DERIVATIVE_STEPS[node->value.op];
+    if (node->value.op == OP_POW) {
+        format = POW_DERIVATIVE_STEPS[derivative_case];
+    } else if (node->value.op == OP_LOG) {
+        format = LOG_DERIVATIVE_STEPS[derivative_case];
+    }
+    assert(format);
+
+    printTex(diff, "\\begin{dmath*}\n\\left(%n\\right)' = ", node);
+    const char* current = format;
+    const char* next = strchr(current, '%');
+    while (next != NULL) {
+        printTex(diff, "%.*s", (int)(next - current), current);
+        printTex(diff, "%n", next[1] == 'l' ? L : R);
+        current = next + 2;
+        next = strchr(current, '%');
+    }
+    printTex(diff, "%s\n\\end{dmath*}\n", current);
+}
+
+
+static TreeNode* takeDerivative(TreeNode** derivative)
+{
+    assert(derivative);
+
+    TreeNode* result = *derivative;
+    *derivative = NULL;
+
+    return result;
 }
 
 
@@ -142,19 +708,45 @@ static TreeNode* copyNode(const TreeNode* node)
 {
     if (node == NULL)
         return NULL;
-    TreeNode* new_node = nodeDup(node);
-    if (new_node == NULL)
+    TreeNode* root = nodeDup(node);
+    if (root == NULL)
         return NULL;
-    new_node->left = copyNode(node->left);
-    if (node->left != NULL)
-        new_node->left->parent = new_node;
-
-    new_node->right = copyNode(node->right);
-    if (new_node->right != NULL)
-        new_node->right->parent = new_node;
-   
-    return new_node;
 
+    WorkStack stack = {};
+    workStackInit(&stack, sizeof(CopyFrame));
+
+    CopyFrame frame = {node, root};
+    OperationStatus status = workStackPush(&stack, &frame);
+    while (status == STATUS_OK && workStackPop(&stack, &frame)) {
+        const TreeNode* children[] = {frame.source->left, frame.source->right};
+        for (size_t index = 0; index < 2 && status == STATUS_OK; index++) {
+            if (children[index] == NULL)
+                continue;
+
+            TreeNode* child = nodeDup(children[index]);
+            if (child == NULL) {
+                status = STATUS_SYSTEM_OUT_OF_MEMORY;
+                break;
+            }
+            child->parent = frame.copy;
+            if (index == 0) {
+                frame.copy->left = child;
+            } else {
+                frame.copy->right = child;
+            }
+
+            CopyFrame child_frame = {children[index], child};
+            status = workStackPush(&stack, &child_frame);
+        }
+    }
+
+    workStackDestroy(&stack);
+    if (status != STATUS_OK) {
+        deleteBranch(root);
+        return NULL;
+    }
+
+    return root;
 }
 
 
@@ -178,273 +770,196 @@ static TreeNode* nodeDup(const TreeNode* node)
 // ------------------------------------------------------------------------------------------------
 // OP_ADD, OP_SUB, OP_MUL, OP_DIV, OP_POS, OP_LOG
 // ------------------------------------------------------------------------------------------------
-static TreeNode* computeAddDerivative(Differentiator* diff, TreeNode* node)
+static TreeNode* computeAddDerivative(Differentiator* diff, TreeNode* node,
+    ChildDerivatives* derivatives)
 {
-    assert(diff); assert(node); 
-    PRINT_EXPRESSION(
-        printTex(diff, "\\left(%n\\right)'+\\left(%n\\right)'", L, R)
-    );
+    assert(diff); assert(node); assert(derivatives);
 
     return ADD(dL, dR);
 }
-static TreeNode* computeSubDerivative(Differentiator* diff, TreeNode* node)
+static TreeNode* computeSubDerivative(Differentiator* diff, TreeNode* node,
+    ChildDerivatives* derivatives)
 {
-    assert(diff); assert(node); 
-    
-    PRINT_EXPRESSION(
-        printTex(diff, "\\left(%n\\right)'-\\left(%n\\right)'", L, R)
-    );
+    assert(diff); assert(node); assert(derivatives);
 
     return SUB(dL, dR);
 }
-static TreeNode* computeMulDerivative(Differentiator* diff, TreeNode* node)
+static TreeNode* computeMulDerivative(Differentiator* diff, TreeNode* node,
+    ChildDerivatives* derivatives)
 {
-    assert(diff); assert(node); 
-    
-    PRINT_EXPRESSION(
-        printTex(diff, "\\left(%n\\right)'\\cdot\\left(%n\\right)+"
-            "\\left(%n\\right)\\cdot\\left(%n\\right)'",
-            L, R, L, R)
-    );
+    assert(diff); assert(node); assert(derivatives);
 
     return ADD(MUL(dL, cR), MUL(cL, dR));
 }
-static TreeNode* computeDivDerivative(Differentiator* diff, TreeNode* node)
+static TreeNode* computeDivDerivative(Differentiator* diff, TreeNode* node,
+    ChildDerivatives* derivatives)
 {
-    assert(diff); assert(node); 
-
-    PRINT_EXPRESSION(
-        printTex(diff, "\\frac{\\left(%n\\right)'\\cdot\\left(%n\\right)-"
-            "\\left(%n\\right)\\cdot\\left(%n\\right)'}{%n}",
-            L, R, L, R, R)
-    );
+    assert(diff); assert(node); assert(derivatives);
 
     return DIV(SUB(MUL(dL, cR), MUL(cL, dR)), POW(cR, CNUM(2)));
 }
-static TreeNode* computePowDerivative(Differentiator* diff, TreeNode* node)
+static TreeNode* computePowDerivative(Differentiator* diff, TreeNode* node,
+    ChildDerivatives* derivatives)
 {
-    assert(diff); assert(node); 
-
-    size_t var_idx = diff->args.derivative_info.diff_var_idx;
-    bool left_contains = containsVariable(L, var_idx);
-    bool right_contains = containsVariable(R, var_idx);
-    if (!left_contains && !right_contains) {
-        PRINT_EXPRESSION(
-            printTex(diff, "0")
-        );
-        return CNUM(0);
-    } else if (left_contains && !right_contains) {
-        PRINT_EXPRESSION(
-            printTex(diff, "\\left(%n\\right)\\cdot\\left(%n\\right)^{%n-1}\\cdot\\left(%n\\right)",
-                R, L, R, L)
-        );
-        return MUL(MUL(cR, POW(cL, SUB(cR, CNUM(1)))), dL);
-    } else if (!left_contains && right_contains) {
-        PRINT_EXPRESSION(
-            printTex(diff, "\\left(%n\\right)\\cdot\\left(%n\\right)^{%n|\\cdot\\ln\\left(%n\\right)}",
-                R, L, R, L)
-        );
-        return MUL(MUL(POW(cL, cR), LOG(CNUM(M_E), cL)), dR);
-    } else {
-        PRINT_EXPRESSION(
-            printTex(diff, "\\left(\\left(%n\\right)'\\cdot\\ln\\left(%n\\right)+"
-                "\\frac{\\left(%n\\right)\\cdot\\left(%n\\right)'}{%n}"
-                "\\right)\\cdot\\left(%n\\right)^{%n}", R, L, R, L, L, L, R)
-        );
-        return MUL(ADD(MUL(dR, LOG(CNUM(M_E), cL)), MUL(DIV(cR, cL), dL)), POW(cL, cR));
+    assert(diff); assert(node); assert(derivatives);
+
+    switch (derivatives->derivative_case) {
+        case DERIVATIVE_CONST:
+            return CNUM(0);
+        case DERIVATIVE_LEFT:
+            return MUL(MUL(cR, POW(cL, SUB(cR, CNUM(1)))), dL);
+        case DERIVATIVE_RIGHT:
+            return MUL(MUL(POW(cL, cR), LOG(CNUM(M_E), cL)), dR);
+        case DERIVATIVE_BOTH:
+        default:
+            return MUL(ADD(MUL(dR, LOG(CNUM(M_E), cL)), MUL(DIV(cR, cL), dL)), POW(cL, cR));
     }
 }
-static TreeNode* computeLogDerivative(Differentiator* diff, TreeNode* node)
+static TreeNode* computeLogDerivative(Differentiator* diff, TreeNode* node,
+    ChildDerivatives* derivatives)
 {
-    assert(diff); assert(node); 
-
-    size_t var_idx = diff->args.derivative_info.diff_var_idx;
-    bool left_contains = containsVariable(L, var_idx);
-    bool right_contains = containsVariable(R, var_idx);
-    if (!left_contains && !right_contains) {
-        PRINT_EXPRESSION(
-            printTex(diff, "0")
-        );
-        return CNUM(0);
-    } else if (left_contains && !right_contains) {
-        PRINT_EXPRESSION(
-            printTex(diff, "-\\frac{\\ln\\left(%n\\right)\\cdot\\left(%n\\right)}{\\left(\\ln"
-                "\\left(%n\right)\\right)^2\\cdot\\left(%n\\right)}", R, L, R, L)
-        );
-        return DIV(MUL(MUL(CNUM(-1), LOG(CNUM(M_E), cR)), dL), MUL(POW(LOG(CNUM(M_E), cL), CNUM(2)), cL));
-    } else if (!left_contains && right_contains) {
-        PRINT_EXPRESSION(
-            printTex(diff, "\\frac{\\left(%n\\right)'}{%n\\cdot\\ln\\left(%n\\right)}", R, R, L)
-        );
-        return DIV(dR, MUL(cR, LOG(CNUM(M_E), cL)));
-    } else {
-        PRINT_EXPRESSION(
-            printTex(diff, "\\frac{\\frac{\\left(%n\\right)'\\cdot\\ln\\left(%n\\right)}{%n}-"
-                "\\frac{\\left(%n\\right)'\\cdot\\ln\\left(%n\\right)}{\\left(%n\\right)}"
-                "{\\left(%n\\right)^2}", R, L, R, L, R, L, L)
-        );
-        return DIV(SUB(DIV(MUL(dR, LOG(CNUM(M_E), cL)), cR), DIV(MUL(dL, LOG(CNUM(M_E), cR)),
-            cL)), POW(LOG(CNUM(M_E), cL), CNUM(2)));
-    };
+    assert(diff); assert(node); assert(derivatives);
+
+    switch (derivatives->derivative_case) {
+        case DERIVATIVE_CONST:
+            return CNUM(0);
+        case DERIVATIVE_LEFT:
+            return DIV(MUL(MUL(CNUM(-1), LOG(CNUM(M_E), cR)), dL),
+                MUL(POW(LOG(CNUM(M_E), cL), CNUM(2)), cL));
+        case DERIVATIVE_RIGHT:
+            return DIV(dR, MUL(cR, LOG(CNUM(M_E), cL)));
+        case DERIVATIVE_BOTH:
+        default:
+            return DIV(SUB(DIV(MUL(dR, LOG(CNUM(M_E), cL)), cR), DIV(MUL(dL, LOG(CNUM(M_E), cR)),
+                cL)), POW(LOG(CNUM(M_E), cL), CNUM(2)));
+    }
 }
 
 // ------------------------------------------------------------------------------------------------
 // OP_SIN, OP_COS, OP_TAN, OP_COT
 // ------------------------------------------------------------------------------------------------
-static TreeNode* computeSinDerivative(Differentiator* diff, TreeNode* node)
+static TreeNode* computeSinDerivative(Differentiator* diff, TreeNode* node,
+    ChildDerivatives* derivatives)
 {
-    assert(diff); assert(node); 
+    assert(diff); assert(node); assert(derivatives);
 
-    PRINT_EXPRESSION(
-        printTex(diff, "\\cos\\left(%n\\right)\\cdot\\left(%n\\right)'", R, R)
-    );
     return MUL(COS(cR), dR);
 }
-static TreeNode* computeCosDerivative(Differentiator* diff, TreeNode* node)
+static TreeNode* computeCosDerivative(Differentiator* diff, TreeNode* node,
+    ChildDerivatives* derivatives)
 {
-    assert(diff); assert(node); 
+    assert(diff); assert(node); assert(derivatives);
 
-    PRINT_EXPRESSION(
-        printTex(diff, "-\\sin\\left(%n\\right)\\cdot\\left(%n\\right)'", R, R)
-    );
     return MUL(MUL(CNUM(-1), SIN(cR)), dR);
 }
-static TreeNode* computeTanDerivative(Differentiator* diff, TreeNode* node)
+static TreeNode* computeTanDerivative(Differentiator* diff, TreeNode* node,
+    ChildDerivatives* derivatives)
 {
-    assert(diff); assert(node); 
+    assert(diff); assert(node); assert(derivatives);
 
-    PRINT_EXPRESSION(
-        printTex(diff, "\\frac{1}{\\cos^2\\left(%n\\right)}\\cdot\\left(%n\\right)'", R, R)
-    );
     return MUL(DIV(CNUM(1), POW(COS(cR), CNUM(2))), dR);
 }
-static TreeNode* computeCotDerivative(Differentiator* diff, TreeNode* node)
+static TreeNode* computeCotDerivative(Differentiator* diff, TreeNode* node,
+    ChildDerivatives* derivatives)
 {
-    assert(diff); assert(node); 
+    assert(diff); assert(node); assert(derivatives);
 
-    PRINT_EXPRESSION(
-        printTex(diff, "-\\frac{1}{\\sin^2\\left(%n\\right)}\\cdot\\left(%n\\right)'", R, R)
-    );
     return MUL(DIV(CNUM(-1), POW(SIN(cR), CNUM(2))), dR);
 }
 
 // ------------------------------------------------------------------------------------------------
 // OP_ASIN, OP_ACOS, OP_ATAN, OP_ACOT
 // ------------------------------------------------------------------------------------------------
-static TreeNode* computeAsinDerivative(Differentiator* diff, TreeNode* node)
+static TreeNode* computeAsinDerivative(Differentiator* diff, TreeNode* node,
+    ChildDerivatives* derivatives)
 {
-    assert(diff); assert(node); 
+    assert(diff); assert(node); assert(derivatives);
 
-    PRINT_EXPRESSION(
-        printTex(diff, "\\frac{1}{\\left(1-\\left(%n\\right)^2\\right)^{0.5}}\\cdot\\left(%n\\right)'", R, R)
-    ); 
     return MUL(POW(SUB(CNUM(1), POW(cR, CNUM(2))), CNUM(-0.5)), dR);
 }
-static TreeNode* computeAcosDerivative(Differentiator* diff, TreeNode* node)
+static TreeNode* computeAcosDerivative(Differentiator* diff, TreeNode* node,
+    ChildDerivatives* derivatives)
 {
-    assert(diff); assert(node); 
+    assert(diff); assert(node); assert(derivatives);
 
-    PRINT_EXPRESSION(
-        printTex(diff, "-\\frac{1}{\\left(1-\\left(%n\\right)^2\\right)^{0.5}}\\cdot\\left(%n\\right)'", R, R)
-    );
     return MUL(MUL(CNUM(-1), POW(SUB(CNUM(1), POW(cR, CNUM(2))), CNUM(-0.5))), dR);
 }
-static TreeNode* computeAtanDerivative(Differentiator* diff, TreeNode* node)
+static TreeNode* computeAtanDerivative(Differentiator* diff, TreeNode* node,
+    ChildDerivatives* derivatives)
 {
-    assert(diff); assert(node); 
+    assert(diff); assert(node); assert(derivatives);
 
-    PRINT_EXPRESSION(
-        printTex(diff, "\\frac{1}{1+\\left(%n\\right)^2}\\cdot\\left(%n\\right)'", R, R)
-    );
     return MUL(DIV(CNUM(1), ADD(CNUM(1), POW(cR, CNUM(2)))), dR);
 }
-static TreeNode* computeAcotDerivative(Differentiator* diff, TreeNode* node)
+static TreeNode* computeAcotDerivative(Differentiator* diff, TreeNode* node,
+    ChildDerivatives* derivatives)
 {
-    assert(diff); assert(node); 
+    assert(diff); assert(node); assert(derivatives);
 
-    PRINT_EXPRESSION(
-        printTex(diff, "-\\frac{1}{1+\\left(%n\\right)^2}\\cdot\\left(%n\\right)'", R, R)
-    );
     return MUL(MUL(DIV(CNUM(1), ADD(CNUM(1), POW(cR, CNUM(2)))), CNUM(-1)), dR);
 }
 
 // ------------------------------------------------------------------------------------------------
 // OP_SINH, OP_COSH, OP_TANH, OP_COTH
 // ------------------------------------------------------------------------------------------------
-static TreeNode* computeSinhDerivative(Differentiator* diff, TreeNode* node)
+static TreeNode* computeSinhDerivative(Differentiator* diff, TreeNode* node,
+    ChildDerivatives* derivatives)
 {
-    assert(diff); assert(node); 
+    assert(diff); assert(node); assert(derivatives);
 
-    PRINT_EXPRESSION(
-        printTex(diff, "\\cosh\\left(%n\\right)\\cdot\\left(%n\\right)'", R, R)
-    ); 
     return MUL(COSH(cR), dR);
 }
-static TreeNode* computeCoshDerivative(Differentiator* diff, TreeNode* node)
+static TreeNode* computeCoshDerivative(Differentiator* diff, TreeNode* node,
+    ChildDerivatives* derivatives)
 {
-    assert(diff); assert(node); 
+    assert(diff); assert(node); assert(derivatives);
 
-    PRINT_EXPRESSION(
-        printTex(diff, "\\sinh\\left(%n\\right)\\cdot\\left(%n\\right)'", R, R)
-    );
     return MUL(SINH(cR), dR);
 }
-static TreeNode* computeTanhDerivative(Differentiator* diff, TreeNode* node)
+static TreeNode* computeTanhDerivative(Differentiator* diff, TreeNode* node,
+    ChildDerivatives* derivatives)
 {
-    assert(diff); assert(node); 
+    assert(diff); assert(node); assert(derivatives);
 
-    PRINT_EXPRESSION(
-        printTex(diff, "\\frac{1}{\\cosh^2\\left(%n\\right)}\\cdot\\left(%n\\right)'", R, R)
-    );
     return MUL(DIV(CNUM(1), POW(COSH(cR), CNUM(2))), dR);
 }
-static TreeNode* computeCothDerivative(Differentiator* diff, TreeNode* node)
+static TreeNode* computeCothDerivative(Differentiator* diff, TreeNode* node,
+    ChildDerivatives* derivatives)
 {
-    assert(diff); assert(node); 
+    assert(diff); assert(node); assert(derivatives);
 
-    PRINT_EXPRESSION(
-        printTex(diff, "-\\frac{1}{\\sinh^2\\left(%n\\right)}\\cdot\\left(%n\\right)'", R, R)
-    );
     return MUL(DIV(CNUM(-1), POW(SINH(cR), CNUM(2))), dR);
 }
 
 // ------------------------------------------------------------------------------------------------
 // OP_ASINH, OP_ACOSH, OP_ATANH, OP_ACOTH
 // ------------------------------------------------------------------------------------------------
-static TreeNode* computeAsinhDerivative(Differentiator* diff, TreeNode* node)
+static TreeNode* computeAsinhDerivative(Differentiator* diff, TreeNode* node,
+    ChildDerivatives* derivatives)
 {
-    assert(diff); assert(node); 
+    assert(diff); assert(node); assert(derivatives);
 
-    PRINT_EXPRESSION(
-        printTex(diff, "\\frac{1}{\\left(\\left(%n\\right)^2+1\\right)^{0.5}}\\cdot\\left(%n\\right)'", R, R)
-    ); 
     return MUL(DIV(CNUM(1), POW(ADD(POW(cR, CNUM(2)), CNUM(1)), CNUM(0.5))), dR);
 }
-static TreeNode* computeAcoshDerivative(Differentiator* diff, TreeNode* node)
+static TreeNode* computeAcoshDerivative(Differentiator* diff, TreeNode* node,
+    ChildDerivatives* derivatives)
 {
-    assert(diff); assert(node); 
+    assert(diff); assert(node); assert(derivatives);
 
-    PRINT_EXPRESSION(
-        printTex(diff, "\\frac{1}{\\left(\\left(%n\\right)^2-1\\right)^{0.5}}\\cdot\\left(%n\\right)'", R, R)
-    ); 
     return MUL(DIV(CNUM(1), POW(SUB(POW(cR, CNUM(2)), CNUM(1)), CNUM(0.5))), dR);
 }
-static TreeNode* computeAtanhDerivative(Differentiator* diff, TreeNode* node)
+static TreeNode* computeAtanhDerivative(Differentiator* diff, TreeNode* node,
+    ChildDerivatives* derivatives)
 {
-    assert(diff); assert(node); 
+    assert(diff); assert(node); assert(derivatives);
 
-    PRINT_EXPRESSION(
-        printTex(diff, "\\frac{1}{1-\\left(%n\\right)^2}\\cdot\\left(%n\\right)'", R, R)
-    );
     return MUL(DIV(CNUM(1), SUB(CNUM(1), POW(cR, CNUM(2)))), dR);
 }
-static TreeNode* computeAcothDerivative(Differentiator* diff, TreeNode* node)
+static TreeNode* computeAcothDerivative(Differentiator* diff, TreeNode* node,
+    ChildDerivatives* derivatives)
 {
-    assert(diff); assert(node); 
+    assert(diff); assert(node); assert(derivatives);
 
-    PRINT_EXPRESSION(
-        printTex(diff, "\\frac{1}{1-\\left(%n\\right)^2}\\cdot\\left(%n\\right)'", R, R)
-    );
     return MUL(DIV(CNUM(1), SUB(CNUM(1), POW(cR, CNUM(2)))), dR);
 }
 
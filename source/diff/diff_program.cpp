@@ -0,0 +1,195 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "diff/diff_program.h"
+#include "diff/diff_defs.h"
+#include "diff/diff_evaluate.h"
+
+#include "tree/tree_stack.h"
+
+#include "status.h"
+
+
+const size_t PROGRAM_BLOCK_SIZE = 256;
+const size_t PROGRAM_MAX_SCRATCH = 1 << 20;
+
+
+typedef struct {
+    const TreeNode* node;
+    bool is_expanded;
+} CompileFrame;
+
+
+static OperationStatus emitCommand(WorkStack* commands, const TreeNode* node);
+
+
+OperationStatus programCompile(EvalProgram* program, const TreeNode* root)
+{
+    assert(program); assert(root);
+
+    WorkStack commands = {};
+    WorkStack frames = {};
+    workStackInit(&commands, sizeof(ProgramCommand));
+    workStackInit(&frames, sizeof(CompileFrame));
+
+// Дерево переводится в постфиксную запись, глубина стека считается по ходу
+    size_t depth = 0;
+    size_t max_depth = 0;
+    CompileFrame frame = {root, false};
+    OperationStatus status = workStackPush(&frames, &frame);
+    while (status == STATUS_OK && workStackPop(&frames, &frame)) {
+        const TreeNode* node = frame.node;
+        if (node->type == NODE_OP && !frame.is_expanded) {
+            CompileFrame expanded = {node, true};
+            CompileFrame right = {node->right, false};
+            CompileFrame left = {node->left, false};
+            status = workStackPush(&frames, &expanded);
+            if (status == STATUS_OK && node->right != NULL)
+                status = workStackPush(&frames, &right);
+            if (status == STATUS_OK && node->left != NULL)
+                status = workStackPush(&frames, &left);
+            continue;
+        }
+
+        status = emitCommand(&commands, node);
+        if (node->type != NODE_OP) {
+            depth++;
+        } else if (node->left != NULL) {
+            depth--;
+        }
+        if (depth > max_depth)
+            max_depth = depth;
+    }
+    workStackDestroy(&frames);
+
+    if (status != STATUS_OK) {
+        workStackDestroy(&commands);
+        return status;
+    }
+
+    program->commands = (ProgramCommand*)commands.data;
+    program->count = commands.count;
+    program->stack_depth = max_depth;
+
+    return STATUS_OK;
+}
+
+
+static OperationStatus emitCommand(WorkStack* commands, const TreeNode* node)
+{
+    assert(commands); assert(node);
+
+    ProgramCommand command = {PROGRAM_NUMBER, OP_NONE, false, 0, 0};
+    switch (node->type) {
+        case NODE_NUM:
+            command.number = node->value.num_val;
+            break;
+        case NODE_VAR:
+            command.type = PROGRAM_VARIABLE;
+            command.var_idx = node->value.var_idx;
+            break;
+        case NODE_OP:
+            command.type = PROGRAM_OPERATION;
+            command.op = node->value.op;
+            command.is_unary = node->left == NULL;
+            break;
+        default:
+            return STATUS_TREE_INVALID_BRANCH_STRUCTURE;
+    }
+
+    return workStackPush(commands, &command);
+}
+
+
+void programDestroy(EvalProgram* program)
+{
+    assert(program);
+
+    free(program->commands);
+    program->commands = NULL;
+    program->count = 0;
+    program->stack_depth = 0;
+}
+
+
+OperationStatus programWorkspaceInit(ProgramWorkspace* workspace, size_t stack_depth)
+{
+    assert(workspace);
+
+    if (stack_depth == 0)
+        stack_depth = 1;
+
+// Для очень глубоких программ блок уменьшается, чтобы буфер оставался ограниченным
+    size_t block_size = PROGRAM_MAX_SCRATCH / stack_depth;
+    if (block_size > PROGRAM_BLOCK_SIZE) block_size = PROGRAM_BLOCK_SIZE;
+    if (block_size == 0) block_size = 1;
+
+    workspace->scratch = (double*)calloc(stack_depth * block_size, sizeof(double));
+    workspace->operands = (const double**)calloc(stack_depth, sizeof(const double*));
+    if (workspace->scratch == NULL || workspace->operands == NULL) {
+        programWorkspaceDestroy(workspace);
+        return STATUS_SYSTEM_OUT_OF_MEMORY;
+    }
+
+    workspace->block_size = block_size;
+    workspace->stack_depth = stack_depth;
+
+    return STATUS_OK;
+}
+
+
+void programWorkspaceDestroy(ProgramWorkspace* workspace)
+{
+    assert(workspace);
+
+    free(workspace->scratch);
+    free(workspace->operands);
+    workspace->scratch = NULL;
+    workspace->operands = NULL;
+    workspace->block_size = 0;
+    workspace->stack_depth = 0;
+}
+
+
+void programEvaluate(const EvalProgram* program, ProgramWorkspace* workspace,
+                     const double* const* columns, size_t count, double* output)
+{
+    assert(program); assert(program->commands); assert(workspace); assert(columns); assert(output);
+    assert(count <= workspace->block_size); assert(program->stack_depth <= workspace->stack_depth);
+
+// Операнды переменных ссылаются прямо на входные столбцы, результат последней команды пишется в выход
+    size_t top = 0;
+    for (size_t index = 0; index < program->count; index++) {
+        const ProgramCommand* command = &program->commands[index];
+        bool is_last = index + 1 == program->count;
+        switch (command->type) {
+            case PROGRAM_NUMBER: {
+                double* slot = is_last ? output : workspace->scratch + top * workspace->block_size;
+                for (size_t point = 0; point < count; point++)
+                    slot[point] = command->number;
+                workspace->operands[top++] = slot;
+                break;
+            }
+            case PROGRAM_VARIABLE: {
+                if (is_last) {
+                    memcpy(output, columns[command->var_idx], count * sizeof(double));
+                } else {
+                    workspace->operands[top++] = columns[command->var_idx];
+                }
+                break;
+            }
+            case PROGRAM_OPERATION: {
+                const double* right = workspace->operands[--top];
+                const double* left = command->is_unary ? NULL : workspace->operands[--top];
+                double* slot = is_last ? output : workspace->scratch + top * workspace->block_size;
+                evaluateOperationBlock(command->op, left, right, slot, count);
+                workspace->operands[top++] = slot;
+                break;
+            }
+            default:
+                break;
+        }
+    }
+}
@@ -0,0 +1,210 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include <assert.h>
+
+#include "diff/diff_request.h"
+#include "diff/diff_defs.h"
+#include "diff/diff.h"
+#include "diff/diff_optimize.h"
+#include "diff/diff_evaluate.h"
+#include "diff/diff_var_table.h"
+#include "diff/diff_cache.h"
+
+#include "tree/tree_io.h"
+#include "tree/tree_write.h"
+#include "tree/tree_lexer.h"
+
+#include "status.h"
+
+
+static OperationStatus differentiateRequest(Differentiator* diff, const DiffRequest* request, FILE* output);
+static OperationStatus evaluatePoints(Differentiator* diff, const char* points, size_t length, FILE* output);
+static OperationStatus parsePointValues(Differentiator* diff, const char* text, size_t length);
+static size_t skipSpaces(const char* text, size_t length, size_t position);
+static void printDerivative(Differentiator* diff, size_t tree_idx, FILE* output);
+
+
+OperationStatus diffProcessRequest(const CmdArgs* args, const DiffRequest* request, FILE* output)
+{
+    assert(args); assert(request); assert(request->expression); assert(output);
+
+    Differentiator diff = {};
+    diff.args = *args;
+    diff.args.derivative_info.order = request->order;
+    diff.args.derivative_info.diff_var_s = request->diff_var;
+// Запросы уже обрабатываются параллельно, поэтому каждый дифференцируется в одном потоке
+    diff.args.thread_count = 1;
+
+    OperationStatus status = diffContextConstructor(&diff);
+    if (status == STATUS_OK) {
+        diff.tex_dump.print_steps = false;
+        status = differentiateRequest(&diff, request, output);
+    }
+    diffContextDestructor(&diff);
+
+    if (status != STATUS_OK) {
+        fprintf(output, "error: [%s] %s\n", ErrorTable[status].status_string,
+            ErrorTable[status].error_message);
+    }
+
+    return status;
+}
+
+
+static OperationStatus differentiateRequest(Differentiator* diff, const DiffRequest* request, FILE* output)
+{
+    assert(diff); assert(request); assert(output);
+
+    OperationStatus status = diffParseExpression(diff, request->expression, request->expression_length);
+    RETURN_IF_STATUS_NOT_OK(status);
+    if (diff->var_table.count == 0)
+        return STATUS_DIFF_CONST_EXPRESSION;
+
+    if (diff->args.derivative_info.diff_var_s != NULL) {
+        status = defineDiffVariable(diff);
+        RETURN_IF_STATUS_NOT_OK(status);
+    }
+
+    size_t cached_count = 0;
+    if (diff->args.cache_info.directory != NULL) {
+        status = diffCacheLookup(diff, diff->args.derivative_info.order, &cached_count);
+        RETURN_IF_STATUS_NOT_OK(status);
+    }
+
+    for (size_t index = 1; index <= diff->args.derivative_info.order; index++) {
+        if (index >= diff->forest.count) {
+            status = diffCalculateDerivative(diff, index - 1);
+            RETURN_IF_STATUS_NOT_OK(status);
+
+            optimizeTree(diff, index);
+        }
+        printDerivative(diff, index, output);
+    }
+
+// Ошибка записи в кэш не портит уже посчитанный ответ
+    if (diff->args.cache_info.directory != NULL)
+        diffCacheStore(diff, cached_count);
+
+    if (request->points == NULL)
+        return STATUS_OK;
+
+    return evaluatePoints(diff, request->points, request->points_length, output);
+}
+
+
+static OperationStatus evaluatePoints(Differentiator* diff, const char* points, size_t length, FILE* output)
+{
+    assert(diff); assert(points); assert(output);
+
+// Точки разделяются ';' или переводом строки, непереданные переменные равны нулю
+    const char* end = points + length;
+    const char* point = points;
+    size_t point_count = 0;
+    bool is_last = false;
+    while (!is_last) {
+        const char* separator = point;
+        while (separator < end && *separator != ';' && *separator != '\n')
+            separator++;
+        size_t point_length = (size_t)(separator - point);
+        is_last = separator == end;
+        size_t trimmed_begin = skipSpaces(point, point_length, 0);
+
+// Пустые точки пропускаются, но пустой список означает одну точку с нулями
+        bool is_only_point = point == points && is_last;
+        if (trimmed_begin == point_length && !is_only_point) {
+            point = is_last ? end : separator + 1;
+            continue;
+        }
+
+        for (size_t index = 0; index < diff->var_table.count; index++)
+            setVariableValue(diff, index, 0);
+
+        OperationStatus status = parsePointValues(diff, point, point_length);
+        RETURN_IF_STATUS_NOT_OK(status);
+
+        point_count++;
+        fprintf(output, "point %zu: %.*s\n", point_count,
+            (int)(point_length - trimmed_begin), point + trimmed_begin);
+        for (size_t index = 0; index < diff->forest.count; index++) {
+            double value = evaluateNode(diff, diff->forest.trees[index].root);
+            if (!isnan(value)) {
+                fprintf(output, "value %zu: %g\n", index, value);
+            } else {
+                fprintf(output, "value %zu: not defined\n", index);
+            }
+        }
+
+        point = is_last ? end : separator + 1;
+    }
+
+    return STATUS_OK;
+}
+
+
+static OperationStatus parsePointValues(Differentiator* diff, const char* text, size_t length)
+{
+    assert(diff); assert(text);
+
+    size_t position = skipSpaces(text, length, 0);
+    while (position < length) {
+        size_t name_begin = position;
+        while (position < length && (isalnum((unsigned char)text[position]) || text[position] == '_'))
+            position++;
+        size_t name_length = position - name_begin;
+
+        position = skipSpaces(text, length, position);
+        if (name_length == 0 || position == length || text[position] != '=')
+            return STATUS_IO_INVALID_USER_INPUT;
+        position = skipSpaces(text, length, position + 1);
+
+        double value = 0;
+        size_t consumed = lexerParseNumber(text + position, length - position, &value);
+        if (consumed == 0)
+            return STATUS_IO_INVALID_USER_INPUT;
+        position = skipSpaces(text, length, position + consumed);
+
+        size_t var_idx = 0;
+        OperationStatus status = addVariable(diff, &var_idx, text + name_begin, name_length);
+        RETURN_IF_STATUS_NOT_OK(status);
+        setVariableValue(diff, var_idx, value);
+
+        if (position < length) {
+            if (text[position] != ',')
+                return STATUS_IO_INVALID_USER_INPUT;
+            position = skipSpaces(text, length, position + 1);
+        }
+    }
+
+    return STATUS_OK;
+}
+
+
+static size_t skipSpaces(const char* text, size_t length, size_t position)
+{
+    assert(text);
+
+    while (position < length && isspace((unsigned char)text[position]))
+        position++;
+
+    return position;
+}
+
+
+static void printDerivative(Differentiator* diff, size_t tree_idx, FILE* output)
+{
+    assert(diff); assert(diff->forest.trees); assert(tree_idx < diff->forest.count); assert(output);
+
+    fprintf(output, "derivative %zu: ", tree_idx);
+
+// Производная пишется в той же записи, что и вход, поэтому ответ можно снова подать в пакетный режим
+    const TreeNode* root = diff->forest.trees[tree_idx].root;
+    if (diff->args.infix_input) {
+        treeWriteInfix(diff, root, output);
+    } else {
+        treeWritePrefix(diff, root, output);
+    }
+    fputc('\n', output);
+}
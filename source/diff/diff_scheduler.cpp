@@ -0,0 +1,259 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <assert.h>
+
+#include "diff/diff_scheduler.h"
+
+#include "status.h"
+
+
+const size_t IDLE_SPIN_COUNT = 64;
+const long IDLE_SLEEP_NS = 50000;
+const size_t START_TASK_COUNT = 64;
+
+
+static OperationStatus dequeInit(TaskDeque* deque);
+static void dequeDestroy(TaskDeque* deque);
+static bool dequePush(TaskDeque* deque, Task* task);
+static Task* dequePop(TaskDeque* deque);
+static Task* dequeSteal(TaskDeque* deque);
+
+static void* workerLoop(void* argument);
+static Task* findTask(TaskWorker* worker);
+static void runTask(TaskWorker* worker, Task* task);
+static void waitIdle(size_t* idle_count);
+
+
+OperationStatus schedulerRun(size_t thread_count, TaskFunc function, void* argument)
+{
+    assert(function);
+
+    if (thread_count == 0)
+        thread_count = 1;
+
+    TaskScheduler scheduler = {};
+    scheduler.workers = (TaskWorker*)calloc(thread_count, sizeof(TaskWorker));
+    pthread_t* threads = (pthread_t*)calloc(thread_count, sizeof(pthread_t));
+    if (scheduler.workers == NULL || threads == NULL) {
+        free(scheduler.workers);
+        free(threads);
+        return STATUS_SYSTEM_OUT_OF_MEMORY;
+    }
+
+    OperationStatus status = STATUS_OK;
+    for (size_t index = 0; index < thread_count && status == STATUS_OK; index++) {
+        scheduler.workers[index] = (TaskWorker){&scheduler, {}, index, index};
+        status = dequeInit(&scheduler.workers[index].deque);
+        if (status == STATUS_OK)
+            scheduler.worker_count++;
+    }
+
+// Корневая задача выполняется в вызывающем потоке, остальные потоки только крадут работу
+    size_t started_count = 0;
+    while (status == STATUS_OK && started_count + 1 < scheduler.worker_count &&
+           pthread_create(&threads[started_count], NULL, workerLoop,
+                          &scheduler.workers[started_count + 1]) == 0) {
+        started_count++;
+    }
+
+    if (status == STATUS_OK) {
+        Task root = {function, argument, 0};
+        runTask(&scheduler.workers[0], &root);
+    }
+
+    __atomic_store_n(&scheduler.is_stopping, 1, __ATOMIC_RELEASE);
+    for (size_t index = 0; index < started_count; index++)
+        pthread_join(threads[index], NULL);
+
+    for (size_t index = 0; index < scheduler.worker_count; index++)
+        dequeDestroy(&scheduler.workers[index].deque);
+    free(scheduler.workers);
+    free(threads);
+
+    return status;
+}
+
+
+void schedulerSpawn(TaskWorker* worker, Task* task)
+{
+    assert(worker); assert(task); assert(task->function);
+
+    __atomic_store_n(&task->is_done, 0, __ATOMIC_RELAXED);
+    if (!dequePush(&worker->deque, task))
+        runTask(worker, task);
+}
+
+
+void schedulerJoin(TaskWorker* worker, Task* task)
+{
+    assert(worker); assert(task);
+
+// Пока задачу выполняет другой поток, ожидающий сам выполняет доступную работу
+    size_t idle_count = 0;
+    while (!__atomic_load_n(&task->is_done, __ATOMIC_ACQUIRE)) {
+        Task* next = findTask(worker);
+        if (next != NULL) {
+            runTask(worker, next);
+            idle_count = 0;
+        } else {
+            waitIdle(&idle_count);
+        }
+    }
+}
+
+
+static OperationStatus dequeInit(TaskDeque* deque)
+{
+    assert(deque);
+
+    deque->tasks = (Task**)calloc(START_TASK_COUNT, sizeof(Task*));
+    if (deque->tasks == NULL)
+        return STATUS_SYSTEM_OUT_OF_MEMORY;
+
+    deque->head = 0;
+    deque->tail = 0;
+    deque->capacity = START_TASK_COUNT;
+    pthread_mutex_init(&deque->mutex, NULL);
+
+    return STATUS_OK;
+}
+
+
+static void dequeDestroy(TaskDeque* deque)
+{
+    assert(deque);
+
+    pthread_mutex_destroy(&deque->mutex);
+    free(deque->tasks);
+    deque->tasks = NULL;
+}
+
+
+static bool dequePush(TaskDeque* deque, Task* task)
+{
+    assert(deque); assert(task);
+
+    pthread_mutex_lock(&deque->mutex);
+    if (deque->tail == deque->capacity) {
+// Украденные задачи освобождают начало массива, его можно переиспользовать
+        size_t count = deque->tail - deque->head;
+        if (2 * count > deque->capacity) {
+            void* temp_ptr = realloc(deque->tasks, 2 * deque->capacity * sizeof(Task*));
+            if (temp_ptr == NULL) {
+                pthread_mutex_unlock(&deque->mutex);
+                return false;
+            }
+            deque->tasks = (Task**)temp_ptr;
+            deque->capacity *= 2;
+        }
+
+        for (size_t index = 0; index < count; index++)
+            deque->tasks[index] = deque->tasks[deque->head + index];
+        deque->head = 0;
+        deque->tail = count;
+    }
+
+    deque->tasks[deque->tail++] = task;
+    pthread_mutex_unlock(&deque->mutex);
+
+    return true;
+}
+
+
+static Task* dequePop(TaskDeque* deque)
+{
+    assert(deque);
+
+    Task* task = NULL;
+    pthread_mutex_lock(&deque->mutex);
+    if (deque->tail > deque->head)
+        task = deque->tasks[--deque->tail];
+    pthread_mutex_unlock(&deque->mutex);
+
+    return task;
+}
+
+
+static Task* dequeSteal(TaskDeque* deque)
+{
+    assert(deque);
+
+    Task* task = NULL;
+    pthread_mutex_lock(&deque->mutex);
+    if (deque->tail > deque->head)
+        task = deque->tasks[deque->head++];
+    pthread_mutex_unlock(&deque->mutex);
+
+    return task;
+}
+
+
+static void* workerLoop(void* argument)
+{
+    assert(argument);
+
+    TaskWorker* worker = (TaskWorker*)argument;
+    size_t idle_count = 0;
+    while (!__atomic_load_n(&worker->scheduler->is_stopping, __ATOMIC_ACQUIRE)) {
+        Task* task = findTask(worker);
+        if (task != NULL) {
+            runTask(worker, task);
+            idle_count = 0;
+        } else {
+            waitIdle(&idle_count);
+        }
+    }
+
+    return NULL;
+}
+
+
+static Task* findTask(TaskWorker* worker)
+{
+    assert(worker);
+
+    Task* task = dequePop(&worker->deque);
+    if (task != NULL)
+        return task;
+
+// Жертвы перебираются по кругу, начиная с той, у которой удалось украсть в прошлый раз
+    TaskScheduler* scheduler = worker->scheduler;
+    for (size_t attempt = 0; attempt < scheduler->worker_count; attempt++) {
+        size_t victim = (worker->victim + attempt) % scheduler->worker_count;
+        if (victim == worker->index)
+            continue;
+
+        task = dequeSteal(&scheduler->workers[victim].deque);
+        if (task != NULL) {
+            worker->victim = victim;
+            return task;
+        }
+    }
+
+    return NULL;
+}
+
+
+static void runTask(TaskWorker* worker, Task* task)
+{
+    assert(worker); assert(task);
+
+    task->function(worker, task->argument);
+    __atomic_store_n(&task->is_done, 1, __ATOMIC_RELEASE);
+}
+
+
+static void waitIdle(size_t* idle_count)
+{
+    assert(idle_count);
+
+    if (++(*idle_count) < IDLE_SPIN_COUNT) {
+        sched_yield();
+    } else {
+        struct timespec delay = {0, IDLE_SLEEP_NS};
+        nanosleep(&delay, NULL);
+    }
+}
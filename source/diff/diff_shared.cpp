@@ -0,0 +1,338 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <assert.h>
+
+#include "diff/diff_shared.h"
+#include "diff/diff_defs.h"
+#include "diff/diff.h"
+#include "diff/diff_optimize.h"
+#include "diff/diff_program.h"
+#include "diff/diff_var_table.h"
+
+#include "tree/tree_io.h"
+
+#include "status.h"
+
+
+typedef struct {
+    const EvalProgram* programs;
+    size_t program_count;
+    size_t stack_depth;
+    const double* const* columns;
+    size_t variable_count;
+    double* outputs;
+    size_t point_count;
+    size_t begin;
+    size_t end;
+    OperationStatus status;
+} SharedEvalTask;
+
+
+static OperationStatus validateSharedRegion(const SharedEvalHeader* header, size_t region_size);
+static bool fitsRegion(uint64_t offset, uint64_t column_count, uint64_t point_count, size_t region_size);
+static OperationStatus mapSharedColumns(Differentiator* diff, SharedEvalHeader* header, const double** columns);
+static OperationStatus prepareDerivatives(Differentiator* diff, size_t order);
+
+static OperationStatus evaluateSharedColumns(Differentiator* diff, SharedEvalHeader* header,
+    const double* const* columns);
+static OperationStatus runSharedTasks(SharedEvalTask* task_template, size_t thread_count);
+static void* evaluateSharedTask(void* argument);
+static void finishSharedEvaluation(void* region, size_t region_size, OperationStatus status);
+
+static OperationStatus openSharedRegion(const char* region_name, int* fd);
+
+
+OperationStatus diffEvaluateShared(Differentiator* diff, void* region, size_t region_size)
+{
+    assert(diff); assert(diff->forest.count != 0); assert(region);
+
+    SharedEvalHeader* header = (SharedEvalHeader*)region;
+    OperationStatus status = validateSharedRegion(header, region_size);
+
+    const double** columns = NULL;
+    if (status == STATUS_OK) {
+        columns = (const double**)calloc(diff->var_table.count + 1, sizeof(const double*));
+        status = columns != NULL ? mapSharedColumns(diff, header, columns) : STATUS_SYSTEM_OUT_OF_MEMORY;
+    }
+    if (status == STATUS_OK)
+        status = prepareDerivatives(diff, header->order);
+    if (status == STATUS_OK)
+        status = evaluateSharedColumns(diff, header, columns);
+
+    free(columns);
+    finishSharedEvaluation(region, region_size, status);
+
+    return status;
+}
+
+
+static OperationStatus validateSharedRegion(const SharedEvalHeader* header, size_t region_size)
+{
+    assert(header);
+
+    if (region_size < sizeof(SharedEvalHeader) || header->magic != SHARED_EVAL_MAGIC)
+        return STATUS_IO_INVALID_USER_INPUT;
+    if (header->column_count > SHARED_EVAL_MAX_COLUMNS || header->order > SHARED_EVAL_MAX_ORDER)
+        return STATUS_IO_INVALID_USER_INPUT;
+    if (header->input_offset % sizeof(double) != 0 || header->output_offset % sizeof(double) != 0)
+        return STATUS_IO_INVALID_USER_INPUT;
+
+    if (!fitsRegion(header->input_offset, header->column_count, header->point_count, region_size) ||
+        !fitsRegion(header->output_offset, header->order + 1, header->point_count, region_size))
+        return STATUS_IO_INVALID_USER_INPUT;
+
+    return STATUS_OK;
+}
+
+
+static bool fitsRegion(uint64_t offset, uint64_t column_count, uint64_t point_count, size_t region_size)
+{
+    if (offset < sizeof(SharedEvalHeader) || offset > region_size)
+        return false;
+    if (point_count == 0)
+        return true;
+    if (column_count > (region_size - offset) / sizeof(double) / point_count)
+        return false;
+
+    return true;
+}
+
+
+static OperationStatus mapSharedColumns(Differentiator* diff, SharedEvalHeader* header, const double** columns)
+{
+    assert(diff); assert(header); assert(columns);
+
+// Столбцы сопоставляются переменным по имени, лишние столбцы допускаются
+    const double* input = (const double*)((const char*)header + header->input_offset);
+    for (size_t var_idx = 0; var_idx < diff->var_table.count; var_idx++) {
+        const char* name = diff->var_table.variables[var_idx].name;
+        columns[var_idx] = NULL;
+        for (size_t column = 0; column < header->column_count; column++) {
+            const char* column_name = header->column_names[column];
+            if (strnlen(column_name, SHARED_EVAL_NAME_SIZE) < SHARED_EVAL_NAME_SIZE &&
+                strcmp(column_name, name) == 0) {
+                columns[var_idx] = input + column * header->point_count;
+                break;
+            }
+        }
+
+        if (columns[var_idx] == NULL)
+            return STATUS_DIFF_UNKNOWN_VARIABLE;
+    }
+
+    return STATUS_OK;
+}
+
+
+static OperationStatus prepareDerivatives(Differentiator* diff, size_t order)
+{
+    assert(diff);
+
+    diff->tex_dump.print_steps = false;
+    while (diff->forest.count <= order) {
+        size_t tree_idx = diff->forest.count;
+        OperationStatus status = diffCalculateDerivative(diff, tree_idx - 1);
+        RETURN_IF_STATUS_NOT_OK(status);
+
+        optimizeTree(diff, tree_idx);
+    }
+
+    return STATUS_OK;
+}
+
+
+static OperationStatus evaluateSharedColumns(Differentiator* diff, SharedEvalHeader* header,
+    const double* const* columns)
+{
+    assert(diff); assert(header); assert(columns);
+
+    size_t program_count = header->order + 1;
+    EvalProgram* programs = (EvalProgram*)calloc(program_count, sizeof(EvalProgram));
+    if (programs == NULL)
+        return STATUS_SYSTEM_OUT_OF_MEMORY;
+
+    OperationStatus status = STATUS_OK;
+    size_t stack_depth = 0;
+    for (size_t index = 0; index < program_count && status == STATUS_OK; index++) {
+        status = programCompile(&programs[index], diff->forest.trees[index].root);
+        if (status == STATUS_OK && programs[index].stack_depth > stack_depth)
+            stack_depth = programs[index].stack_depth;
+    }
+
+    if (status == STATUS_OK) {
+        SharedEvalTask task_template = {programs, program_count, stack_depth, columns,
+            diff->var_table.count, (double*)((char*)header + header->output_offset),
+            header->point_count, 0, header->point_count, STATUS_OK};
+        status = runSharedTasks(&task_template, diff->args.thread_count);
+    }
+
+    for (size_t index = 0; index < program_count; index++)
+        programDestroy(&programs[index]);
+    free(programs);
+
+    return status;
+}
+
+
+static OperationStatus runSharedTasks(SharedEvalTask* task_template, size_t thread_count)
+{
+    assert(task_template);
+
+    size_t point_count = task_template->point_count;
+    if (thread_count > point_count)
+        thread_count = point_count;
+    if (thread_count <= 1) {
+        evaluateSharedTask(task_template);
+        return task_template->status;
+    }
+
+    SharedEvalTask* tasks = (SharedEvalTask*)calloc(thread_count, sizeof(SharedEvalTask));
+    pthread_t* threads = (pthread_t*)calloc(thread_count, sizeof(pthread_t));
+    if (tasks == NULL || threads == NULL) {
+        free(tasks);
+        free(threads);
+        return STATUS_SYSTEM_OUT_OF_MEMORY;
+    }
+
+// Точки делятся на непрерывные диапазоны, каждый поток пишет только в свой диапазон выходов
+    for (size_t index = 0; index < thread_count; index++) {
+        tasks[index] = *task_template;
+        tasks[index].begin = point_count * index / thread_count;
+        tasks[index].end = point_count * (index + 1) / thread_count;
+    }
+
+    size_t started_count = 0;
+    for (size_t index = 0; index < thread_count; index++) {
+        if (pthread_create(&threads[index], NULL, evaluateSharedTask, &tasks[index]) != 0)
+            evaluateSharedTask(&tasks[index]);
+        else
+            threads[started_count++] = threads[index];
+    }
+
+    for (size_t index = 0; index < started_count; index++)
+        pthread_join(threads[index], NULL);
+
+    OperationStatus status = STATUS_OK;
+    for (size_t index = 0; index < thread_count; index++) {
+        if (tasks[index].status != STATUS_OK)
+            status = tasks[index].status;
+    }
+
+    free(tasks);
+    free(threads);
+    return status;
+}
+
+
+static void* evaluateSharedTask(void* argument)
+{
+    assert(argument);
+
+    SharedEvalTask* task = (SharedEvalTask*)argument;
+    ProgramWorkspace workspace = {};
+    const double** block_columns = (const double**)calloc(task->variable_count + 1, sizeof(const double*));
+    task->status = block_columns != NULL ? programWorkspaceInit(&workspace, task->stack_depth)
+                                         : STATUS_SYSTEM_OUT_OF_MEMORY;
+    if (task->status != STATUS_OK) {
+        free(block_columns);
+        return NULL;
+    }
+
+    for (size_t begin = task->begin; begin < task->end; begin += workspace.block_size) {
+        size_t count = task->end - begin < workspace.block_size ? task->end - begin : workspace.block_size;
+        for (size_t var_idx = 0; var_idx < task->variable_count; var_idx++)
+            block_columns[var_idx] = task->columns[var_idx] + begin;
+
+        for (size_t index = 0; index < task->program_count; index++) {
+            double* output = task->outputs + index * task->point_count + begin;
+            programEvaluate(&task->programs[index], &workspace, block_columns, count, output);
+        }
+    }
+
+    programWorkspaceDestroy(&workspace);
+    free(block_columns);
+    return NULL;
+}
+
+
+static void finishSharedEvaluation(void* region, size_t region_size, OperationStatus status)
+{
+    assert(region);
+
+    if (region_size < sizeof(SharedEvalHeader))
+        return;
+
+// Слово состояния служит футексом: ждущий процесс будится после записи всех выходов
+    SharedEvalHeader* header = (SharedEvalHeader*)region;
+    header->status = (uint32_t)status;
+    __atomic_store_n(&header->state, status == STATUS_OK ? SHARED_EVAL_DONE : SHARED_EVAL_FAILED,
+        __ATOMIC_RELEASE);
+    syscall(SYS_futex, &header->state, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+
+OperationStatus diffRunShared(Differentiator* diff)
+{
+    assert(diff); assert(diff->args.shared_info.region);
+
+    int fd = -1;
+    OperationStatus status = openSharedRegion(diff->args.shared_info.region, &fd);
+    RETURN_IF_STATUS_NOT_OK(status);
+
+    struct stat info = {};
+    void* region = MAP_FAILED;
+    if (fstat(fd, &info) == 0 && info.st_size > 0)
+        region = mmap(NULL, (size_t)info.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (region == MAP_FAILED)
+        return STATUS_SYSTEM_CALL_ERROR;
+    size_t region_size = (size_t)info.st_size;
+
+    status = diffLoadExpression(diff);
+    if (status == STATUS_OK && diff->var_table.count == 0)
+        status = STATUS_DIFF_CONST_EXPRESSION;
+    if (status == STATUS_OK && diff->args.derivative_info.diff_var_s != NULL)
+        status = defineDiffVariable(diff);
+
+    if (status == STATUS_OK) {
+        status = diffEvaluateShared(diff, region, region_size);
+    } else {
+        finishSharedEvaluation(region, region_size, status);
+    }
+    munmap(region, region_size);
+
+    if (diff->args.shared_info.event_fd >= 0) {
+        uint64_t event = 1;
+        if (write(diff->args.shared_info.event_fd, &event, sizeof(event)) != sizeof(event) &&
+            status == STATUS_OK)
+            status = STATUS_SYSTEM_CALL_ERROR;
+    }
+
+    return status;
+}
+
+
+static OperationStatus openSharedRegion(const char* region_name, int* fd)
+{
+    assert(region_name); assert(fd);
+
+// Имя с '/' открывается через shm_open, число считается унаследованным дескриптором memfd
+    if (region_name[0] == '/') {
+        *fd = shm_open(region_name, O_RDWR, 0);
+    } else {
+        char* end = NULL;
+        long descriptor = strtol(region_name, &end, 10);
+        *fd = *end == '\0' && descriptor >= 0 && descriptor <= INT_MAX ? (int)descriptor : -1;
+    }
+
+    return *fd != -1 ? STATUS_OK : STATUS_IO_FILE_OPEN_ERROR;
+}
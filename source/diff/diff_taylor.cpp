@@ -10,14 +10,12 @@
 #include "diff/diff_evaluate.h"
 #include "diff/diff_var_table.h"
 #include "diff/diff_optimize.h"
+#include "diff/diff_output.h"
 
 #include "status.h"
 
 #include "tree/tree.h"
 
-#include "tex_dump/tex_struct.h"
-#include "tex_dump/plot_generator.h"
-
 #include "tree/tree.h"
 
 
@@ -42,15 +40,7 @@ OperationStatus diffTaylorSeries(Differentiator* diff)
     diff->tex_dump.print_steps = true;
     TREE_DUMP(diff, tree_idx, STATUS_OK, "Optimizing Taylor Tree");
 
-    char output_filename[BUFFER_SIZE] = "";
-    snprintf(output_filename, BUFFER_SIZE, "%s/%s_%03zu", GNUPLOT_IMAGES_DIRECTORY,
-        GNUPLOT_OUTPUT_FILENAME, tree_idx);
-
-    OperationStatus status = generatePlot(diff, output_filename, 2, 0, tree_idx);
-
-    if (status == STATUS_OK) {
-        printTaylorSeries(diff, output_filename, tree_idx);
-    }
+    OperationStatus status = diff->output.backend->taylor(diff, tree_idx);
 
     treeDestructor(&diff->forest.trees[tree_idx]);
     return status;
@@ -9,8 +9,47 @@
 #include "status.h"
 
 
+const size_t NAME_BLOCK_SIZE = 4096;
+
+
 static OperationStatus findVariable(Differentiator* diff, size_t* var_idx, const char* variable, size_t var_len);
+static size_t* findSlot(const VarTable* table, const char* variable, size_t var_len);
+static size_t hashName(const char* variable, size_t var_len);
 static OperationStatus variableTableResize(Differentiator* diff);
+static OperationStatus slotsResize(VarTable* table);
+static OperationStatus storeName(NameArena* arena, const char* variable, size_t var_len, char** name);
+
+
+OperationStatus variableTableInit(VarTable* table)
+{
+    assert(table);
+
+    *table = (VarTable){};
+    table->variables = (Variable*)calloc(START_ELEMENT_COUNT, sizeof(Variable));
+    table->slots = (size_t*)calloc(2 * START_ELEMENT_COUNT, sizeof(size_t));
+    if (table->variables == NULL || table->slots == NULL) {
+        variableTableDestroy(table);
+        return STATUS_SYSTEM_OUT_OF_MEMORY;
+    }
+
+    table->capacity = START_ELEMENT_COUNT;
+    table->slot_count = 2 * START_ELEMENT_COUNT;
+    return STATUS_OK;
+}
+
+
+void variableTableDestroy(VarTable* table)
+{
+    assert(table);
+
+    for (size_t index = 0; index < table->names.block_count; index++)
+        free(table->names.blocks[index]);
+    free(table->names.blocks);
+    free(table->variables);
+    free(table->slots);
+
+    *table = (VarTable){};
+}
 
 
 void setVariableValue(Differentiator* diff, size_t var_idx, double value)
@@ -25,14 +64,8 @@ OperationStatus defineDiffVariable(Differentiator* diff)
 {
     assert(diff); assert(diff->var_table.variables);
 
-    for (size_t index = 0; index < diff->var_table.count; index++) {
-        if (strcmp(diff->var_table.variables[index].name, diff->args.derivative_info.diff_var_s) == 0) {
-            diff->args.derivative_info.diff_var_idx = index;
-            return STATUS_OK;
-        }
-    }
-
-    return STATUS_DIFF_UNKNOWN_VARIABLE;
+    const char* diff_var = diff->args.derivative_info.diff_var_s;
+    return findVariable(diff, &diff->args.derivative_info.diff_var_idx, diff_var, strlen(diff_var));
 }
 
 
@@ -40,8 +73,10 @@ OperationStatus defineVariables(Differentiator* diff)
 {
     assert(diff); assert(diff->var_table.variables);
 
+// В машинных форматах стандартный вывод занят результатом, поэтому приглашение уходит в stderr
+    FILE* prompt = diff->args.output_format == OUTPUT_TEX ? stdout : stderr;
     for (size_t index = 0; index < diff->var_table.count; index++) {
-        printf("Value of variable '%s': ", diff->var_table.variables[index].name);
+        fprintf(prompt, "Value of variable '%s': ", diff->var_table.variables[index].name);
         if (scanf("%lf", &diff->var_table.variables[index].value) != 1) {
             return STATUS_IO_INVALID_USER_INPUT;
         }
@@ -64,16 +99,21 @@ OperationStatus addVariable(Differentiator* diff, size_t* var_idx, const char* v
     }
     assert(diff->var_table.count < diff->var_table.capacity);
 
-    char* temp_ptr = (char*)calloc(var_len + 1, 1);
-    if (temp_ptr == NULL)
-        return STATUS_SYSTEM_OUT_OF_MEMORY;
-    strncpy(temp_ptr, variable, var_len);
-    temp_ptr[var_len] = '\0';
+// Заполненность индекса держится не выше половины, чтобы цепочки проб оставались короткими
+    if (2 * (diff->var_table.count + 1) > diff->var_table.slot_count) {
+        status = slotsResize(&diff->var_table);
+        RETURN_IF_STATUS_NOT_OK(status);
+    }
+
+    char* name = NULL;
+    status = storeName(&diff->var_table.names, variable, var_len, &name);
+    RETURN_IF_STATUS_NOT_OK(status);
 
-    diff->var_table.variables[diff->var_table.count].name = temp_ptr;
+    diff->var_table.variables[diff->var_table.count].name = name;
     diff->var_table.variables[diff->var_table.count].value = 0;
     *var_idx = diff->var_table.count;
     diff->var_table.count++;
+    *findSlot(&diff->var_table, variable, var_len) = diff->var_table.count;
 
     return STATUS_OK;
 }
@@ -83,15 +123,43 @@ static OperationStatus findVariable(Differentiator* diff, size_t* var_idx, const
 {
     assert(diff); assert(diff->var_table.variables); assert(var_idx); assert(variable);
 
-    for (size_t index = 0; index < diff->var_table.count; index++) {
-        const char* existing_name = diff->var_table.variables[index].name;
-        if (strncmp(variable, existing_name, var_len) == 0 && existing_name[var_len] == '\0') { 
-            *var_idx = index;
-            return STATUS_OK;
-        }
+    size_t slot = *findSlot(&diff->var_table, variable, var_len);
+    if (slot == 0)
+        return STATUS_DIFF_UNKNOWN_VARIABLE;
+
+    *var_idx = slot - 1;
+    return STATUS_OK;
+}
+
+
+static size_t* findSlot(const VarTable* table, const char* variable, size_t var_len)
+{
+    assert(table); assert(table->slots); assert(variable);
+
+// В слоте хранится индекс переменной + 1, ноль означает пустой слот
+    size_t mask = table->slot_count - 1;
+    for (size_t slot = hashName(variable, var_len) & mask;; slot = (slot + 1) & mask) {
+        if (table->slots[slot] == 0)
+            return &table->slots[slot];
+
+        const char* existing_name = table->variables[table->slots[slot] - 1].name;
+        if (strncmp(variable, existing_name, var_len) == 0 && existing_name[var_len] == '\0')
+            return &table->slots[slot];
+    }
+}
+
+
+static size_t hashName(const char* variable, size_t var_len)
+{
+    assert(variable);
+
+    size_t hash = 0xCBF29CE484222325ULL;
+    for (size_t index = 0; index < var_len; index++) {
+        hash ^= (unsigned char)variable[index];
+        hash *= 0x100000001B3ULL;
     }
 
-    return STATUS_DIFF_UNKNOWN_VARIABLE;
+    return hash;
 }
 
 
@@ -99,7 +167,7 @@ static OperationStatus variableTableResize(Differentiator* diff)
 {
     assert(diff); assert(diff->var_table.variables); assert(diff->var_table.capacity != 0);
 
-    void* temp_ptr = realloc(diff->var_table.variables, diff->var_table.capacity * 2);
+    void* temp_ptr = realloc(diff->var_table.variables, diff->var_table.capacity * 2 * sizeof(Variable));
     if (temp_ptr == NULL)
         return STATUS_SYSTEM_OUT_OF_MEMORY;
 
@@ -109,3 +177,62 @@ static OperationStatus variableTableResize(Differentiator* diff)
     return STATUS_OK;
 }
 
+
+static OperationStatus slotsResize(VarTable* table)
+{
+    assert(table); assert(table->slots); assert(table->slot_count != 0);
+
+    size_t slot_count = 2 * table->slot_count;
+    size_t* slots = (size_t*)calloc(slot_count, sizeof(size_t));
+    if (slots == NULL)
+        return STATUS_SYSTEM_OUT_OF_MEMORY;
+
+    for (size_t index = 0; index < table->count; index++) {
+        const char* name = table->variables[index].name;
+        size_t slot = hashName(name, strlen(name)) & (slot_count - 1);
+        while (slots[slot] != 0)
+            slot = (slot + 1) & (slot_count - 1);
+        slots[slot] = index + 1;
+    }
+
+    free(table->slots);
+    table->slots = slots;
+    table->slot_count = slot_count;
+
+    return STATUS_OK;
+}
+
+
+static OperationStatus storeName(NameArena* arena, const char* variable, size_t var_len, char** name)
+{
+    assert(arena); assert(variable); assert(name);
+
+// Имена лежат в блоках, которые не перемещаются, поэтому указатели на них остаются валидными
+    if (arena->block_count == 0 || arena->used + var_len + 1 > arena->block_size) {
+        if (arena->block_count == arena->block_capacity) {
+            size_t capacity = arena->block_capacity != 0 ? 2 * arena->block_capacity : START_ELEMENT_COUNT;
+            void* temp_ptr = realloc(arena->blocks, capacity * sizeof(char*));
+            if (temp_ptr == NULL)
+                return STATUS_SYSTEM_OUT_OF_MEMORY;
+
+            arena->blocks = (char**)temp_ptr;
+            arena->block_capacity = capacity;
+        }
+
+        size_t block_size = var_len + 1 > NAME_BLOCK_SIZE ? var_len + 1 : NAME_BLOCK_SIZE;
+        char* block = (char*)malloc(block_size);
+        if (block == NULL)
+            return STATUS_SYSTEM_OUT_OF_MEMORY;
+
+        arena->blocks[arena->block_count++] = block;
+        arena->block_size = block_size;
+        arena->used = 0;
+    }
+
+    *name = arena->blocks[arena->block_count - 1] + arena->used;
+    memcpy(*name, variable, var_len);
+    (*name)[var_len] = '\0';
+    arena->used += var_len + 1;
+
+    return STATUS_OK;
+}
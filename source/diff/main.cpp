@@ -10,19 +10,28 @@
 #include "diff/diff_evaluate.h"
 #include "diff/diff_var_table.h"
 #include "diff/diff_taylor.h"
+#include "diff/diff_batch.h"
+#include "diff/diff_cache.h"
+#include "diff/diff_shared.h"
+#include "diff/diff_output.h"
+
+#include "server/diff_server.h"
 
 #include "status.h"
 
-#include "tex_dump/tex_struct.h"
-#include "tex_dump/plot_generator.h"
+#include "tex_dump/render_pipeline.h"
 
 #include "tree/tree.h"
 #include "tree/tree_io.h"
+#include "tree/tree_binary.h"
 
 
 const size_t MAX_ORDER_FOR_OUTPUT = 2;
 
 
+static OperationStatus processExpression(Differentiator* diff);
+
+
 int main(const int argc, const char** argv)
 {
     Differentiator diff = {};
@@ -32,53 +41,95 @@ int main(const int argc, const char** argv)
         return 1;
     }
 
-    status = diffLoadExpression(&diff);
+    if (diff.args.batch_info.batch_file != NULL) {
+        status = diffRunBatch(&diff.args);
+    } else if (diff.args.socket_path != NULL) {
+        status = diffRunServer(&diff.args);
+    } else if (diff.args.shared_info.region != NULL) {
+        status = diffRunShared(&diff);
+    } else {
+        status = processExpression(&diff);
+    }
+
+    diffDestructor(&diff);
+    if (status != STATUS_OK) {
+        printErrorStatus(status);
+        return 1;
+    } else {
+        return 0;
+    }
+}
+
+
+static OperationStatus processExpression(Differentiator* diff)
+{
+    assert(diff);
+
+    const OutputBackend* output = diff->output.backend;
+
+// Сохраненный лес уже содержит производные, они не пересчитываются
+    const char* forest_file = diff->args.forest_info.load_file;
+    OperationStatus status = forest_file != NULL ? diffLoadForest(diff, forest_file) : diffLoadExpression(diff);
     if (status == STATUS_OK) {
-        if (diff.var_table.count == 0) {
+        if (diff->var_table.count == 0) {
             status = STATUS_DIFF_CONST_EXPRESSION;
             
         } else {
-            printIntroduction(&diff);
+            output->introduction(diff);
         }
     }
 
-    if (status == STATUS_OK && diff.args.derivative_info.compute) {
-        status = defineVariables(&diff);
+    if (status == STATUS_OK && diff->args.derivative_info.compute) {
+        status = defineVariables(diff);
+    }
+
+    size_t cached_count = 0;
+    bool use_cache = status == STATUS_OK && diff->args.cache_info.directory != NULL && diff->forest.count == 1;
+    if (use_cache) {
+        status = diffCacheLookup(diff, diff->args.derivative_info.order, &cached_count);
     }
     if (status == STATUS_OK) {
-        for (size_t index = 0; index <= diff.args.derivative_info.order; index++) {
+        for (size_t index = 0; index <= diff->args.derivative_info.order; index++) {
             if (index > MAX_ORDER_FOR_OUTPUT) {
-                diff.tex_dump.print_steps = false;
+                diff->tex_dump.print_steps = false;
             }
 
+            struct timespec start = {};
+            clock_gettime(CLOCK_MONOTONIC, &start);
             if (index > 0) {
-                printTex(&diff, "\\chapter{%zu-я производная}", index);
-                status = diffCalculateDerivative(&diff, index - 1);
-                if (status != STATUS_OK) {
-                    break;
+                bool is_cached = index < diff->forest.count;
+                output->derivative(diff, index, is_cached);
+                if (!is_cached) {
+                    status = diffCalculateDerivative(diff, index - 1);
+                    if (status != STATUS_OK) {
+                        break;
+                    }
+
+                    optimizeTree(diff, index);
                 }
-
-                optimizeTree(&diff, index);
             }
 
-            if (diff.args.derivative_info.compute)
-                diffEvaluate(&diff, index);
+            if (diff->args.derivative_info.compute)
+                diffEvaluate(diff, index);
 
-            if (index > 0) {
-                printPlot(&diff, index);
-            }
+            output->result(diff, index, getElapsedTime(&start));
         }
     }
+// Разложение строит свой график синхронно, поэтому отложенные графики дорисовываются здесь
+    renderPipelineFinish(diff);
 
-    if (status == STATUS_OK && diff.args.taylor_info.decomposition) {
-        diffTaylorSeries(&diff);
+    if (status == STATUS_OK && use_cache) {
+        status = diffCacheStore(diff, cached_count);
+        diffCachePrintStats(stderr);
     }
 
-    diffDestructor(&diff);
-    if (status != STATUS_OK) {
-        printErrorStatus(status);
-        return 1;
-    } else {
-        return 0;
+    if (status == STATUS_OK && diff->args.taylor_info.decomposition) {
+        diffTaylorSeries(diff);
+    }
+
+    if (status == STATUS_OK && diff->args.forest_info.save_file != NULL) {
+        status = diffSaveForest(diff, diff->args.forest_info.save_file);
     }
+
+    return status;
 }
@@ -7,19 +7,23 @@
 #include "graph_dump/graph_generator.h"
 #include "diff/diff_defs.h"
 #include "tree/tree.h"
+#include "tree/tree_stack.h"
 
 
-static void generateNode(Differentiator* diff, TreeNode* node,
-    FILE* graph_file, int rank, int* counter);
-static void printNodeAttributes(Differentiator* diff, TreeNode* node, FILE* graph_file, int id);
+typedef struct {
+    TreeNode* node;
+    int parent_id;
+    int rank;
+    bool is_left;
+} GraphFrame;
+
 
-static void generateSimpleNode(Differentiator* diff, TreeNode* node,
-    FILE* graph_file, int rank, int* counter);
+static void generateNodes(Differentiator* diff, TreeNode* root, FILE* graph_file, bool is_simple);
+static void printNodeAttributes(Differentiator* diff, TreeNode* node, FILE* graph_file, int id);
 static void printSimpleNodeAttributes(Differentiator* diff, TreeNode* node, FILE* graph_file, int id);
 
 static void printNodeColor(TreeNode* node, FILE* graph_file);
 static void printNodeData(Differentiator* diff, TreeNode* node, FILE* graph_file);
-static const char* nodeTypeToString(NodeType type);
 
 
 void generateGraph(Differentiator* diff, size_t tree_idx, const char* graph_filename)
@@ -34,38 +38,54 @@ void generateGraph(Differentiator* diff, size_t tree_idx, const char* graph_file
     fprintf(graph_file, "\trankdir=TB\n");
     fprintf(graph_file, "\tgraph[splines=line];\n");
 
-    int counter = 0;
-    int rank = 0;
-    if (diff->args.simple_graph) {
-        generateSimpleNode(diff, diff->forest.trees[tree_idx].root, graph_file, rank, &counter);
-    } else {
-        generateNode(diff, diff->forest.trees[tree_idx].root, graph_file, rank, &counter);
-    }
+    generateNodes(diff, diff->forest.trees[tree_idx].root, graph_file, diff->args.simple_graph);
     fprintf(graph_file, "}\n\n");
 
     assert(fclose(graph_file) == 0);
 }
 
 
-static void generateNode(Differentiator* diff, TreeNode* node,
-    FILE* graph_file, int rank, int* counter)
+static void generateNodes(Differentiator* diff, TreeNode* root, FILE* graph_file, bool is_simple)
 {
-    assert(diff); assert(diff->var_table.variables); assert(node);
-    assert(graph_file); assert(counter);
-   
-    int id = ++(*counter); 
-
-    printNodeAttributes(diff, node, graph_file, id);
-    if (node->left) {
-        fprintf(graph_file, "\tnode_%d:left -> node_%d:n [rank=%d];\n", 
-                id, *counter + 1, rank);
-        generateNode(diff, node->left, graph_file, rank + 1, counter);
-    }
-    if (node->right) {
-        fprintf(graph_file, "\tnode_%d:right -> node_%d:n [rank=%d];\n", 
-                id, *counter + 1, rank);
-        generateNode(diff, node->right, graph_file, rank + 1, counter);
+    assert(diff); assert(diff->var_table.variables); assert(root); assert(graph_file);
+
+    WorkStack stack = {};
+    workStackInit(&stack, sizeof(GraphFrame));
+
+// Номера узлов раздаются в прямом порядке обхода, как и раньше при рекурсии
+    int counter = 0;
+    GraphFrame frame = {root, 0, 0, false};
+    OperationStatus status = workStackPush(&stack, &frame);
+    while (status == STATUS_OK && workStackPop(&stack, &frame)) {
+        int id = ++counter;
+        if (frame.parent_id != 0) {
+            if (is_simple) {
+                fprintf(graph_file, "\tnode_%d -> node_%d [rank=%d];\n",
+                        frame.parent_id, id, frame.rank - 1);
+            } else {
+                fprintf(graph_file, "\tnode_%d:%s -> node_%d:n [rank=%d];\n",
+                        frame.parent_id, frame.is_left ? "left" : "right", id, frame.rank - 1);
+            }
+        }
+
+        if (is_simple) {
+            printSimpleNodeAttributes(diff, frame.node, graph_file, id);
+        } else {
+            printNodeAttributes(diff, frame.node, graph_file, id);
+        }
+
+        TreeNode* node = frame.node;
+        if (node->right) {
+            GraphFrame right_frame = {node->right, id, frame.rank + 1, false};
+            status = workStackPush(&stack, &right_frame);
+        }
+        if (node->left && status == STATUS_OK) {
+            GraphFrame left_frame = {node->left, id, frame.rank + 1, true};
+            status = workStackPush(&stack, &left_frame);
+        }
     }
+
+    workStackDestroy(&stack);
 }
 
 
@@ -93,25 +113,6 @@ static void printNodeAttributes(Differentiator* diff, TreeNode* node, FILE* grap
 }
 
 
-static void generateSimpleNode(Differentiator* diff, TreeNode* node,
-    FILE* graph_file, int rank, int* counter)
-{
-    assert(diff); assert(diff->var_table.variables); assert(node);
-    assert(graph_file); assert(counter);
-  
-    int id = ++(*counter); 
-    printSimpleNodeAttributes(diff, node, graph_file, id);
-    if (node->left) {
-        fprintf(graph_file, "\tnode_%d -> node_%d [rank=%d];\n", id, *counter + 1, rank);
-        generateSimpleNode(diff, node->left, graph_file, rank + 1, counter);
-    }
-    if (node->right) {
-        fprintf(graph_file, "\tnode_%d -> node_%d [rank=%d];\n", id, *counter + 1, rank);
-        generateSimpleNode(diff, node->right, graph_file, rank + 1, counter);
-    }
-}
-
-
 static void printSimpleNodeAttributes(Differentiator* diff, TreeNode* node, FILE* graph_file, int id)
 {
     assert(diff); assert(node); assert(graph_file);
@@ -128,12 +129,8 @@ static void printNodeColor(TreeNode* node, FILE* graph_file)
 {
     assert(node); assert(graph_file);
 
-    switch (node->type) {
-        case NODE_OP:  fprintf(graph_file, "fillcolor=\"#FCCC94\", color=\"#F87C08\", "); break;
-        case NODE_VAR: fprintf(graph_file, "fillcolor=\"#80DBED\", color=\"#1286DF\", "); break;
-        case NODE_NUM: fprintf(graph_file, "fillcolor=\"#87EA00\", color=\"#589800\", "); break;
-        default:       fprintf(graph_file, "fillcolor=\"#FF0700\", color=\"#A60400\", "); break;
-    }
+    NodeColors colors = getNodeColors(node);
+    fprintf(graph_file, "fillcolor=\"%s\", color=\"%s\", ", colors.fill, colors.stroke);
 }
 
 
@@ -141,16 +138,39 @@ static void printNodeData(Differentiator* diff, TreeNode* node, FILE* graph_file
 {
     assert(diff); assert(diff->var_table.variables); assert(node); assert(graph_file);
 
+    char data[BUFFER_SIZE] = "";
+    formatNodeData(diff, node, data, sizeof(data));
+    fprintf(graph_file, "%s", data);
+}
+
+
+NodeColors getNodeColors(const TreeNode* node)
+{
+    assert(node);
+
+    switch (node->type) {
+        case NODE_OP:  return (NodeColors){"#FCCC94", "#F87C08"};
+        case NODE_VAR: return (NodeColors){"#80DBED", "#1286DF"};
+        case NODE_NUM: return (NodeColors){"#87EA00", "#589800"};
+        default:       return (NodeColors){"#FF0700", "#A60400"};
+    }
+}
+
+
+int formatNodeData(Differentiator* diff, const TreeNode* node, char* buffer, size_t size)
+{
+    assert(diff); assert(diff->var_table.variables); assert(node); assert(buffer);
+
     switch (node->type) {
-        case NODE_OP:  fprintf(graph_file, "%s", OP_TABLE[node->value.op].symbol); break;
-        case NODE_VAR: fprintf(graph_file, "'%s'", diff->var_table.variables[node->value.var_idx].name); break;
-        case NODE_NUM: fprintf(graph_file, "%g", node->value.num_val); break;
-        default:       fprintf(graph_file, "UNKNOWN_TYPE"); break;
+        case NODE_OP:  return snprintf(buffer, size, "%s", OP_TABLE[node->value.op].symbol);
+        case NODE_VAR: return snprintf(buffer, size, "'%s'", diff->var_table.variables[node->value.var_idx].name);
+        case NODE_NUM: return snprintf(buffer, size, "%g", node->value.num_val);
+        default:       return snprintf(buffer, size, "UNKNOWN_TYPE");
     }
 }
 
 
-static const char* nodeTypeToString(NodeType type)
+const char* nodeTypeToString(NodeType type)
 {
     switch (type) {
         case NODE_OP:  return "NODE_OP";
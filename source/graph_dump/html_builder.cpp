@@ -2,10 +2,15 @@
 #include <stdlib.h>
 #include <stdarg.h>
 #include <string.h>
+#include <unistd.h>
 #include <assert.h>
 
 #include "graph_dump/html_builder.h"
 #include "graph_dump/graph_generator.h"
+#include "graph_dump/svg_generator.h"
+
+#include "tex_dump/render_jobs.h"
+#include "tex_dump/render_cache.h"
 
 #include "diff/diff_defs.h"
 
@@ -30,8 +35,11 @@ typedef struct {
 } DumpInfo;
 
 
-static void createHtmlDump(Differentiator* diff, BinaryTree* tree, DumpInfo* info, const char* image);
+static void createHtmlDump(Differentiator* diff, size_t tree_idx, DumpInfo* info, const char* image,
+                           const TreeStats* stats);
 static void writeTreeInfo(Differentiator* diff, BinaryTree* tree, DumpInfo* info);
+static void writeTreeStats(Differentiator* diff, const TreeStats* stats);
+static bool isDumpSkipped(Differentiator* diff, OperationStatus status);
 static void convertDotToSvg(const char* dot_file, const char* svg_file);
 
 
@@ -43,10 +51,8 @@ void openGraphDumpFile(Differentiator* diff)
     snprintf(DIRECTORY, BUFFER_SIZE, "%s/tree_dump_%03d",
         GRAPH_DUMP_DIRECTORY, dump_counter);
 
-    char command[BUFFER_SIZE * 3] = {};
-    snprintf(command, BUFFER_SIZE * 3, "rm -rf %s && mkdir -p %s",
-             DIRECTORY, DIRECTORY);
-    system(command);
+    removeDirectory(DIRECTORY);
+    makeDirectory(DIRECTORY);
 
     char filename[BUFFER_SIZE * 2] = {};
     snprintf(filename, BUFFER_SIZE * 2, "%s/tree_dump_%03d.html",
@@ -61,10 +67,13 @@ void openGraphDumpFile(Differentiator* diff)
 void treeDump(Differentiator* diff, size_t tree_idx, OperationStatus status, const char* file, 
               const char* function, int line, const char* format, ...)
 {
-    assert(diff); assert(GRAPH_FILE); assert(diff->var_table.variables);
+    assert(diff); assert(diff->var_table.variables);
     assert(diff->forest.trees); assert(tree_idx <= diff->forest.count);
     assert(file); assert(function); assert(format);
 
+    if (GRAPH_FILE == NULL || isDumpSkipped(diff, status))
+        return;
+
     char message[BUFFER_SIZE] = {};
     if (format[0] != '\0') {
         va_list args;
@@ -77,7 +86,16 @@ void treeDump(Differentiator* diff, size_t tree_idx, OperationStatus status, con
     char graph_dot_file[BUFFER_SIZE * 2] = {};
     char graph_svg_file[BUFFER_SIZE * 2] = {};
 
-    if (diff->tex_dump.print_steps) {
+// Слишком большие деревья не рисуются, вместо графа в дамп пишется их сводка
+    TreeStats stats = {};
+    bool is_summary = false;
+    if (diff->tex_dump.print_steps && diff->args.diagnostics_info.node_limit != 0) {
+        is_summary = treeCollectStats(diff->forest.trees[tree_idx].root, &stats) == STATUS_OK &&
+                     stats.node_count > diff->args.diagnostics_info.node_limit;
+    }
+
+// Без --graphviz дерево раскладывается на месте и встраивается в HTML, файлы не нужны
+    if (diff->tex_dump.print_steps && diff->args.use_graphviz && !is_summary) {
         snprintf(graph_dot_file, BUFFER_SIZE * 2, "%s/tree_graph_%03zu.dot",
                 DIRECTORY, diff->graph_dump.image_counter);
         snprintf(graph_svg_file, BUFFER_SIZE * 2, "%s/tree_graph_%03zu.svg",
@@ -85,22 +103,22 @@ void treeDump(Differentiator* diff, size_t tree_idx, OperationStatus status, con
 
         generateGraph(diff, tree_idx, graph_dot_file);
         convertDotToSvg(graph_dot_file, graph_svg_file);
-
-        char command[BUFFER_SIZE * 3] = {};
-        snprintf(command, BUFFER_SIZE * 3, "rm %s", graph_dot_file);
-        system(command);
     }
 
     snprintf(graph_svg_file, BUFFER_SIZE * 2, "tree_graph_%03zu.svg", diff->graph_dump.image_counter);
-    createHtmlDump(diff, &diff->forest.trees[tree_idx], &info, graph_svg_file);
+    createHtmlDump(diff, tree_idx, &info, diff->args.use_graphviz ? graph_svg_file : NULL,
+                   is_summary ? &stats : NULL);
 
     diff->graph_dump.image_counter++;
 }
 
 
-static void createHtmlDump(Differentiator* diff, BinaryTree* tree, DumpInfo* info, const char* image)
+static void createHtmlDump(Differentiator* diff, size_t tree_idx, DumpInfo* info, const char* image,
+                           const TreeStats* stats)
 {
-    assert(diff); assert(tree); assert(info); assert(info); assert(image);
+    assert(diff); assert(diff->forest.trees); assert(info);
+
+    BinaryTree* tree = &diff->forest.trees[tree_idx];
 
     fprintf(GRAPH_FILE, "<html>\n");
     fprintf(GRAPH_FILE, "<style>\n");
@@ -111,10 +129,14 @@ static void createHtmlDump(Differentiator* diff, BinaryTree* tree, DumpInfo* inf
     writeTreeInfo(diff, tree, info);
 
     fprintf(GRAPH_FILE, "<div style=\"overflow-x: auto; white-space: nowrap;\">\n");
-    if (diff->tex_dump.print_steps) {
+    if (diff->tex_dump.print_steps && stats != NULL) {
+        writeTreeStats(diff, stats);
+    } else if (diff->tex_dump.print_steps && image != NULL) {
         fprintf(GRAPH_FILE, "<img src=\"%s\" "
             "style=\"zoom:0.65; -moz-transform:scale(0.1); -moz-transform-origin:top left;\">\n",
             image);
+    } else if (diff->tex_dump.print_steps) {
+        generateSvg(diff, tree_idx, GRAPH_FILE);
     }
     fprintf(GRAPH_FILE, "</div>\n");
 
@@ -142,14 +164,58 @@ static void writeTreeInfo(Differentiator* diff, BinaryTree* tree, DumpInfo* info
 }
 
 
+static void writeTreeStats(Differentiator* diff, const TreeStats* stats)
+{
+    assert(diff); assert(stats);
+
+    fprintf(GRAPH_FILE, "\t<p>Graph omitted: %zu nodes exceed the limit of %zu</p>\n",
+        stats->node_count, diff->args.diagnostics_info.node_limit);
+    fprintf(GRAPH_FILE, "\t<table border=\"1\" cellpadding=\"4\">\n");
+    fprintf(GRAPH_FILE, "\t\t<tr><td>Nodes</td><td>%zu</td></tr>\n", stats->node_count);
+    fprintf(GRAPH_FILE, "\t\t<tr><td>Depth</td><td>%zu</td></tr>\n", stats->depth);
+    for (size_t type = 0; type < sizeof(stats->type_counts) / sizeof(*stats->type_counts); type++) {
+        fprintf(GRAPH_FILE, "\t\t<tr><td>%s</td><td>%zu</td></tr>\n",
+            nodeTypeToString((NodeType)type), stats->type_counts[type]);
+    }
+    fprintf(GRAPH_FILE, "\t</table>\n");
+}
+
+
+static bool isDumpSkipped(Differentiator* diff, OperationStatus status)
+{
+    assert(diff);
+
+// В выборочном режиме пишется каждый N-й дамп, дампы с ошибкой сохраняются всегда
+    size_t call_idx = diff->graph_dump.call_counter++;
+    size_t period = diff->args.diagnostics_info.sample_period;
+    switch (diff->args.diagnostics_info.level) {
+        case DIAGNOSTICS_FULL:    return false;
+        case DIAGNOSTICS_SAMPLED: return status == STATUS_OK && period > 1 && call_idx % period != 0;
+        case DIAGNOSTICS_OFF:
+        case DIAGNOSTICS_VERIFY:
+        default:                  return true;
+    }
+}
+
+
 static void convertDotToSvg(const char* dot_file, const char* svg_file)
 {
     assert(dot_file);
     assert(svg_file);
 
-    char command[BUFFER_SIZE] = {};
-    snprintf(command, BUFFER_SIZE, "dot -Tsvg %s -o %s",
-             dot_file, svg_file);
+// Ключ — текст графа вместе с форматом вывода, одинаковые деревья рисуются один раз
+    const char* format = "dot -Tsvg";
+    RenderArtifact artifact = {};
+    renderCacheKeyInit(&artifact);
+    renderCacheKeyAdd(&artifact, format, strlen(format));
+    snprintf(artifact.path, sizeof(artifact.path), "%s", svg_file);
+    bool has_key = renderCacheHashFile(&artifact, dot_file);
+    if (has_key && renderCacheFetch(&artifact)) {
+        unlink(dot_file);
+        return;
+    }
 
-    system(command);
-}
\ No newline at end of file
+// Исходный .dot удаляется, когда dot закончит работу
+    const char* argv[] = {"dot", "-Tsvg", dot_file, "-o", svg_file, NULL};
+    renderJobSubmit(argv, &dot_file, 1, has_key ? &artifact : NULL, false);
+}
@@ -0,0 +1,507 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <assert.h>
+
+#include "graph_dump/svg_generator.h"
+#include "graph_dump/graph_generator.h"
+
+#include "diff/diff_defs.h"
+
+#include "tree/tree_stack.h"
+
+#include "status.h"
+
+
+// Размеры подобраны под моноширинный шрифт: ширина символа — 0.6 кегля
+const double SVG_FONT_SIZE = 14;
+const double SVG_CHAR_WIDTH = 8.4;
+const double SVG_CELL_PADDING = 8;
+const double SVG_ROW_HEIGHT = 22;
+const size_t SVG_RECORD_ROWS = 4;
+const double SVG_SIBLING_GAP = 16;
+const double SVG_LEVEL_GAP = 40;
+const double SVG_MARGIN = 10;
+const size_t SVG_NO_NODE = SIZE_MAX;
+
+
+typedef struct {
+    const TreeNode* node;
+    size_t parent;
+    size_t children[2];
+    size_t child_count;
+    size_t number;
+    size_t depth;
+    double width;
+    double prelim;
+    double mod;
+    double shift;
+    double change;
+    size_t thread;
+    size_t ancestor;
+    size_t default_ancestor;
+    double x;
+} LayoutNode;
+
+
+typedef struct {
+    LayoutNode* nodes;
+    size_t count;
+    size_t capacity;
+    bool is_simple;
+    double node_height;
+} TreeLayout;
+
+
+typedef struct {
+    const TreeNode* node;
+    size_t parent;
+    size_t number;
+} LayoutFrame;
+
+
+static OperationStatus collectLayoutNodes(Differentiator* diff, const TreeNode* root, TreeLayout* layout);
+static OperationStatus addLayoutNode(Differentiator* diff, TreeLayout* layout, const LayoutFrame* frame);
+static double getNodeWidth(Differentiator* diff, const TreeNode* node, bool is_simple);
+
+static void firstWalk(TreeLayout* layout, size_t v);
+static size_t apportion(TreeLayout* layout, size_t v, size_t default_ancestor);
+static void moveSubtree(TreeLayout* layout, size_t left, size_t right, double shift);
+static void executeShifts(TreeLayout* layout, size_t v);
+static size_t nextLeft(const TreeLayout* layout, size_t v);
+static size_t nextRight(const TreeLayout* layout, size_t v);
+static size_t leftSibling(const TreeLayout* layout, size_t v);
+static double getDistance(const TreeLayout* layout, size_t left, size_t right);
+static void secondWalk(TreeLayout* layout);
+
+static void printSvgEdge(const TreeLayout* layout, size_t v, FILE* svg_file);
+static void printSvgNode(Differentiator* diff, const TreeLayout* layout, size_t v, FILE* svg_file);
+static void printSvgText(FILE* svg_file, double x, double y, const char* text);
+static double getNodeY(const TreeLayout* layout, size_t v);
+
+
+OperationStatus generateSvg(Differentiator* diff, size_t tree_idx, FILE* svg_file)
+{
+    assert(diff); assert(diff->forest.trees); assert(tree_idx <= diff->forest.count);
+    assert(diff->forest.trees[tree_idx].root); assert(svg_file);
+
+    TreeLayout layout = {};
+    layout.is_simple = diff->args.simple_graph;
+    layout.node_height = layout.is_simple ? 1.5 * SVG_ROW_HEIGHT : (double)SVG_RECORD_ROWS * SVG_ROW_HEIGHT;
+
+    OperationStatus status = collectLayoutNodes(diff, diff->forest.trees[tree_idx].root, &layout);
+    if (status != STATUS_OK) {
+        free(layout.nodes);
+        return status;
+    }
+
+// Узлы лежат в порядке "корень, правое, левое", поэтому обратный проход — обратный обход слева направо
+    for (size_t index = layout.count; index-- > 0; )
+        firstWalk(&layout, index);
+    secondWalk(&layout);
+
+    double min_x = 0, max_x = 0;
+    size_t max_depth = 0;
+    for (size_t index = 0; index < layout.count; index++) {
+        const LayoutNode* node = &layout.nodes[index];
+        if (index == 0 || node->x - node->width / 2 < min_x)
+            min_x = node->x - node->width / 2;
+        if (index == 0 || node->x + node->width / 2 > max_x)
+            max_x = node->x + node->width / 2;
+        if (node->depth > max_depth)
+            max_depth = node->depth;
+    }
+    for (size_t index = 0; index < layout.count; index++)
+        layout.nodes[index].x += SVG_MARGIN - min_x;
+
+    double width = max_x - min_x + 2 * SVG_MARGIN;
+    double height = getNodeY(&layout, 0) + (double)max_depth * (layout.node_height + SVG_LEVEL_GAP) +
+        layout.node_height + SVG_MARGIN;
+    size_t svg_id = diff->graph_dump.image_counter;
+
+    fprintf(svg_file, "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"%.0f\" height=\"%.0f\" "
+        "viewBox=\"0 0 %.0f %.0f\" font-family=\"Monospace\" font-size=\"%g\" "
+        "style=\"zoom:0.65; -moz-transform:scale(0.1); -moz-transform-origin:top left;\">\n",
+        width, height, width, height, SVG_FONT_SIZE);
+    fprintf(svg_file, "<defs><marker id=\"arrow_%zu\" viewBox=\"0 0 10 10\" refX=\"10\" refY=\"5\" "
+        "markerWidth=\"8\" markerHeight=\"8\" orient=\"auto\"><path d=\"M0,0 L10,5 L0,10 z\"/></marker></defs>\n",
+        svg_id);
+
+// Ребра рисуются первыми, чтобы узлы лежали поверх них
+    fprintf(svg_file, "<g stroke=\"black\" marker-end=\"url(#arrow_%zu)\">\n", svg_id);
+    for (size_t index = 1; index < layout.count; index++)
+        printSvgEdge(&layout, index, svg_file);
+    fprintf(svg_file, "</g>\n");
+
+    for (size_t index = 0; index < layout.count; index++)
+        printSvgNode(diff, &layout, index, svg_file);
+    fprintf(svg_file, "</svg>\n");
+
+    free(layout.nodes);
+    return STATUS_OK;
+}
+
+
+static OperationStatus collectLayoutNodes(Differentiator* diff, const TreeNode* root, TreeLayout* layout)
+{
+    assert(diff); assert(root); assert(layout);
+
+    WorkStack stack = {};
+    workStackInit(&stack, sizeof(LayoutFrame));
+
+    LayoutFrame frame = {root, SVG_NO_NODE, 0};
+    OperationStatus status = workStackPush(&stack, &frame);
+    while (status == STATUS_OK && workStackPop(&stack, &frame)) {
+        status = addLayoutNode(diff, layout, &frame);
+        if (status != STATUS_OK)
+            break;
+
+        size_t index = layout->count - 1;
+        const TreeNode* node = frame.node;
+        if (node->left) {
+            LayoutFrame left_frame = {node->left, index, 0};
+            status = workStackPush(&stack, &left_frame);
+        }
+        if (node->right && status == STATUS_OK) {
+            LayoutFrame right_frame = {node->right, index, node->left ? 1u : 0u};
+            status = workStackPush(&stack, &right_frame);
+        }
+    }
+    workStackDestroy(&stack);
+
+    return status;
+}
+
+
+static OperationStatus addLayoutNode(Differentiator* diff, TreeLayout* layout, const LayoutFrame* frame)
+{
+    assert(diff); assert(layout); assert(frame); assert(frame->node);
+
+    if (layout->count == layout->capacity) {
+        size_t capacity = layout->capacity != 0 ? 2 * layout->capacity : START_ELEMENT_COUNT;
+        void* temp_ptr = realloc(layout->nodes, capacity * sizeof(LayoutNode));
+        if (temp_ptr == NULL)
+            return STATUS_SYSTEM_OUT_OF_MEMORY;
+
+        layout->nodes = (LayoutNode*)temp_ptr;
+        layout->capacity = capacity;
+    }
+
+    size_t index = layout->count++;
+    LayoutNode* node = &layout->nodes[index];
+    *node = (LayoutNode){};
+    node->node = frame->node;
+    node->parent = frame->parent;
+    node->number = frame->number;
+    node->width = getNodeWidth(diff, frame->node, layout->is_simple);
+    node->thread = SVG_NO_NODE;
+    node->ancestor = index;
+
+    if (frame->parent != SVG_NO_NODE) {
+        LayoutNode* parent = &layout->nodes[frame->parent];
+        node->depth = parent->depth + 1;
+        parent->children[frame->number] = index;
+        parent->child_count++;
+    }
+
+    return STATUS_OK;
+}
+
+
+static double getNodeWidth(Differentiator* diff, const TreeNode* node, bool is_simple)
+{
+    assert(diff); assert(node);
+
+    char data[BUFFER_SIZE] = "";
+    size_t data_length = (size_t)formatNodeData(diff, node, data, sizeof(data));
+    if (is_simple)
+        return (double)data_length * SVG_CHAR_WIDTH + 2 * SVG_CELL_PADDING;
+
+// Запись повторяет метку Mrecord: указатель, тип, значение и строка с двумя детьми
+    char pointer[BUFFER_SIZE] = "";
+    size_t pointer_length = (size_t)snprintf(pointer, sizeof(pointer), "%p", (const void*)node);
+    size_t type_length = strlen("Type: ") + strlen(nodeTypeToString(node->type));
+    size_t value_length = strlen("Value: ") + data_length;
+
+    size_t row_length = pointer_length;
+    if (type_length > row_length)
+        row_length = type_length;
+    if (value_length > row_length)
+        row_length = value_length;
+
+    double rows_width = (double)row_length * SVG_CHAR_WIDTH + 2 * SVG_CELL_PADDING;
+    double children_width = 2 * ((double)pointer_length * SVG_CHAR_WIDTH + 2 * SVG_CELL_PADDING);
+
+    return rows_width > children_width ? rows_width : children_width;
+}
+
+
+static void firstWalk(TreeLayout* layout, size_t v)
+{
+    assert(layout); assert(v < layout->count);
+
+    LayoutNode* node = &layout->nodes[v];
+    size_t sibling = leftSibling(layout, v);
+    if (node->child_count != 0) {
+        executeShifts(layout, v);
+
+        double midpoint = (layout->nodes[node->children[0]].prelim +
+                           layout->nodes[node->children[node->child_count - 1]].prelim) / 2;
+        if (sibling != SVG_NO_NODE) {
+            node->prelim = layout->nodes[sibling].prelim + getDistance(layout, sibling, v);
+            node->mod = node->prelim - midpoint;
+        } else {
+            node->prelim = midpoint;
+        }
+    } else if (sibling != SVG_NO_NODE) {
+        node->prelim = layout->nodes[sibling].prelim + getDistance(layout, sibling, v);
+    }
+
+// Поддерево готово, его можно придвинуть к уже размещенным левым братьям
+    if (node->parent != SVG_NO_NODE) {
+        LayoutNode* parent = &layout->nodes[node->parent];
+        if (node->number == 0)
+            parent->default_ancestor = v;
+        parent->default_ancestor = apportion(layout, v, parent->default_ancestor);
+    }
+}
+
+
+static size_t apportion(TreeLayout* layout, size_t v, size_t default_ancestor)
+{
+    assert(layout); assert(v < layout->count);
+
+    size_t sibling = leftSibling(layout, v);
+    if (sibling == SVG_NO_NODE)
+        return default_ancestor;
+
+    LayoutNode* nodes = layout->nodes;
+    size_t inner_right = v;
+    size_t outer_right = v;
+    size_t inner_left = sibling;
+    size_t outer_left = nodes[nodes[v].parent].children[0];
+    double inner_right_sum = nodes[inner_right].mod;
+    double outer_right_sum = nodes[outer_right].mod;
+    double inner_left_sum = nodes[inner_left].mod;
+    double outer_left_sum = nodes[outer_left].mod;
+
+// Правый контур левых поддеревьев сравнивается с левым контуром нового поддерева уровень за уровнем
+    while (nextRight(layout, inner_left) != SVG_NO_NODE && nextLeft(layout, inner_right) != SVG_NO_NODE) {
+        inner_left = nextRight(layout, inner_left);
+        inner_right = nextLeft(layout, inner_right);
+        outer_left = nextLeft(layout, outer_left);
+        outer_right = nextRight(layout, outer_right);
+        nodes[outer_right].ancestor = v;
+
+        double shift = (nodes[inner_left].prelim + inner_left_sum) - (nodes[inner_right].prelim + inner_right_sum) +
+            getDistance(layout, inner_left, inner_right);
+        if (shift > 0) {
+            size_t ancestor = nodes[inner_left].ancestor;
+            if (nodes[ancestor].parent != nodes[v].parent)
+                ancestor = default_ancestor;
+            moveSubtree(layout, ancestor, v, shift);
+            inner_right_sum += shift;
+            outer_right_sum += shift;
+        }
+
+        inner_left_sum += nodes[inner_left].mod;
+        inner_right_sum += nodes[inner_right].mod;
+        outer_left_sum += nodes[outer_left].mod;
+        outer_right_sum += nodes[outer_right].mod;
+    }
+
+// Нити продолжают более короткий контур, чтобы следующие сравнения шли за линейное время
+    if (nextRight(layout, inner_left) != SVG_NO_NODE && nextRight(layout, outer_right) == SVG_NO_NODE) {
+        nodes[outer_right].thread = nextRight(layout, inner_left);
+        nodes[outer_right].mod += inner_left_sum - outer_right_sum;
+    }
+    if (nextLeft(layout, inner_right) != SVG_NO_NODE && nextLeft(layout, outer_left) == SVG_NO_NODE) {
+        nodes[outer_left].thread = nextLeft(layout, inner_right);
+        nodes[outer_left].mod += inner_right_sum - outer_left_sum;
+        default_ancestor = v;
+    }
+
+    return default_ancestor;
+}
+
+
+static void moveSubtree(TreeLayout* layout, size_t left, size_t right, double shift)
+{
+    assert(layout); assert(left < layout->count); assert(right < layout->count);
+
+    LayoutNode* nodes = layout->nodes;
+    double subtrees = (double)(nodes[right].number - nodes[left].number);
+    nodes[right].change -= shift / subtrees;
+    nodes[right].shift += shift;
+    nodes[left].change += shift / subtrees;
+    nodes[right].prelim += shift;
+    nodes[right].mod += shift;
+}
+
+
+static void executeShifts(TreeLayout* layout, size_t v)
+{
+    assert(layout); assert(v < layout->count);
+
+    double shift = 0;
+    double change = 0;
+    const LayoutNode* node = &layout->nodes[v];
+    for (size_t index = node->child_count; index-- > 0; ) {
+        LayoutNode* child = &layout->nodes[node->children[index]];
+        child->prelim += shift;
+        child->mod += shift;
+        change += child->change;
+        shift += child->shift + change;
+    }
+}
+
+
+static size_t nextLeft(const TreeLayout* layout, size_t v)
+{
+    assert(layout); assert(v < layout->count);
+
+    const LayoutNode* node = &layout->nodes[v];
+    return node->child_count != 0 ? node->children[0] : node->thread;
+}
+
+
+static size_t nextRight(const TreeLayout* layout, size_t v)
+{
+    assert(layout); assert(v < layout->count);
+
+    const LayoutNode* node = &layout->nodes[v];
+    return node->child_count != 0 ? node->children[node->child_count - 1] : node->thread;
+}
+
+
+static size_t leftSibling(const TreeLayout* layout, size_t v)
+{
+    assert(layout); assert(v < layout->count);
+
+    const LayoutNode* node = &layout->nodes[v];
+    if (node->parent == SVG_NO_NODE || node->number == 0)
+        return SVG_NO_NODE;
+
+    return layout->nodes[node->parent].children[node->number - 1];
+}
+
+
+static double getDistance(const TreeLayout* layout, size_t left, size_t right)
+{
+    assert(layout);
+
+    return (layout->nodes[left].width + layout->nodes[right].width) / 2 + SVG_SIBLING_GAP;
+}
+
+
+static void secondWalk(TreeLayout* layout)
+{
+    assert(layout);
+
+// Родитель всегда раньше детей, поэтому накопленный сдвиг передается одним прямым проходом
+    for (size_t index = 0; index < layout->count; index++) {
+        LayoutNode* node = &layout->nodes[index];
+        node->x += node->prelim;
+        for (size_t child = 0; child < node->child_count; child++)
+            layout->nodes[node->children[child]].x = node->x - node->prelim + node->mod;
+    }
+}
+
+
+static void printSvgEdge(const TreeLayout* layout, size_t v, FILE* svg_file)
+{
+    assert(layout); assert(v < layout->count); assert(svg_file);
+
+    const LayoutNode* node = &layout->nodes[v];
+    const LayoutNode* parent = &layout->nodes[node->parent];
+
+// В полной записи ребро выходит из ячейки левого или правого ребенка
+    double start_x = parent->x;
+    double start_y = getNodeY(layout, node->parent) + layout->node_height;
+    if (!layout->is_simple) {
+        start_x += node->node == parent->node->left ? -parent->width / 4 : parent->width / 4;
+        start_y -= SVG_ROW_HEIGHT / 2;
+    }
+
+    fprintf(svg_file, "<line x1=\"%.1f\" y1=\"%.1f\" x2=\"%.1f\" y2=\"%.1f\"/>\n",
+        start_x, start_y, node->x, getNodeY(layout, v));
+}
+
+
+static void printSvgNode(Differentiator* diff, const TreeLayout* layout, size_t v, FILE* svg_file)
+{
+    assert(diff); assert(layout); assert(v < layout->count); assert(svg_file);
+
+    const LayoutNode* layout_node = &layout->nodes[v];
+    const TreeNode* node = layout_node->node;
+    NodeColors colors = getNodeColors(node);
+    double left = layout_node->x - layout_node->width / 2;
+    double top = getNodeY(layout, v);
+
+    fprintf(svg_file, "<g fill=\"%s\" stroke=\"%s\" stroke-width=\"2\">"
+        "<rect x=\"%.1f\" y=\"%.1f\" width=\"%.1f\" height=\"%.1f\" rx=\"%g\"/>",
+        colors.fill, colors.stroke, left, top, layout_node->width, layout->node_height,
+        layout->is_simple ? 0 : SVG_CELL_PADDING);
+
+    char data[BUFFER_SIZE] = "";
+    formatNodeData(diff, node, data, sizeof(data));
+    if (layout->is_simple) {
+        fprintf(svg_file, "</g>\n");
+        printSvgText(svg_file, layout_node->x, top + layout->node_height / 2, data);
+        return;
+    }
+
+    for (size_t row = 1; row < SVG_RECORD_ROWS; row++) {
+        double y = top + (double)row * SVG_ROW_HEIGHT;
+        fprintf(svg_file, "<line x1=\"%.1f\" y1=\"%.1f\" x2=\"%.1f\" y2=\"%.1f\"/>",
+            left, y, left + layout_node->width, y);
+    }
+    double bottom_row = top + (double)(SVG_RECORD_ROWS - 1) * SVG_ROW_HEIGHT;
+    fprintf(svg_file, "<line x1=\"%.1f\" y1=\"%.1f\" x2=\"%.1f\" y2=\"%.1f\"/></g>\n",
+        layout_node->x, bottom_row, layout_node->x, top + layout->node_height);
+
+    char row_text[BUFFER_SIZE * 2] = "";
+    snprintf(row_text, sizeof(row_text), "%p", (const void*)node);
+    printSvgText(svg_file, layout_node->x, top + SVG_ROW_HEIGHT / 2, row_text);
+    snprintf(row_text, sizeof(row_text), "Type: %s", nodeTypeToString(node->type));
+    printSvgText(svg_file, layout_node->x, top + 1.5 * SVG_ROW_HEIGHT, row_text);
+    snprintf(row_text, sizeof(row_text), "Value: %s", data);
+    printSvgText(svg_file, layout_node->x, top + 2.5 * SVG_ROW_HEIGHT, row_text);
+
+    double children_y = bottom_row + SVG_ROW_HEIGHT / 2;
+    const TreeNode* children[] = {node->left, node->right};
+    for (size_t child = 0; child < 2; child++) {
+        if (children[child] != NULL)
+            snprintf(row_text, sizeof(row_text), "%p", (const void*)children[child]);
+        else
+            snprintf(row_text, sizeof(row_text), "nil");
+        double x = layout_node->x + (child == 0 ? -layout_node->width / 4 : layout_node->width / 4);
+        printSvgText(svg_file, x, children_y, row_text);
+    }
+}
+
+
+static void printSvgText(FILE* svg_file, double x, double y, const char* text)
+{
+    assert(svg_file); assert(text);
+
+    fprintf(svg_file, "<text x=\"%.1f\" y=\"%.1f\" text-anchor=\"middle\" dominant-baseline=\"central\">", x, y);
+    for (const char* symbol = text; *symbol != '\0'; symbol++) {
+        switch (*symbol) {
+            case '<':  fputs("&lt;", svg_file); break;
+            case '>':  fputs("&gt;", svg_file); break;
+            case '&':  fputs("&amp;", svg_file); break;
+            default:   fputc(*symbol, svg_file); break;
+        }
+    }
+    fprintf(svg_file, "</text>\n");
+}
+
+
+static double getNodeY(const TreeLayout* layout, size_t v)
+{
+    assert(layout); assert(v < layout->count);
+
+    return SVG_MARGIN + (double)layout->nodes[v].depth * (layout->node_height + SVG_LEVEL_GAP);
+}
@@ -0,0 +1,311 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <assert.h>
+
+#include "server/server_protocol.h"
+
+#include "status.h"
+
+
+typedef struct {
+    const char* socket_path;
+    const char* expression;
+    const char* diff_var;
+    const char* order;
+    const char** points;
+    size_t point_count;
+    size_t request_count;
+    size_t connection_count;
+} ClientArgs;
+
+
+typedef struct {
+    const ClientArgs* args;
+    const char* request;
+    size_t request_length;
+    size_t request_count;
+    double* latencies;
+    size_t failed_count;
+} ClientConnection;
+
+
+static bool parseClientArgs(ClientArgs* args, const int argc, const char** argv);
+static char* buildRequest(const ClientArgs* args, size_t* length);
+static int connectToServer(const char* socket_path);
+
+static int sendSingleRequest(const ClientArgs* args, const char* request, size_t request_length);
+static int runLoad(const ClientArgs* args, const char* request, size_t request_length);
+static void* loadConnection(void* argument);
+static void printLoadReport(double* latencies, size_t count, size_t failed_count, double total_time);
+
+static int compareLatencies(const void* first, const void* second);
+static double getTime();
+
+
+int main(const int argc, const char** argv)
+{
+    ClientArgs args = {};
+    if (!parseClientArgs(&args, argc, argv)) {
+        fprintf(stderr, "Usage: %s --socket <path> --expression <expr> [--var <name>] [--order <n>]\n"
+            "\t[--point \"x=1, y=2\"]... [--requests <n>] [--connections <n>]\n", argv[0]);
+        free(args.points);
+        return 1;
+    }
+
+    size_t request_length = 0;
+    char* request = buildRequest(&args, &request_length);
+    int result = 1;
+    if (request != NULL) {
+        if (args.request_count > 1) {
+            result = runLoad(&args, request, request_length);
+        } else {
+            result = sendSingleRequest(&args, request, request_length);
+        }
+    }
+
+    free(request);
+    free(args.points);
+    return result;
+}
+
+
+static bool parseClientArgs(ClientArgs* args, const int argc, const char** argv)
+{
+    assert(args); assert(argv);
+
+    args->order = "1";
+    args->request_count = 1;
+    args->connection_count = 1;
+    args->points = (const char**)calloc((size_t)argc, sizeof(const char*));
+    if (args->points == NULL)
+        return false;
+
+    for (size_t index = 1; index + 1 < (size_t)argc; index += 2) {
+        const char* option = argv[index];
+        const char* value = argv[index + 1];
+        if (strcmp(option, "--socket") == 0) {
+            args->socket_path = value;
+        } else if (strcmp(option, "--expression") == 0) {
+            args->expression = value;
+        } else if (strcmp(option, "--var") == 0) {
+            args->diff_var = value;
+        } else if (strcmp(option, "--order") == 0) {
+            args->order = value;
+        } else if (strcmp(option, "--point") == 0) {
+            args->points[args->point_count++] = value;
+        } else if (strcmp(option, "--requests") == 0) {
+            args->request_count = strtoull(value, NULL, 10);
+        } else if (strcmp(option, "--connections") == 0) {
+            args->connection_count = strtoull(value, NULL, 10);
+        } else {
+            return false;
+        }
+    }
+
+    return argc % 2 == 1 && args->socket_path != NULL && args->expression != NULL &&
+           args->request_count != 0 && args->connection_count != 0;
+}
+
+
+static char* buildRequest(const ClientArgs* args, size_t* length)
+{
+    assert(args); assert(length);
+
+    char* request = NULL;
+    FILE* stream = open_memstream(&request, length);
+    if (stream == NULL)
+        return NULL;
+
+    fprintf(stream, "%s\n%s\n%s\n", args->expression, args->diff_var != NULL ? args->diff_var : "",
+        args->order);
+    for (size_t index = 0; index < args->point_count; index++)
+        fprintf(stream, "%s\n", args->points[index]);
+
+    fclose(stream);
+    return request;
+}
+
+
+static int connectToServer(const char* socket_path)
+{
+    assert(socket_path);
+
+    struct sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(address.sun_path))
+        return -1;
+    strcpy(address.sun_path, socket_path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd == -1)
+        return -1;
+    if (connect(fd, (struct sockaddr*)&address, sizeof(address)) == -1) {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+
+static int sendSingleRequest(const ClientArgs* args, const char* request, size_t request_length)
+{
+    assert(args); assert(request);
+
+    int fd = connectToServer(args->socket_path);
+    if (fd == -1) {
+        fprintf(stderr, "Failed to connect to %s\n", args->socket_path);
+        return 1;
+    }
+
+    char* response = NULL;
+    size_t capacity = 0;
+    size_t length = 0;
+    bool is_closed = false;
+    OperationStatus status = serverWriteFrame(fd, request, request_length);
+    if (status == STATUS_OK)
+        status = serverReadFrame(fd, &response, &capacity, &length, &is_closed);
+    close(fd);
+
+    int result = 1;
+    if (status == STATUS_OK && !is_closed) {
+        fwrite(response, 1, length, stdout);
+        result = 0;
+    } else {
+        fprintf(stderr, "Server did not answer the request\n");
+    }
+
+    free(response);
+    return result;
+}
+
+
+static int runLoad(const ClientArgs* args, const char* request, size_t request_length)
+{
+    assert(args); assert(request);
+
+    size_t connection_count = args->connection_count;
+    ClientConnection* connections = (ClientConnection*)calloc(connection_count, sizeof(ClientConnection));
+    pthread_t* threads = (pthread_t*)calloc(connection_count, sizeof(pthread_t));
+    double* latencies = (double*)calloc(args->request_count, sizeof(double));
+    if (connections == NULL || threads == NULL || latencies == NULL) {
+        free(connections);
+        free(threads);
+        free(latencies);
+        return 1;
+    }
+
+// Запросы делятся между соединениями поровну, каждое соединение шлет их последовательно
+    double* connection_latencies = latencies;
+    for (size_t index = 0; index < connection_count; index++) {
+        size_t count = args->request_count / connection_count + (index < args->request_count % connection_count ? 1 : 0);
+        connections[index] = (ClientConnection){args, request, request_length, count, connection_latencies, 0};
+        connection_latencies += count;
+    }
+
+    double start = getTime();
+    size_t started_count = 0;
+    for (size_t index = 0; index < connection_count; index++) {
+        if (pthread_create(&threads[index], NULL, loadConnection, &connections[index]) != 0)
+            break;
+        started_count++;
+    }
+
+    size_t failed_count = 0;
+    size_t finished_count = 0;
+    for (size_t index = 0; index < started_count; index++) {
+        pthread_join(threads[index], NULL);
+        failed_count += connections[index].failed_count;
+        finished_count += connections[index].request_count;
+    }
+    double total_time = getTime() - start;
+
+    printLoadReport(latencies, finished_count, failed_count, total_time);
+
+    free(connections);
+    free(threads);
+    free(latencies);
+    return failed_count == 0 && started_count == connection_count ? 0 : 1;
+}
+
+
+static void* loadConnection(void* argument)
+{
+    assert(argument);
+
+    ClientConnection* connection = (ClientConnection*)argument;
+    int fd = connectToServer(connection->args->socket_path);
+    if (fd == -1) {
+        connection->failed_count = connection->request_count;
+        return NULL;
+    }
+
+    char* response = NULL;
+    size_t capacity = 0;
+    for (size_t index = 0; index < connection->request_count; index++) {
+        double start = getTime();
+        size_t length = 0;
+        bool is_closed = false;
+        OperationStatus status = serverWriteFrame(fd, connection->request, connection->request_length);
+        if (status == STATUS_OK)
+            status = serverReadFrame(fd, &response, &capacity, &length, &is_closed);
+        connection->latencies[index] = getTime() - start;
+
+        if (status != STATUS_OK || is_closed) {
+            connection->failed_count += connection->request_count - index;
+            break;
+        }
+        if (strncmp(response, "error:", 6) == 0 || strstr(response, "\nerror:") != NULL)
+            connection->failed_count++;
+    }
+
+    free(response);
+    close(fd);
+    return NULL;
+}
+
+
+static void printLoadReport(double* latencies, size_t count, size_t failed_count, double total_time)
+{
+    assert(latencies);
+
+    qsort(latencies, count, sizeof(double), compareLatencies);
+
+    double sum = 0;
+    for (size_t index = 0; index < count; index++)
+        sum += latencies[index];
+
+    printf("requests:   %zu (%zu failed)\n", count, failed_count);
+    printf("total time: %.3f s\n", total_time);
+    printf("throughput: %.1f requests/s\n", total_time > 0 ? (double)count / total_time : 0);
+    if (count == 0)
+        return;
+
+    printf("latency:    mean %.3f ms, p50 %.3f ms, p90 %.3f ms, p99 %.3f ms, max %.3f ms\n",
+        sum / (double)count * 1000, latencies[count / 2] * 1000, latencies[count * 9 / 10] * 1000,
+        latencies[count * 99 / 100] * 1000, latencies[count - 1] * 1000);
+}
+
+
+static int compareLatencies(const void* first, const void* second)
+{
+    double first_value = *(const double*)first;
+    double second_value = *(const double*)second;
+
+    return (first_value > second_value) - (first_value < second_value);
+}
+
+
+static double getTime()
+{
+    struct timespec now = {};
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (double)now.tv_sec + (double)now.tv_nsec / 1e9;
+}
@@ -0,0 +1,302 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <signal.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <assert.h>
+
+#include "server/diff_server.h"
+#include "server/server_protocol.h"
+
+#include "diff/diff_defs.h"
+#include "diff/diff_request.h"
+
+#include "status.h"
+
+
+typedef struct {
+    const CmdArgs* args;
+    int listen_fd;
+    int* client_fds;
+    bool is_stopping;
+    pthread_mutex_t mutex;
+} ServerState;
+
+
+typedef struct {
+    ServerState* state;
+    size_t index;
+} ServerWorker;
+
+
+static OperationStatus openServerSocket(const char* socket_path, int* listen_fd);
+static void stopServer(ServerState* state, size_t worker_count);
+
+static void* serverWorker(void* argument);
+static bool registerClient(ServerState* state, size_t worker_idx, int client_fd);
+static void serveConnection(const CmdArgs* args, int client_fd);
+static OperationStatus handleRequest(const CmdArgs* args, char* frame, size_t length,
+    char** response, size_t* response_size);
+static bool parseOrder(const char* text, size_t* order);
+static char* takeLine(char** text, char* end);
+
+
+OperationStatus diffRunServer(const CmdArgs* args)
+{
+    assert(args); assert(args->socket_path);
+
+    ServerState state = {};
+    state.args = args;
+    OperationStatus status = openServerSocket(args->socket_path, &state.listen_fd);
+    RETURN_IF_STATUS_NOT_OK(status);
+
+    size_t worker_count = args->thread_count;
+    pthread_t* threads = (pthread_t*)calloc(worker_count, sizeof(pthread_t));
+    ServerWorker* workers = (ServerWorker*)calloc(worker_count, sizeof(ServerWorker));
+    state.client_fds = (int*)calloc(worker_count, sizeof(int));
+    if (threads == NULL || workers == NULL || state.client_fds == NULL) {
+        free(threads);
+        free(workers);
+        free(state.client_fds);
+        close(state.listen_fd);
+        unlink(args->socket_path);
+        return STATUS_SYSTEM_OUT_OF_MEMORY;
+    }
+    pthread_mutex_init(&state.mutex, NULL);
+
+// Сигналы остановки блокируются до запуска потоков, их принимает только sigwait
+    sigset_t stop_signals = {};
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGINT);
+    sigaddset(&stop_signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &stop_signals, NULL);
+
+    size_t started_count = 0;
+    for (size_t index = 0; index < worker_count; index++) {
+        state.client_fds[index] = -1;
+        workers[index] = (ServerWorker){&state, index};
+        if (pthread_create(&threads[started_count], NULL, serverWorker, &workers[index]) == 0)
+            started_count++;
+    }
+
+    if (started_count != 0) {
+        fprintf(stderr, "Serving on %s with %zu workers\n", args->socket_path, started_count);
+        int signal_number = 0;
+        sigwait(&stop_signals, &signal_number);
+    } else {
+        status = STATUS_SYSTEM_CALL_ERROR;
+    }
+
+    stopServer(&state, worker_count);
+    for (size_t index = 0; index < started_count; index++)
+        pthread_join(threads[index], NULL);
+
+    pthread_mutex_destroy(&state.mutex);
+    close(state.listen_fd);
+    unlink(args->socket_path);
+    free(state.client_fds);
+    free(workers);
+    free(threads);
+
+    return status;
+}
+
+
+static OperationStatus openServerSocket(const char* socket_path, int* listen_fd)
+{
+    assert(socket_path); assert(listen_fd);
+
+    struct sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(address.sun_path))
+        return STATUS_CLI_UNKNOWN_OPTION;
+    strcpy(address.sun_path, socket_path);
+
+    *listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (*listen_fd == -1)
+        return STATUS_SYSTEM_CALL_ERROR;
+
+    unlink(socket_path);
+    if (bind(*listen_fd, (struct sockaddr*)&address, sizeof(address)) == -1 ||
+        listen(*listen_fd, SOMAXCONN) == -1) {
+        close(*listen_fd);
+        return STATUS_SYSTEM_CALL_ERROR;
+    }
+
+    return STATUS_OK;
+}
+
+
+static void stopServer(ServerState* state, size_t worker_count)
+{
+    assert(state); assert(state->client_fds);
+
+// shutdown будит потоки, ждущие в accept и в чтении запросов открытых соединений
+    pthread_mutex_lock(&state->mutex);
+    state->is_stopping = true;
+    shutdown(state->listen_fd, SHUT_RDWR);
+    for (size_t index = 0; index < worker_count; index++) {
+        if (state->client_fds[index] != -1)
+            shutdown(state->client_fds[index], SHUT_RD);
+    }
+    pthread_mutex_unlock(&state->mutex);
+}
+
+
+static void* serverWorker(void* argument)
+{
+    assert(argument);
+
+    ServerWorker* worker = (ServerWorker*)argument;
+    ServerState* state = worker->state;
+    while (true) {
+        int client_fd = accept(state->listen_fd, NULL, NULL);
+        if (client_fd == -1) {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            break;
+        }
+
+        if (!registerClient(state, worker->index, client_fd)) {
+            close(client_fd);
+            break;
+        }
+        serveConnection(state->args, client_fd);
+        registerClient(state, worker->index, -1);
+        close(client_fd);
+    }
+
+    return NULL;
+}
+
+
+static bool registerClient(ServerState* state, size_t worker_idx, int client_fd)
+{
+    assert(state); assert(state->client_fds);
+
+    pthread_mutex_lock(&state->mutex);
+    bool is_stopping = state->is_stopping;
+    state->client_fds[worker_idx] = is_stopping ? -1 : client_fd;
+    pthread_mutex_unlock(&state->mutex);
+
+    return !is_stopping;
+}
+
+
+static void serveConnection(const CmdArgs* args, int client_fd)
+{
+    assert(args);
+
+    char* frame = NULL;
+    size_t capacity = 0;
+    while (true) {
+        size_t length = 0;
+        bool is_closed = false;
+        OperationStatus status = serverReadFrame(client_fd, &frame, &capacity, &length, &is_closed);
+        if (status != STATUS_OK || is_closed)
+            break;
+
+        char* response = NULL;
+        size_t response_size = 0;
+        status = handleRequest(args, frame, length, &response, &response_size);
+        if (status == STATUS_OK)
+            status = serverWriteFrame(client_fd, response, response_size);
+        free(response);
+
+        if (status != STATUS_OK)
+            break;
+    }
+
+    free(frame);
+}
+
+
+static OperationStatus handleRequest(const CmdArgs* args, char* frame, size_t length,
+    char** response, size_t* response_size)
+{
+    assert(args); assert(frame); assert(response); assert(response_size);
+
+    FILE* output = open_memstream(response, response_size);
+    if (output == NULL)
+        return STATUS_SYSTEM_OUT_OF_MEMORY;
+
+    struct timespec start = {};
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+// Строки запроса разбираются на месте: переводы строк заменяются нулями
+    char* end = frame + length;
+    char* text = frame;
+    char* expression = takeLine(&text, end);
+    char* diff_var = takeLine(&text, end);
+    char* order = takeLine(&text, end);
+
+    DiffRequest request = {expression, strlen(expression), NULL, args->derivative_info.order, NULL, 0};
+    if (diff_var != NULL && diff_var[0] != '\0')
+        request.diff_var = diff_var;
+    if (text != NULL && text != end) {
+        request.points = text;
+        request.points_length = (size_t)(end - text);
+    }
+
+    bool is_valid_order = order == NULL || order[0] == '\0' || parseOrder(order, &request.order);
+    if (!is_valid_order) {
+        fprintf(output, "error: [%s] %s\n", ErrorTable[STATUS_IO_INVALID_USER_INPUT].status_string,
+            ErrorTable[STATUS_IO_INVALID_USER_INPUT].error_message);
+    } else {
+        diffProcessRequest(args, &request, output);
+    }
+
+    struct timespec finish = {};
+    clock_gettime(CLOCK_MONOTONIC, &finish);
+    fprintf(output, "time: %.3f ms\n", (double)(finish.tv_sec - start.tv_sec) * 1000 +
+        (double)(finish.tv_nsec - start.tv_nsec) / 1e6);
+
+    if (fclose(output) != 0)
+        return STATUS_SYSTEM_OUT_OF_MEMORY;
+
+    return STATUS_OK;
+}
+
+
+static bool parseOrder(const char* text, size_t* order)
+{
+    assert(text); assert(order);
+
+// strtoull принимает знак и пробелы, поэтому строка сначала проверяется на одни цифры
+    if (text[0] < '0' || text[0] > '9')
+        return false;
+
+    char* text_end = NULL;
+    errno = 0;
+    unsigned long long value = strtoull(text, &text_end, 10);
+    if (*text_end != '\0' || errno == ERANGE || value > SERVER_MAX_ORDER)
+        return false;
+
+    *order = (size_t)value;
+    return true;
+}
+
+
+static char* takeLine(char** text, char* end)
+{
+    assert(text); assert(end);
+
+    char* line = *text;
+    if (line == NULL)
+        return NULL;
+
+    char* newline = (char*)memchr(line, '\n', (size_t)(end - line));
+    if (newline == NULL) {
+        *text = NULL;
+        return line;
+    }
+
+    *newline = '\0';
+    *text = newline + 1;
+    return line;
+}
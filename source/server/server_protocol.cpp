@@ -0,0 +1,109 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <assert.h>
+
+#include "server/server_protocol.h"
+
+#include "status.h"
+
+
+static OperationStatus readAll(int fd, void* data, size_t size, bool* is_closed);
+static OperationStatus writeAll(int fd, const void* data, size_t size);
+
+
+OperationStatus serverReadFrame(int fd, char** buffer, size_t* capacity, size_t* length, bool* is_closed)
+{
+    assert(buffer); assert(capacity); assert(length); assert(is_closed);
+
+    uint32_t network_length = 0;
+    OperationStatus status = readAll(fd, &network_length, sizeof(network_length), is_closed);
+    if (status != STATUS_OK || *is_closed)
+        return status;
+
+    uint32_t frame_length = ntohl(network_length);
+    if (frame_length > SERVER_MAX_FRAME_SIZE)
+        return STATUS_IO_INVALID_USER_INPUT;
+
+// Нагрузка дополняется нулем, чтобы ее строки можно было разбирать на месте
+    if (*capacity < (size_t)frame_length + 1) {
+        char* temp_ptr = (char*)realloc(*buffer, (size_t)frame_length + 1);
+        if (temp_ptr == NULL)
+            return STATUS_SYSTEM_OUT_OF_MEMORY;
+        *buffer = temp_ptr;
+        *capacity = (size_t)frame_length + 1;
+    }
+
+    status = readAll(fd, *buffer, frame_length, is_closed);
+    RETURN_IF_STATUS_NOT_OK(status);
+    if (*is_closed && frame_length != 0)
+        return STATUS_IO_FILE_READ_ERROR;
+
+    (*buffer)[frame_length] = '\0';
+    *length = frame_length;
+
+    return STATUS_OK;
+}
+
+
+OperationStatus serverWriteFrame(int fd, const char* data, size_t length)
+{
+    assert(data);
+
+    if (length > SERVER_MAX_FRAME_SIZE)
+        return STATUS_IO_INVALID_USER_INPUT;
+
+    uint32_t network_length = htonl((uint32_t)length);
+    OperationStatus status = writeAll(fd, &network_length, sizeof(network_length));
+    RETURN_IF_STATUS_NOT_OK(status);
+
+    return writeAll(fd, data, length);
+}
+
+
+static OperationStatus readAll(int fd, void* data, size_t size, bool* is_closed)
+{
+    assert(data); assert(is_closed);
+
+    *is_closed = false;
+    size_t received = 0;
+    while (received < size) {
+        ssize_t result = read(fd, (char*)data + received, size - received);
+        if (result == 0) {
+            if (received != 0)
+                return STATUS_IO_FILE_READ_ERROR;
+            *is_closed = true;
+            return STATUS_OK;
+        }
+        if (result < 0) {
+            if (errno == EINTR)
+                continue;
+            return STATUS_IO_FILE_READ_ERROR;
+        }
+        received += (size_t)result;
+    }
+
+    return STATUS_OK;
+}
+
+
+static OperationStatus writeAll(int fd, const void* data, size_t size)
+{
+    assert(data);
+
+    size_t sent = 0;
+    while (sent < size) {
+        ssize_t result = send(fd, (const char*)data + sent, size - sent, MSG_NOSIGNAL);
+        if (result < 0) {
+            if (errno == EINTR)
+                continue;
+            return STATUS_IO_FILE_WRITE_ERROR;
+        }
+        sent += (size_t)result;
+    }
+
+    return STATUS_OK;
+}
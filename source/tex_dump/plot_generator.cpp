@@ -3,8 +3,12 @@
 #include <math.h>
 #include <assert.h>
 #include <stdarg.h>
+#include <string.h>
+#include <pthread.h>
 
 #include "tex_dump/plot_generator.h"
+#include "tex_dump/render_jobs.h"
+#include "tex_dump/render_cache.h"
 
 #include "diff/diff_defs.h"
 #include "diff/diff_evaluate.h"
@@ -15,29 +19,103 @@
 
 const char* GNUPLOT_OUTPUT_FILENAME =  "plot_output";
 const char* GNUPLOT_IMAGES_DIRECTORY = "tex/images";
-const char* GNUPLOT_DATA_FILENAME =    "plot_data";
-const char* GNUPLOT_SCRIPT_FILENAME =  "plot_script";
 
 
-double GNUPLOT_SHIFT = 0.001;
+// Начальная сетка, после которой интервалы делятся пополам, пока хорда заметно отклоняется от функции
+const size_t PLOT_INITIAL_INTERVALS = 128;
+const size_t PLOT_MAX_DEPTH = 16;
+const size_t PLOT_MAX_POINTS = 4096;
+// Допуски задаются в долях высоты графика
+const double PLOT_TOLERANCE = 0.001;
+const double PLOT_JUMP_FRACTION = 0.05;
+// Размер страницы pdfcairo; в один столбец пикселей попадает не больше двух точек
+const double PLOT_WIDTH_INCHES = 5;
+const double PLOT_HEIGHT_INCHES = 3;
+const size_t PLOT_DPI = 300;
+const size_t PLOT_CACHE_CAPACITY = 32;
 
 
-static OperationStatus processPlotting(Differentiator* diff, const char* output_filename,
-    size_t* tree_indexes, size_t tree_count);
+typedef struct {
+    double* points;
+    size_t count;
+} PlotData;
 
-static OperationStatus generatePlotData(Differentiator* diff, size_t tree_idx);
 
-static OperationStatus generatePlotScript(Differentiator* diff, const char* output_filename,
-    const char* script_filename, size_t* tree_indexes, size_t tree_count);
-static void printScriptInfo(Differentiator* diff, const char* output_filename,
-    FILE* script_file, size_t* tree_indexes, size_t tree_count);
+typedef struct {
+    double x;
+    double y;
+} PlotPoint;
+
+
+typedef struct {
+    Differentiator* diff;
+    const TreeNode* root;
+    double tolerance;
+    double jump;
+    bool* is_active;
+} PlotSampler;
+
 
-static OperationStatus finishPlotting(const char* script_filename);
+typedef struct {
+    size_t index;
+    size_t count;
+    PlotPoint min;
+    PlotPoint max;
+} PlotColumn;
 
-static OperationStatus deleteScriptFile(const char* script_filename);
-static OperationStatus deleteDataFile(size_t tree_idx);
 
-static void createDirectory(const char* directory);
+// Точки одного и того же дерева переиспользуются, пока не изменились его версия, окно и переменные
+typedef struct {
+    size_t tree_idx;
+    size_t version;
+    size_t var_idx;
+    PlotRange range;
+    double* values;
+    size_t value_count;
+    PlotData data;
+} PlotCacheEntry;
+
+
+static pthread_mutex_t plot_cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+static PlotCacheEntry plot_cache[PLOT_CACHE_CAPACITY] = {};
+static size_t plot_cache_next = 0;
+
+
+// Один gnuplot на весь запуск: графики всех порядков и разложения идут в него по очереди
+static pthread_mutex_t gnuplot_mutex = PTHREAD_MUTEX_INITIALIZER;
+static RenderCoprocess gnuplot = {-1, NULL};
+static bool is_gnuplot_failed = false;
+// Файлы, отправленные в gnuplot, попадают в кэш только после его завершения, когда PDF дописаны
+static RenderArtifact* pending_artifacts = NULL;
+static size_t pending_count = 0;
+static size_t pending_capacity = 0;
+
+
+static OperationStatus processPlotting(Differentiator* diff, const char* output_filename,
+    size_t* tree_indexes, size_t tree_count);
+
+static OperationStatus generatePlotData(Differentiator* diff, size_t tree_idx, PlotData* data);
+static OperationStatus refinePlotData(PlotSampler* sampler, PlotData* data, size_t active_count);
+static OperationStatus breakDiscontinuities(PlotSampler* sampler, PlotData* data, size_t active_count);
+static bool isIntervalRefinable(const PlotSampler* sampler, double left, double middle, double right);
+static double samplePlotValue(PlotSampler* sampler, double x);
+static void decimatePlotData(const PlotRange* range, PlotData* data);
+static bool loadCachedPlotData(Differentiator* diff, size_t tree_idx, PlotData* data);
+static void storeCachedPlotData(Differentiator* diff, size_t tree_idx, const PlotData* data);
+static bool isPlotCacheHit(const PlotCacheEntry* entry, const Differentiator* diff, size_t tree_idx);
+static void destroyPlotCacheEntry(PlotCacheEntry* entry);
+static size_t flushColumn(double* points, size_t position, const PlotColumn* column);
+static OperationStatus sendPlot(Differentiator* diff, const char* output_filename,
+    size_t* tree_indexes, size_t tree_count, const PlotData* data);
+static OperationStatus writeGnuplotCommands(const char* commands, size_t size,
+    const char* output_filename, const RenderArtifact* artifact);
+static OperationStatus startGnuplot();
+static void addPendingArtifact(const RenderArtifact* artifact);
+
+static void printScriptInfo(Differentiator* diff, const char* output_filename,
+    FILE* script_file, size_t* tree_indexes, size_t tree_count, const PlotData* data, PlotPoint* center);
+static void writePlotData(FILE* script_file, size_t* tree_indexes, size_t tree_count,
+    const PlotData* data, const PlotPoint* center, size_t taylor_idx);
 
 
 OperationStatus generatePlot(Differentiator* diff, const char* output_filename, size_t tree_count, ...)
@@ -45,7 +123,7 @@ OperationStatus generatePlot(Differentiator* diff, const char* output_filename,
     assert(diff); assert(diff->var_table.variables); assert(diff->forest.trees);
     assert(output_filename);
 
-    createDirectory(GNUPLOT_IMAGES_DIRECTORY);
+    makeDirectory(GNUPLOT_IMAGES_DIRECTORY);
     size_t* tree_indexes = (size_t*)calloc(tree_count, sizeof(size_t));
     if (tree_indexes == NULL) {
         return STATUS_SYSTEM_OUT_OF_MEMORY;
@@ -65,101 +143,502 @@ OperationStatus generatePlot(Differentiator* diff, const char* output_filename,
 }
 
 
+OperationStatus finishPlotting()
+{
+    pthread_mutex_lock(&gnuplot_mutex);
+    OperationStatus status = is_gnuplot_failed ? STATUS_SYSTEM_CALL_ERROR : STATUS_OK;
+    if (gnuplot.input != NULL) {
+        OperationStatus finish_status = renderCoprocessFinish(&gnuplot);
+        if (status == STATUS_OK)
+            status = finish_status;
+    }
+    for (size_t index = 0; index < pending_count && status == STATUS_OK; index++)
+        renderCacheStore(&pending_artifacts[index]);
+    free(pending_artifacts);
+    pending_artifacts = NULL;
+    pending_count = 0;
+    pending_capacity = 0;
+    is_gnuplot_failed = false;
+    pthread_mutex_unlock(&gnuplot_mutex);
+
+    pthread_mutex_lock(&plot_cache_mutex);
+    for (size_t index = 0; index < PLOT_CACHE_CAPACITY; index++)
+        destroyPlotCacheEntry(&plot_cache[index]);
+    plot_cache_next = 0;
+    pthread_mutex_unlock(&plot_cache_mutex);
+
+    return status;
+}
+
+
 static OperationStatus processPlotting(Differentiator* diff, const char* output_filename,
     size_t* tree_indexes, size_t tree_count)
 {
     assert(diff); assert(diff->forest.trees); assert(output_filename); assert(tree_indexes); 
 
-    static size_t script_counter = 0;
+    PlotData* data = (PlotData*)calloc(tree_count, sizeof(PlotData));
+    if (data == NULL) {
+        return STATUS_SYSTEM_OUT_OF_MEMORY;
+    }
+
+// Точки считаются до захвата gnuplot, чтобы вычисления не ждали чужой отрисовки
     OperationStatus status = STATUS_OK;
+    for (size_t index = 0; index < tree_count && status == STATUS_OK; index++) {
+        if (loadCachedPlotData(diff, tree_indexes[index], &data[index]))
+            continue;
 
-    for (size_t index = 0; index < tree_count; index++) {
-        status = generatePlotData(diff, tree_indexes[index]);
-        if (status != STATUS_OK) {
-            break;
+        status = generatePlotData(diff, tree_indexes[index], &data[index]);
+        if (status == STATUS_OK) {
+            decimatePlotData(&diff->tex_dump.range, &data[index]);
+            storeCachedPlotData(diff, tree_indexes[index], &data[index]);
         }
     }
 
     if (status == STATUS_OK) {
-        char script_filename[BUFFER_SIZE * 2] = "";
-        snprintf(script_filename, BUFFER_SIZE * 2, "%s/%s_%03zu",
-            GNUPLOT_IMAGES_DIRECTORY, GNUPLOT_SCRIPT_FILENAME, script_counter);
-        script_counter++;
+        status = sendPlot(diff, output_filename, tree_indexes, tree_count, data);
+    }
 
-        status = generatePlotScript(diff, output_filename, script_filename, tree_indexes, tree_count);
-        if (status == STATUS_OK) {
-            status = finishPlotting(script_filename);
-        }
+    for (size_t index = 0; index < tree_count; index++) {
+        free(data[index].points);
+    }
+    free(data);
 
-        deleteScriptFile(script_filename);
+    return status;
+}
+
+
+static OperationStatus generatePlotData(Differentiator* diff, size_t tree_idx, PlotData* data)
+{
+    assert(diff); assert(diff->forest.trees); assert(data);
+
+    const PlotRange* range = &diff->tex_dump.range;
+    double height = range->y_max - range->y_min;
+    PlotSampler sampler = {diff, diff->forest.trees[tree_idx].root,
+        height * PLOT_TOLERANCE, height * PLOT_JUMP_FRACTION, NULL};
+
+    size_t count = PLOT_INITIAL_INTERVALS + 1;
+    data->points = (double*)calloc(2 * count, sizeof(double));
+    sampler.is_active = (bool*)calloc(count, sizeof(bool));
+    if (data->points == NULL || sampler.is_active == NULL) {
+        free(sampler.is_active);
+        return STATUS_SYSTEM_OUT_OF_MEMORY;
     }
 
-    for (size_t index = 0; index < tree_count; index++) {
-        deleteDataFile(tree_indexes[index]);
+    double step = (range->x_max - range->x_min) / (double)PLOT_INITIAL_INTERVALS;
+    for (size_t index = 0; index < count; index++) {
+        double x = range->x_min + step * (double)index;
+        data->points[2 * index] = x;
+        data->points[2 * index + 1] = samplePlotValue(&sampler, x);
+        sampler.is_active[index] = index + 1 < count;
     }
+    data->count = count;
 
+// На каждом проходе делятся все еще не сошедшиеся интервалы, поэтому они всегда одной ширины
+    OperationStatus status = STATUS_OK;
+    size_t depth = 0;
+    size_t active_count = PLOT_INITIAL_INTERVALS;
+    while (status == STATUS_OK && active_count > 0 && depth < PLOT_MAX_DEPTH &&
+           data->count + active_count <= PLOT_MAX_POINTS) {
+        status = refinePlotData(&sampler, data, active_count);
+
+        active_count = 0;
+        for (size_t index = 0; index + 1 < data->count; index++)
+            active_count += sampler.is_active[index];
+        depth++;
+    }
+
+// Скачок, не сошедшийся до минимальной ширины, считается разрывом и не соединяется линией
+    if (status == STATUS_OK && depth == PLOT_MAX_DEPTH && active_count > 0)
+        status = breakDiscontinuities(&sampler, data, active_count);
+
+    free(sampler.is_active);
     return status;
 }
 
 
-static OperationStatus generatePlotData(Differentiator* diff, size_t tree_idx)
+static OperationStatus refinePlotData(PlotSampler* sampler, PlotData* data, size_t active_count)
 {
-    assert(diff); assert(diff->forest.trees);
+    assert(sampler); assert(sampler->is_active); assert(data); assert(data->points);
+
+    size_t count = data->count + active_count;
+    double* points = (double*)calloc(2 * count, sizeof(double));
+    bool* is_active = (bool*)calloc(count, sizeof(bool));
+    if (points == NULL || is_active == NULL) {
+        free(points);
+        free(is_active);
+        return STATUS_SYSTEM_OUT_OF_MEMORY;
+    }
+
+    size_t position = 0;
+    for (size_t index = 0; index < data->count; index++) {
+        double x = data->points[2 * index];
+        double y = data->points[2 * index + 1];
+        points[2 * position] = x;
+        points[2 * position + 1] = y;
+        position++;
+        if (!sampler->is_active[index])
+            continue;
+
+        double next_x = data->points[2 * index + 2];
+        double next_y = data->points[2 * index + 3];
+        double middle_x = (x + next_x) / 2;
+        double middle_y = samplePlotValue(sampler, middle_x);
+        bool is_refinable = isIntervalRefinable(sampler, y, middle_y, next_y);
+
+        is_active[position - 1] = is_refinable;
+        is_active[position] = is_refinable;
+        points[2 * position] = middle_x;
+        points[2 * position + 1] = middle_y;
+        position++;
+    }
+
+    free(data->points);
+    free(sampler->is_active);
+    data->points = points;
+    data->count = count;
+    sampler->is_active = is_active;
+
+    return STATUS_OK;
+}
+
 
-    char data_filename[BUFFER_SIZE * 2] = "";
-    snprintf(data_filename, BUFFER_SIZE * 2, "%s/%s_%03zu", GNUPLOT_IMAGES_DIRECTORY,
-        GNUPLOT_DATA_FILENAME, tree_idx);
+static OperationStatus breakDiscontinuities(PlotSampler* sampler, PlotData* data, size_t active_count)
+{
+    assert(sampler); assert(sampler->is_active); assert(data); assert(data->points);
 
-    FILE* data_file = fopen(data_filename, "w");
-    if (data_file == NULL) {
-        return STATUS_IO_FILE_OPEN_ERROR;
+    double* points = (double*)calloc(2 * (data->count + active_count), sizeof(double));
+    if (points == NULL) {
+        return STATUS_SYSTEM_OUT_OF_MEMORY;
     }
 
-    for (double x = diff->tex_dump.range.x_min; x <= diff->tex_dump.range.x_max; x += GNUPLOT_SHIFT) {
-        setVariableValue(diff, diff->args.derivative_info.diff_var_idx, x);
-        double y = evaluateNode(diff, diff->forest.trees[tree_idx].root);
-        if (!isnan(y)) {
-            fprintf(data_file, "%f %f\n", x, y);
-        } else {
-            fprintf(data_file, "\n");
+    size_t position = 0;
+    for (size_t index = 0; index < data->count; index++) {
+        points[2 * position] = data->points[2 * index];
+        points[2 * position + 1] = data->points[2 * index + 1];
+        position++;
+        if (!sampler->is_active[index])
+            continue;
+
+        double y = data->points[2 * index + 1];
+        double next_y = data->points[2 * index + 3];
+        if (!isnan(y) && !isnan(next_y) && fabs(next_y - y) > sampler->jump) {
+            points[2 * position] = (data->points[2 * index] + data->points[2 * index + 2]) / 2;
+            points[2 * position + 1] = NAN;
+            position++;
         }
     }
 
-    if (fclose(data_file) != 0) {
-        return STATUS_IO_FILE_CLOSE_ERROR;
-    }
+    free(data->points);
+    data->points = points;
+    data->count = position;
+
     return STATUS_OK;
 }
 
 
-static OperationStatus generatePlotScript(Differentiator* diff, const char* output_filename,
-    const char* script_filename, size_t* tree_indexes, size_t tree_count)
+static bool isIntervalRefinable(const PlotSampler* sampler, double left, double middle, double right)
+{
+    assert(sampler);
+
+// Граница области определения уточняется всегда, полностью неопределенный интервал — никогда
+    size_t nan_count = (size_t)isnan(left) + (size_t)isnan(middle) + (size_t)isnan(right);
+    if (nan_count > 0)
+        return nan_count < 3;
+
+// Участок целиком за одной границей окна все равно не виден
+    const PlotRange* range = &sampler->diff->tex_dump.range;
+    if ((left > range->y_max && middle > range->y_max && right > range->y_max) ||
+        (left < range->y_min && middle < range->y_min && right < range->y_min))
+        return false;
+
+    return fabs(middle - (left + right) / 2) > sampler->tolerance;
+}
+
+
+static double samplePlotValue(PlotSampler* sampler, double x)
+{
+    assert(sampler); assert(sampler->root);
+
+// Бесконечность рисуется так же, как неопределенная точка
+    setVariableValue(sampler->diff, sampler->diff->args.derivative_info.diff_var_idx, x);
+    double value = evaluateNode(sampler->diff, sampler->root);
+
+    return isfinite(value) ? value : NAN;
+}
+
+
+static void decimatePlotData(const PlotRange* range, PlotData* data)
 {
-    assert(diff); assert(diff->forest.trees); assert(output_filename);
-    assert(script_filename); assert(tree_indexes); 
+    assert(range); assert(data); assert(data->points);
+
+    double width = range->x_max - range->x_min;
+    if (!(width > 0))
+        return;
+
+// От каждого столбца остаются минимум и максимум, поэтому прореживание можно делать на месте
+    size_t column_count = (size_t)(PLOT_WIDTH_INCHES * (double)PLOT_DPI);
+    double* points = data->points;
+    PlotColumn column = {};
+    size_t position = 0;
+    for (size_t index = 0; index < data->count; index++) {
+        PlotPoint point = {points[2 * index], points[2 * index + 1]};
+        if (isnan(point.y)) {
+            position = flushColumn(points, position, &column);
+            column.count = 0;
+            if (position == 0 || !isnan(points[2 * position - 1])) {
+                points[2 * position] = point.x;
+                points[2 * position + 1] = NAN;
+                position++;
+            }
+            continue;
+        }
+
+        double offset = (point.x - range->x_min) / width * (double)column_count;
+        size_t column_idx = offset <= 0 ? 0 : (size_t)offset;
+        if (column_idx >= column_count)
+            column_idx = column_count - 1;
 
-    FILE* script_file = fopen(script_filename, "w");
-    if (script_file == NULL) {
-        return STATUS_IO_FILE_OPEN_ERROR;
+        if (column.count > 0 && column.index != column_idx) {
+            position = flushColumn(points, position, &column);
+            column.count = 0;
+        }
+        if (column.count == 0) {
+            column.index = column_idx;
+            column.min = point;
+            column.max = point;
+        } else if (point.y < column.min.y) {
+            column.min = point;
+        } else if (point.y > column.max.y) {
+            column.max = point;
+        }
+        column.count++;
     }
 
-    printScriptInfo(diff, output_filename, script_file, tree_indexes, tree_count);
+    data->count = flushColumn(points, position, &column);
+}
+
+
+static size_t flushColumn(double* points, size_t position, const PlotColumn* column)
+{
+    assert(points); assert(column);
+
+    if (column->count == 0)
+        return position;
 
-    if (fclose(script_file) != 0) { 
-        return STATUS_IO_FILE_CLOSE_ERROR;
+    const PlotPoint* first = column->min.x <= column->max.x ? &column->min : &column->max;
+    const PlotPoint* second = first == &column->min ? &column->max : &column->min;
+    points[2 * position] = first->x;
+    points[2 * position + 1] = first->y;
+    position++;
+
+    if (second->x > first->x) {
+        points[2 * position] = second->x;
+        points[2 * position + 1] = second->y;
+        position++;
     }
-    return STATUS_OK;
+
+    return position;
+}
+
+
+static bool loadCachedPlotData(Differentiator* diff, size_t tree_idx, PlotData* data)
+{
+    assert(diff); assert(diff->forest.trees); assert(data);
+
+    bool is_found = false;
+    pthread_mutex_lock(&plot_cache_mutex);
+    for (size_t index = 0; index < PLOT_CACHE_CAPACITY && !is_found; index++) {
+        const PlotCacheEntry* entry = &plot_cache[index];
+        if (!isPlotCacheHit(entry, diff, tree_idx))
+            continue;
+
+        data->points = (double*)calloc(2 * entry->data.count, sizeof(double));
+        if (data->points != NULL) {
+            memcpy(data->points, entry->data.points, 2 * entry->data.count * sizeof(double));
+            data->count = entry->data.count;
+            is_found = true;
+        }
+        break;
+    }
+    pthread_mutex_unlock(&plot_cache_mutex);
+
+    return is_found;
+}
+
+
+static void storeCachedPlotData(Differentiator* diff, size_t tree_idx, const PlotData* data)
+{
+    assert(diff); assert(diff->forest.trees); assert(data); assert(data->points);
+
+    size_t version = diff->forest.trees[tree_idx].version;
+    if (version == 0)
+        return;
+
+    size_t value_count = diff->var_table.count;
+    PlotCacheEntry entry = {tree_idx, version, diff->args.derivative_info.diff_var_idx,
+        diff->tex_dump.range, NULL, value_count, {NULL, data->count}};
+    entry.values = (double*)calloc(value_count != 0 ? value_count : 1, sizeof(double));
+    entry.data.points = (double*)calloc(2 * data->count, sizeof(double));
+    if (entry.values == NULL || entry.data.points == NULL) {
+        destroyPlotCacheEntry(&entry);
+        return;
+    }
+
+// Значение переменной дифференцирования при построении не важно, поэтому оно не запоминается
+    for (size_t index = 0; index < value_count; index++) {
+        if (index != entry.var_idx)
+            entry.values[index] = diff->var_table.variables[index].value;
+    }
+    memcpy(entry.data.points, data->points, 2 * data->count * sizeof(double));
+
+    pthread_mutex_lock(&plot_cache_mutex);
+    destroyPlotCacheEntry(&plot_cache[plot_cache_next]);
+    plot_cache[plot_cache_next] = entry;
+    plot_cache_next = (plot_cache_next + 1) % PLOT_CACHE_CAPACITY;
+    pthread_mutex_unlock(&plot_cache_mutex);
+}
+
+
+static bool isPlotCacheHit(const PlotCacheEntry* entry, const Differentiator* diff, size_t tree_idx)
+{
+    assert(entry); assert(diff);
+
+    if (entry->data.points == NULL || entry->tree_idx != tree_idx ||
+        entry->version != diff->forest.trees[tree_idx].version ||
+        entry->var_idx != diff->args.derivative_info.diff_var_idx ||
+        entry->value_count != diff->var_table.count ||
+        memcmp(&entry->range, &diff->tex_dump.range, sizeof(PlotRange)) != 0)
+        return false;
+
+    for (size_t index = 0; index < entry->value_count; index++) {
+        if (index != entry->var_idx &&
+            memcmp(&entry->values[index], &diff->var_table.variables[index].value, sizeof(double)) != 0)
+            return false;
+    }
+
+    return true;
+}
+
+
+static void destroyPlotCacheEntry(PlotCacheEntry* entry)
+{
+    assert(entry);
+
+    free(entry->values);
+    free(entry->data.points);
+    entry->values = NULL;
+    entry->data.points = NULL;
+    entry->data.count = 0;
+}
+
+
+static OperationStatus sendPlot(Differentiator* diff, const char* output_filename,
+    size_t* tree_indexes, size_t tree_count, const PlotData* data)
+{
+    assert(diff); assert(output_filename); assert(tree_indexes); assert(data);
+
+// Команды собираются в памяти целиком: их хеш и есть ключ готового PDF в кэше
+    char* commands = NULL;
+    size_t size = 0;
+    FILE* stream = open_memstream(&commands, &size);
+    if (stream == NULL) {
+        return STATUS_SYSTEM_OUT_OF_MEMORY;
+    }
+
+    PlotPoint center = {};
+    printScriptInfo(diff, output_filename, stream, tree_indexes, tree_count, data, &center);
+    writePlotData(stream, tree_indexes, tree_count, data, &center, diff->forest.count);
+    fprintf(stream, "unset output\n");
+    if (fclose(stream) != 0) {
+        free(commands);
+        return STATUS_SYSTEM_OUT_OF_MEMORY;
+    }
+
+    RenderArtifact artifact = {};
+    renderCacheKeyInit(&artifact);
+    renderCacheKeyAdd(&artifact, commands, size);
+    snprintf(artifact.path, sizeof(artifact.path), "%s.pdf", output_filename);
+
+    OperationStatus status = STATUS_OK;
+    if (!renderCacheFetch(&artifact)) {
+        status = writeGnuplotCommands(commands, size, output_filename, &artifact);
+    }
+    free(commands);
+
+    return status;
+}
+
+
+static OperationStatus writeGnuplotCommands(const char* commands, size_t size,
+    const char* output_filename, const RenderArtifact* artifact)
+{
+    assert(commands); assert(output_filename); assert(artifact);
+
+    pthread_mutex_lock(&gnuplot_mutex);
+    OperationStatus status = startGnuplot();
+    if (status == STATUS_OK) {
+        fwrite(commands, sizeof(char), size, gnuplot.input);
+
+        if (fflush(gnuplot.input) != 0 || ferror(gnuplot.input)) {
+            fprintf(stderr, "Gnuplot error with file '%s'!\n", output_filename);
+            is_gnuplot_failed = true;
+            status = STATUS_SYSTEM_CALL_ERROR;
+        } else if (renderCacheIsEnabled()) {
+            addPendingArtifact(artifact);
+        }
+    }
+    pthread_mutex_unlock(&gnuplot_mutex);
+
+    return status;
+}
+
+
+static OperationStatus startGnuplot()
+{
+    if (gnuplot.input != NULL) {
+        return STATUS_OK;
+    }
+    if (is_gnuplot_failed) {
+        return STATUS_SYSTEM_CALL_ERROR;
+    }
+
+    const char* argv[] = {"gnuplot", NULL};
+    OperationStatus status = renderCoprocessStart(argv, &gnuplot);
+    if (status != STATUS_OK) {
+        is_gnuplot_failed = true;
+    }
+
+    return status;
+}
+
+
+static void addPendingArtifact(const RenderArtifact* artifact)
+{
+    assert(artifact);
+
+// Не попавший в список файл просто не будет закэширован
+    if (pending_count == pending_capacity) {
+        size_t capacity = pending_capacity != 0 ? 2 * pending_capacity : START_ELEMENT_COUNT;
+        void* temp_ptr = realloc(pending_artifacts, capacity * sizeof(RenderArtifact));
+        if (temp_ptr == NULL)
+            return;
+
+        pending_artifacts = (RenderArtifact*)temp_ptr;
+        pending_capacity = capacity;
+    }
+
+    pending_artifacts[pending_count++] = *artifact;
 }
 
 
 static void printScriptInfo(Differentiator* diff, const char* output_filename,
-    FILE* script_file, size_t* tree_indexes, size_t tree_count)
+    FILE* script_file, size_t* tree_indexes, size_t tree_count, const PlotData* data, PlotPoint* center)
 {
     assert(diff); assert(diff->forest.trees); assert(output_filename); 
-    assert(script_file); assert(tree_indexes); 
+    assert(script_file); assert(tree_indexes); assert(data); assert(center);
 
     fprintf(script_file, 
-        "set terminal pdfcairo enhanced font 'Helvetica,12'\n"
+        "set terminal pdfcairo enhanced font 'Helvetica,12' size %gin,%gin\n"
         "set output '%s.pdf'\n"
         "set xlabel 'X Axis'\n"
         "set xrange [%g:%g]\n"
@@ -167,18 +646,14 @@ static void printScriptInfo(Differentiator* diff, const char* output_filename,
         "set yrange [%g:%g]\n"
         "set border 3\n"
         "set tics out\n"
-        "set grid xtics ytics ls 1 lc 'gray' dt 3\n", output_filename,
+        "set grid xtics ytics ls 1 lc 'gray' dt 3\n",
+        PLOT_WIDTH_INCHES, PLOT_HEIGHT_INCHES, output_filename,
         diff->tex_dump.range.x_min, diff->tex_dump.range.x_max,
         diff->tex_dump.range.y_min, diff->tex_dump.range.y_max);
 
     for (size_t index = 0; index < tree_count; index++) {
-        if (index == 0) {
-            fprintf(script_file, "plot '%s/%s_%03zu' using 1:2 with lines",
-                GNUPLOT_IMAGES_DIRECTORY, GNUPLOT_DATA_FILENAME, tree_indexes[0]);
-        } else {
-            fprintf(script_file, ", '%s/%s_%03zu' using 1:2 with lines",
-                GNUPLOT_IMAGES_DIRECTORY, GNUPLOT_DATA_FILENAME, tree_indexes[index]);
-        }
+        fprintf(script_file, "%s '-' binary record=(%zu) format='%%float64%%float64' using 1:2 with lines",
+            index == 0 ? "plot" : ",", data[index].count);
 
         if (tree_indexes[index] == 0) {
             fprintf(script_file, " title 'Функция'");
@@ -190,9 +665,11 @@ static void printScriptInfo(Differentiator* diff, const char* output_filename,
             double y = evaluateNode(diff, diff->forest.trees[tree_indexes[index]].root);
 
             double slope = evaluateNode(diff, diff->forest.trees[1].root);
+            center->x = x;
+            center->y = y;
             fprintf(script_file, 
-                ", \\\n    \"\" using (%lf):(%lf) with points pt 3 ps 0.8 lc 'red' "
-                "title 'Центр разложения'", x, y);
+                ", \\\n    '-' binary record=(1) format='%%float64%%float64' using 1:2 "
+                "with points pt 3 ps 0.8 lc 'red' title 'Центр разложения'");
 
             fprintf(script_file, ", \\\n %lf * (x - %lf) + %lf with lines dt 3 "
                 "lc 'black' title 'Касательная'", slope, x, y);
@@ -201,64 +678,21 @@ static void printScriptInfo(Differentiator* diff, const char* output_filename,
         }
     }
 
-    fprintf(script_file, "\nquit\n");
+    fprintf(script_file, "\n");
 }
 
 
-static OperationStatus finishPlotting(const char* script_filename)
+static void writePlotData(FILE* script_file, size_t* tree_indexes, size_t tree_count,
+    const PlotData* data, const PlotPoint* center, size_t taylor_idx)
 {
-    assert(script_filename);
-
-    char command[BUFFER_SIZE * 2] = "";
-    snprintf(command, BUFFER_SIZE * 2, "gnuplot %s", script_filename);
-
-    int result = system(command);
-    if (result != 0) {
-        fprintf(stderr, "Gnuplot error with file '%s'!", script_filename);
-        return STATUS_SYSTEM_CALL_ERROR;
-    }
+    assert(script_file); assert(tree_indexes); assert(data); assert(center);
 
-    return STATUS_OK;
-}
-
-
-static OperationStatus deleteScriptFile(const char* script_filename)
-{
-    char command[BUFFER_SIZE * 2] = "";
-    snprintf(command, BUFFER_SIZE * 2, "rm %s", script_filename);
-
-    int result = system(command);
-    if (result != 0) {
-        fprintf(stderr, "An error occurred while deleting the file %s!", script_filename);
-        return STATUS_SYSTEM_CALL_ERROR;
-    }
-
-    return STATUS_OK;
-}
-
-
-static OperationStatus deleteDataFile(size_t tree_idx)
-{
-    char command[BUFFER_SIZE * 2] = "";
-    snprintf(command, BUFFER_SIZE * 2, "rm %s/%s_%03zu", GNUPLOT_IMAGES_DIRECTORY,
-        GNUPLOT_DATA_FILENAME, tree_idx);
-
-    int result = system(command);
-    if (result != 0) {
-        fprintf(stderr, "An error occurred while deleting the file %s/%s_%zu!", 
-            GNUPLOT_IMAGES_DIRECTORY, GNUPLOT_DATA_FILENAME, tree_idx);
-        return STATUS_SYSTEM_CALL_ERROR;    
+// Блоки данных идут в том же порядке, что и источники '-' в команде plot
+    for (size_t index = 0; index < tree_count; index++) {
+        fwrite(data[index].points, 2 * sizeof(double), data[index].count, script_file);
+        if (tree_indexes[index] == taylor_idx) {
+            double point[] = {center->x, center->y};
+            fwrite(point, sizeof(double), 2, script_file);
+        }
     }
-
-    return STATUS_OK;
 }
-
-
-static void createDirectory(const char* directory)
-{
-    assert(directory);
-
-    char command[BUFFER_SIZE] = "";
-    snprintf(command, BUFFER_SIZE, "mkdir -p %s", directory);
-    system(command);
-}
\ No newline at end of file
@@ -0,0 +1,341 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <assert.h>
+
+#include "tex_dump/render_cache.h"
+#include "tex_dump/render_jobs.h"
+
+#include "diff/diff_cache.h"
+
+#include "status.h"
+
+
+const char ARTIFACT_DIRECTORY[] = "artifacts";
+const char ARTIFACT_SUFFIX[] = ".artifact";
+const size_t COPY_BUFFER_SIZE = 1 << 16;
+const size_t DIGEST_SIZE = 32;
+
+
+static const uint32_t SHA256_INITIAL_STATE[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+
+static const uint32_t SHA256_ROUND_CONSTANTS[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+
+// Каталог задается до запуска стадий отрисовки и дальше только читается
+static char cache_directory[BUFFER_SIZE * 2] = "";
+static bool is_cache_enabled = false;
+static size_t cache_size_limit = 0;
+
+static size_t cache_hits = 0;
+static size_t cache_misses = 0;
+static size_t temp_counter = 0;
+
+
+static bool getArtifactPath(const RenderDigest* key, char* path, size_t size);
+static bool copyFile(const char* source, const char* destination);
+
+static void digestUpdate(RenderDigest* digest, const void* data, size_t size);
+static void digestFinish(const RenderDigest* digest, uint8_t* result);
+static void digestCompress(uint32_t* state, const uint8_t* block);
+static inline uint32_t rotateRight(uint32_t value, unsigned shift);
+
+
+void renderCacheOpen(const char* directory, size_t size_limit)
+{
+    is_cache_enabled = false;
+    if (directory == NULL)
+        return;
+
+    int length = snprintf(cache_directory, sizeof(cache_directory), "%s/%s", directory, ARTIFACT_DIRECTORY);
+    if (length <= 0 || (size_t)length >= sizeof(cache_directory))
+        return;
+
+    is_cache_enabled = makeDirectory(cache_directory) == STATUS_OK;
+    cache_size_limit = size_limit;
+}
+
+
+bool renderCacheIsEnabled()
+{
+    return is_cache_enabled;
+}
+
+
+void renderCacheKeyInit(RenderArtifact* artifact)
+{
+    assert(artifact);
+
+    memcpy(artifact->key.state, SHA256_INITIAL_STATE, sizeof(SHA256_INITIAL_STATE));
+    artifact->key.length = 0;
+    artifact->key.block_length = 0;
+}
+
+
+void renderCacheKeyAdd(RenderArtifact* artifact, const void* data, size_t size)
+{
+    assert(artifact); assert(data || size == 0);
+
+// Без кэша ключ не нужен, поэтому графики не платят за хеширование команд
+    if (is_cache_enabled)
+        digestUpdate(&artifact->key, data, size);
+}
+
+
+bool renderCacheHashFile(RenderArtifact* artifact, const char* path)
+{
+    assert(artifact); assert(path);
+
+    if (!is_cache_enabled)
+        return false;
+
+    FILE* file = fopen(path, "rb");
+    uint8_t* buffer = (uint8_t*)calloc(COPY_BUFFER_SIZE, sizeof(uint8_t));
+    bool is_read = file != NULL && buffer != NULL;
+    while (is_read) {
+        size_t count = fread(buffer, sizeof(uint8_t), COPY_BUFFER_SIZE, file);
+        digestUpdate(&artifact->key, buffer, count);
+        if (count < COPY_BUFFER_SIZE) {
+            is_read = !ferror(file);
+            break;
+        }
+    }
+
+    free(buffer);
+    if (file != NULL)
+        fclose(file);
+
+    return is_read;
+}
+
+
+bool renderCacheHashDirectory(RenderArtifact* artifact, const char* directory)
+{
+    assert(artifact); assert(directory);
+
+    if (!is_cache_enabled)
+        return false;
+
+// Файлы перебираются по имени, чтобы порядок readdir не влиял на ключ
+    struct dirent** items = NULL;
+    int count = scandir(directory, &items, NULL, alphasort);
+    if (count < 0)
+        return false;
+
+    bool is_hashed = true;
+    for (int index = 0; index < count; index++) {
+        const char* name = items[index]->d_name;
+        char path[BUFFER_SIZE * 2] = "";
+        if (is_hashed && name[0] != '.') {
+            digestUpdate(&artifact->key, name, strlen(name) + 1);
+            int length = snprintf(path, sizeof(path), "%s/%s", directory, name);
+            is_hashed = length > 0 && (size_t)length < sizeof(path) && renderCacheHashFile(artifact, path);
+        }
+        free(items[index]);
+    }
+    free(items);
+
+    return is_hashed;
+}
+
+
+bool renderCacheFetch(const RenderArtifact* artifact)
+{
+    assert(artifact);
+
+    if (!is_cache_enabled)
+        return false;
+
+    char path[BUFFER_SIZE * 3] = "";
+    bool is_found = getArtifactPath(&artifact->key, path, sizeof(path)) && copyFile(path, artifact->path);
+    if (is_found) {
+        utimensat(AT_FDCWD, path, NULL, 0);
+        __atomic_fetch_add(&cache_hits, 1, __ATOMIC_RELAXED);
+    } else {
+        __atomic_fetch_add(&cache_misses, 1, __ATOMIC_RELAXED);
+    }
+
+    return is_found;
+}
+
+
+void renderCacheStore(const RenderArtifact* artifact)
+{
+    assert(artifact);
+
+    char path[BUFFER_SIZE * 3] = "";
+    if (!is_cache_enabled || !getArtifactPath(&artifact->key, path, sizeof(path)))
+        return;
+
+// Как и в кэше производных, запись появляется в каталоге только целиком
+    char temp_path[BUFFER_SIZE * 3 + 64] = "";
+    snprintf(temp_path, sizeof(temp_path), "%s.%d.%zu.tmp", path, getpid(),
+        __atomic_fetch_add(&temp_counter, 1, __ATOMIC_RELAXED));
+
+    if (!copyFile(artifact->path, temp_path) || rename(temp_path, path) != 0) {
+        unlink(temp_path);
+        return;
+    }
+
+    diffCacheEvict(cache_directory, ARTIFACT_SUFFIX, cache_size_limit);
+}
+
+
+void renderCachePrintStats(FILE* output)
+{
+    assert(output);
+
+    fprintf(output, "Render cache: %zu hits, %zu misses\n",
+        __atomic_load_n(&cache_hits, __ATOMIC_RELAXED), __atomic_load_n(&cache_misses, __ATOMIC_RELAXED));
+}
+
+
+static bool getArtifactPath(const RenderDigest* key, char* path, size_t size)
+{
+    assert(key); assert(path);
+
+    uint8_t digest[DIGEST_SIZE] = {};
+    digestFinish(key, digest);
+
+    char name[2 * DIGEST_SIZE + 1] = "";
+    for (size_t index = 0; index < DIGEST_SIZE; index++)
+        snprintf(name + 2 * index, 3, "%02x", digest[index]);
+
+    int length = snprintf(path, size, "%s/%s%s", cache_directory, name, ARTIFACT_SUFFIX);
+
+    return length > 0 && (size_t)length < size;
+}
+
+
+static bool copyFile(const char* source, const char* destination)
+{
+    assert(source); assert(destination);
+
+// Копия, а не жесткая ссылка: инструменты перезаписывают выходные файлы на месте
+    int input = open(source, O_RDONLY | O_CLOEXEC);
+    if (input < 0)
+        return false;
+
+    int output = open(destination, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    uint8_t* buffer = (uint8_t*)calloc(COPY_BUFFER_SIZE, sizeof(uint8_t));
+    bool is_copied = output >= 0 && buffer != NULL;
+    while (is_copied) {
+        ssize_t count = read(input, buffer, COPY_BUFFER_SIZE);
+        if (count <= 0) {
+            is_copied = count == 0;
+            break;
+        }
+        is_copied = write(output, buffer, (size_t)count) == count;
+    }
+
+    free(buffer);
+    close(input);
+    if (output >= 0 && close(output) != 0)
+        is_copied = false;
+
+    return is_copied;
+}
+
+
+static void digestUpdate(RenderDigest* digest, const void* data, size_t size)
+{
+    assert(digest); assert(data || size == 0);
+
+    const uint8_t* bytes = (const uint8_t*)data;
+    digest->length += size;
+    while (size > 0) {
+        size_t part = sizeof(digest->block) - digest->block_length;
+        if (part > size)
+            part = size;
+        memcpy(digest->block + digest->block_length, bytes, part);
+        digest->block_length += part;
+        bytes += part;
+        size -= part;
+
+        if (digest->block_length == sizeof(digest->block)) {
+            digestCompress(digest->state, digest->block);
+            digest->block_length = 0;
+        }
+    }
+}
+
+
+static void digestFinish(const RenderDigest* digest, uint8_t* result)
+{
+    assert(digest); assert(result);
+
+// Состояние копируется, чтобы один ключ можно было дописывать и завершать несколько раз
+    RenderDigest final = *digest;
+    uint64_t bit_length = final.length * 8;
+    uint8_t padding = 0x80;
+    digestUpdate(&final, &padding, 1);
+    padding = 0;
+    while (final.block_length != sizeof(final.block) - sizeof(uint64_t))
+        digestUpdate(&final, &padding, 1);
+
+    uint8_t length_bytes[sizeof(uint64_t)] = {};
+    for (size_t index = 0; index < sizeof(uint64_t); index++)
+        length_bytes[index] = (uint8_t)(bit_length >> (56 - 8 * index));
+    digestUpdate(&final, length_bytes, sizeof(length_bytes));
+
+    for (size_t index = 0; index < DIGEST_SIZE; index++)
+        result[index] = (uint8_t)(final.state[index / 4] >> (24 - 8 * (index % 4)));
+}
+
+
+static void digestCompress(uint32_t* state, const uint8_t* block)
+{
+    assert(state); assert(block);
+
+    uint32_t words[64] = {};
+    for (size_t index = 0; index < 16; index++) {
+        words[index] = (uint32_t)block[4 * index] << 24 | (uint32_t)block[4 * index + 1] << 16 |
+                       (uint32_t)block[4 * index + 2] << 8 | (uint32_t)block[4 * index + 3];
+    }
+    for (size_t index = 16; index < 64; index++) {
+        uint32_t s0 = rotateRight(words[index - 15], 7) ^ rotateRight(words[index - 15], 18) ^ (words[index - 15] >> 3);
+        uint32_t s1 = rotateRight(words[index - 2], 17) ^ rotateRight(words[index - 2], 19) ^ (words[index - 2] >> 10);
+        words[index] = words[index - 16] + s0 + words[index - 7] + s1;
+    }
+
+    uint32_t work[8] = {};
+    memcpy(work, state, sizeof(work));
+    for (size_t index = 0; index < 64; index++) {
+        uint32_t s1 = rotateRight(work[4], 6) ^ rotateRight(work[4], 11) ^ rotateRight(work[4], 25);
+        uint32_t choice = (work[4] & work[5]) ^ (~work[4] & work[6]);
+        uint32_t temp1 = work[7] + s1 + choice + SHA256_ROUND_CONSTANTS[index] + words[index];
+        uint32_t s0 = rotateRight(work[0], 2) ^ rotateRight(work[0], 13) ^ rotateRight(work[0], 22);
+        uint32_t majority = (work[0] & work[1]) ^ (work[0] & work[2]) ^ (work[1] & work[2]);
+        uint32_t temp2 = s0 + majority;
+
+        memmove(work + 1, work, 7 * sizeof(uint32_t));
+        work[4] += temp1;
+        work[0] = temp1 + temp2;
+    }
+
+    for (size_t index = 0; index < 8; index++)
+        state[index] += work[index];
+}
+
+
+static inline uint32_t rotateRight(uint32_t value, unsigned shift)
+{
+    return value >> shift | value << (32 - shift);
+}
@@ -0,0 +1,319 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <spawn.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <assert.h>
+
+#include "tex_dump/render_jobs.h"
+#include "tree/tree_defs.h"
+
+#include "status.h"
+
+
+extern char** environ;
+
+
+const int MAX_OPEN_DIRECTORIES = 16;
+
+
+typedef struct {
+    pid_t pid;
+    bool is_waited;
+    char tool[BUFFER_SIZE];
+    char target[BUFFER_SIZE * 2];
+    char* cleanup_files[MAX_CLEANUP_FILES];
+    size_t cleanup_count;
+    RenderArtifact artifact;
+    bool has_artifact;
+} RenderProcess;
+
+
+// Запущенные процессы общие для всего приложения: их ждут и стадии отрисовки, и основной поток
+static pthread_mutex_t jobs_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t job_finished = PTHREAD_COND_INITIALIZER;
+static RenderProcess* running_jobs[MAX_RENDER_JOBS] = {};
+static size_t running_count = 0;
+static size_t job_limit = 1;
+static OperationStatus jobs_status = STATUS_OK;
+
+
+static RenderProcess* createRenderProcess(const char* const* argv, const char* const* cleanup_files,
+                                          size_t cleanup_count, const RenderArtifact* artifact);
+static void destroyRenderProcess(RenderProcess* process);
+static bool spawnRenderProcess(RenderProcess* process, const char* const* argv, bool is_quiet);
+static void reapRenderProcessLocked();
+static void finishRenderProcess(RenderProcess* process, bool is_success);
+static int removeEntry(const char* path, const struct stat*, int, struct FTW*);
+static bool waitRenderProcess(pid_t pid);
+
+
+void renderJobsSetLimit(size_t limit)
+{
+    pthread_mutex_lock(&jobs_mutex);
+    job_limit = limit == 0 ? 1 : limit < MAX_RENDER_JOBS ? limit : MAX_RENDER_JOBS;
+    pthread_mutex_unlock(&jobs_mutex);
+}
+
+
+OperationStatus renderJobSubmit(const char* const* argv, const char* const* cleanup_files,
+                                size_t cleanup_count, const RenderArtifact* artifact, bool is_quiet)
+{
+    assert(argv); assert(argv[0]); assert(cleanup_count <= MAX_CLEANUP_FILES);
+    assert(cleanup_files != NULL || cleanup_count == 0);
+
+    RenderProcess* process = createRenderProcess(argv, cleanup_files, cleanup_count, artifact);
+    if (process == NULL)
+        return STATUS_SYSTEM_OUT_OF_MEMORY;
+
+// При исчерпании лимита отправитель сам дожидается одного из запущенных процессов
+    pthread_mutex_lock(&jobs_mutex);
+    while (running_count >= job_limit)
+        reapRenderProcessLocked();
+
+    bool is_spawned = spawnRenderProcess(process, argv, is_quiet);
+    if (is_spawned)
+        running_jobs[running_count++] = process;
+    else if (jobs_status == STATUS_OK)
+        jobs_status = STATUS_SYSTEM_CALL_ERROR;
+    pthread_mutex_unlock(&jobs_mutex);
+
+    if (!is_spawned) {
+        finishRenderProcess(process, false);
+        destroyRenderProcess(process);
+        return STATUS_SYSTEM_CALL_ERROR;
+    }
+
+    return STATUS_OK;
+}
+
+
+OperationStatus renderJobsWait()
+{
+    pthread_mutex_lock(&jobs_mutex);
+    while (running_count != 0)
+        reapRenderProcessLocked();
+
+    OperationStatus status = jobs_status;
+    jobs_status = STATUS_OK;
+    pthread_mutex_unlock(&jobs_mutex);
+
+    return status;
+}
+
+
+OperationStatus renderCoprocessStart(const char* const* argv, RenderCoprocess* coprocess)
+{
+    assert(argv); assert(argv[0]); assert(coprocess);
+
+// Конец канала закрывается при exec, иначе другие инструменты держали бы ввод открытым
+    int pipe_fds[2] = {-1, -1};
+    if (pipe2(pipe_fds, O_CLOEXEC) != 0)
+        return STATUS_SYSTEM_CALL_ERROR;
+
+    posix_spawn_file_actions_t actions = {};
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, pipe_fds[0], STDIN_FILENO);
+    int result = posix_spawnp(&coprocess->pid, argv[0], &actions, NULL, const_cast<char* const*>(argv), environ);
+    posix_spawn_file_actions_destroy(&actions);
+    close(pipe_fds[0]);
+
+    coprocess->input = result == 0 ? fdopen(pipe_fds[1], "w") : NULL;
+    if (coprocess->input == NULL) {
+        fprintf(stderr, "%s error: the process could not be started!\n", argv[0]);
+        close(pipe_fds[1]);
+        if (result == 0)
+            waitRenderProcess(coprocess->pid);
+        coprocess->pid = -1;
+        return STATUS_SYSTEM_CALL_ERROR;
+    }
+
+// Если процесс завершится раньше, запись вернет ошибку вместо завершения по SIGPIPE
+    signal(SIGPIPE, SIG_IGN);
+    return STATUS_OK;
+}
+
+
+OperationStatus renderCoprocessFinish(RenderCoprocess* coprocess)
+{
+    assert(coprocess); assert(coprocess->input);
+
+    bool is_success = fclose(coprocess->input) == 0;
+    is_success = waitRenderProcess(coprocess->pid) && is_success;
+    coprocess->input = NULL;
+    coprocess->pid = -1;
+
+    return is_success ? STATUS_OK : STATUS_SYSTEM_CALL_ERROR;
+}
+
+
+OperationStatus makeDirectory(const char* path)
+{
+    assert(path);
+
+    char directory[BUFFER_SIZE * 2] = "";
+    if ((size_t)snprintf(directory, sizeof(directory), "%s", path) >= sizeof(directory))
+        return STATUS_IO_INVALID_USER_INPUT;
+
+// Как mkdir -p: промежуточные каталоги создаются по очереди, существующие пропускаются
+    for (char* current = directory + 1; ; current++) {
+        bool is_end = *current == '\0';
+        if (*current != '/' && !is_end)
+            continue;
+
+        *current = '\0';
+        if (mkdir(directory, 0755) != 0 && errno != EEXIST)
+            return STATUS_SYSTEM_CALL_ERROR;
+        if (is_end)
+            break;
+        *current = '/';
+    }
+
+    return STATUS_OK;
+}
+
+
+OperationStatus removeDirectory(const char* path)
+{
+    assert(path);
+
+    if (nftw(path, removeEntry, MAX_OPEN_DIRECTORIES, FTW_DEPTH | FTW_PHYS) != 0 && errno != ENOENT)
+        return STATUS_SYSTEM_CALL_ERROR;
+
+    return STATUS_OK;
+}
+
+
+static int removeEntry(const char* path, const struct stat*, int, struct FTW*)
+{
+    return remove(path);
+}
+
+
+static RenderProcess* createRenderProcess(const char* const* argv, const char* const* cleanup_files,
+                                          size_t cleanup_count, const RenderArtifact* artifact)
+{
+    assert(argv);
+
+    RenderProcess* process = (RenderProcess*)calloc(1, sizeof(RenderProcess));
+    if (process == NULL)
+        return NULL;
+
+// В сообщении об ошибке указывается последний аргумент: это файл, который обрабатывает инструмент
+    size_t last_arg = 0;
+    while (argv[last_arg + 1] != NULL)
+        last_arg++;
+    snprintf(process->tool, sizeof(process->tool), "%s", argv[0]);
+    snprintf(process->target, sizeof(process->target), "%s", argv[last_arg]);
+    if (artifact != NULL) {
+        process->artifact = *artifact;
+        process->has_artifact = true;
+    }
+
+    for (size_t index = 0; index < cleanup_count; index++) {
+        process->cleanup_files[index] = strdup(cleanup_files[index]);
+        if (process->cleanup_files[index] == NULL) {
+            destroyRenderProcess(process);
+            return NULL;
+        }
+        process->cleanup_count++;
+    }
+
+    return process;
+}
+
+
+static void destroyRenderProcess(RenderProcess* process)
+{
+    assert(process);
+
+    for (size_t index = 0; index < process->cleanup_count; index++)
+        free(process->cleanup_files[index]);
+    free(process);
+}
+
+
+static bool spawnRenderProcess(RenderProcess* process, const char* const* argv, bool is_quiet)
+{
+    assert(process); assert(argv);
+
+    posix_spawn_file_actions_t actions = {};
+    posix_spawn_file_actions_init(&actions);
+    if (is_quiet)
+        posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+
+// Аргументы не изменяются дочерним процессом, posix_spawn лишь не объявляет их константными
+    int result = posix_spawnp(&process->pid, argv[0], &actions, NULL, const_cast<char* const*>(argv), environ);
+    posix_spawn_file_actions_destroy(&actions);
+
+    return result == 0;
+}
+
+
+static void reapRenderProcessLocked()
+{
+    RenderProcess* process = NULL;
+    for (size_t index = 0; index < running_count && process == NULL; index++) {
+        if (!running_jobs[index]->is_waited)
+            process = running_jobs[index];
+    }
+// Всех запущенных уже ждут другие потоки, остается дождаться их результата
+    if (process == NULL) {
+        pthread_cond_wait(&job_finished, &jobs_mutex);
+        return;
+    }
+
+    process->is_waited = true;
+    pthread_mutex_unlock(&jobs_mutex);
+
+    bool is_success = waitRenderProcess(process->pid);
+    finishRenderProcess(process, is_success);
+
+    pthread_mutex_lock(&jobs_mutex);
+    for (size_t index = 0; index < running_count; index++) {
+        if (running_jobs[index] == process) {
+            running_jobs[index] = running_jobs[--running_count];
+            break;
+        }
+    }
+    if (!is_success && jobs_status == STATUS_OK)
+        jobs_status = STATUS_SYSTEM_CALL_ERROR;
+    pthread_cond_broadcast(&job_finished);
+
+    destroyRenderProcess(process);
+}
+
+
+static void finishRenderProcess(RenderProcess* process, bool is_success)
+{
+    assert(process);
+
+    if (!is_success)
+        fprintf(stderr, "%s error with file '%s'!\n", process->tool, process->target);
+    else if (process->has_artifact)
+        renderCacheStore(&process->artifact);
+
+    for (size_t index = 0; index < process->cleanup_count; index++) {
+        if (unlink(process->cleanup_files[index]) != 0)
+            fprintf(stderr, "An error occurred while deleting the file %s!\n", process->cleanup_files[index]);
+    }
+}
+
+
+static bool waitRenderProcess(pid_t pid)
+{
+    int wait_status = 0;
+    pid_t result = -1;
+    do {
+        result = waitpid(pid, &wait_status, 0);
+    } while (result == -1 && errno == EINTR);
+
+    return result == pid && WIFEXITED(wait_status) && WEXITSTATUS(wait_status) == 0;
+}
@@ -0,0 +1,250 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <assert.h>
+
+#include "tex_dump/render_pipeline.h"
+#include "tex_dump/plot_generator.h"
+#include "tex_dump/render_jobs.h"
+
+#include "diff/diff_defs.h"
+
+#include "status.h"
+
+
+const size_t RENDER_QUEUE_CAPACITY = 4;
+
+
+typedef struct {
+    char output_filename[BUFFER_SIZE * 2];
+    Differentiator* snapshot;
+    size_t tree_idx;
+} RenderJob;
+
+
+// Ограниченная очередь: при заполнении вычисления ждут отрисовку
+typedef struct {
+    RenderJob* jobs[RENDER_QUEUE_CAPACITY];
+    size_t head;
+    size_t count;
+    bool is_closed;
+    bool is_started;
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+} RenderStage;
+
+
+struct RenderPipeline {
+    RenderStage plot_stage;
+};
+
+
+static bool stageStart(RenderStage* stage);
+static void stageFinish(RenderStage* stage);
+static void stagePush(RenderStage* stage, RenderJob* job);
+static RenderJob* stagePop(RenderStage* stage);
+static void* renderStageLoop(void* argument);
+
+static void destroyRenderJob(RenderJob* job);
+static Differentiator* createPlotSnapshot(const Differentiator* diff, size_t tree_idx);
+static void destroyPlotSnapshot(Differentiator* snapshot);
+
+
+void renderPipelineStart(Differentiator* diff)
+{
+    assert(diff); assert(diff->render == NULL);
+
+    RenderPipeline* render = (RenderPipeline*)calloc(1, sizeof(RenderPipeline));
+    if (render == NULL)
+        return;
+
+// Если стадию запустить не удалось, данные графиков готовятся синхронно, как раньше
+    diff->render = render;
+    if (!stageStart(&render->plot_stage))
+        renderPipelineFinish(diff);
+}
+
+
+void renderPipelineFinish(Differentiator* diff)
+{
+    assert(diff);
+
+    if (diff->render != NULL) {
+        stageFinish(&diff->render->plot_stage);
+        free(diff->render);
+        diff->render = NULL;
+    }
+
+    renderJobsWait();
+}
+
+
+void renderPlot(Differentiator* diff, const char* output_filename, size_t tree_idx)
+{
+    assert(diff); assert(output_filename); assert(tree_idx < diff->forest.count);
+
+    if (diff->render == NULL) {
+        generatePlot(diff, output_filename, 1, tree_idx);
+        return;
+    }
+
+// Стадия получает свою копию переменных и корней, чтобы не зависеть от дальнейших вычислений
+    RenderJob* job = (RenderJob*)calloc(1, sizeof(RenderJob));
+    Differentiator* snapshot = createPlotSnapshot(diff, tree_idx);
+    if (job == NULL || snapshot == NULL) {
+        free(job);
+        destroyPlotSnapshot(snapshot);
+        return;
+    }
+
+    job->snapshot = snapshot;
+    job->tree_idx = tree_idx;
+    snprintf(job->output_filename, sizeof(job->output_filename), "%s", output_filename);
+
+    stagePush(&diff->render->plot_stage, job);
+}
+
+
+static bool stageStart(RenderStage* stage)
+{
+    assert(stage);
+
+    stage->head = 0;
+    stage->count = 0;
+    stage->is_closed = false;
+    pthread_mutex_init(&stage->mutex, NULL);
+    pthread_cond_init(&stage->not_empty, NULL);
+    pthread_cond_init(&stage->not_full, NULL);
+
+    stage->is_started = pthread_create(&stage->thread, NULL, renderStageLoop, stage) == 0;
+    return stage->is_started;
+}
+
+
+static void stageFinish(RenderStage* stage)
+{
+    assert(stage);
+
+    pthread_mutex_lock(&stage->mutex);
+    stage->is_closed = true;
+    pthread_cond_broadcast(&stage->not_empty);
+    pthread_mutex_unlock(&stage->mutex);
+
+// Оставшиеся задания дорисовываются до остановки потока
+    if (stage->is_started)
+        pthread_join(stage->thread, NULL);
+
+    RenderJob* job = NULL;
+    while ((job = stagePop(stage)) != NULL)
+        destroyRenderJob(job);
+
+    pthread_cond_destroy(&stage->not_full);
+    pthread_cond_destroy(&stage->not_empty);
+    pthread_mutex_destroy(&stage->mutex);
+}
+
+
+static void stagePush(RenderStage* stage, RenderJob* job)
+{
+    assert(stage); assert(job);
+
+    pthread_mutex_lock(&stage->mutex);
+    while (stage->count == RENDER_QUEUE_CAPACITY)
+        pthread_cond_wait(&stage->not_full, &stage->mutex);
+
+    stage->jobs[(stage->head + stage->count) % RENDER_QUEUE_CAPACITY] = job;
+    stage->count++;
+    pthread_cond_signal(&stage->not_empty);
+    pthread_mutex_unlock(&stage->mutex);
+}
+
+
+static RenderJob* stagePop(RenderStage* stage)
+{
+    assert(stage);
+
+    pthread_mutex_lock(&stage->mutex);
+    while (stage->count == 0 && !stage->is_closed)
+        pthread_cond_wait(&stage->not_empty, &stage->mutex);
+
+    RenderJob* job = NULL;
+    if (stage->count != 0) {
+        job = stage->jobs[stage->head];
+        stage->head = (stage->head + 1) % RENDER_QUEUE_CAPACITY;
+        stage->count--;
+        pthread_cond_signal(&stage->not_full);
+    }
+    pthread_mutex_unlock(&stage->mutex);
+
+    return job;
+}
+
+
+static void* renderStageLoop(void* argument)
+{
+    assert(argument);
+
+    RenderStage* stage = (RenderStage*)argument;
+    RenderJob* job = NULL;
+    while ((job = stagePop(stage)) != NULL) {
+        generatePlot(job->snapshot, job->output_filename, 1, job->tree_idx);
+        destroyRenderJob(job);
+    }
+
+    return NULL;
+}
+
+
+static void destroyRenderJob(RenderJob* job)
+{
+    assert(job);
+
+    destroyPlotSnapshot(job->snapshot);
+    free(job);
+}
+
+
+static Differentiator* createPlotSnapshot(const Differentiator* diff, size_t tree_idx)
+{
+    assert(diff); assert(diff->forest.trees); assert(tree_idx < diff->forest.count);
+
+    size_t variable_count = diff->var_table.count;
+    Differentiator* snapshot = (Differentiator*)calloc(1, sizeof(Differentiator));
+    BinaryTree* trees = (BinaryTree*)calloc(tree_idx + 1, sizeof(BinaryTree));
+    Variable* variables = (Variable*)calloc(variable_count != 0 ? variable_count : 1, sizeof(Variable));
+    if (snapshot == NULL || trees == NULL || variables == NULL) {
+        free(snapshot);
+        free(trees);
+        free(variables);
+        return NULL;
+    }
+
+// Деревья не копируются: после оптимизации производная больше не меняется до конца отчета
+    memcpy(trees, diff->forest.trees, (tree_idx + 1) * sizeof(BinaryTree));
+    memcpy(variables, diff->var_table.variables, variable_count * sizeof(Variable));
+
+    snapshot->forest.trees = trees;
+    snapshot->forest.capacity = tree_idx + 1;
+    snapshot->forest.count = tree_idx + 1;
+    snapshot->var_table.variables = variables;
+    snapshot->var_table.capacity = variable_count;
+    snapshot->var_table.count = variable_count;
+    snapshot->args = diff->args;
+    snapshot->tex_dump.range = diff->tex_dump.range;
+
+    return snapshot;
+}
+
+
+static void destroyPlotSnapshot(Differentiator* snapshot)
+{
+    if (snapshot == NULL)
+        return;
+
+    free(snapshot->forest.trees);
+    free(snapshot->var_table.variables);
+    free(snapshot);
+}
@@ -0,0 +1,145 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <assert.h>
+
+#include "tex_dump/tex_elision.h"
+#include "tree/tree_stack.h"
+
+#include "status.h"
+
+
+const size_t ELISION_START_CAPACITY = 16;
+const size_t ELISION_MIN_NODES = 4;
+
+
+static OperationStatus addPlaceholder(TexElision* elision, const TreeNode* node);
+static int comparePlaceholders(const void* first, const void* second);
+static bool isSmallSubtree(const TreeNode* root);
+
+
+OperationStatus texElisionBuild(TexElision* elision, const TreeNode* root, size_t node_limit, size_t depth_limit)
+{
+    assert(elision); assert(root);
+
+    WorkStack level = {};
+    WorkStack next_level = {};
+    workStackInit(&level, sizeof(const TreeNode*));
+    workStackInit(&next_level, sizeof(const TreeNode*));
+
+// Узлы раскрываются по уровням: так бюджет тратится на верх формулы, а глубокие поддеревья становятся обозначениями
+    size_t expanded_count = 0;
+    OperationStatus status = workStackPush(&level, &root);
+    for (size_t depth = 0; status == STATUS_OK && level.count != 0; depth++) {
+        const TreeNode** nodes = (const TreeNode**)(void*)level.data;
+        for (size_t index = 0; index < level.count && status == STATUS_OK; index++) {
+            const TreeNode* node = nodes[index];
+            if (node->type != NODE_OP)
+                continue;
+
+// Маленькие поддеревья короче своего обозначения, они печатаются целиком
+            if (node != root && (expanded_count >= node_limit || depth >= depth_limit)) {
+                if (!isSmallSubtree(node))
+                    status = addPlaceholder(elision, node);
+                continue;
+            }
+
+            expanded_count++;
+            if (node->left)
+                status = workStackPush(&next_level, &node->left);
+            if (node->right && status == STATUS_OK)
+                status = workStackPush(&next_level, &node->right);
+        }
+
+        WorkStack temp = level;
+        level = next_level;
+        next_level = temp;
+        next_level.count = 0;
+    }
+
+    workStackDestroy(&level);
+    workStackDestroy(&next_level);
+
+// Поиск при печати идет бинарным поиском по адресам узлов
+    if (elision->count != 0)
+        qsort(elision->items, elision->count, sizeof(TexPlaceholder), comparePlaceholders);
+
+    return status;
+}
+
+
+TexPlaceholder* texElisionFind(TexElision* elision, const TreeNode* node)
+{
+    assert(elision); assert(node);
+
+    if (elision->count == 0)
+        return NULL;
+
+    TexPlaceholder key = {node, 0};
+    return (TexPlaceholder*)bsearch(&key, elision->items, elision->count, sizeof(TexPlaceholder), comparePlaceholders);
+}
+
+
+void texElisionDestroy(TexElision* elision)
+{
+    assert(elision);
+
+    free(elision->items);
+    elision->items = NULL;
+    elision->count = 0;
+    elision->capacity = 0;
+}
+
+
+static OperationStatus addPlaceholder(TexElision* elision, const TreeNode* node)
+{
+    assert(elision); assert(node);
+
+    if (elision->count == elision->capacity) {
+        size_t capacity = elision->capacity == 0 ? ELISION_START_CAPACITY : elision->capacity * 2;
+        void* temp_ptr = realloc(elision->items, capacity * sizeof(TexPlaceholder));
+        if (temp_ptr == NULL)
+            return STATUS_SYSTEM_OUT_OF_MEMORY;
+
+        elision->items = (TexPlaceholder*)temp_ptr;
+        elision->capacity = capacity;
+    }
+
+    elision->items[elision->count++] = (TexPlaceholder){node, 0};
+    return STATUS_OK;
+}
+
+
+static int comparePlaceholders(const void* first, const void* second)
+{
+    assert(first); assert(second);
+
+    uintptr_t first_node = (uintptr_t)((const TexPlaceholder*)first)->node;
+    uintptr_t second_node = (uintptr_t)((const TexPlaceholder*)second)->node;
+
+    return (first_node > second_node) - (first_node < second_node);
+}
+
+
+static bool isSmallSubtree(const TreeNode* root)
+{
+    assert(root);
+
+    WorkStack stack = {};
+    workStackInit(&stack, sizeof(const TreeNode*));
+
+// Обход останавливается, как только узлов становится больше порога
+    size_t node_count = 0;
+    const TreeNode* node = root;
+    OperationStatus status = workStackPush(&stack, &node);
+    while (status == STATUS_OK && node_count <= ELISION_MIN_NODES && workStackPop(&stack, &node)) {
+        node_count++;
+        if (node->left)
+            status = workStackPush(&stack, &node->left);
+        if (node->right && status == STATUS_OK)
+            status = workStackPush(&stack, &node->right);
+    }
+
+    workStackDestroy(&stack);
+    return status == STATUS_OK && node_count <= ELISION_MIN_NODES;
+}
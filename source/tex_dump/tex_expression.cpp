@@ -6,43 +6,153 @@
 #include <math.h>
 
 #include "tex_dump/tex_expression.h"
+#include "tex_dump/tex_elision.h"
 
 #include "diff/diff_defs.h"
 
+#include "tree/tree.h"
 
-static void printNode(Differentiator* diff, TreeNode* node);
-static void printOperator(Differentiator* diff, TreeNode* node);
-static void printAdd(Differentiator* diff, TreeNode* node);
 
-static bool needParentheses(TreeNode* node);
-static bool isBinaryOperator(OpType op);
-static size_t getOperatorPriority(TreeNode* node);
+
+typedef struct {
+    const char* text;
+    size_t length;
+} TexText;
+
+
+// Состояние обхода: узел только что достигнут или из него вернулись после левого/правого поддерева
+typedef enum {
+    PRINT_ENTER = 0,
+    PRINT_AFTER_LEFT,
+    PRINT_AFTER_RIGHT
+} PrintState;
+
+
+typedef struct {
+    TexText before;
+    TexText between;
+    TexText after;
+    size_t priority;
+    bool is_binary;
+} OperatorLayout;
+
+
+typedef struct {
+    FILE* file;
+    char* data;
+    size_t length;
+    size_t capacity;
+} TexBuffer;
+
+
+// nodes[k - 1] — поддерево, которое в отчете обозначено A_k
+typedef struct {
+    const TreeNode** nodes;
+    size_t count;
+    size_t capacity;
+} TexDefinitions;
+
+
+// Длина шаблона считается при компиляции, при печати строки только копируются
+#define TEX_TEXT(text) {text, sizeof(text) - 1}
+
+
+const size_t TEX_BUFFER_START_SIZE = 1 << 12;
+const size_t TEX_BUFFER_FLUSH_SIZE = 1 << 18;
+const size_t TEX_NUMBER_SIZE = 32;
+const size_t TEX_DEFINITIONS_START_SIZE = 16;
+const size_t TEX_SIGNIFICANT_DIGITS = 6;
+const double TEX_MAX_FAST_NUMBER = 1e6;
+const double TEX_MIN_SCALED_NUMBER = 1e5;
+const double TEX_ROUNDING_MARGIN = 1e-6;
+const double TEX_DECIMAL_POWERS[] = {1e-4, 1e-3, 1e-2, 1e-1, 1e0, 1e1, 1e2, 1e3, 1e4, 1e5};
+const double TEX_DIGIT_SCALES[]   = {1e9,  1e8,  1e7,  1e6,  1e5, 1e4, 1e3, 1e2, 1e1, 1e0};
+const size_t TEX_DECIMAL_POWER_COUNT = sizeof(TEX_DECIMAL_POWERS) / sizeof(*TEX_DECIMAL_POWERS);
+
+
+static void printElidedExpression(Differentiator* diff, TreeNode* root);
+static void printElidedFormula(Differentiator* diff, const TreeNode* root, TexDefinitions* definitions);
+static void printPlaceholder(TexBuffer* buffer, TexPlaceholder* placeholder, TexDefinitions* definitions);
+
+static void printNode(Differentiator* diff, TexBuffer* buffer, const TreeNode* root,
+                      TexElision* elision, TexDefinitions* definitions);
+static void printNodeOpening(Differentiator* diff, TexBuffer* buffer, const TreeNode* node, bool is_wrapped);
+static void printNodeClosing(Differentiator* diff, TexBuffer* buffer, const TreeNode* node, bool is_wrapped);
+static bool hasPrintedChildren(const TreeNode* node);
+static void printRemainder(Differentiator* diff, TexBuffer* buffer);
+
+static void texBufferWrite(TexBuffer* buffer, const char* text, size_t length);
+static void texBufferWriteNumber(TexBuffer* buffer, double number);
+static size_t formatShortNumber(double number, char* output);
+static void texBufferFlush(TexBuffer* buffer);
+static bool texBufferReserve(TexBuffer* buffer, size_t length);
+
+static bool needParentheses(const TreeNode* node);
+
+
+const OperatorLayout OPERATOR_LAYOUTS[OP_MAX_COUNT] = {
+    [OP_ADD] = {TEX_TEXT(""), TEX_TEXT(" + "), TEX_TEXT(""), 1, true},
+    [OP_SUB] = {TEX_TEXT(""), TEX_TEXT(" - "), TEX_TEXT(""), 1, true},
+    [OP_MUL] = {TEX_TEXT(""), TEX_TEXT(" \\cdot "), TEX_TEXT(""), 2, true},
+    [OP_DIV] = {TEX_TEXT("\\frac{"), TEX_TEXT("}{"), TEX_TEXT("}"), 2, true},
+
+    [OP_POW] = {TEX_TEXT("{"), TEX_TEXT("}^{"), TEX_TEXT("}"), 3, true},
+    [OP_LOG] = {TEX_TEXT("\\log_{"), TEX_TEXT("}{"), TEX_TEXT("}"), 4, true},
+
+    [OP_SIN] = {TEX_TEXT("\\sin{"), TEX_TEXT(""), TEX_TEXT("}"), 4, false},
+    [OP_COS] = {TEX_TEXT("\\cos{"), TEX_TEXT(""), TEX_TEXT("}"), 4, false},
+    [OP_TAN] = {TEX_TEXT("\\tan{"), TEX_TEXT(""), TEX_TEXT("}"), 4, false},
+    [OP_COT] = {TEX_TEXT("\\cot{"), TEX_TEXT(""), TEX_TEXT("}"), 4, false},
+
+    [OP_ASIN] = {TEX_TEXT("\\arcsin{"), TEX_TEXT(""), TEX_TEXT("}"), 4, false},
+    [OP_ACOS] = {TEX_TEXT("\\arccos{"), TEX_TEXT(""), TEX_TEXT("}"), 4, false},
+    [OP_ATAN] = {TEX_TEXT("\\arctan{"), TEX_TEXT(""), TEX_TEXT("}"), 4, false},
+    [OP_ACOT] = {TEX_TEXT("\\arccot{"), TEX_TEXT(""), TEX_TEXT("}"), 4, false},
+
+    [OP_SINH] = {TEX_TEXT("\\sinh{"), TEX_TEXT(""), TEX_TEXT("}"), 4, false},
+    [OP_COSH] = {TEX_TEXT("\\cosh{"), TEX_TEXT(""), TEX_TEXT("}"), 4, false},
+    [OP_TANH] = {TEX_TEXT("\\tanh{"), TEX_TEXT(""), TEX_TEXT("}"), 4, false},
+    [OP_COTH] = {TEX_TEXT("\\coth{"), TEX_TEXT(""), TEX_TEXT("}"), 4, false},
+
+    [OP_ASINH] = {TEX_TEXT("\\operatorname{asinh}{"), TEX_TEXT(""), TEX_TEXT("}"), 4, false},
+    [OP_ACOSH] = {TEX_TEXT("\\operatorname{acosh}{"), TEX_TEXT(""), TEX_TEXT("}"), 4, false},
+    [OP_ATANH] = {TEX_TEXT("\\operatorname{atanh}{"), TEX_TEXT(""), TEX_TEXT("}"), 4, false},
+    [OP_ACOTH] = {TEX_TEXT("\\operatorname{acoth}{"), TEX_TEXT(""), TEX_TEXT("}"), 4, false},
+
+    [OP_NONE] = {TEX_TEXT(""), TEX_TEXT(""), TEX_TEXT(""), 4, false}
+};
 
 
 void printExpression(Differentiator* diff, size_t tree_idx)
 {
     assert(diff); assert(diff->forest.trees); assert(tree_idx <= diff->forest.count);
 
-    
-    printTex(diff, "\\begin{dmath*}\n\\text{%s}", diff->tex_dump.function_name);
-    printTex(diff, "%n\n\\end{dmath*}\n\n", diff->forest.trees[tree_idx].root);
-    /*if (tree_idx > 0 && tree_idx < diff->args.derivative_info.order) {
-        if (tree_idx > 3) {
-            printTex(diff, "^{(%zu)}", tree_idx);
-        } else {
-            for (size_t index = 0; index < tree_idx; index++) {
-                printTex(diff, "'");
-            }
-        }
-    }*/
+    if (TEX_FILE == NULL)
+        return;
+
+    TreeNode* root = diff->forest.trees[tree_idx].root;
+    TreeStats stats = {};
+    treeCollectStats(root, &stats);
 
-    //printTex(diff, " = %n\n\\end{dmath*}\n\n", diff->forest.trees[tree_idx].root);
+// Большие выражения печатаются с обозначениями вместо глубоких поддеревьев, иначе xelatex не справляется
+    printTex(diff, "\\begin{dmath*}\n\\text{%s}", diff->tex_dump.function_name);
+    size_t node_limit = diff->args.tex_limit_info.node_limit;
+    if (node_limit == 0 || stats.node_count <= node_limit) {
+        printTex(diff, "%n\n\\end{dmath*}\n", root);
+    } else {
+        printElidedExpression(diff, root);
+    }
+    printTex(diff, "\\textit{Узлов в выражении: %zu, глубина: %zu.}\n\n", stats.node_count, stats.depth);
 }
 
 
 void printTex(Differentiator* diff, const char* format, ...)
 {
-    assert(diff); assert(diff->tex_dump.file); assert(format);
+    assert(diff); assert(format);
+
+// Без открытого файла (пакетный режим) отчет не пишется
+    if (TEX_FILE == NULL)
+        return;
 
     va_list args = {};
     va_start(args, format);
@@ -54,7 +164,10 @@ void printTex(Differentiator* diff, const char* format, ...)
         va_end(args);
         return;
     }
-    fprintf(TEX_FILE, "%.*s", (int)(next - current), current);
+
+// Текст между выражениями копируется в тот же буфер, файл получает его одним блоком
+    TexBuffer buffer = {TEX_FILE, NULL, 0, 0};
+    texBufferWrite(&buffer, current, (size_t)(next - current));
     do {
         const char* temp = strchr(next + 1, '%');
         current = next;
@@ -64,46 +177,187 @@ void printTex(Differentiator* diff, const char* format, ...)
             TreeNode* node = va_arg(args, TreeNode*);
             assert(node);
             assert(node->type >= 0);
-            printNode(diff, node);
-            if (next) {
-                fprintf(TEX_FILE, "%.*s", (int)(next - current - 2), current + 2);
-            } else {
-                fprintf(TEX_FILE, "%s", current + 2);
-            }
+            printNode(diff, &buffer, node, NULL, NULL);
+            texBufferWrite(&buffer, current + 2, next ? (size_t)(next - current - 2) : strlen(current + 2));
         } else {
+            texBufferFlush(&buffer);
             vfprintf(TEX_FILE, current, args);
             break;
         }
     } while (next);
 
+    texBufferFlush(&buffer);
+    free(buffer.data);
     va_end(args);
 }
 
 
-static void printNode(Differentiator* diff, TreeNode* node)
+static void printElidedExpression(Differentiator* diff, TreeNode* root)
 {
-    assert(diff); assert(diff->var_table.variables); assert(node);
+    assert(diff); assert(root);
+
+    TexDefinitions definitions = {};
+    printElidedFormula(diff, root, &definitions);
+    printTex(diff, "\n\\end{dmath*}\n");
+
+// Определения сами печатаются с сокращениями, а их число ограничено, поэтому объем отчета не зависит от размера дерева
+    size_t definition_limit = diff->args.tex_limit_info.definition_limit;
+    size_t defined_count = 0;
+    for (; defined_count < definitions.count && defined_count < definition_limit; defined_count++) {
+        printTex(diff, "\\begin{dmath*}\nA_{%zu} = ", defined_count + 1);
+        printElidedFormula(diff, definitions.nodes[defined_count], &definitions);
+        printTex(diff, "\n\\end{dmath*}\n");
+    }
+    if (defined_count + 1 == definitions.count) {
+        printTex(diff, "Обозначение $A_{%zu}$ не раскрывается из-за размера выражения.\n\n", definitions.count);
+    } else if (defined_count < definitions.count) {
+        printTex(diff, "Обозначения $A_{%zu}$--$A_{%zu}$ не раскрываются из-за размера выражения.\n\n",
+            defined_count + 1, definitions.count);
+    }
 
-    bool need_parentheses = needParentheses(node);
+    free(definitions.nodes);
+}
 
-    if (node == diff->highlight_node) {
-        printTex(diff, "{\\color{red} ");
+
+static void printElidedFormula(Differentiator* diff, const TreeNode* root, TexDefinitions* definitions)
+{
+    assert(diff); assert(root); assert(definitions);
+
+    TexElision elision = {};
+    OperationStatus status = texElisionBuild(&elision, root, diff->args.tex_limit_info.node_limit,
+                                             diff->args.tex_limit_info.depth_limit);
+    if (status != STATUS_OK) {
+        fprintf(stderr, "Error: not enough memory to print expression\n");
+    } else {
+        TexBuffer buffer = {TEX_FILE, NULL, 0, 0};
+        printNode(diff, &buffer, root, &elision, definitions);
+        texBufferFlush(&buffer);
+        free(buffer.data);
+    }
+
+    texElisionDestroy(&elision);
+}
+
+
+static void printPlaceholder(TexBuffer* buffer, TexPlaceholder* placeholder, TexDefinitions* definitions)
+{
+    assert(buffer); assert(placeholder); assert(definitions);
+
+// Номера раздаются в порядке печати, чтобы A_1, A_2, ... шли в формуле слева направо
+    if (placeholder->number == 0) {
+        if (definitions->count == definitions->capacity) {
+            size_t capacity = definitions->capacity == 0 ? TEX_DEFINITIONS_START_SIZE : definitions->capacity * 2;
+            void* temp_ptr = realloc(definitions->nodes, capacity * sizeof(const TreeNode*));
+            if (temp_ptr == NULL) {
+                texBufferWrite(buffer, "\\ldots", 6);
+                return;
+            }
+            definitions->nodes = (const TreeNode**)temp_ptr;
+            definitions->capacity = capacity;
+        }
+        definitions->nodes[definitions->count++] = placeholder->node;
+        placeholder->number = definitions->count;
+    }
+
+    if (!texBufferReserve(buffer, TEX_NUMBER_SIZE))
+        return;
+    int length = snprintf(buffer->data + buffer->length, TEX_NUMBER_SIZE, "A_{%zu}", placeholder->number);
+    if (length > 0)
+        buffer->length += (size_t)length;
+}
+
+
+static void printNode(Differentiator* diff, TexBuffer* buffer, const TreeNode* root,
+                      TexElision* elision, TexDefinitions* definitions)
+{
+    assert(diff); assert(diff->var_table.variables); assert(buffer); assert(root);
+
+// Обход идет по ссылкам на родителя, поэтому печать не выделяет память под стек
+    const TreeNode* node = root;
+    PrintState state = PRINT_ENTER;
+    bool is_elided = false;
+// Формула с обозначениями стоит отдельной строкой, поэтому ее корень не берется в скобки
+    bool is_root_wrapped = elision == NULL;
+    while (true) {
+        switch (state) {
+            case PRINT_ENTER: {
+                TexPlaceholder* placeholder = elision != NULL ? texElisionFind(elision, node) : NULL;
+                if (placeholder != NULL) {
+                    printPlaceholder(buffer, placeholder, definitions);
+                    is_elided = true;
+                    state = PRINT_AFTER_RIGHT;
+                    break;
+                }
+                printNodeOpening(diff, buffer, node, node != root || is_root_wrapped);
+                if (hasPrintedChildren(node) && node->left) {
+                    node = node->left;
+                    continue;
+                }
+                state = PRINT_AFTER_LEFT;
+                break;
+            }
+            case PRINT_AFTER_LEFT: {
+                if (hasPrintedChildren(node) && node->right) {
+                    const TexText* between = &OPERATOR_LAYOUTS[node->value.op].between;
+                    if (node->left)
+                        texBufferWrite(buffer, between->text, between->length);
+                    node = node->right;
+                    state = PRINT_ENTER;
+                    continue;
+                }
+// Сумма без правого слагаемого - последний член разложения Тейлора
+                if (hasPrintedChildren(node) && node->value.op == OP_ADD)
+                    printRemainder(diff, buffer);
+                state = PRINT_AFTER_RIGHT;
+                break;
+            }
+            case PRINT_AFTER_RIGHT: {
+                if (!is_elided)
+                    printNodeClosing(diff, buffer, node, node != root || is_root_wrapped);
+                is_elided = false;
+                if (node == root)
+                    return;
+                state = node == node->parent->left ? PRINT_AFTER_LEFT : PRINT_AFTER_RIGHT;
+                node = node->parent;
+                break;
+            }
+            default: {
+                return;
+            }
+        }
     }
-    if (need_parentheses) {
-        printTex(diff, "(");
+}
+
+
+static void printNodeOpening(Differentiator* diff, TexBuffer* buffer, const TreeNode* node, bool is_wrapped)
+{
+    assert(diff); assert(buffer); assert(node);
+
+    if (node == diff->highlight_node) {
+        const TexText opening = TEX_TEXT("{\\color{red} ");
+        texBufferWrite(buffer, opening.text, opening.length);
     }
+    if (is_wrapped && needParentheses(node))
+        texBufferWrite(buffer, "(", 1);
 
     switch (node->type) {
         case NODE_OP: {
-            printOperator(diff, node);
+            assert(node->value.op != OP_NONE);
+            if (node->value.op >= OP_NONE) {
+                fprintf(stderr, "Critical error: Unknown op type %d\n", node->value.op);
+                break;
+            }
+            const TexText* before = &OPERATOR_LAYOUTS[node->value.op].before;
+            texBufferWrite(buffer, before->text, before->length);
             break;
         }
         case NODE_VAR: {
-            printTex(diff, "%s", diff->var_table.variables[node->value.var_idx].name);
+            const char* name = diff->var_table.variables[node->value.var_idx].name;
+            texBufferWrite(buffer, name, strlen(name));
             break;
         }
         case NODE_NUM: {
-            printTex(diff, "%g", node->value.num_val);
+            texBufferWriteNumber(buffer, node->value.num_val);
             break;
         }
         default: {
@@ -111,79 +365,188 @@ static void printNode(Differentiator* diff, TreeNode* node)
             break;
         }
     }
+}
+
+
+static void printNodeClosing(Differentiator* diff, TexBuffer* buffer, const TreeNode* node, bool is_wrapped)
+{
+    assert(diff); assert(buffer); assert(node);
 
-    if (need_parentheses) {
-        printTex(diff, ")");
+    if (hasPrintedChildren(node)) {
+        const TexText* after = &OPERATOR_LAYOUTS[node->value.op].after;
+        texBufferWrite(buffer, after->text, after->length);
     }
-    if (node == diff->highlight_node) {
-        printTex(diff, "}");
+    if (is_wrapped && needParentheses(node))
+        texBufferWrite(buffer, ")", 1);
+    if (node == diff->highlight_node)
+        texBufferWrite(buffer, "}", 1);
+}
+
+
+static bool hasPrintedChildren(const TreeNode* node)
+{
+    assert(node);
+
+    return node->type == NODE_OP && node->value.op < OP_NONE;
+}
+
+
+static void printRemainder(Differentiator* diff, TexBuffer* buffer)
+{
+    assert(diff); assert(diff->var_table.count != 0); assert(buffer);
+
+    size_t diff_var_idx = diff->args.derivative_info.diff_var_idx;
+    if (!texBufferReserve(buffer, BUFFER_SIZE))
+        return;
+
+    char* end = buffer->data + buffer->length;
+    int length = 0;
+    if (fabs(diff->args.taylor_info.center) < EPS) {
+        length = snprintf(end, BUFFER_SIZE, " + o(%s^{%zu})", diff->var_table.variables[diff_var_idx].name,
+            diff->args.derivative_info.order);
+    } else {
+        length = snprintf(end, BUFFER_SIZE, " + o((%s - %g)^{%zu})", diff->var_table.variables[diff_var_idx].name,
+            diff->args.taylor_info.center, diff->args.derivative_info.order);
     }
+    if (length > 0)
+        buffer->length += (size_t)length < BUFFER_SIZE ? (size_t)length : BUFFER_SIZE - 1;
 }
 
 
-static void printOperator(Differentiator* diff, TreeNode* node)
+static void texBufferWrite(TexBuffer* buffer, const char* text, size_t length)
 {
-    assert(diff); assert(node); assert(node->type == NODE_OP);
-    assert(node->value.op != OP_NONE);
-
-    switch (node->value.op) {
-        case OP_ADD: printAdd(diff, node); break;
-        case OP_SUB: printTex(diff, "%n - %n", node->left, node->right); break;
-        case OP_MUL: printTex(diff, "%n \\cdot %n", node->left, node->right); break;
-        case OP_DIV: printTex(diff, "\\frac{%n}{%n}", node->left, node->right); break;
-
-        case OP_POW: printTex(diff, "{%n}^{%n}", node->left, node->right); break;
-        case OP_LOG: printTex(diff, "\\log_{%n}{%n}", node->left, node->right); break;
-
-        case OP_SIN: printTex(diff, "\\sin{%n}", node->right); break;
-        case OP_COS: printTex(diff, "\\cos{%n}", node->right); break;
-        case OP_TAN: printTex(diff, "\\tan{%n}", node->right); break;
-        case OP_COT: printTex(diff, "\\cot{%n}", node->right); break;
-
-        case OP_ASIN: printTex(diff, "\\arcsin{%n}", node->right); break;
-        case OP_ACOS: printTex(diff, "\\arccos{%n}", node->right); break;
-        case OP_ATAN: printTex(diff, "\\arctan{%n}", node->right); break;
-        case OP_ACOT: printTex(diff, "\\arccot{%n}", node->right); break;
-
-        case OP_SINH: printTex(diff, "\\sinh{%n}", node->right); break;
-        case OP_COSH: printTex(diff, "\\cosh{%n}", node->right); break;
-        case OP_TANH: printTex(diff, "\\tanh{%n}", node->right); break;
-        case OP_COTH: printTex(diff, "\\coth{%n}", node->right); break;
-
-        case OP_ASINH: printTex(diff, "\\operatorname{asinh}{%n}", node->right); break;
-        case OP_ACOSH: printTex(diff, "\\operatorname{acosh}{%n}", node->right); break;
-        case OP_ATANH: printTex(diff, "\\operatorname{atanh}{%n}", node->right); break;
-        case OP_ACOTH: printTex(diff, "\\operatorname{acoth}{%n}", node->right); break;
-
-        case OP_NONE: fprintf(stderr, "Error: OP_NONE detected in tex print\n"); break;
-        default: fprintf(stderr, "Critical error: Unknown op type %d\n", node->value.op); break;
+    assert(buffer); assert(text);
+
+// Пустой кусок (формат начинается с '%') не трогает буфер, который мог быть еще не выделен
+    if (length == 0)
+        return;
+
+// Если память не выделилась, текст пишется напрямую, чтобы отчет не терял куски
+    if (!texBufferReserve(buffer, length)) {
+        fwrite(text, 1, length, buffer->file);
+        return;
     }
+
+    memcpy(buffer->data + buffer->length, text, length);
+    buffer->length += length;
 }
 
 
-static void printAdd(Differentiator* diff, TreeNode* node)
+static void texBufferWriteNumber(TexBuffer* buffer, double number)
 {
-    assert(diff); assert(node); assert(diff->var_table.count != 0);
+    assert(buffer);
 
-    bool is_remainder = node->right == NULL;
+    if (!texBufferReserve(buffer, TEX_NUMBER_SIZE)) {
+        fprintf(buffer->file, "%g", number);
+        return;
+    }
 
-    size_t diff_var_idx = diff->args.derivative_info.diff_var_idx;
-    printTex(diff, "%n", node->left);
-    if (is_remainder) {
-        if (fabs(diff->args.taylor_info.center) < EPS) {
-            printTex(diff, " + o(%s^{%zu})", diff->var_table.variables[diff_var_idx],
-                diff->args.derivative_info.order);
-        } else {
-            printTex(diff, " + o((%s - %g)^{%zu})", diff->var_table.variables[diff_var_idx],
-                diff->args.taylor_info.center, diff->args.derivative_info.order);
-        }
-    } else {
-        printTex(diff, " + %n", node->right);
+    char* end = buffer->data + buffer->length;
+    size_t length = formatShortNumber(number, end);
+    if (length == 0) {
+        int printed = snprintf(end, TEX_NUMBER_SIZE, "%g", number);
+        length = printed > 0 ? (size_t)printed : 0;
     }
+    buffer->length += length;
 }
 
 
-static bool needParentheses(TreeNode* node)
+static size_t formatShortNumber(double number, char* output)
+{
+    assert(output);
+
+    double magnitude = fabs(number);
+    size_t length = 0;
+    if (signbit(number))
+        output[length++] = '-';
+    if (magnitude <= 0) {
+        output[length++] = '0';
+        return length;
+    }
+// Вне этого диапазона (и для NaN) %g переходит к экспоненте, такие числа печатает snprintf
+    if (!(magnitude >= TEX_DECIMAL_POWERS[0] && magnitude < TEX_MAX_FAST_NUMBER))
+        return 0;
+
+// %g оставляет шесть значащих цифр: число масштабируется так, чтобы они стали целой частью
+    size_t power_idx = TEX_DECIMAL_POWER_COUNT - 1;
+    while (magnitude < TEX_DECIMAL_POWERS[power_idx])
+        power_idx--;
+    double scaled = magnitude * TEX_DIGIT_SCALES[power_idx];
+    double fraction = scaled - floor(scaled);
+// Близкие к середине случаи и перенос в новый разряд отдаются snprintf, чтобы округление совпадало
+    if (scaled < TEX_MIN_SCALED_NUMBER || fabs(fraction - 0.5) < TEX_ROUNDING_MARGIN)
+        return 0;
+    unsigned long digits = (unsigned long)scaled + (fraction > 0.5 ? 1 : 0);
+    if (digits >= (unsigned long)TEX_MAX_FAST_NUMBER)
+        return 0;
+
+    char text[TEX_SIGNIFICANT_DIGITS] = "";
+    for (size_t index = TEX_SIGNIFICANT_DIGITS; index != 0; index--) {
+        text[index - 1] = (char)('0' + digits % 10);
+        digits /= 10;
+    }
+
+// Старший разряд стоит на позиции power_idx - 4: отрицательные означают ведущие нули дробной части
+    long exponent = (long)power_idx - 4;
+    size_t integer_digits = exponent >= 0 ? (size_t)exponent + 1 : 0;
+    size_t digit_count = TEX_SIGNIFICANT_DIGITS;
+    while (digit_count > integer_digits && text[digit_count - 1] == '0')
+        digit_count--;
+
+    if (integer_digits == 0)
+        output[length++] = '0';
+    memcpy(output + length, text, integer_digits);
+    length += integer_digits;
+    if (digit_count > integer_digits) {
+        output[length++] = '.';
+        for (long zero = exponent + 1; zero < 0; zero++)
+            output[length++] = '0';
+        memcpy(output + length, text + integer_digits, digit_count - integer_digits);
+        length += digit_count - integer_digits;
+    }
+
+    return length;
+}
+
+
+static void texBufferFlush(TexBuffer* buffer)
+{
+    assert(buffer);
+
+    if (buffer->length != 0)
+        fwrite(buffer->data, 1, buffer->length, buffer->file);
+    buffer->length = 0;
+}
+
+
+static bool texBufferReserve(TexBuffer* buffer, size_t length)
+{
+    assert(buffer);
+
+    if (buffer->length + length <= buffer->capacity)
+        return true;
+
+// Накопленный текст сбрасывается крупными блоками, поэтому буфер не растет вместе с выражением
+    if (buffer->length + length > TEX_BUFFER_FLUSH_SIZE)
+        texBufferFlush(buffer);
+    if (buffer->length + length <= buffer->capacity)
+        return true;
+
+    size_t capacity = buffer->capacity == 0 ? TEX_BUFFER_START_SIZE : buffer->capacity;
+    while (capacity < buffer->length + length)
+        capacity *= 2;
+
+    char* data = (char*)realloc(buffer->data, capacity);
+    if (data == NULL)
+        return false;
+
+    buffer->data = data;
+    buffer->capacity = capacity;
+    return true;
+}
+
+
+static bool needParentheses(const TreeNode* node)
 {
     if (node == NULL || node->parent == NULL) {
         return false;
@@ -199,15 +562,17 @@ static bool needParentheses(TreeNode* node)
 
     OpType parent_op = node->parent->value.op;
     OpType node_op = node->value.op;
-    if (!isBinaryOperator(parent_op)) {
-        if (node->type == NODE_OP && isBinaryOperator(node_op)) {
+    const OperatorLayout* parent_layout = &OPERATOR_LAYOUTS[parent_op < OP_NONE ? parent_op : OP_NONE];
+    const OperatorLayout* node_layout = &OPERATOR_LAYOUTS[node_op < OP_NONE ? node_op : OP_NONE];
+    if (!parent_layout->is_binary) {
+        if (node->type == NODE_OP && node_layout->is_binary) {
             return true;
         }
         return false;
     }
 
-    size_t node_priority = getOperatorPriority(node);
-    size_t parent_priority = getOperatorPriority(node->parent);
+    size_t node_priority = node_layout->priority;
+    size_t parent_priority = parent_layout->priority;
     
     if (parent_priority > node_priority) {
         return true;
@@ -234,35 +599,3 @@ static bool needParentheses(TreeNode* node)
 
     return false;
 }
-
-
-static bool isBinaryOperator(OpType op)
-{
-    switch (op) {
-        case OP_ADD:
-        case OP_SUB:
-        case OP_MUL:
-        case OP_DIV:
-        case OP_POW:
-        case OP_LOG: return true;
-        default:     return false;
-    }
-}
-
-
-static size_t getOperatorPriority(TreeNode* node)
-{
-    assert(node);
-    
-    OpType op = node->value.op;
-    if (op == OP_ADD || op == OP_SUB) {
-        return 1;
-    } else if (op == OP_MUL || op == OP_DIV) {
-        return 2;
-    } else if (op == OP_POW) {
-        return 3;
-    } else {
-        return 4;
-    }
-}
-
@@ -4,10 +4,14 @@
 #include <math.h>
 #include <assert.h>
 #include <stdarg.h>
+#include <unistd.h>
 
 #include "tex_dump/tex_struct.h"
 #include "tex_dump/tex_expression.h"
 #include "tex_dump/plot_generator.h"
+#include "tex_dump/render_pipeline.h"
+#include "tex_dump/render_jobs.h"
+#include "tex_dump/render_cache.h"
 
 #include "diff/diff_defs.h"
 #include "diff/diff_evaluate.h"
@@ -19,6 +23,8 @@
 
 static void printTitle(Differentiator* diff);
 static void openTexDumpFile(Differentiator* diff);
+static bool getDocumentKey(Differentiator* diff, RenderArtifact* artifact);
+static OperationStatus buildDocument(Differentiator* diff, const RenderArtifact* artifact);
 
 
 static const char* TEX_DIRECTORY = "tex";
@@ -106,7 +112,7 @@ void printPlot(Differentiator* diff, size_t tree_idx)
     char output_file[BUFFER_SIZE] = "";
     snprintf(output_file, BUFFER_SIZE, "%s/%s_%03zu", GNUPLOT_IMAGES_DIRECTORY,
         GNUPLOT_OUTPUT_FILENAME, tree_idx);
-    generatePlot(diff, output_file, 1, tree_idx);
+    renderPlot(diff, output_file, tree_idx);
 
     if (tree_idx == 0) {
         printTex(diff,
@@ -162,20 +168,71 @@ OperationStatus texClose(Differentiator* diff)
     assert(fclose(TEX_FILE) == 0);
     TEX_FILE = NULL;
 
-    char command[BUFFER_SIZE * 2] = {}; 
-    snprintf(command, BUFFER_SIZE * 2, "xelatex -interaction=batchmode -output-directory=%s %s > /dev/null",
-        TEX_DIRECTORY, diff->tex_dump.filename);
-    int result = system(command);
-    result = system(command);
-
-    snprintf(command, BUFFER_SIZE * 2, "rm %s.toc %s.log %s.aux %s.out", TEX_FILENAME,
-        TEX_FILENAME, TEX_FILENAME, TEX_FILENAME);
-    result = system(command);
-    if (result != 0) {
-        return STATUS_SYSTEM_CALL_ERROR;
+// Документ собирается только после всех графиков
+    finishPlotting();
+    renderJobsWait();
+
+    RenderArtifact artifact = {};
+    snprintf(artifact.path, sizeof(artifact.path), "%s.pdf", TEX_FILENAME);
+    bool has_key = getDocumentKey(diff, &artifact);
+    OperationStatus status = STATUS_OK;
+    if (!has_key || !renderCacheFetch(&artifact))
+        status = buildDocument(diff, has_key ? &artifact : NULL);
+
+    if (diff->args.cache_info.directory != NULL)
+        renderCachePrintStats(stderr);
+
+    return status;
+}
+
+
+static bool getDocumentKey(Differentiator* diff, RenderArtifact* artifact)
+{
+    assert(diff); assert(artifact);
+
+// PDF зависит от исходника, стиля и всех подключаемых графиков
+    const char* tool = "xelatex";
+    renderCacheKeyInit(artifact);
+    renderCacheKeyAdd(artifact, tool, strlen(tool));
+
+    char style_filename[BUFFER_SIZE] = {};
+    snprintf(style_filename, BUFFER_SIZE, "%s/style.tex", TEX_DIRECTORY);
+
+    return renderCacheHashFile(artifact, diff->tex_dump.filename) &&
+           (access(style_filename, F_OK) != 0 || renderCacheHashFile(artifact, style_filename)) &&
+           renderCacheHashDirectory(artifact, GNUPLOT_IMAGES_DIRECTORY);
+}
+
+
+static OperationStatus buildDocument(Differentiator* diff, const RenderArtifact* artifact)
+{
+    assert(diff);
+
+// Второй проход xelatex нужен для оглавления
+    char output_directory[BUFFER_SIZE] = {};
+    snprintf(output_directory, BUFFER_SIZE, "-output-directory=%s", TEX_DIRECTORY);
+    const char* argv[] = {"xelatex", "-interaction=batchmode", output_directory, diff->tex_dump.filename, NULL};
+    bool is_built = true;
+    for (size_t pass = 0; pass < 2; pass++) {
+        renderJobSubmit(argv, NULL, 0, NULL, true);
+        is_built = renderJobsWait() == STATUS_OK && is_built;
+    }
+
+    if (is_built && artifact != NULL)
+        renderCacheStore(artifact);
+
+    OperationStatus status = STATUS_OK;
+    const char* extensions[] = {"toc", "log", "aux", "out"};
+    for (size_t index = 0; index < sizeof(extensions) / sizeof(extensions[0]); index++) {
+        char filename[BUFFER_SIZE] = {};
+        snprintf(filename, BUFFER_SIZE, "%s.%s", TEX_FILENAME, extensions[index]);
+        if (unlink(filename) != 0) {
+            fprintf(stderr, "An error occurred while deleting the file %s!\n", filename);
+            status = STATUS_SYSTEM_CALL_ERROR;
+        }
     }
     
-    return STATUS_OK;
+    return status;
 }
 
 
@@ -183,9 +240,9 @@ static void openTexDumpFile(Differentiator* diff)
 {
     assert(diff);
 
-    char command[BUFFER_SIZE] = "";
-    snprintf(command, BUFFER_SIZE, "rm -rf %s/images", TEX_DIRECTORY);
-    system(command);
+    char images_directory[BUFFER_SIZE] = "";
+    snprintf(images_directory, BUFFER_SIZE, "%s/images", TEX_DIRECTORY);
+    removeDirectory(images_directory);
 
     snprintf(diff->tex_dump.filename, BUFFER_SIZE, "%s.tex", TEX_FILENAME);
 
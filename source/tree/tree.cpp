@@ -4,15 +4,26 @@
 #include <assert.h>
 
 #include "tree/tree.h"
+#include "tree/tree_stack.h"
 
 #include "diff/diff_defs.h"
 
 #include "status.h"
 
 
+typedef struct {
+    const TreeNode* node;
+    size_t depth;
+} StatsFrame;
+
+
 static OperationStatus nodeVerify(TreeNode* node);
 
 
+// Версии уникальны на весь процесс, поэтому новое дерево на месте старого не совпадет с ним
+static size_t tree_version_counter = 0;
+
+
 OperationStatus treeVerify(BinaryTree* tree)
 {
     assert(tree); assert(tree->root);
@@ -40,23 +51,26 @@ static OperationStatus nodeVerify(TreeNode* node)
 {
     assert(node);
 
-    if (node->parent == NULL)
-        return STATUS_TREE_MISSING_PARENT;
-    if (node->parent->left != node && node->parent->right != node)
-        return STATUS_TREE_PARENT_CHILD_MISMATCH;
-
-    OperationStatus status = STATUS_OK;
-    if (node->left == NULL && node->right == NULL) {
-        return STATUS_OK;
-    } else if (node->left != NULL && node->right != NULL) {
-        status = nodeVerify(node->left);
-        if (status != STATUS_OK) return status;
-        status = nodeVerify(node->right);
-        if (status != STATUS_OK) return status;
-        return STATUS_OK;
+    WorkStack stack = {};
+    workStackInit(&stack, sizeof(TreeNode*));
+
+    OperationStatus status = workStackPush(&stack, &node);
+    TreeNode* current = NULL;
+    while (status == STATUS_OK && workStackPop(&stack, &current)) {
+        if (current->parent == NULL) {
+            status = STATUS_TREE_MISSING_PARENT;
+        } else if (current->parent->left != current && current->parent->right != current) {
+            status = STATUS_TREE_PARENT_CHILD_MISMATCH;
+        } else if (current->right != NULL) {
+            status = workStackPush(&stack, &current->right);
+        }
+        if (status == STATUS_OK && current->left != NULL) {
+            status = workStackPush(&stack, &current->left);
+        }
     }
-   
-    return STATUS_OK;
+
+    workStackDestroy(&stack);
+    return status;
 }
 
 
@@ -79,24 +93,66 @@ OperationStatus treeConstructor(BinaryTree* tree, const char* name,
 
     tree->root = NULL;
     tree->origin = (CreationInfo){name, file, function, line};
+    treeUpdateVersion(tree);
 
     return STATUS_OK;
 }
 
 
-void deleteBranch(TreeNode* node)
+void treeUpdateVersion(BinaryTree* tree)
 {
-    assert(node);
+    assert(tree);
+
+    tree->version = __atomic_add_fetch(&tree_version_counter, 1, __ATOMIC_RELAXED);
+}
 
-    if (node->left) {
-        deleteBranch(node->left);
-        node->left = NULL;
+
+OperationStatus treeCollectStats(const TreeNode* root, TreeStats* stats)
+{
+    assert(root); assert(stats);
+
+    WorkStack stack = {};
+    workStackInit(&stack, sizeof(StatsFrame));
+
+    StatsFrame frame = {root, 1};
+    OperationStatus status = workStackPush(&stack, &frame);
+    while (status == STATUS_OK && workStackPop(&stack, &frame)) {
+        stats->node_count++;
+        if (frame.depth > stats->depth)
+            stats->depth = frame.depth;
+        if ((size_t)frame.node->type < sizeof(stats->type_counts) / sizeof(*stats->type_counts))
+            stats->type_counts[frame.node->type]++;
+
+        if (frame.node->right) {
+            StatsFrame right_frame = {frame.node->right, frame.depth + 1};
+            status = workStackPush(&stack, &right_frame);
+        }
+        if (frame.node->left && status == STATUS_OK) {
+            StatsFrame left_frame = {frame.node->left, frame.depth + 1};
+            status = workStackPush(&stack, &left_frame);
+        }
     }
-    if (node->right) {
-        deleteBranch(node->right);
-        node->right = NULL;
+
+    workStackDestroy(&stack);
+    return status;
+}
+
+
+void deleteBranch(TreeNode* node)
+{
+// Левый ребенок поворотом поднимается наверх, поэтому удаление идет без стека и рекурсии
+    while (node != NULL) {
+        TreeNode* left = node->left;
+        if (left != NULL) {
+            node->left = left->right;
+            left->right = node;
+            node = left;
+        } else {
+            TreeNode* right = node->right;
+            free(node);
+            node = right;
+        }
     }
-    free(node);
 }
 
 
@@ -104,6 +160,7 @@ void treeDestructor(BinaryTree* tree)
 {
     assert(tree);
 
+    tree->version = 0;
     if (tree->root == NULL)
         return;
     deleteBranch(tree->root);
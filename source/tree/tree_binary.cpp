@@ -0,0 +1,614 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <assert.h>
+
+#include "tree/tree_binary.h"
+#include "tree/tree.h"
+#include "tree/tree_stack.h"
+
+#include "diff/diff.h"
+#include "diff/diff_var_table.h"
+#include "diff/diff_defs.h"
+
+#include "status.h"
+
+
+const uint8_t NODE_TAG_TYPE_MASK = 0x3;
+const uint8_t NODE_TAG_LEFT = 0x4;
+const uint8_t NODE_TAG_RIGHT = 0x8;
+
+
+typedef struct {
+    uint8_t* data;
+    size_t size;
+    size_t capacity;
+} ByteBuffer;
+
+
+typedef struct {
+    double* values;
+    size_t count;
+    size_t values_capacity;
+    size_t* slots;
+    size_t slot_count;
+} ConstantTable;
+
+
+typedef struct {
+    const TreeNode* node;
+    bool is_expanded;
+} EncodeFrame;
+
+
+typedef struct {
+    const uint8_t* cursor;
+    const uint8_t* end;
+    const uint8_t* constants;
+    const ForestFileHeader* header;
+} ForestReader;
+
+
+static OperationStatus bufferAppend(ByteBuffer* buffer, const void* data, size_t size);
+static OperationStatus bufferAppendVarint(ByteBuffer* buffer, uint64_t value);
+static OperationStatus bufferAppendString(ByteBuffer* buffer, const char* string);
+
+static OperationStatus constantTableFind(ConstantTable* table, double value, size_t* index);
+static OperationStatus constantTableGrow(ConstantTable* table);
+static size_t hashConstant(double value);
+static void constantTableDestroy(ConstantTable* table);
+
+static OperationStatus encodeTree(ByteBuffer* trees, ByteBuffer* nodes, ConstantTable* constants,
+                                  const TreeNode* root);
+static OperationStatus encodeNode(ByteBuffer* nodes, ConstantTable* constants, WorkStack* indices,
+                                  const TreeNode* node, size_t node_idx);
+static OperationStatus encodeNames(ByteBuffer* names, const Differentiator* diff);
+static OperationStatus writeForestFile(const char* filename, const ForestFileHeader* header,
+                                       const ConstantTable* constants, const ByteBuffer* names,
+                                       const ByteBuffer* trees);
+
+static bool validateForestHeader(const ForestFileHeader* header, size_t file_size);
+static bool readVarint(ForestReader* reader, uint64_t* value);
+static OperationStatus decodeNames(Differentiator* diff, ForestReader* reader);
+static OperationStatus decodeTree(Differentiator* diff, ForestReader* reader, TreeNode** root);
+static OperationStatus decodeNode(TreeNode** nodes, size_t node_idx, ForestReader* reader,
+                                  size_t* linked_count);
+static OperationStatus linkChild(TreeNode* parent, TreeNode* child, TreeNode** slot, size_t* linked_count);
+
+
+OperationStatus diffSaveForest(const Differentiator* diff, const char* filename)
+{
+    assert(diff); assert(diff->forest.trees); assert(filename);
+
+    ByteBuffer trees = {};
+    ByteBuffer nodes = {};
+    ByteBuffer names = {};
+    ConstantTable constants = {};
+
+    OperationStatus status = STATUS_OK;
+    for (size_t index = 0; index < diff->forest.count && status == STATUS_OK; index++)
+        status = encodeTree(&trees, &nodes, &constants, diff->forest.trees[index].root);
+    if (status == STATUS_OK)
+        status = encodeNames(&names, diff);
+
+    if (status == STATUS_OK) {
+        ForestFileHeader header = {};
+        header.magic = FOREST_FILE_MAGIC;
+        header.version = FOREST_FILE_VERSION;
+        header.tree_count = (uint32_t)diff->forest.count;
+        header.variable_count = (uint32_t)diff->var_table.count;
+        header.constant_count = (uint32_t)constants.count;
+        header.diff_var_idx = (uint32_t)diff->args.derivative_info.diff_var_idx;
+        header.constants_offset = sizeof(ForestFileHeader);
+        header.names_offset = header.constants_offset + constants.count * sizeof(double);
+        header.trees_offset = header.names_offset + names.size;
+        header.file_size = header.trees_offset + trees.size;
+
+        status = writeForestFile(filename, &header, &constants, &names, &trees);
+    }
+
+    free(trees.data);
+    free(nodes.data);
+    free(names.data);
+    constantTableDestroy(&constants);
+    return status;
+}
+
+
+static OperationStatus bufferAppend(ByteBuffer* buffer, const void* data, size_t size)
+{
+    assert(buffer); assert(data);
+
+    if (buffer->size + size > buffer->capacity) {
+        size_t capacity = buffer->capacity != 0 ? buffer->capacity : BUFFER_SIZE;
+        while (buffer->size + size > capacity)
+            capacity *= 2;
+
+        void* temp_ptr = realloc(buffer->data, capacity);
+        if (temp_ptr == NULL)
+            return STATUS_SYSTEM_OUT_OF_MEMORY;
+        buffer->data = (uint8_t*)temp_ptr;
+        buffer->capacity = capacity;
+    }
+
+    memcpy(buffer->data + buffer->size, data, size);
+    buffer->size += size;
+    return STATUS_OK;
+}
+
+
+static OperationStatus bufferAppendVarint(ByteBuffer* buffer, uint64_t value)
+{
+    assert(buffer);
+
+// По 7 бит на байт, старший бит означает продолжение
+    uint8_t bytes[10] = {};
+    size_t length = 0;
+    do {
+        bytes[length] = (uint8_t)(value & 0x7F);
+        value >>= 7;
+        if (value != 0)
+            bytes[length] |= 0x80;
+        length++;
+    } while (value != 0);
+
+    return bufferAppend(buffer, bytes, length);
+}
+
+
+static OperationStatus bufferAppendString(ByteBuffer* buffer, const char* string)
+{
+    assert(buffer);
+
+    size_t length = string != NULL ? strlen(string) : 0;
+    OperationStatus status = bufferAppendVarint(buffer, length);
+    if (status == STATUS_OK && length != 0)
+        status = bufferAppend(buffer, string, length);
+
+    return status;
+}
+
+
+static OperationStatus constantTableFind(ConstantTable* table, double value, size_t* index)
+{
+    assert(table); assert(index);
+
+    if (2 * (table->count + 1) > table->slot_count) {
+        OperationStatus status = constantTableGrow(table);
+        RETURN_IF_STATUS_NOT_OK(status);
+    }
+
+// Константы сравниваются побитово, в слоте хранится индекс + 1, ноль означает пустой слот
+    size_t mask = table->slot_count - 1;
+    for (size_t slot = hashConstant(value) & mask;; slot = (slot + 1) & mask) {
+        if (table->slots[slot] == 0) {
+            if (table->count == table->values_capacity) {
+                size_t capacity = table->values_capacity != 0 ? 2 * table->values_capacity : START_ELEMENT_COUNT;
+                void* temp_ptr = realloc(table->values, capacity * sizeof(double));
+                if (temp_ptr == NULL)
+                    return STATUS_SYSTEM_OUT_OF_MEMORY;
+                table->values = (double*)temp_ptr;
+                table->values_capacity = capacity;
+            }
+
+            table->values[table->count] = value;
+            table->slots[slot] = ++table->count;
+            *index = table->count - 1;
+            return STATUS_OK;
+        }
+
+        if (memcmp(&table->values[table->slots[slot] - 1], &value, sizeof(double)) == 0) {
+            *index = table->slots[slot] - 1;
+            return STATUS_OK;
+        }
+    }
+}
+
+
+static OperationStatus constantTableGrow(ConstantTable* table)
+{
+    assert(table);
+
+    size_t slot_count = table->slot_count != 0 ? 2 * table->slot_count : 2 * START_ELEMENT_COUNT;
+    size_t* slots = (size_t*)calloc(slot_count, sizeof(size_t));
+    if (slots == NULL)
+        return STATUS_SYSTEM_OUT_OF_MEMORY;
+
+    for (size_t index = 0; index < table->count; index++) {
+        size_t slot = hashConstant(table->values[index]) & (slot_count - 1);
+        while (slots[slot] != 0)
+            slot = (slot + 1) & (slot_count - 1);
+        slots[slot] = index + 1;
+    }
+
+    free(table->slots);
+    table->slots = slots;
+    table->slot_count = slot_count;
+    return STATUS_OK;
+}
+
+
+static size_t hashConstant(double value)
+{
+    uint64_t bits = 0;
+    memcpy(&bits, &value, sizeof(bits));
+
+    bits ^= bits >> 33;
+    bits *= 0xFF51AFD7ED558CCDULL;
+    bits ^= bits >> 33;
+    return bits;
+}
+
+
+static void constantTableDestroy(ConstantTable* table)
+{
+    assert(table);
+
+    free(table->values);
+    free(table->slots);
+    *table = (ConstantTable){};
+}
+
+
+static OperationStatus encodeTree(ByteBuffer* trees, ByteBuffer* nodes, ConstantTable* constants,
+                                  const TreeNode* root)
+{
+    assert(trees); assert(nodes); assert(constants);
+
+    WorkStack frames = {};
+    WorkStack indices = {};
+    workStackInit(&frames, sizeof(EncodeFrame));
+    workStackInit(&indices, sizeof(size_t));
+
+// Узлы пишутся в обратном порядке обхода: правый ребенок всегда стоит прямо перед родителем,
+// для левого при наличии правого записывается расстояние до него
+    nodes->size = 0;
+    size_t node_count = 0;
+    EncodeFrame frame = {root, false};
+    OperationStatus status = root != NULL ? workStackPush(&frames, &frame) : STATUS_OK;
+    while (status == STATUS_OK && workStackPop(&frames, &frame)) {
+        if (frame.is_expanded) {
+            status = encodeNode(nodes, constants, &indices, frame.node, node_count++);
+            continue;
+        }
+
+        EncodeFrame next = {frame.node, true};
+        status = workStackPush(&frames, &next);
+        if (status == STATUS_OK && frame.node->right != NULL) {
+            next = (EncodeFrame){frame.node->right, false};
+            status = workStackPush(&frames, &next);
+        }
+        if (status == STATUS_OK && frame.node->left != NULL) {
+            next = (EncodeFrame){frame.node->left, false};
+            status = workStackPush(&frames, &next);
+        }
+    }
+
+    if (status == STATUS_OK)
+        status = bufferAppendVarint(trees, node_count);
+    if (status == STATUS_OK && nodes->size != 0)
+        status = bufferAppend(trees, nodes->data, nodes->size);
+
+    workStackDestroy(&frames);
+    workStackDestroy(&indices);
+    return status;
+}
+
+
+static OperationStatus encodeNode(ByteBuffer* nodes, ConstantTable* constants, WorkStack* indices,
+                                  const TreeNode* node, size_t node_idx)
+{
+    assert(nodes); assert(constants); assert(indices); assert(node);
+
+    uint8_t tag = (uint8_t)node->type;
+    if (node->left != NULL)
+        tag |= NODE_TAG_LEFT;
+    if (node->right != NULL)
+        tag |= NODE_TAG_RIGHT;
+
+    uint64_t payload = 0;
+    OperationStatus status = STATUS_OK;
+    switch (node->type) {
+        case NODE_OP:  payload = (uint64_t)node->value.op; break;
+        case NODE_VAR: payload = node->value.var_idx; break;
+        case NODE_NUM: {
+            size_t constant_idx = 0;
+            status = constantTableFind(constants, node->value.num_val, &constant_idx);
+            payload = constant_idx;
+            break;
+        }
+        default: return STATUS_TREE_INVALID_BRANCH_STRUCTURE;
+    }
+
+    size_t left_idx = 0;
+    size_t right_idx = 0;
+    if (node->right != NULL)
+        workStackPop(indices, &right_idx);
+    if (node->left != NULL)
+        workStackPop(indices, &left_idx);
+
+    if (status == STATUS_OK)
+        status = bufferAppend(nodes, &tag, sizeof(tag));
+    if (status == STATUS_OK)
+        status = bufferAppendVarint(nodes, payload);
+    if (status == STATUS_OK && node->left != NULL && node->right != NULL)
+        status = bufferAppendVarint(nodes, node_idx - left_idx);
+    if (status == STATUS_OK)
+        status = workStackPush(indices, &node_idx);
+
+    return status;
+}
+
+
+static OperationStatus encodeNames(ByteBuffer* names, const Differentiator* diff)
+{
+    assert(names); assert(diff);
+
+    OperationStatus status = STATUS_OK;
+    for (size_t index = 0; index < diff->var_table.count && status == STATUS_OK; index++)
+        status = bufferAppendString(names, diff->var_table.variables[index].name);
+    if (status == STATUS_OK)
+        status = bufferAppendString(names, diff->tex_dump.function_name);
+
+    return status;
+}
+
+
+static OperationStatus writeForestFile(const char* filename, const ForestFileHeader* header,
+                                       const ConstantTable* constants, const ByteBuffer* names,
+                                       const ByteBuffer* trees)
+{
+    assert(filename); assert(header); assert(constants); assert(names); assert(trees);
+
+    FILE* file = fopen(filename, "wb");
+    if (file == NULL)
+        return STATUS_IO_FILE_OPEN_ERROR;
+
+    OperationStatus status = STATUS_OK;
+    if (fwrite(header, sizeof(*header), 1, file) != 1 ||
+        fwrite(constants->values, sizeof(double), constants->count, file) != constants->count ||
+        fwrite(names->data, 1, names->size, file) != names->size ||
+        fwrite(trees->data, 1, trees->size, file) != trees->size) {
+        status = STATUS_IO_FILE_WRITE_ERROR;
+    }
+
+    if (fclose(file) != 0 && status == STATUS_OK)
+        status = STATUS_IO_FILE_CLOSE_ERROR;
+    return status;
+}
+
+
+OperationStatus diffLoadForest(Differentiator* diff, const char* filename)
+{
+    assert(diff); assert(diff->forest.trees); assert(diff->forest.count == 0);
+    assert(diff->var_table.count == 0); assert(filename);
+
+    int fd = open(filename, O_RDONLY);
+    if (fd == -1)
+        return STATUS_IO_FILE_OPEN_ERROR;
+
+    struct stat info = {};
+    void* data = MAP_FAILED;
+    if (fstat(fd, &info) == 0 && (size_t)info.st_size >= sizeof(ForestFileHeader))
+        data = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        return STATUS_IO_FILE_READ_ERROR;
+
+    size_t file_size = (size_t)info.st_size;
+    const ForestFileHeader* header = (const ForestFileHeader*)data;
+    if (!validateForestHeader(header, file_size)) {
+        munmap(data, file_size);
+        return STATUS_IO_FILE_READ_ERROR;
+    }
+
+// Константы берутся прямо из отображения, имена и узлы читаются одним линейным проходом
+    const uint8_t* bytes = (const uint8_t*)data;
+    ForestReader reader = {bytes + header->names_offset, bytes + header->trees_offset,
+        bytes + header->constants_offset, header};
+
+    OperationStatus status = decodeNames(diff, &reader);
+    if (status == STATUS_OK)
+        status = diffForestReserve(diff, header->tree_count);
+
+    reader.end = bytes + header->file_size;
+    for (size_t index = 0; index < header->tree_count && status == STATUS_OK; index++) {
+        TREE_CREATE(&diff->forest.trees[index]);
+        status = decodeTree(diff, &reader, &diff->forest.trees[index].root);
+        if (status == STATUS_OK)
+            diff->forest.count++;
+    }
+
+    if (status == STATUS_OK && reader.cursor != reader.end)
+        status = STATUS_IO_FILE_READ_ERROR;
+
+    munmap(data, file_size);
+    return status;
+}
+
+
+static bool validateForestHeader(const ForestFileHeader* header, size_t file_size)
+{
+    assert(header);
+
+    if (header->magic != FOREST_FILE_MAGIC || header->version != FOREST_FILE_VERSION)
+        return false;
+    if (header->file_size != file_size || header->tree_count == 0)
+        return false;
+    if (header->constants_offset < sizeof(ForestFileHeader) || header->constants_offset % sizeof(double) != 0)
+        return false;
+    if (header->constants_offset > file_size ||
+        header->constant_count > (file_size - header->constants_offset) / sizeof(double))
+        return false;
+    if (header->names_offset < header->constants_offset + header->constant_count * sizeof(double) ||
+        header->trees_offset < header->names_offset || header->trees_offset > file_size)
+        return false;
+    if (header->variable_count != 0 && header->diff_var_idx >= header->variable_count)
+        return false;
+
+    return true;
+}
+
+
+static bool readVarint(ForestReader* reader, uint64_t* value)
+{
+    assert(reader); assert(value);
+
+    *value = 0;
+    for (unsigned shift = 0; shift < 64 && reader->cursor < reader->end; shift += 7) {
+        uint8_t byte = *reader->cursor++;
+        *value |= (uint64_t)(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0)
+            return true;
+    }
+
+    return false;
+}
+
+
+static OperationStatus decodeNames(Differentiator* diff, ForestReader* reader)
+{
+    assert(diff); assert(reader);
+
+    OperationStatus status = STATUS_OK;
+    uint64_t length = 0;
+    for (size_t index = 0; index < reader->header->variable_count && status == STATUS_OK; index++) {
+        if (!readVarint(reader, &length) || length == 0 || length > (size_t)(reader->end - reader->cursor))
+            return STATUS_IO_FILE_READ_ERROR;
+
+        size_t var_idx = 0;
+        status = addVariable(diff, &var_idx, (const char*)reader->cursor, length);
+        if (status == STATUS_OK && var_idx != index)
+            status = STATUS_IO_FILE_READ_ERROR;
+        reader->cursor += length;
+    }
+    RETURN_IF_STATUS_NOT_OK(status);
+
+    if (!readVarint(reader, &length) || length > (size_t)(reader->end - reader->cursor))
+        return STATUS_IO_FILE_READ_ERROR;
+    if (length != 0) {
+        char* function_name = (char*)calloc(length + 1, 1);
+        if (function_name == NULL)
+            return STATUS_SYSTEM_OUT_OF_MEMORY;
+        memcpy(function_name, reader->cursor, length);
+
+        free(diff->tex_dump.function_name);
+        diff->tex_dump.function_name = function_name;
+        reader->cursor += length;
+    }
+
+    diff->args.derivative_info.diff_var_idx = reader->header->diff_var_idx;
+    return reader->cursor == reader->end ? STATUS_OK : STATUS_IO_FILE_READ_ERROR;
+}
+
+
+static OperationStatus decodeTree(Differentiator* diff, ForestReader* reader, TreeNode** root)
+{
+    assert(diff); assert(reader); assert(root);
+
+// Каждый узел занимает минимум два байта, это ограничивает размер массива до его выделения
+    uint64_t node_count = 0;
+    if (!readVarint(reader, &node_count) || node_count == 0 ||
+        node_count > (size_t)(reader->end - reader->cursor) / 2)
+        return STATUS_IO_FILE_READ_ERROR;
+
+    TreeNode** nodes = (TreeNode**)calloc(node_count, sizeof(TreeNode*));
+    if (nodes == NULL)
+        return STATUS_SYSTEM_OUT_OF_MEMORY;
+
+    OperationStatus status = STATUS_OK;
+    size_t linked_count = 0;
+    for (size_t index = 0; index < node_count && status == STATUS_OK; index++)
+        status = decodeNode(nodes, index, reader, &linked_count);
+
+// Ровно n - 1 связей при ссылках только назад дают одно дерево с корнем в последнем узле
+    if (status == STATUS_OK && linked_count != node_count - 1)
+        status = STATUS_TREE_INVALID_BRANCH_STRUCTURE;
+
+    if (status == STATUS_OK) {
+        *root = nodes[node_count - 1];
+    } else {
+        for (size_t index = 0; index < node_count; index++)
+            free(nodes[index]);
+    }
+
+    free(nodes);
+    return status;
+}
+
+
+static OperationStatus decodeNode(TreeNode** nodes, size_t node_idx, ForestReader* reader,
+                                  size_t* linked_count)
+{
+    assert(nodes); assert(reader); assert(linked_count);
+
+    uint64_t payload = 0;
+    if (reader->cursor == reader->end)
+        return STATUS_IO_FILE_READ_ERROR;
+    uint8_t tag = *reader->cursor++;
+    if ((tag & ~(NODE_TAG_TYPE_MASK | NODE_TAG_LEFT | NODE_TAG_RIGHT)) != 0 || !readVarint(reader, &payload))
+        return STATUS_IO_FILE_READ_ERROR;
+
+    OperationStatus status = createNode(&nodes[node_idx]);
+    RETURN_IF_STATUS_NOT_OK(status);
+    TreeNode* node = nodes[node_idx];
+
+    switch ((NodeType)(tag & NODE_TAG_TYPE_MASK)) {
+        case NODE_OP:
+            if (payload >= OP_NONE)
+                return STATUS_IO_FILE_READ_ERROR;
+            node->type = NODE_OP;
+            node->value.op = (OpType)payload;
+            break;
+        case NODE_VAR:
+            if (payload >= reader->header->variable_count)
+                return STATUS_IO_FILE_READ_ERROR;
+            node->type = NODE_VAR;
+            node->value.var_idx = payload;
+            break;
+        case NODE_NUM:
+            if (payload >= reader->header->constant_count)
+                return STATUS_IO_FILE_READ_ERROR;
+            node->type = NODE_NUM;
+            memcpy(&node->value.num_val, reader->constants + payload * sizeof(double), sizeof(double));
+            break;
+        default:
+            return STATUS_IO_FILE_READ_ERROR;
+    }
+
+    uint64_t left_offset = 1;
+    if ((tag & NODE_TAG_RIGHT) != 0) {
+        if (node_idx == 0)
+            return STATUS_TREE_INVALID_BRANCH_STRUCTURE;
+        status = linkChild(node, nodes[node_idx - 1], &node->right, linked_count);
+        RETURN_IF_STATUS_NOT_OK(status);
+
+        if ((tag & NODE_TAG_LEFT) != 0 && !readVarint(reader, &left_offset))
+            return STATUS_IO_FILE_READ_ERROR;
+    }
+    if ((tag & NODE_TAG_LEFT) != 0) {
+        if (left_offset == 0 || left_offset > node_idx)
+            return STATUS_TREE_INVALID_BRANCH_STRUCTURE;
+        status = linkChild(node, nodes[node_idx - left_offset], &node->left, linked_count);
+    }
+
+    return status;
+}
+
+
+static OperationStatus linkChild(TreeNode* parent, TreeNode* child, TreeNode** slot, size_t* linked_count)
+{
+    assert(parent); assert(child); assert(slot); assert(linked_count);
+
+    if (child->parent != NULL)
+        return STATUS_TREE_INVALID_BRANCH_STRUCTURE;
+
+    child->parent = parent;
+    *slot = child;
+    (*linked_count)++;
+    return STATUS_OK;
+}
@@ -1,13 +1,14 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/stat.h>
 #include <assert.h>
-#include <errno.h>
 
 #include "tree/tree_io.h"
 #include "tree/tree.h"
 #include "tree/tree_parse.h"
+#include "tree/tree_source.h"
+#include "tree/tree_lexer.h"
+#include "tree/tree_stack.h"
 
 #include "diff/diff_var_table.h"
 #include "diff/diff_defs.h"
@@ -17,20 +18,16 @@
 
 static OperationStatus treeInfixLoad(Differentiator* diff, size_t tree_idx, FILE* input_file);
 static OperationStatus treePrefixLoad(Differentiator* diff, size_t tree_idx, FILE* input_file);
+static OperationStatus treeInfixParse(Differentiator* diff, size_t tree_idx, SourceStream* stream);
 
-static OperationStatus parseNode(TreeNode** node, Differentiator* diff,
-    char* src_code, int* position);
-static OperationStatus readNode(TreeNode** node, Differentiator* diff,
-    char* src_code, int* position);
-static OperationStatus readTitle(TreeNode* node, Differentiator* diff,
-    char* src_code, int* position);
+static OperationStatus readTree(TreeNode** root, Differentiator* diff, Lexer* lexer);
+static OperationStatus closeNodes(WorkStack* stack, TreeNode*** slot, Lexer* lexer);
+static OperationStatus readNode(TreeNode** node, Differentiator* diff, Lexer* lexer);
+static OperationStatus readTitle(TreeNode* node, Differentiator* diff, Lexer* lexer);
+static OperationStatus lexerError(const Lexer* lexer);
 
-static OperationStatus getFunctionName(Differentiator* diff, char* buffer, size_t length);
-static void getParameters(Differentiator* diff, char* buffer);
-
-static OpType getOpType(const char* buffer);
-static inline void skipWhitespaces(char* src_code, int* position);
-static size_t getFileSize(FILE* input_file);
+static OperationStatus getFunctionName(Differentiator* diff, const char* buffer, size_t length);
+static void getParameters(Differentiator* diff, const SourceStream* stream);
 
 
 OperationStatus diffLoadExpression(Differentiator* diff)
@@ -40,7 +37,8 @@ OperationStatus diffLoadExpression(Differentiator* diff)
     OperationStatus status = TREE_CREATE(&diff->forest.trees[0]);
     RETURN_IF_STATUS_NOT_OK(status);
 
-    FILE* input_file = fopen(diff->args.input_file, "r");
+    bool is_stdin = strcmp(diff->args.input_file, "-") == 0;
+    FILE* input_file = is_stdin ? stdin : fopen(diff->args.input_file, "r");
     if (input_file == NULL) {
         return STATUS_IO_FILE_OPEN_ERROR;
     }
@@ -50,7 +48,7 @@ OperationStatus diffLoadExpression(Differentiator* diff)
     } else {
         status = treePrefixLoad(diff, 0, input_file);
     }
-    if (fclose(input_file) != 0 && status == STATUS_OK) {
+    if (!is_stdin && fclose(input_file) != 0 && status == STATUS_OK) {
         status = STATUS_IO_FILE_CLOSE_ERROR;
     }
 
@@ -59,168 +57,232 @@ OperationStatus diffLoadExpression(Differentiator* diff)
 }
 
 
+OperationStatus diffParseExpression(Differentiator* diff, const char* text, size_t length)
+{
+    assert(diff); assert(diff->forest.trees); assert(diff->forest.count == 0); assert(text);
+
+    OperationStatus status = TREE_CREATE(&diff->forest.trees[0]);
+    RETURN_IF_STATUS_NOT_OK(status);
+
+    SourceStream stream = {};
+    if (diff->args.infix_input) {
+// Имя функции перед '=' необязательно
+        const char* equal_sign = (const char*)memchr(text, '=', length);
+        if (equal_sign != NULL) {
+            size_t name_length = (size_t)(equal_sign + 1 - text);
+            status = getFunctionName(diff, text, name_length);
+            text += name_length;
+            length -= name_length;
+        }
+
+        sourceStreamOpenMemory(&stream, text, length);
+        if (status == STATUS_OK)
+            status = treeInfixParse(diff, 0, &stream);
+    } else {
+        sourceStreamOpenMemory(&stream, text, length);
+        Lexer lexer = {};
+        lexerInit(&lexer, &stream, LEXER_PREFIX);
+        status = readTree(&diff->forest.trees[0].root, diff, &lexer);
+        lexerDestroy(&lexer);
+    }
+
+    diff->forest.count++;
+    return status;
+}
+
+
 static OperationStatus treeInfixLoad(Differentiator* diff, size_t tree_idx, FILE* input_file)
 {
     assert(diff); assert(tree_idx < diff->forest.capacity); assert(input_file);
- 
-    size_t file_size = getFileSize(input_file);
-    if (file_size == 0) {
-        return STATUS_IO_FILE_EMPTY;
-    }
 
-    char* src_code = (char*)calloc(file_size + 1, 1);
-    if (src_code == NULL) {
-        return STATUS_SYSTEM_OUT_OF_MEMORY;
-    }
+    SourceBuffer source = {};
+    OperationStatus status = sourceBufferLoad(&source, input_file);
+    RETURN_IF_STATUS_NOT_OK(status);
 
-    size_t read_size = fread(src_code, 1, file_size, input_file);
-    if (read_size != file_size) {
+    const char* equal_sign = (const char*)memchr(source.data, '=', source.size);
+    if (equal_sign == NULL) {
+        sourceBufferRelease(&source);
         return STATUS_IO_FILE_READ_ERROR;
     }
 
-    char* buffer = strchr(src_code, '=') + 1;
-    size_t length = (size_t)(buffer - src_code);
-    OperationStatus status = getFunctionName(diff, src_code, length);
-    if (status != STATUS_OK) {
-        free(src_code);
-        return status;
-    }
-    diff->forest.trees[tree_idx].root = getTree(diff, &buffer);
-    getParameters(diff, buffer);
+    size_t length = (size_t)(equal_sign + 1 - source.data);
+    status = getFunctionName(diff, source.data, length);
+    if (status == STATUS_OK) {
+        SourceStream stream = {};
+        sourceStreamOpenMemory(&stream, equal_sign + 1, source.size - length);
 
-    free(src_code);
-    if (diff->forest.trees[tree_idx].root == NULL) {
-        return STATUS_IO_FILE_READ_ERROR;
+        status = treeInfixParse(diff, tree_idx, &stream);
+        if (status == STATUS_OK)
+            getParameters(diff, &stream);
     }
 
-    return STATUS_OK;
+    sourceBufferRelease(&source);
+    return status;
 }
 
 
-static OperationStatus treePrefixLoad(Differentiator* diff, size_t tree_idx, FILE* input_file)
+static OperationStatus treeInfixParse(Differentiator* diff, size_t tree_idx, SourceStream* stream)
 {
-    assert(diff); assert(diff->forest.trees); assert(input_file);
-    
-    size_t file_size = getFileSize(input_file);
-    if (file_size == 0) {
-        return STATUS_IO_FILE_EMPTY;
-    }
+    assert(diff); assert(diff->forest.trees); assert(stream);
 
-    char* src_code = (char*)calloc(file_size + 1, 1);
-    if (src_code == NULL) {
-        return STATUS_SYSTEM_OUT_OF_MEMORY;
-    }
+    Lexer lexer = {};
+    lexerInit(&lexer, stream, LEXER_INFIX);
 
     OperationStatus status = STATUS_OK;
-    size_t read_size = fread(src_code, 1, file_size, input_file);
-    if (read_size != file_size) {
+    diff->forest.trees[tree_idx].root = getTree(diff, &lexer);
+    if (diff->forest.trees[tree_idx].root == NULL)
         status = STATUS_IO_FILE_READ_ERROR;
-    }
-    if (status == STATUS_OK) {
-        int position = 0;    
-        status = readNode(&diff->forest.trees[tree_idx].root, diff, src_code, &position);
-    }
 
-    free(src_code);
+    lexerDestroy(&lexer);
     return status;
 }
 
 
-static OperationStatus parseNode(TreeNode** node, Differentiator* diff,
-    char* src_code, int* position)
+static OperationStatus treePrefixLoad(Differentiator* diff, size_t tree_idx, FILE* input_file)
 {
-    assert(node); ; assert(diff); assert(diff->var_table.variables); 
-    assert(src_code); assert(position);
+    assert(diff); assert(diff->forest.trees); assert(input_file);
 
-    OperationStatus status = createNode(node);
+    SourceStream stream = {};
+    OperationStatus status = sourceStreamOpen(&stream, input_file);
     RETURN_IF_STATUS_NOT_OK(status);
-    (*position)++;
 
-    skipWhitespaces(src_code, position);
+    Lexer lexer = {};
+    lexerInit(&lexer, &stream, LEXER_PREFIX);
+    status = readTree(&diff->forest.trees[tree_idx].root, diff, &lexer);
 
-    status = readTitle(*node, diff, src_code, position);
-    RETURN_IF_STATUS_NOT_OK(status);
+    lexerDestroy(&lexer);
+    sourceStreamClose(&stream);
+    return status;
+}
 
-    skipWhitespaces(src_code, position);
-    status = readNode(&(*node)->left, diff, src_code, position);
-    RETURN_IF_STATUS_NOT_OK(status);
-    if ((*node)->left != NULL)
-        (*node)->left->parent = *node;
 
-    skipWhitespaces(src_code, position);
-    status = readNode(&(*node)->right, diff, src_code, position);
-    RETURN_IF_STATUS_NOT_OK(status);
-    if ((*node)->right != NULL)
-        (*node)->right->parent = *node;
+static OperationStatus readTree(TreeNode** root, Differentiator* diff, Lexer* lexer)
+{
+    assert(root); assert(diff); assert(diff->var_table.variables); assert(lexer);
 
-    skipWhitespaces(src_code, position);
-    (*position)++;
+    WorkStack stack = {};
+    workStackInit(&stack, sizeof(TreeNode*));
 
-    return STATUS_OK;
+// В стеке лежат открытые узлы, slot указывает на поле, куда будет прочитан следующий узел
+    TreeNode** slot = root;
+    TreeNode* parent = NULL;
+    OperationStatus status = STATUS_OK;
+    while (status == STATUS_OK) {
+        status = readNode(slot, diff, lexer);
+        if (status != STATUS_OK)
+            break;
+        if (*slot != NULL) {
+            (*slot)->parent = parent;
+            parent = *slot;
+            status = workStackPush(&stack, slot);
+            slot = &parent->left;
+            continue;
+        }
+
+        status = closeNodes(&stack, &slot, lexer);
+        if (status != STATUS_OK || stack.count == 0)
+            break;
+        parent = *(TreeNode**)workStackTop(&stack);
+    }
+
+    workStackDestroy(&stack);
+    return status;
 }
 
 
-static OperationStatus readNode(TreeNode** node, Differentiator* diff,
-    char* src_code, int* position)
+static OperationStatus closeNodes(WorkStack* stack, TreeNode*** slot, Lexer* lexer)
 {
-    assert(node); ; assert(diff); assert(diff->var_table.variables); 
-    assert(src_code); assert(position);
+    assert(stack); assert(slot); assert(*slot); assert(lexer);
+
+    TreeNode* node = NULL;
+    while (stack->count != 0) {
+        node = *(TreeNode**)workStackTop(stack);
+        if (*slot == &node->left) {
+            *slot = &node->right;
+            return STATUS_OK;
+        }
 
-    skipWhitespaces(src_code, position);
+        if (!lexerIsSymbol(lexer, ')'))
+            return lexerError(lexer);
+        lexerConsume(lexer);
 
-    if (src_code[*position] == '(') {
-        return parseNode(node, diff, src_code, position);
-    } else if (strncmp(&src_code[*position], "nil", 3) == 0) {
-        (*position) += 3;
-        *node = NULL;
-        return STATUS_OK;
+        workStackPop(stack, &node);
+        if (node->parent != NULL) {
+            *slot = node->parent->left == node ? &node->parent->left : &node->parent->right;
+        }
     }
- 
-    return STATUS_IO_FILE_READ_ERROR;
+
+    return STATUS_OK;
 }
 
 
-static OperationStatus readTitle(TreeNode* node, Differentiator* diff,
-    char* src_code, int* position)
+static OperationStatus readNode(TreeNode** node, Differentiator* diff, Lexer* lexer)
 {
-    assert(node); ; assert(diff); assert(diff->var_table.variables); 
-    assert(src_code); assert(position);
+    assert(node); assert(diff); assert(diff->var_table.variables); assert(lexer);
 
-    char buffer[BUFFER_SIZE] = {};
-    int read_count = 0;
-    int result = sscanf(&src_code[*position], "%s%n", buffer, &read_count);
-    *position += read_count;
-    if (result != 1) {
-        return STATUS_IO_FILE_READ_ERROR;
+    if (lexerIsSymbol(lexer, '(')) {
+        OperationStatus status = createNode(node);
+        RETURN_IF_STATUS_NOT_OK(status);
+        lexerConsume(lexer);
+
+        return readTitle(*node, diff, lexer);
     }
 
-    OpType optype = getOpType(buffer);
-    if (optype != OP_NONE) {
-        node->type = NODE_OP;
-        node->value.op = optype;
+    const Token* token = lexerPeek(lexer);
+    if (token->type == TOKEN_IDENTIFIER && token->length == 3 &&
+        strncmp(token->text, "nil", 3) == 0) {
+        lexerConsume(lexer);
+        *node = NULL;
         return STATUS_OK;
     }
+ 
+    return lexerError(lexer);
+}
+
+
+static OperationStatus readTitle(TreeNode* node, Differentiator* diff, Lexer* lexer)
+{
+    assert(node); assert(diff); assert(diff->var_table.variables); assert(lexer);
 
-    char* endptr = NULL;
-    double value = strtod(buffer, &endptr);
-    assert(endptr);
+    const Token* token = lexerPeek(lexer);
     OperationStatus status = STATUS_OK;
-    if (*endptr == '\0') {
-        node->type = NODE_NUM;
-        node->value.num_val = value;
-        status = STATUS_OK;
-    } else if (endptr == buffer) {
-        node->type = NODE_VAR;
-        status = addVariable(diff, &node->value.var_idx, buffer, strlen(buffer));
-    } else {
-        status = STATUS_PARSER_INVALID_IDENTIFIER;
+    switch (token->type) {
+        case TOKEN_OPERATOR:
+            node->type = NODE_OP;
+            node->value.op = token->op;
+            break;
+        case TOKEN_NUMBER:
+            node->type = NODE_NUM;
+            node->value.num_val = token->number;
+            break;
+        case TOKEN_IDENTIFIER:
+            node->type = NODE_VAR;
+            status = addVariable(diff, &node->value.var_idx, token->text, token->length);
+            break;
+        case TOKEN_INVALID:
+            status = lexer->status != STATUS_OK ? lexer->status : STATUS_PARSER_INVALID_IDENTIFIER;
+            break;
+        case TOKEN_END:
+        case TOKEN_SYMBOL:
+        default:
+            status = STATUS_IO_FILE_READ_ERROR;
+            break;
     }
+    lexerConsume(lexer);
 
     return status;
 }
 
 
-static OperationStatus getFunctionName(Differentiator* diff, char* buffer, size_t length)
+static OperationStatus lexerError(const Lexer* lexer)
+{
+    assert(lexer);
+
+    return lexer->status != STATUS_OK ? lexer->status : STATUS_IO_FILE_READ_ERROR;
+}
+
+
+static OperationStatus getFunctionName(Differentiator* diff, const char* buffer, size_t length)
 {
     assert(diff); assert(buffer);
 
@@ -237,9 +299,14 @@ static OperationStatus getFunctionName(Differentiator* diff, char* buffer, size_
 }
 
 
-static void getParameters(Differentiator* diff, char* buffer)
+static void getParameters(Differentiator* diff, const SourceStream* stream)
 {
-    assert(diff); assert(buffer);
+    assert(diff); assert(stream); assert(stream->file == NULL);
+
+    char buffer[BUFFER_SIZE] = {};
+    size_t remaining = stream->chunk_size - stream->position;
+    memcpy(buffer, stream->chunk + stream->position,
+        remaining < BUFFER_SIZE - 1 ? remaining : BUFFER_SIZE - 1);
 
     double x_min =0, x_max = 0, y_min = 0, y_max = 0;
     size_t order = 0;
@@ -258,41 +325,3 @@ static void getParameters(Differentiator* diff, char* buffer)
         diff->args.taylor_info.center = x_0;
     }
 }
-
-
-static OpType getOpType(const char* buffer)
-{
-    assert(buffer);
-
-    for (int index = 0; OP_TABLE[index].op != OP_NONE; index++) {
-        if (strcmp(buffer, OP_TABLE[index].symbol) == 0) {
-            return OP_TABLE[index].op;
-        }
-    }
-
-    return OP_NONE;
-}
-
-
-static inline void skipWhitespaces(char* src_code, int* position)
-{
-    assert(src_code); assert(position);
-
-    while (src_code[*position] == ' '  || src_code[*position] == '\t' ||
-        src_code[*position] == '\n' || src_code[*position] == '\r') {
-        (*position)++;
-    }
-}
-
-
-static size_t getFileSize(FILE* input_file)
-{
-    assert(input_file != NULL);
-
-    struct stat buf = {};
-    if (fstat(fileno(input_file), &buf) == -1)
-        return 0;
-
-    return (size_t)buf.st_size;
-}
-
@@ -0,0 +1,605 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <assert.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "tree/tree_lexer.h"
+#include "tree/tree_source.h"
+#include "tree/tree_defs.h"
+
+#include "status.h"
+
+
+const size_t OPERATOR_HASH_SIZE = 64;
+const size_t MAX_SIGNIFICANT_DIGITS = 19;
+const unsigned long long MAX_EXACT_MANTISSA = 1ULL << 53;
+const int MAX_EXACT_POWER = 22;
+
+static const double EXACT_POWERS_OF_TEN[MAX_EXACT_POWER + 1] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+
+typedef struct {
+    OpType slots[OPERATOR_HASH_SIZE];
+} OperatorHashTable;
+
+
+static void lexerScan(Lexer* lexer);
+static void scanPrefixToken(Lexer* lexer);
+static void scanInfixToken(Lexer* lexer);
+
+static bool readWord(Lexer* lexer, const char** word, size_t* length);
+static bool appendWord(Lexer* lexer, size_t* length, const char* part, size_t part_length);
+static void classifyWord(Token* token, const char* word, size_t length);
+static void classifyWordSlow(Token* token, const char* word, size_t length);
+static bool mayBeSpecialNumber(const char* word, size_t length);
+
+static const char* skipSpaces(const char* current, const char* end, bool skip_newlines);
+static const char* scanWord(const char* current, const char* end);
+static const char* scanIdentifier(const char* current, const char* end);
+
+static inline bool isSpace(char symbol, bool skip_newlines);
+static inline bool isIdentifierSymbol(char symbol);
+static inline bool isDigit(char symbol);
+
+
+// Хеш подобран так, чтобы символы OP_TABLE не конфликтовали - это проверяется при компиляции
+static constexpr size_t operatorHash(const char* word, size_t length)
+{
+    size_t second = length > 1 ? 1 : 0;
+    size_t penultimate = length > 1 ? length - 2 : 0;
+
+    return (length + (unsigned char)word[second] + 20 * (unsigned char)word[penultimate] +
+        (unsigned char)word[length - 1]) % OPERATOR_HASH_SIZE;
+}
+
+
+static constexpr size_t symbolLength(const char* symbol)
+{
+    size_t length = 0;
+    while (symbol[length] != '\0')
+        length++;
+
+    return length;
+}
+
+
+static constexpr OperatorHashTable buildOperatorHashTable()
+{
+    OperatorHashTable table = {};
+    for (size_t index = 0; index < OPERATOR_HASH_SIZE; index++)
+        table.slots[index] = OP_NONE;
+
+    for (size_t index = 0; OP_TABLE[index].op != OP_NONE; index++) {
+        const char* symbol = OP_TABLE[index].symbol;
+        table.slots[operatorHash(symbol, symbolLength(symbol))] = OP_TABLE[index].op;
+    }
+
+    return table;
+}
+
+
+static constexpr OperatorHashTable OPERATOR_HASH_TABLE = buildOperatorHashTable();
+
+
+static constexpr bool isOperatorHashPerfect()
+{
+    for (size_t index = 0; OP_TABLE[index].op != OP_NONE; index++) {
+        const char* symbol = OP_TABLE[index].symbol;
+        if (OP_TABLE[index].op != (OpType)index ||
+            OPERATOR_HASH_TABLE.slots[operatorHash(symbol, symbolLength(symbol))] != OP_TABLE[index].op)
+            return false;
+    }
+
+    return true;
+}
+
+
+static_assert(isOperatorHashPerfect(), "operatorHash has collisions on OP_TABLE symbols");
+
+
+void lexerInit(Lexer* lexer, SourceStream* stream, LexerMode mode)
+{
+    assert(lexer); assert(stream);
+    assert(mode == LEXER_PREFIX || stream->file == NULL);
+
+    lexer->stream = stream;
+    lexer->mode = mode;
+    lexer->token = (Token){TOKEN_END, NULL, 0, 0, OP_NONE};
+    lexer->has_token = false;
+    lexer->word = NULL;
+    lexer->word_capacity = 0;
+    lexer->status = STATUS_OK;
+}
+
+
+void lexerDestroy(Lexer* lexer)
+{
+    assert(lexer);
+
+    free(lexer->word);
+    lexer->word = NULL;
+    lexer->word_capacity = 0;
+    lexer->stream = NULL;
+}
+
+
+const Token* lexerPeek(Lexer* lexer)
+{
+    assert(lexer); assert(lexer->stream);
+
+    if (!lexer->has_token) {
+        lexerScan(lexer);
+        lexer->has_token = true;
+    }
+
+    return &lexer->token;
+}
+
+
+void lexerConsume(Lexer* lexer)
+{
+    assert(lexer);
+
+    lexerPeek(lexer);
+    lexer->has_token = false;
+}
+
+
+bool lexerIsSymbol(Lexer* lexer, char symbol)
+{
+    assert(lexer);
+
+    const Token* token = lexerPeek(lexer);
+    return token->type == TOKEN_SYMBOL && token->text[0] == symbol;
+}
+
+
+OpType lexerFindOperator(const char* word, size_t length)
+{
+    assert(word);
+
+    if (length == 0)
+        return OP_NONE;
+
+    OpType op = OPERATOR_HASH_TABLE.slots[operatorHash(word, length)];
+    if (op == OP_NONE)
+        return OP_NONE;
+
+    const char* symbol = OP_TABLE[op].symbol;
+    if (strncmp(word, symbol, length) == 0 && symbol[length] == '\0')
+        return op;
+
+    return OP_NONE;
+}
+
+
+size_t lexerParseNumber(const char* text, size_t length, double* value)
+{
+    assert(text); assert(value);
+
+    size_t position = 0;
+    bool negative = false;
+    if (position < length && (text[position] == '-' || text[position] == '+')) {
+        negative = text[position] == '-';
+        position++;
+    }
+
+    unsigned long long mantissa = 0;
+    size_t significant_digits = 0;
+    size_t digit_count = 0;
+    int exponent = 0;
+    while (position < length && isDigit(text[position])) {
+        if (significant_digits < MAX_SIGNIFICANT_DIGITS) {
+            mantissa = mantissa * 10 + (unsigned long long)(text[position] - '0');
+            significant_digits += mantissa != 0;
+        } else {
+            exponent++;
+            significant_digits++;
+        }
+        digit_count++;
+        position++;
+    }
+    if (position < length && text[position] == '.') {
+        position++;
+        while (position < length && isDigit(text[position])) {
+            if (significant_digits < MAX_SIGNIFICANT_DIGITS) {
+                mantissa = mantissa * 10 + (unsigned long long)(text[position] - '0');
+                significant_digits += mantissa != 0;
+                exponent--;
+            } else {
+                significant_digits++;
+            }
+            digit_count++;
+            position++;
+        }
+    }
+    if (digit_count == 0)
+        return 0;
+
+    if (position < length && (text[position] == 'e' || text[position] == 'E')) {
+        size_t exponent_position = position + 1;
+        bool negative_exponent = false;
+        if (exponent_position < length &&
+            (text[exponent_position] == '-' || text[exponent_position] == '+')) {
+            negative_exponent = text[exponent_position] == '-';
+            exponent_position++;
+        }
+        if (exponent_position < length && isDigit(text[exponent_position])) {
+            int explicit_exponent = 0;
+            while (exponent_position < length && isDigit(text[exponent_position])) {
+                if (explicit_exponent < 100000)
+                    explicit_exponent = explicit_exponent * 10 + (text[exponent_position] - '0');
+                exponent_position++;
+            }
+            exponent += negative_exponent ? -explicit_exponent : explicit_exponent;
+            position = exponent_position;
+        }
+    }
+
+// Быстрый путь Клингера точен: мантисса и степень десяти представимы в double без округления
+    if (significant_digits <= MAX_SIGNIFICANT_DIGITS && mantissa <= MAX_EXACT_MANTISSA &&
+        exponent >= -MAX_EXACT_POWER && exponent <= MAX_EXACT_POWER) {
+        double result = (double)mantissa;
+        if (exponent < 0) {
+            result /= EXACT_POWERS_OF_TEN[-exponent];
+        } else {
+            result *= EXACT_POWERS_OF_TEN[exponent];
+        }
+        *value = negative ? -result : result;
+        return position;
+    }
+
+    char buffer[BUFFER_SIZE] = {};
+    char* copy = position < BUFFER_SIZE ? buffer : (char*)calloc(position + 1, 1);
+    if (copy == NULL)
+        return 0;
+    memcpy(copy, text, position);
+    *value = strtod(copy, NULL);
+    if (copy != buffer)
+        free(copy);
+
+    return position;
+}
+
+
+static void lexerScan(Lexer* lexer)
+{
+    assert(lexer); assert(lexer->stream);
+
+    SourceStream* stream = lexer->stream;
+    lexer->token = (Token){TOKEN_END, NULL, 0, 0, OP_NONE};
+    if (lexer->status != STATUS_OK) {
+        lexer->token.type = TOKEN_INVALID;
+        return;
+    }
+
+    bool skip_newlines = lexer->mode == LEXER_PREFIX;
+    while (true) {
+        const char* begin = stream->chunk + stream->position;
+        const char* end = stream->chunk + stream->chunk_size;
+        const char* current = skipSpaces(begin, end, skip_newlines);
+        stream->position = (size_t)(current - stream->chunk);
+        if (current < end)
+            break;
+
+        if (!sourceStreamRefill(stream)) {
+            if (stream->error) {
+                lexer->status = STATUS_IO_FILE_READ_ERROR;
+                lexer->token.type = TOKEN_INVALID;
+            }
+            return;
+        }
+    }
+
+    if (lexer->mode == LEXER_PREFIX) {
+        scanPrefixToken(lexer);
+    } else {
+        scanInfixToken(lexer);
+    }
+}
+
+
+static void scanPrefixToken(Lexer* lexer)
+{
+    assert(lexer);
+
+    SourceStream* stream = lexer->stream;
+    Token* token = &lexer->token;
+
+    const char* current = stream->chunk + stream->position;
+    if (*current == '(' || *current == ')') {
+        *token = (Token){TOKEN_SYMBOL, current, 1, 0, OP_NONE};
+        stream->position++;
+        return;
+    }
+
+    const char* word = NULL;
+    size_t length = 0;
+    if (!readWord(lexer, &word, &length)) {
+        token->type = TOKEN_INVALID;
+        return;
+    }
+    classifyWord(token, word, length);
+}
+
+
+static void scanInfixToken(Lexer* lexer)
+{
+    assert(lexer);
+
+    SourceStream* stream = lexer->stream;
+    Token* token = &lexer->token;
+
+    const char* current = stream->chunk + stream->position;
+    const char* end = stream->chunk + stream->chunk_size;
+    if (isDigit(*current)) {
+        double value = 0;
+        size_t length = lexerParseNumber(current, (size_t)(end - current), &value);
+        *token = (Token){TOKEN_NUMBER, current, length, value, OP_NONE};
+    } else if (isalpha((unsigned char)*current)) {
+        size_t length = (size_t)(scanIdentifier(current, end) - current);
+        OpType op = lexerFindOperator(current, length);
+        if (op != OP_NONE && isalpha((unsigned char)OP_TABLE[op].symbol[0])) {
+            *token = (Token){TOKEN_OPERATOR, current, length, 0, op};
+        } else {
+            *token = (Token){TOKEN_IDENTIFIER, current, length, 0, OP_NONE};
+// inf и nan treeWriteInfix пишет словами, остальные имена с тем же началом остаются переменными
+            if (mayBeSpecialNumber(current, length)) {
+                classifyWordSlow(token, current, length);
+                if (token->type == TOKEN_INVALID)
+                    token->type = TOKEN_IDENTIFIER;
+            }
+        }
+    } else if (strchr("+-*/^(),\n", *current) != NULL) {
+        *token = (Token){TOKEN_SYMBOL, current, 1, 0, OP_NONE};
+    } else {
+        *token = (Token){TOKEN_INVALID, current, 1, 0, OP_NONE};
+    }
+
+    stream->position += token->length;
+}
+
+
+static bool readWord(Lexer* lexer, const char** word, size_t* length)
+{
+    assert(lexer); assert(word); assert(length);
+
+    SourceStream* stream = lexer->stream;
+    const char* begin = stream->chunk + stream->position;
+    const char* end = stream->chunk + stream->chunk_size;
+    const char* word_end = scanWord(begin, end);
+    stream->position = (size_t)(word_end - stream->chunk);
+
+// Слово целиком лежит в текущем куске - отдаем его без копирования
+    if (word_end < end || stream->file == NULL) {
+        *word = begin;
+        *length = (size_t)(word_end - begin);
+        return true;
+    }
+
+    size_t word_length = 0;
+    if (!appendWord(lexer, &word_length, begin, (size_t)(word_end - begin)))
+        return false;
+    while (sourceStreamRefill(stream)) {
+        begin = stream->chunk;
+        end = stream->chunk + stream->chunk_size;
+        word_end = scanWord(begin, end);
+        stream->position = (size_t)(word_end - begin);
+        if (!appendWord(lexer, &word_length, begin, (size_t)(word_end - begin)))
+            return false;
+        if (word_end < end)
+            break;
+    }
+    if (stream->error) {
+        lexer->status = STATUS_IO_FILE_READ_ERROR;
+        return false;
+    }
+
+    *word = lexer->word;
+    *length = word_length;
+    return true;
+}
+
+
+static bool appendWord(Lexer* lexer, size_t* length, const char* part, size_t part_length)
+{
+    assert(lexer); assert(length); assert(part);
+
+    if (*length + part_length > lexer->word_capacity) {
+        size_t new_capacity = lexer->word_capacity == 0 ? BUFFER_SIZE : lexer->word_capacity;
+        while (new_capacity < *length + part_length)
+            new_capacity *= 2;
+
+        char* temp_ptr = (char*)realloc(lexer->word, new_capacity);
+        if (temp_ptr == NULL) {
+            lexer->status = STATUS_SYSTEM_OUT_OF_MEMORY;
+            return false;
+        }
+        lexer->word = temp_ptr;
+        lexer->word_capacity = new_capacity;
+    }
+
+    memcpy(lexer->word + *length, part, part_length);
+    *length += part_length;
+
+    return true;
+}
+
+
+static void classifyWord(Token* token, const char* word, size_t length)
+{
+    assert(token); assert(word);
+
+    *token = (Token){TOKEN_IDENTIFIER, word, length, 0, OP_NONE};
+
+    OpType op = lexerFindOperator(word, length);
+    if (op != OP_NONE) {
+        token->type = TOKEN_OPERATOR;
+        token->op = op;
+        return;
+    }
+
+    double value = 0;
+    size_t consumed = lexerParseNumber(word, length, &value);
+    if (consumed == length) {
+        token->type = TOKEN_NUMBER;
+        token->number = value;
+    } else if (consumed != 0 || mayBeSpecialNumber(word, length)) {
+        classifyWordSlow(token, word, length);
+    }
+}
+
+
+// Редкие записи (inf, nan, шестнадцатеричные числа) разбираются strtod, как и раньше
+static void classifyWordSlow(Token* token, const char* word, size_t length)
+{
+    assert(token); assert(word);
+
+    char buffer[BUFFER_SIZE] = {};
+    size_t copy_length = length < BUFFER_SIZE - 1 ? length : BUFFER_SIZE - 1;
+    memcpy(buffer, word, copy_length);
+
+    char* endptr = NULL;
+    double value = strtod(buffer, &endptr);
+    assert(endptr);
+    if (*endptr == '\0' && copy_length == length) {
+        token->type = TOKEN_NUMBER;
+        token->number = value;
+    } else if (endptr == buffer) {
+        token->type = TOKEN_IDENTIFIER;
+    } else {
+        token->type = TOKEN_INVALID;
+    }
+}
+
+
+static bool mayBeSpecialNumber(const char* word, size_t length)
+{
+    assert(word);
+
+    size_t position = 0;
+    if (position < length && (word[position] == '-' || word[position] == '+'))
+        position++;
+
+    return position < length && strchr("iInN", word[position]) != NULL;
+}
+
+
+static const char* skipSpaces(const char* current, const char* end, bool skip_newlines)
+{
+    assert(current); assert(end);
+
+#ifdef __SSE2__
+    const __m128i space   = _mm_set1_epi8(' ');
+    const __m128i tab     = _mm_set1_epi8('\t');
+    const __m128i cr      = _mm_set1_epi8('\r');
+    const __m128i newline = skip_newlines ? _mm_set1_epi8('\n') : _mm_set1_epi8(' ');
+    while (end - current >= 16) {
+        __m128i block = _mm_loadu_si128((const __m128i*)current);
+        __m128i is_space = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(block, space), _mm_cmpeq_epi8(block, tab)),
+            _mm_or_si128(_mm_cmpeq_epi8(block, cr), _mm_cmpeq_epi8(block, newline)));
+        unsigned mask = ~(unsigned)_mm_movemask_epi8(is_space) & 0xFFFFu;
+        if (mask != 0)
+            return current + __builtin_ctz(mask);
+        current += 16;
+    }
+#endif
+
+    while (current < end && isSpace(*current, skip_newlines))
+        current++;
+
+    return current;
+}
+
+
+static const char* scanWord(const char* current, const char* end)
+{
+    assert(current); assert(end);
+
+#ifdef __SSE2__
+    const __m128i space         = _mm_set1_epi8(' ');
+    const __m128i tab           = _mm_set1_epi8('\t');
+    const __m128i cr            = _mm_set1_epi8('\r');
+    const __m128i newline       = _mm_set1_epi8('\n');
+    const __m128i open_bracket  = _mm_set1_epi8('(');
+    const __m128i close_bracket = _mm_set1_epi8(')');
+    while (end - current >= 16) {
+        __m128i block = _mm_loadu_si128((const __m128i*)current);
+        __m128i is_delimiter = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(block, space), _mm_cmpeq_epi8(block, tab)),
+            _mm_or_si128(_mm_cmpeq_epi8(block, cr), _mm_cmpeq_epi8(block, newline)));
+        is_delimiter = _mm_or_si128(is_delimiter, _mm_or_si128(
+            _mm_cmpeq_epi8(block, open_bracket), _mm_cmpeq_epi8(block, close_bracket)));
+        unsigned mask = (unsigned)_mm_movemask_epi8(is_delimiter);
+        if (mask != 0)
+            return current + __builtin_ctz(mask);
+        current += 16;
+    }
+#endif
+
+    while (current < end && !isSpace(*current, true) && *current != '(' && *current != ')')
+        current++;
+
+    return current;
+}
+
+
+static const char* scanIdentifier(const char* current, const char* end)
+{
+    assert(current); assert(end);
+
+#ifdef __SSE2__
+    const __m128i lower_case  = _mm_set1_epi8(0x20);
+    const __m128i before_a    = _mm_set1_epi8('a' - 1);
+    const __m128i after_z     = _mm_set1_epi8('z' + 1);
+    const __m128i before_zero = _mm_set1_epi8('0' - 1);
+    const __m128i after_nine  = _mm_set1_epi8('9' + 1);
+    const __m128i underscore  = _mm_set1_epi8('_');
+    while (end - current >= 16) {
+        __m128i block = _mm_loadu_si128((const __m128i*)current);
+        __m128i folded = _mm_or_si128(block, lower_case);
+        __m128i is_alpha = _mm_and_si128(_mm_cmpgt_epi8(folded, before_a),
+            _mm_cmplt_epi8(folded, after_z));
+        __m128i is_digit = _mm_and_si128(_mm_cmpgt_epi8(block, before_zero),
+            _mm_cmplt_epi8(block, after_nine));
+        __m128i is_identifier = _mm_or_si128(_mm_or_si128(is_alpha, is_digit),
+            _mm_cmpeq_epi8(block, underscore));
+        unsigned mask = ~(unsigned)_mm_movemask_epi8(is_identifier) & 0xFFFFu;
+        if (mask != 0)
+            return current + __builtin_ctz(mask);
+        current += 16;
+    }
+#endif
+
+    while (current < end && isIdentifierSymbol(*current))
+        current++;
+
+    return current;
+}
+
+
+static inline bool isSpace(char symbol, bool skip_newlines)
+{
+    return symbol == ' ' || symbol == '\t' || symbol == '\r' || (skip_newlines && symbol == '\n');
+}
+
+
+static inline bool isIdentifierSymbol(char symbol)
+{
+    return isalnum((unsigned char)symbol) || symbol == '_';
+}
+
+
+static inline bool isDigit(char symbol)
+{
+    return symbol >= '0' && symbol <= '9';
+}
@@ -1,347 +1,379 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <ctype.h>
 #include <assert.h>
 
 #include "tree/tree_parse.h"
+#include "tree/tree_lexer.h"
+#include "tree/tree_stack.h"
 #include "tree/tree.h"
 
 #include "diff/diff_defs.h"
 #include "diff/diff_var_table.h"
 
 
-static TreeNode* getBinaryFunction(Differentiator* diff, char** buffer, OpInfo op_info);
-static TreeNode* getUnaryFunction(Differentiator* diff, char** buffer, OpInfo op_info);
+typedef enum {
+    PARSE_FRAME_OPERATOR = 0,
+    PARSE_FRAME_GROUP,
+    PARSE_FRAME_FUNCTION,
+    PARSE_FRAME_LOG_BASE,
+    PARSE_FRAME_LOG_ARGUMENT
+} ParseFrameType;
 
-static TreeNode* createOperator(OpType op, TreeNode* left, TreeNode* right);
-static TreeNode* createVariable(size_t var_idx);
-static TreeNode* createNumber(double value);
-static bool isReservedFunctionName(char* str, size_t len);
 
-static void skipWhitespaces(char** buffer);
+typedef struct {
+    ParseFrameType type;
+    OpType op;
+} ParseFrame;
 
 
-TreeNode* getTree(Differentiator* diff, char** buffer)
-{
-    assert(diff); assert(buffer); assert(*buffer);
-   
-    skipWhitespaces(buffer);
-    TreeNode* node = getExpression(diff, buffer);
-    skipWhitespaces(buffer);
-    if (**buffer != '\n' && **buffer != '\0') {
-        fprintf(stderr, "Syntax error in getTree!\n");
-        if (node) {
-            deleteBranch(node);
-        }
-        return NULL;
-    }
+typedef struct {
+    WorkStack operands;
+    WorkStack frames;
+} ParseState;
 
-    (*buffer)++;
-    return node;
-}
 
+static OperationStatus parseOperand(Differentiator* diff, Lexer* lexer, ParseState* state, bool* expect_operand);
+static OperationStatus parseValue(Differentiator* diff, Lexer* lexer, ParseState* state, bool* expect_operand);
+static OperationStatus parseOperator(Lexer* lexer, ParseState* state, bool* expect_operand, bool* is_finished);
 
-TreeNode* getExpression(Differentiator* diff, char** buffer)
-{
-    assert(diff); assert(buffer); assert(*buffer);
+static OperationStatus parseVariable(Differentiator* diff, Lexer* lexer, ParseState* state);
+static OperationStatus parseFunction(Lexer* lexer, ParseState* state);
+static OperationStatus parseBinaryOperator(Lexer* lexer, ParseState* state, OpType op);
+static OperationStatus parseClosingParenthesis(ParseState* state);
+static OperationStatus parseComma(ParseState* state);
+static OperationStatus finishExpression(ParseState* state);
 
-    TreeNode* node_1= getTerm(diff, buffer);
-    skipWhitespaces(buffer);
+static OperationStatus reduceOperators(ParseState* state, size_t min_priority);
+static OperationStatus reduceFrame(ParseState* state, OpType op, bool is_binary);
+static OperationStatus pushOperand(ParseState* state, TreeNode* node);
+static OperationStatus pushFrame(ParseState* state, ParseFrameType type, OpType op);
+static size_t getBinaryPriority(OpType op);
+static OpType getBinaryOperator(Lexer* lexer);
+static void parseStateDestroy(ParseState* state);
 
-    while (**buffer == '+' || **buffer == '-') {
-        char op = **buffer;
-        (*buffer)++;
+static TreeNode* createOperator(OpType op, TreeNode* left, TreeNode* right);
+static TreeNode* createVariable(size_t var_idx);
+static TreeNode* createNumber(double value);
 
-        skipWhitespaces(buffer);
-        TreeNode* node_2 = getTerm(diff, buffer);
 
-        OpType op_type = OP_NONE;
-        if (op == '+') {
-            op_type = OP_ADD;
-        } else if (op == '-') {
-            op_type = OP_SUB;
+TreeNode* getTree(Differentiator* diff, Lexer* lexer)
+{
+    assert(diff); assert(lexer);
+
+    ParseState state = {};
+    workStackInit(&state.operands, sizeof(TreeNode*));
+    workStackInit(&state.frames, sizeof(ParseFrame));
+
+// Вместо рекурсивного спуска используется сортировочная станция с явными стеками
+    OperationStatus status = STATUS_OK;
+    bool expect_operand = true;
+    bool is_finished = false;
+    while (status == STATUS_OK && !is_finished) {
+        if (expect_operand) {
+            status = parseOperand(diff, lexer, &state, &expect_operand);
         } else {
-            deleteBranch(node_1);
-            deleteBranch(node_2);
-            return NULL;
+            status = parseOperator(lexer, &state, &expect_operand, &is_finished);
         }
+    }
 
-        TreeNode* op_node = createOperator(op_type, node_1, node_2);
-        if (op_node == NULL) {
-            deleteBranch(node_1);
-            deleteBranch(node_2);
-            return NULL;
-        }
-        node_1 = op_node;
-
-        skipWhitespaces(buffer);
+    TreeNode* node = NULL;
+    if (status == STATUS_OK && state.operands.count == 1) {
+        workStackPop(&state.operands, &node);
+        lexerConsume(lexer);
+    } else {
+        fprintf(stderr, "Syntax error in getTree!\n");
     }
 
-    return node_1;
+    parseStateDestroy(&state);
+    return node;
 }
 
 
-TreeNode* getTerm(Differentiator* diff, char** buffer) 
+static OperationStatus parseOperand(Differentiator* diff, Lexer* lexer, ParseState* state, bool* expect_operand)
 {
-    assert(diff); assert(buffer); assert(*buffer);
+    assert(diff); assert(lexer); assert(state); assert(expect_operand);
+
+    if (!lexerIsSymbol(lexer, '('))
+        return parseValue(diff, lexer, state, expect_operand);
+
+// Отрицательное число принимается только в виде "(-N)", так их записывает treeWriteInfix
+    lexerConsume(lexer);
+    if (!lexerIsSymbol(lexer, '-'))
+        return pushFrame(state, PARSE_FRAME_GROUP, OP_NONE);
+
+    lexerConsume(lexer);
+    const Token* number = lexerPeek(lexer);
+    if (number->type != TOKEN_NUMBER)
+        return STATUS_IO_FILE_READ_ERROR;
+    double value = -number->number;
+    lexerConsume(lexer);
+    if (!lexerIsSymbol(lexer, ')'))
+        return STATUS_IO_FILE_READ_ERROR;
+    lexerConsume(lexer);
+
+    *expect_operand = false;
+    return pushOperand(state, createNumber(value));
+}
 
-    TreeNode* node_1 = getPower(diff, buffer);
-    skipWhitespaces(buffer);
 
-    while (**buffer == '*' || **buffer == '/') {
-        char op = **buffer;
-        (*buffer)++;
+static OperationStatus parseValue(Differentiator* diff, Lexer* lexer, ParseState* state, bool* expect_operand)
+{
+    assert(diff); assert(lexer); assert(state); assert(expect_operand);
+
+    const Token* token = lexerPeek(lexer);
+    switch (token->type) {
+        case TOKEN_NUMBER: {
+            OperationStatus status = pushOperand(state, createNumber(token->number));
+            lexerConsume(lexer);
+            *expect_operand = false;
+            return status;
+        }
+        case TOKEN_IDENTIFIER:
+            *expect_operand = false;
+            return parseVariable(diff, lexer, state);
+        case TOKEN_OPERATOR:
+            return parseFunction(lexer, state);
+        case TOKEN_END:
+        case TOKEN_SYMBOL:
+        case TOKEN_INVALID:
+        default:
+            return STATUS_IO_FILE_READ_ERROR;
+    }
+}
 
-        skipWhitespaces(buffer);
-        TreeNode* node_2 = getPower(diff, buffer);
 
-        OpType op_type = OP_NONE;
-        if (op == '*') {
-            op_type = OP_MUL;
-        } else if (op == '/') {
-            op_type = OP_DIV;
-        } else {
-            deleteBranch(node_1);
-            deleteBranch(node_2);
-            return NULL;
-        }
+static OperationStatus parseOperator(Lexer* lexer, ParseState* state, bool* expect_operand, bool* is_finished)
+{
+    assert(lexer); assert(state); assert(expect_operand); assert(is_finished);
 
-        TreeNode* op_node = createOperator(op_type, node_1, node_2);
-        if (op_node == NULL) {
-            deleteBranch(node_1);
-            deleteBranch(node_2);
-            return NULL;
-        }
-        node_1 = op_node;
+    const Token* token = lexerPeek(lexer);
+    if (token->type == TOKEN_END || lexerIsSymbol(lexer, '\n')) {
+        *is_finished = true;
+        return finishExpression(state);
+    }
+
+    OpType op = getBinaryOperator(lexer);
+    if (op != OP_NONE) {
+        *expect_operand = true;
+        return parseBinaryOperator(lexer, state, op);
+    }
 
-        skipWhitespaces(buffer);
+    OperationStatus status = STATUS_IO_FILE_READ_ERROR;
+    if (lexerIsSymbol(lexer, ')')) {
+        status = parseClosingParenthesis(state);
+    } else if (lexerIsSymbol(lexer, ',')) {
+        status = parseComma(state);
+        *expect_operand = true;
     }
+    RETURN_IF_STATUS_NOT_OK(status);
 
-    return node_1;
+    lexerConsume(lexer);
+    return STATUS_OK;
 }
 
 
-TreeNode* getPower(Differentiator* diff, char** buffer)
+static OperationStatus parseVariable(Differentiator* diff, Lexer* lexer, ParseState* state)
 {
-    assert(diff); assert(buffer); assert(*buffer);
+    assert(diff); assert(diff->var_table.variables); assert(lexer); assert(state);
 
-    TreeNode* node_1 = getPrimary(diff, buffer);
-    skipWhitespaces(buffer);
+    const Token* token = lexerPeek(lexer);
+    size_t var_idx = 0;
+    OperationStatus status = addVariable(diff, &var_idx, token->text, token->length);
+    RETURN_IF_STATUS_NOT_OK(status);
 
-    while (**buffer == '^') {
-        (*buffer)++;
+    lexerConsume(lexer);
+    if (lexerIsSymbol(lexer, '('))
+        return STATUS_PARSER_INVALID_IDENTIFIER;
 
-        skipWhitespaces(buffer);
-        TreeNode* node_2 = getPrimary(diff, buffer);
-
-        TreeNode* op_node = createOperator(OP_POW, node_1, node_2);
-        if (op_node == NULL) { deleteBranch(node_1);
-            deleteBranch(node_2);
-            return NULL;
-        }
-        node_1 = op_node;
-
-        skipWhitespaces(buffer);
-    }
-
-    return node_1;
+    return pushOperand(state, createVariable(var_idx));
 }
 
 
-TreeNode* getPrimary(Differentiator* diff, char** buffer) 
+static OperationStatus parseFunction(Lexer* lexer, ParseState* state)
 {
-    assert(diff); assert(buffer); assert(*buffer);
+    assert(lexer); assert(state);
 
-    if (**buffer == '(') {
-        (*buffer)++;
+    OpType op = lexerPeek(lexer)->op;
+    lexerConsume(lexer);
+    if (!lexerIsSymbol(lexer, '('))
+        return STATUS_IO_FILE_READ_ERROR;
+    lexerConsume(lexer);
 
-        skipWhitespaces(buffer);
-        TreeNode* node = getExpression(diff, buffer);
-        skipWhitespaces(buffer);
+    return pushFrame(state, op == OP_LOG ? PARSE_FRAME_LOG_BASE : PARSE_FRAME_FUNCTION, op);
+}
 
-        (*buffer)++;
-        return node;
-    }
-   
-    TreeNode* node = NULL;
-    if (isdigit(**buffer)) {
-        node = getNumber(diff, buffer);
-        if (node != NULL) return node;
-    }
 
-    node = getVariable(diff, buffer);    
-    if (node != NULL) return node;
+static OperationStatus parseBinaryOperator(Lexer* lexer, ParseState* state, OpType op)
+{
+    assert(lexer); assert(state);
 
-    node = getFunction(diff, buffer);
-    if (node != NULL) return node;
+    OperationStatus status = reduceOperators(state, getBinaryPriority(op));
+    RETURN_IF_STATUS_NOT_OK(status);
 
-    return NULL;
+    lexerConsume(lexer);
+    return pushFrame(state, PARSE_FRAME_OPERATOR, op);
 }
 
 
-TreeNode* getVariable(Differentiator* diff, char** buffer)
+static OperationStatus parseClosingParenthesis(ParseState* state)
 {
-    assert(diff); assert(diff->var_table.variables); assert(buffer); assert(*buffer);
-
-    //printf("%s\n", *buffer);
-    if (isalpha(**buffer)) {
-        char* variable_end = *buffer;
-        while (isalpha(*variable_end) || isdigit(*variable_end) || *variable_end == '_')
-            variable_end++;
-      
-        size_t len = (size_t)(variable_end - *buffer);
-        if (isReservedFunctionName(*buffer, len)) return NULL;
-        if (*variable_end == '(') return NULL;
-
-        size_t var_idx = 0;
-        if (addVariable(diff, &var_idx, *buffer, len) != STATUS_OK)
-            return NULL;
-
-        TreeNode* node = createVariable(var_idx);
-        if (node == NULL) return NULL;
-
-        *buffer = variable_end;
-        return node;
-    } else {
-        return NULL;
+    assert(state);
+
+    OperationStatus status = reduceOperators(state, 0);
+    RETURN_IF_STATUS_NOT_OK(status);
+
+    ParseFrame frame = {};
+    if (!workStackPop(&state->frames, &frame))
+        return STATUS_IO_FILE_READ_ERROR;
+
+    switch (frame.type) {
+        case PARSE_FRAME_GROUP:        return STATUS_OK;
+        case PARSE_FRAME_FUNCTION:     return reduceFrame(state, frame.op, false);
+        case PARSE_FRAME_LOG_ARGUMENT: return reduceFrame(state, frame.op, true);
+        case PARSE_FRAME_LOG_BASE:
+        case PARSE_FRAME_OPERATOR:
+        default:                       return STATUS_IO_FILE_READ_ERROR;
     }
 }
 
 
-TreeNode* getFunction(Differentiator* diff, char** buffer)
+static OperationStatus parseComma(ParseState* state)
 {
-    assert(diff); assert(buffer); assert(*buffer);
-
-    if (isalpha(**buffer)) {
-        char* function_end = *buffer;
-        while (isalpha(*function_end) || isdigit(*function_end) || *function_end == '_')
-            function_end++;
-        
-        size_t len = (size_t)(function_end - *buffer);
-        bool is_function = false;
-        size_t index = 0;
-
-        for (; index < OP_TABLE_COUNT; index++) {
-            const char* existing_name = OP_TABLE[index].symbol;
-            if (strncmp(*buffer, existing_name, len) == 0 && existing_name[len] == '\0') {
-                is_function = true;
-                break;
-            }
-        }
-        if (!is_function) return NULL;
-        *buffer += len;
+    assert(state);
 
-        if (OP_TABLE[index].op == OP_LOG) {
-            return getBinaryFunction(diff, buffer, OP_TABLE[index]);
-        } else {
-            return getUnaryFunction(diff, buffer, OP_TABLE[index]);
-        }
-    } else {
-        return NULL;
-    }
+    OperationStatus status = reduceOperators(state, 0);
+    RETURN_IF_STATUS_NOT_OK(status);
+
+    ParseFrame* frame = (ParseFrame*)workStackTop(&state->frames);
+    if (frame == NULL || frame->type != PARSE_FRAME_LOG_BASE)
+        return STATUS_IO_FILE_READ_ERROR;
+    frame->type = PARSE_FRAME_LOG_ARGUMENT;
+
+    return STATUS_OK;
 }
 
 
-static TreeNode* getUnaryFunction(Differentiator* diff, char** buffer, OpInfo op_info)
+static OperationStatus finishExpression(ParseState* state)
 {
-    assert(diff); assert(buffer); assert(*buffer);
+    assert(state);
+
+    OperationStatus status = reduceOperators(state, 0);
+    RETURN_IF_STATUS_NOT_OK(status);
 
-    skipWhitespaces(buffer);
+    if (state->frames.count != 0)
+        return STATUS_IO_FILE_READ_ERROR;
 
-    if (**buffer != '(') return NULL;
-    (*buffer)++;
+    return STATUS_OK;
+}
 
-    skipWhitespaces(buffer);
 
-    TreeNode* expression = getExpression(diff, buffer);
-    if (expression == NULL) return NULL;
+static OperationStatus reduceOperators(ParseState* state, size_t min_priority)
+{
+    assert(state);
+
+// Все операторы левоассоциативны, поэтому сворачиваем и при равном приоритете
+    ParseFrame* frame = (ParseFrame*)workStackTop(&state->frames);
+    while (frame != NULL && frame->type == PARSE_FRAME_OPERATOR &&
+           getBinaryPriority(frame->op) >= min_priority) {
+        OpType op = frame->op;
+        state->frames.count--;
+
+        OperationStatus status = reduceFrame(state, op, true);
+        RETURN_IF_STATUS_NOT_OK(status);
+        frame = (ParseFrame*)workStackTop(&state->frames);
+    }
+
+    return STATUS_OK;
+}
 
-    skipWhitespaces(buffer);
 
-    if (**buffer != ')') {
-        deleteBranch(expression);
-        return NULL;
+static OperationStatus reduceFrame(ParseState* state, OpType op, bool is_binary)
+{
+    assert(state);
+
+    TreeNode* left = NULL;
+    TreeNode* right = NULL;
+    if (!workStackPop(&state->operands, &right))
+        return STATUS_IO_FILE_READ_ERROR;
+    if (is_binary && !workStackPop(&state->operands, &left)) {
+        deleteBranch(right);
+        return STATUS_IO_FILE_READ_ERROR;
     }
-    (*buffer)++;
 
-    TreeNode* node = createOperator(op_info.op, NULL, expression);
+    TreeNode* node = createOperator(op, left, right);
     if (node == NULL) {
-        deleteBranch(expression);
-        return NULL;
+        deleteBranch(left);
+        deleteBranch(right);
+        return STATUS_SYSTEM_OUT_OF_MEMORY;
     }
 
-    return node;
+    return pushOperand(state, node);
 }
 
 
-static TreeNode* getBinaryFunction(Differentiator* diff, char** buffer, OpInfo op_info)
+static OperationStatus pushOperand(ParseState* state, TreeNode* node)
 {
-    assert(diff); assert(buffer); assert(*buffer);
+    assert(state);
 
-    skipWhitespaces(buffer);
+    if (node == NULL)
+        return STATUS_SYSTEM_OUT_OF_MEMORY;
 
-    if (**buffer != '(') return NULL;
-    (*buffer)++;
+    OperationStatus status = workStackPush(&state->operands, &node);
+    if (status != STATUS_OK)
+        deleteBranch(node);
 
-    skipWhitespaces(buffer);
+    return status;
+}
 
-    TreeNode* left_expression = getExpression(diff, buffer);
-    if (left_expression == NULL) return NULL;
 
-    skipWhitespaces(buffer);
+static OperationStatus pushFrame(ParseState* state, ParseFrameType type, OpType op)
+{
+    assert(state);
 
-    if (**buffer != ',') {
-        deleteBranch(left_expression);
-        return NULL;
-    }
-    (*buffer)++;
+    ParseFrame frame = {type, op};
+    return workStackPush(&state->frames, &frame);
+}
 
-    skipWhitespaces(buffer);
 
-    TreeNode* right_expression = getExpression(diff, buffer);
-    if (right_expression == NULL) return NULL;
-    if (**buffer != ')') {
-        deleteBranch(right_expression);
-        deleteBranch(left_expression);
-        return NULL;
+static size_t getBinaryPriority(OpType op)
+{
+    switch (op) {
+        case OP_ADD:
+        case OP_SUB: return 1;
+        case OP_MUL:
+        case OP_DIV: return 2;
+        case OP_POW: return 3;
+        default:     return 0;
     }
-    (*buffer)++;
+}
 
-    skipWhitespaces(buffer);
 
-    TreeNode* node = createOperator(op_info.op, left_expression, right_expression);
-    if (node == NULL) {
-        deleteBranch(left_expression);
-        deleteBranch(right_expression);
-        return NULL;
-    }
+static OpType getBinaryOperator(Lexer* lexer)
+{
+    assert(lexer);
 
-    return node;
+    if (lexerIsSymbol(lexer, '+')) return OP_ADD;
+    if (lexerIsSymbol(lexer, '-')) return OP_SUB;
+    if (lexerIsSymbol(lexer, '*')) return OP_MUL;
+    if (lexerIsSymbol(lexer, '/')) return OP_DIV;
+    if (lexerIsSymbol(lexer, '^')) return OP_POW;
+
+    return OP_NONE;
 }
 
 
-TreeNode* getNumber(Differentiator* diff, char** buffer)
+static void parseStateDestroy(ParseState* state)
 {
-    assert(diff); assert(buffer); assert(*buffer);
-
-    int value = 0;
-    int iteration_count = 0;
-    while (isdigit(**buffer)) {
-        value = value * 10 + (**buffer - '0');
-        (*buffer)++;
-        iteration_count++;
-    }
+    assert(state);
 
-    if (iteration_count == 0) {
-        fprintf(stderr, "Syntax error in getNumber!\n");
-        return NULL;
+    TreeNode* node = NULL;
+    while (workStackPop(&state->operands, &node)) {
+        deleteBranch(node);
     }
 
-    TreeNode* node = createNumber(value);
-    if (node == NULL) return NULL;
-
-    return node;
+    workStackDestroy(&state->operands);
+    workStackDestroy(&state->frames);
 }
 
 
@@ -391,27 +423,3 @@ static TreeNode* createNumber(double value)
 
     return node;
 }
-
-
-static bool isReservedFunctionName(char* str, size_t len)
-{
-    assert(str); 
-
-    for (size_t index = 0; index < OP_TABLE_COUNT; index++) {
-        const char* existing_name = OP_TABLE[index].symbol;
-        if (strncmp(str, existing_name, len) == 0 && existing_name[len] == '\0')
-            return true;
-    }
-
-    return false;
-}
-
-
-static void skipWhitespaces(char** buffer)
-{
-    assert(buffer); assert(*buffer);
-
-    while (**buffer == '\t' || **buffer == ' ') {
-        (*buffer)++;
-    }
-}
\ No newline at end of file
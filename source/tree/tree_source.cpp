@@ -0,0 +1,186 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <assert.h>
+
+#include "tree/tree_source.h"
+
+#include "status.h"
+
+
+const size_t SOURCE_READ_CHUNK = 1 << 16;
+
+
+static OperationStatus sourceBufferMap(SourceBuffer* source, int fd, size_t size);
+static OperationStatus sourceBufferRead(SourceBuffer* source, FILE* input_file);
+
+
+OperationStatus sourceBufferLoad(SourceBuffer* source, FILE* input_file)
+{
+    assert(source); assert(input_file);
+
+    source->data = NULL;
+    source->size = 0;
+    source->is_mapped = false;
+
+    struct stat info = {};
+    if (fstat(fileno(input_file), &info) == -1)
+        return STATUS_IO_FILE_READ_ERROR;
+
+// Регулярные файлы отображаются в память без копирования, пайпы и терминалы читаются через fread
+    if (S_ISREG(info.st_mode)) {
+        if (info.st_size == 0)
+            return STATUS_IO_FILE_EMPTY;
+        if (sourceBufferMap(source, fileno(input_file), (size_t)info.st_size) == STATUS_OK)
+            return STATUS_OK;
+    }
+
+    return sourceBufferRead(source, input_file);
+}
+
+
+void sourceBufferRelease(SourceBuffer* source)
+{
+    assert(source);
+
+    if (source->data == NULL)
+        return;
+
+    if (source->is_mapped) {
+        munmap(source->data, source->size);
+    } else {
+        free(source->data);
+    }
+    source->data = NULL;
+    source->size = 0;
+    source->is_mapped = false;
+}
+
+
+static OperationStatus sourceBufferMap(SourceBuffer* source, int fd, size_t size)
+{
+    assert(source);
+
+    void* data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED)
+        return STATUS_SYSTEM_CALL_ERROR;
+    madvise(data, size, MADV_SEQUENTIAL);
+
+    source->data = (char*)data;
+    source->size = size;
+    source->is_mapped = true;
+
+    return STATUS_OK;
+}
+
+
+static OperationStatus sourceBufferRead(SourceBuffer* source, FILE* input_file)
+{
+    assert(source); assert(input_file);
+
+    char* data = NULL;
+    size_t size = 0;
+    size_t capacity = 0;
+
+    while (true) {
+        if (capacity - size < SOURCE_READ_CHUNK) {
+            size_t new_capacity = capacity == 0 ? SOURCE_READ_CHUNK : capacity * 2;
+            char* temp_ptr = (char*)realloc(data, new_capacity);
+            if (temp_ptr == NULL) {
+                free(data);
+                return STATUS_SYSTEM_OUT_OF_MEMORY;
+            }
+            data = temp_ptr;
+            capacity = new_capacity;
+        }
+
+        size_t read_size = fread(data + size, 1, capacity - size, input_file);
+        size += read_size;
+        if (read_size == 0)
+            break;
+    }
+
+    if (ferror(input_file)) {
+        free(data);
+        return STATUS_IO_FILE_READ_ERROR;
+    }
+    if (size == 0) {
+        free(data);
+        return STATUS_IO_FILE_EMPTY;
+    }
+
+    source->data = data;
+    source->size = size;
+    source->is_mapped = false;
+
+    return STATUS_OK;
+}
+
+
+OperationStatus sourceStreamOpen(SourceStream* stream, FILE* input_file)
+{
+    assert(stream); assert(input_file);
+
+    stream->file = input_file;
+    stream->chunk_size = 0;
+    stream->position = 0;
+    stream->error = false;
+
+    stream->chunk_storage = (char*)calloc(SOURCE_READ_CHUNK, 1);
+    stream->chunk = stream->chunk_storage;
+    if (stream->chunk_storage == NULL)
+        return STATUS_SYSTEM_OUT_OF_MEMORY;
+
+    if (!sourceStreamRefill(stream)) {
+        OperationStatus status = stream->error ? STATUS_IO_FILE_READ_ERROR : STATUS_IO_FILE_EMPTY;
+        sourceStreamClose(stream);
+        return status;
+    }
+
+    return STATUS_OK;
+}
+
+
+void sourceStreamOpenMemory(SourceStream* stream, const char* data, size_t size)
+{
+    assert(stream); assert(data);
+
+    stream->file = NULL;
+    stream->chunk = data;
+    stream->chunk_storage = NULL;
+    stream->chunk_size = size;
+    stream->position = 0;
+    stream->error = false;
+}
+
+
+void sourceStreamClose(SourceStream* stream)
+{
+    assert(stream);
+
+    free(stream->chunk_storage);
+    stream->chunk_storage = NULL;
+    stream->chunk = NULL;
+    stream->file = NULL;
+}
+
+
+bool sourceStreamRefill(SourceStream* stream)
+{
+    assert(stream);
+
+    if (stream->file == NULL || stream->error)
+        return false;
+
+    stream->position = 0;
+    stream->chunk_size = fread(stream->chunk_storage, 1, SOURCE_READ_CHUNK, stream->file);
+    if (stream->chunk_size == 0) {
+        stream->error = ferror(stream->file) != 0;
+        stream->file = NULL;
+        return false;
+    }
+
+    return true;
+}
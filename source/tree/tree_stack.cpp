@@ -0,0 +1,93 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "tree/tree_stack.h"
+
+#include "status.h"
+
+
+const size_t WORK_STACK_START_CAPACITY = 64;
+
+
+static OperationStatus workStackResize(WorkStack* stack);
+
+
+void workStackInit(WorkStack* stack, size_t element_size)
+{
+    assert(stack); assert(element_size != 0);
+
+    stack->data = NULL;
+    stack->element_size = element_size;
+    stack->count = 0;
+    stack->capacity = 0;
+}
+
+
+void workStackDestroy(WorkStack* stack)
+{
+    assert(stack);
+
+    free(stack->data);
+    stack->data = NULL;
+    stack->count = 0;
+    stack->capacity = 0;
+}
+
+
+OperationStatus workStackPush(WorkStack* stack, const void* element)
+{
+    assert(stack); assert(element);
+
+    if (stack->count == stack->capacity) {
+        OperationStatus status = workStackResize(stack);
+        RETURN_IF_STATUS_NOT_OK(status);
+    }
+
+    memcpy(stack->data + stack->count * stack->element_size, element, stack->element_size);
+    stack->count++;
+
+    return STATUS_OK;
+}
+
+
+bool workStackPop(WorkStack* stack, void* element)
+{
+    assert(stack); assert(element);
+
+    if (stack->count == 0)
+        return false;
+
+    stack->count--;
+    memcpy(element, stack->data + stack->count * stack->element_size, stack->element_size);
+
+    return true;
+}
+
+
+void* workStackTop(WorkStack* stack)
+{
+    assert(stack);
+
+    if (stack->count == 0)
+        return NULL;
+
+    return stack->data + (stack->count - 1) * stack->element_size;
+}
+
+
+static OperationStatus workStackResize(WorkStack* stack)
+{
+    assert(stack);
+
+    size_t new_capacity = stack->capacity == 0 ? WORK_STACK_START_CAPACITY : stack->capacity * 2;
+    char* temp_ptr = (char*)realloc(stack->data, new_capacity * stack->element_size);
+    if (temp_ptr == NULL)
+        return STATUS_SYSTEM_OUT_OF_MEMORY;
+
+    stack->data = temp_ptr;
+    stack->capacity = new_capacity;
+
+    return STATUS_OK;
+}
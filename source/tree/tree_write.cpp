@@ -0,0 +1,389 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+
+#include "tree/tree_write.h"
+#include "tree/tree_defs.h"
+
+#include "diff/diff_defs.h"
+
+#include "status.h"
+
+
+const size_t WRITE_BUFFER_SIZE = 1 << 16;
+const size_t MAX_FRACTION_DIGITS = 17;
+const double MAX_EXACT_INTEGER = 9007199254740992.0;
+const double MIN_PLAIN_MAGNITUDE = 1e-4;
+const size_t INFIX_ATOM_PRIORITY = 4;
+
+
+// Состояние обхода: узел только что достигнут или из него вернулись после левого/правого поддерева
+typedef enum {
+    WRITE_ENTER = 0,
+    WRITE_AFTER_LEFT,
+    WRITE_AFTER_RIGHT
+} WriteState;
+
+
+typedef struct {
+    FILE* file;
+    char* data;
+    size_t length;
+    size_t capacity;
+} WriteBuffer;
+
+
+static void writeBufferOpen(WriteBuffer* buffer, FILE* file);
+static OperationStatus writeBufferClose(WriteBuffer* buffer);
+static void writeBufferFlush(WriteBuffer* buffer);
+static void writeText(WriteBuffer* buffer, const char* text, size_t length);
+static void writeChar(WriteBuffer* buffer, char symbol);
+static void writeNumber(WriteBuffer* buffer, double number);
+static void writeTitle(Differentiator* diff, WriteBuffer* buffer, const TreeNode* node);
+
+static size_t formatDecimal(unsigned long long mantissa, size_t fraction_digits, char* text);
+static bool isInfixBinary(const TreeNode* node);
+static bool isInfixGrouped(const TreeNode* node);
+static size_t getInfixPriority(const TreeNode* node);
+
+
+OperationStatus treeWritePrefix(Differentiator* diff, const TreeNode* root, FILE* output)
+{
+    assert(diff); assert(root); assert(output);
+
+    WriteBuffer buffer = {};
+    writeBufferOpen(&buffer, output);
+
+// Формат совпадает с тем, что читает readTree: ( заголовок левый правый ), пустой потомок - nil
+    const TreeNode* node = root;
+    WriteState state = WRITE_ENTER;
+    while (node != NULL) {
+        switch (state) {
+            case WRITE_ENTER:
+                writeText(&buffer, "( ", 2);
+                writeTitle(diff, &buffer, node);
+                writeChar(&buffer, ' ');
+                if (node->left != NULL) {
+                    node = node->left;
+                    continue;
+                }
+                writeText(&buffer, "nil ", 4);
+                state = WRITE_AFTER_LEFT;
+                break;
+            case WRITE_AFTER_LEFT:
+                if (node->right != NULL) {
+                    node = node->right;
+                    state = WRITE_ENTER;
+                    continue;
+                }
+                writeText(&buffer, "nil ", 4);
+                state = WRITE_AFTER_RIGHT;
+                break;
+            case WRITE_AFTER_RIGHT:
+                writeChar(&buffer, ')');
+                if (node == root) {
+                    node = NULL;
+                    break;
+                }
+                writeChar(&buffer, ' ');
+                state = node->parent->left == node ? WRITE_AFTER_LEFT : WRITE_AFTER_RIGHT;
+                node = node->parent;
+                break;
+            default:
+                assert(0 && "Unknown write state");
+                node = NULL;
+                break;
+        }
+    }
+
+    return writeBufferClose(&buffer);
+}
+
+
+OperationStatus treeWriteInfix(Differentiator* diff, const TreeNode* root, FILE* output)
+{
+    assert(diff); assert(root); assert(output);
+
+    WriteBuffer buffer = {};
+    writeBufferOpen(&buffer, output);
+
+// Скобки ставятся только там, где без них getTree построил бы другое дерево
+    const TreeNode* node = root;
+    WriteState state = WRITE_ENTER;
+    while (node != NULL) {
+        switch (state) {
+            case WRITE_ENTER:
+// Отрицательное число берется в скобки, чтобы минус не сливался с оператором перед ним
+                if (node->type == NODE_NUM && signbit(node->value.num_val)) {
+                    writeChar(&buffer, '(');
+                    writeNumber(&buffer, node->value.num_val);
+                    writeChar(&buffer, ')');
+                    state = WRITE_AFTER_RIGHT;
+                    break;
+                }
+                if (node->type != NODE_OP) {
+                    writeTitle(diff, &buffer, node);
+                    state = WRITE_AFTER_RIGHT;
+                    break;
+                }
+                if (!isInfixBinary(node)) {
+                    writeTitle(diff, &buffer, node);
+                    writeChar(&buffer, '(');
+                } else if (node->left != NULL && isInfixGrouped(node->left)) {
+                    writeChar(&buffer, '(');
+                }
+                if (node->left != NULL) {
+                    node = node->left;
+                    continue;
+                }
+// Недостающий операнд вычисляется как ноль, так же он и записывается
+                if (isInfixBinary(node))
+                    writeChar(&buffer, '0');
+                state = WRITE_AFTER_LEFT;
+                break;
+            case WRITE_AFTER_LEFT:
+                if (isInfixBinary(node)) {
+                    if (node->left != NULL && isInfixGrouped(node->left))
+                        writeChar(&buffer, ')');
+                    writeTitle(diff, &buffer, node);
+                    if (node->right != NULL && isInfixGrouped(node->right))
+                        writeChar(&buffer, '(');
+                } else if (node->value.op == OP_LOG) {
+                    writeChar(&buffer, ',');
+                }
+                if (node->right != NULL) {
+                    node = node->right;
+                    state = WRITE_ENTER;
+                    continue;
+                }
+                writeChar(&buffer, '0');
+                state = WRITE_AFTER_RIGHT;
+                break;
+            case WRITE_AFTER_RIGHT:
+                if (node->type == NODE_OP && !isInfixBinary(node)) {
+                    writeChar(&buffer, ')');
+                } else if (node->type == NODE_OP && node->right != NULL && isInfixGrouped(node->right)) {
+                    writeChar(&buffer, ')');
+                }
+                if (node == root) {
+                    node = NULL;
+                    break;
+                }
+                state = node->parent->left == node ? WRITE_AFTER_LEFT : WRITE_AFTER_RIGHT;
+                node = node->parent;
+                break;
+            default:
+                assert(0 && "Unknown write state");
+                node = NULL;
+                break;
+        }
+    }
+
+    return writeBufferClose(&buffer);
+}
+
+
+size_t treeFormatNumber(double number, char* text)
+{
+    assert(text);
+
+    size_t length = 0;
+    if (signbit(number))
+        text[length++] = '-';
+    double magnitude = fabs(number);
+
+// Ищем самую короткую десятичную дробь m / 10^k, которая читается обратно в то же число.
+// m и 10^k точны в double, поэтому деление округляется так же, как разбор строки лексером.
+// Как и в %g, совсем маленькие числа короче записываются с порядком
+    if (magnitude < MAX_EXACT_INTEGER && (magnitude >= MIN_PLAIN_MAGNITUDE || magnitude <= 0)) {
+        double scale = 1;
+        for (size_t digits = 0; digits <= MAX_FRACTION_DIGITS; digits++) {
+            double mantissa = nearbyint(magnitude * scale);
+            if (mantissa >= MAX_EXACT_INTEGER)
+                break;
+            if (fabs(mantissa / scale - magnitude) <= 0)
+                return length + formatDecimal((unsigned long long)mantissa, digits, text + length);
+            scale *= 10;
+        }
+    }
+
+// Очень большие, очень маленькие и неконечные числа печатаются через printf с проверкой точности
+    for (int precision = 15; precision <= 17; precision++) {
+        int written = snprintf(text + length, NUMBER_TEXT_SIZE - length, "%.*g", precision, magnitude);
+        if (precision == 17 || fabs(strtod(text + length, NULL) - magnitude) <= 0)
+            return length + (size_t)written;
+    }
+
+    return length;
+}
+
+
+static void writeBufferOpen(WriteBuffer* buffer, FILE* file)
+{
+    assert(buffer); assert(file);
+
+// Если память не выделилась, текст пишется прямо в файл
+    buffer->file = file;
+    buffer->data = (char*)calloc(WRITE_BUFFER_SIZE, sizeof(char));
+    buffer->length = 0;
+    buffer->capacity = buffer->data != NULL ? WRITE_BUFFER_SIZE : 0;
+}
+
+
+static OperationStatus writeBufferClose(WriteBuffer* buffer)
+{
+    assert(buffer); assert(buffer->file);
+
+    writeBufferFlush(buffer);
+    free(buffer->data);
+    buffer->data = NULL;
+    buffer->capacity = 0;
+
+    return ferror(buffer->file) ? STATUS_IO_FILE_WRITE_ERROR : STATUS_OK;
+}
+
+
+static void writeBufferFlush(WriteBuffer* buffer)
+{
+    assert(buffer); assert(buffer->file);
+
+    if (buffer->length != 0)
+        fwrite(buffer->data, 1, buffer->length, buffer->file);
+    buffer->length = 0;
+}
+
+
+static void writeText(WriteBuffer* buffer, const char* text, size_t length)
+{
+    assert(buffer); assert(text);
+
+    if (length == 0)
+        return;
+
+    if (buffer->length + length > buffer->capacity) {
+        writeBufferFlush(buffer);
+        if (length > buffer->capacity) {
+            fwrite(text, 1, length, buffer->file);
+            return;
+        }
+    }
+
+    memcpy(buffer->data + buffer->length, text, length);
+    buffer->length += length;
+}
+
+
+static void writeChar(WriteBuffer* buffer, char symbol)
+{
+    assert(buffer);
+
+    if (buffer->length == buffer->capacity) {
+        writeBufferFlush(buffer);
+        if (buffer->capacity == 0) {
+            fputc(symbol, buffer->file);
+            return;
+        }
+    }
+
+    buffer->data[buffer->length++] = symbol;
+}
+
+
+static void writeNumber(WriteBuffer* buffer, double number)
+{
+    assert(buffer);
+
+    char text[NUMBER_TEXT_SIZE] = {};
+    size_t length = treeFormatNumber(number, text);
+    writeText(buffer, text, length);
+}
+
+
+static void writeTitle(Differentiator* diff, WriteBuffer* buffer, const TreeNode* node)
+{
+    assert(diff); assert(diff->var_table.variables); assert(buffer); assert(node);
+
+    const char* text = NULL;
+    switch (node->type) {
+        case NODE_OP:
+            text = OP_TABLE[node->value.op].symbol;
+            break;
+        case NODE_VAR:
+            text = diff->var_table.variables[node->value.var_idx].name;
+            break;
+        case NODE_NUM:
+            writeNumber(buffer, node->value.num_val);
+            return;
+        default:
+            assert(0 && "Unknown node type");
+            return;
+    }
+    writeText(buffer, text, strlen(text));
+}
+
+
+static size_t formatDecimal(unsigned long long mantissa, size_t fraction_digits, char* text)
+{
+    assert(text); assert(fraction_digits <= MAX_FRACTION_DIGITS);
+
+// Цифры собираются с конца, перед точкой всегда остается хотя бы один ноль
+    char digits[NUMBER_TEXT_SIZE] = {};
+    size_t count = 0;
+    do {
+        digits[count++] = (char)('0' + mantissa % 10);
+        mantissa /= 10;
+    } while (mantissa != 0);
+    while (count <= fraction_digits)
+        digits[count++] = '0';
+
+    size_t length = 0;
+    for (size_t index = count; index-- > 0; ) {
+        text[length++] = digits[index];
+        if (index == fraction_digits && index != 0)
+            text[length++] = '.';
+    }
+
+    return length;
+}
+
+
+static bool isInfixBinary(const TreeNode* node)
+{
+    assert(node);
+
+    return getInfixPriority(node) < INFIX_ATOM_PRIORITY;
+}
+
+
+static bool isInfixGrouped(const TreeNode* node)
+{
+    assert(node);
+
+    if (node->parent == NULL || !isInfixBinary(node->parent))
+        return false;
+
+// Все операторы разбираются левоассоциативно, поэтому правый операнд равного приоритета тоже берется в скобки
+    size_t priority = getInfixPriority(node);
+    size_t parent_priority = getInfixPriority(node->parent);
+    return node->parent->right == node ? priority <= parent_priority : priority < parent_priority;
+}
+
+
+static size_t getInfixPriority(const TreeNode* node)
+{
+    assert(node);
+
+    if (node->type != NODE_OP)
+        return INFIX_ATOM_PRIORITY;
+
+    switch (node->value.op) {
+        case OP_ADD:
+        case OP_SUB: return 1;
+        case OP_MUL:
+        case OP_DIV: return 2;
+        case OP_POW: return 3;
+        default:     return INFIX_ATOM_PRIORITY;
+    }
+}
@@ -0,0 +1,171 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <assert.h>
+
+#include "tests.h"
+
+#include "diff/diff_batch.h"
+
+#include "tex_dump/render_jobs.h"
+
+
+const size_t BATCH_TEST_THREADS = 4;
+const size_t BATCH_TEST_LIGHT_LINES = 24;
+const size_t BATCH_TEST_HEAVY_TERMS = 200;
+
+
+static OperationStatus writeBatchFile(const char* path, size_t* line_count);
+static OperationStatus runBatch(const char* input_path, const char* output_path, size_t thread_count,
+    char** text);
+static bool checkLineOrder(const char* text, size_t line_count);
+static void removeTimeLines(char* text);
+
+
+bool testBatchOrder()
+{
+    char directory[] = "/tmp/diffuzor_batch_XXXXXX";
+    if (mkdtemp(directory) == NULL)
+        return false;
+
+    char input_path[BUFFER_SIZE] = "";
+    char output_path[BUFFER_SIZE] = "";
+    snprintf(input_path, sizeof(input_path), "%s/input", directory);
+    snprintf(output_path, sizeof(output_path), "%s/output", directory);
+
+    size_t line_count = 0;
+    char* serial = NULL;
+    char* parallel = NULL;
+    OperationStatus status = writeBatchFile(input_path, &line_count);
+    if (status == STATUS_OK)
+        status = runBatch(input_path, output_path, 1, &serial);
+    if (status == STATUS_OK)
+        status = runBatch(input_path, output_path, BATCH_TEST_THREADS, &parallel);
+
+// Первое выражение самое долгое, поэтому при нескольких потоках оно готово последним
+    bool is_passed = status == STATUS_OK && checkLineOrder(parallel, line_count);
+    if (is_passed) {
+        removeTimeLines(serial);
+        removeTimeLines(parallel);
+        is_passed = strcmp(serial, parallel) == 0;
+        if (!is_passed)
+            fprintf(stderr, "batch: output on %zu threads differs from the serial one\n", BATCH_TEST_THREADS);
+    }
+
+    if (status != STATUS_OK)
+        fprintf(stderr, "batch: [%s] %s\n", ErrorTable[status].status_string, ErrorTable[status].error_message);
+    free(serial);
+    free(parallel);
+    removeDirectory(directory);
+    return is_passed;
+}
+
+
+static OperationStatus writeBatchFile(const char* path, size_t* line_count)
+{
+    assert(path); assert(line_count);
+
+    FILE* file = fopen(path, "w");
+    if (file == NULL)
+        return STATUS_IO_FILE_OPEN_ERROR;
+
+    for (size_t index = 1; index <= BATCH_TEST_HEAVY_TERMS; index++)
+        fprintf(file, "%s%zu*x^%zu*sin(x*y+%zu)", index == 1 ? "" : "+", index, index % 5 + 2, index);
+    fprintf(file, "\n\n(x\nsin(x)*y ; x=1, y=2\n");
+    *line_count = 4;
+
+// Пустая строка и строка с ошибкой тоже занимают номера, но пустая не дает результата
+    for (size_t index = 1; index <= BATCH_TEST_LIGHT_LINES; index++)
+        fprintf(file, "x^%zu+%zu*y\n", index, index);
+    *line_count += BATCH_TEST_LIGHT_LINES;
+
+    return fclose(file) == 0 ? STATUS_OK : STATUS_IO_FILE_CLOSE_ERROR;
+}
+
+
+static OperationStatus runBatch(const char* input_path, const char* output_path, size_t thread_count,
+    char** text)
+{
+    assert(input_path); assert(output_path); assert(text);
+
+    CmdArgs args = {};
+    OperationStatus status = testArgsCreate(&args, true);
+    RETURN_IF_STATUS_NOT_OK(status);
+
+    args.batch_info.batch_file = input_path;
+    args.batch_info.output_file = output_path;
+    args.derivative_info.order = 2;
+    args.thread_count = thread_count;
+    status = diffRunBatch(&args);
+    RETURN_IF_STATUS_NOT_OK(status);
+
+    FILE* file = fopen(output_path, "r");
+    if (file == NULL)
+        return STATUS_IO_FILE_OPEN_ERROR;
+
+    size_t size = 0;
+    char* buffer = NULL;
+    status = STATUS_IO_FILE_READ_ERROR;
+    if (fseek(file, 0, SEEK_END) == 0 && (size = (size_t)ftell(file)) != 0 && fseek(file, 0, SEEK_SET) == 0 &&
+        (buffer = (char*)calloc(size + 1, 1)) != NULL && fread(buffer, 1, size, file) == size)
+        status = STATUS_OK;
+    fclose(file);
+
+    if (status != STATUS_OK) {
+        free(buffer);
+        return status;
+    }
+    *text = buffer;
+    return STATUS_OK;
+}
+
+
+static bool checkLineOrder(const char* text, size_t line_count)
+{
+    assert(text);
+
+// Заголовки идут по номерам строк входа, пропущена только пустая вторая строка
+    size_t expected = 1;
+    for (const char* line = text; line != NULL && *line != '\0'; line = strchr(line, '\n')) {
+        if (*line == '\n')
+            line++;
+
+        size_t line_number = 0;
+        if (sscanf(line, "expression %zu:", &line_number) != 1)
+            continue;
+        if (expected == 2)
+            expected++;
+        if (line_number != expected) {
+            fprintf(stderr, "batch: result for line %zu comes where line %zu was expected\n",
+                line_number, expected);
+            return false;
+        }
+        expected++;
+    }
+
+    if (expected != line_count + 1) {
+        fprintf(stderr, "batch: output ends before line %zu of %zu\n", expected, line_count);
+        return false;
+    }
+    return true;
+}
+
+
+static void removeTimeLines(char* text)
+{
+    assert(text);
+
+// Время выполнения - единственная часть вывода, зависящая от запуска
+    char* write = text;
+    for (const char* line = text; *line != '\0';) {
+        const char* newline = strchr(line, '\n');
+        size_t length = newline != NULL ? (size_t)(newline - line) + 1 : strlen(line);
+        if (strncmp(line, "time: ", strlen("time: ")) != 0) {
+            memmove(write, line, length);
+            write += length;
+        }
+        line += length;
+    }
+    *write = '\0';
+}
@@ -0,0 +1,221 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <assert.h>
+
+#include "tests.h"
+
+#include "diff/diff.h"
+#include "diff/diff_cache.h"
+#include "diff/diff_evaluate.h"
+#include "diff/diff_optimize.h"
+#include "diff/diff_output.h"
+#include "diff/diff_var_table.h"
+
+#include "tex_dump/render_jobs.h"
+
+#include "tree/tree_io.h"
+#include "tree/tree_binary.h"
+
+
+const size_t CACHE_TEST_ORDER = 3;
+const char CACHE_TEST_EXPRESSION[] = "sin(x*y)+x^3/y";
+const char CACHE_FORGED_EXPRESSION[] = "cos(x)*y^2+x";
+
+
+typedef struct {
+    const char* name;
+    double value;
+} CacheVariable;
+
+
+static const CacheVariable CACHE_VARIABLES[] = {
+    {"x", 1.5},
+    {"y", 0.25}
+};
+
+
+static double CAPTURED_CACHE_VALUES[CACHE_TEST_ORDER + 1] = {};
+
+
+static OperationStatus computeAndStore(const char* directory, const char* expression,
+    double* values, const char* save_path);
+static OperationStatus lookupExpression(Differentiator* diff, const char* directory, const char* expression,
+    size_t* cached_count);
+static OperationStatus captureForestValues(Differentiator* diff, double* values);
+static bool findCacheEntry(const char* directory, char* path, size_t size);
+static bool checkCachedValues(const double* expected, const double* actual);
+static void captureCacheValue(Differentiator* diff, size_t tree_idx, double value);
+
+
+// Значения берутся тем же путем, что и у --compute: через diffEvaluate и выходной модуль
+static const OutputBackend CACHE_CAPTURE_BACKEND = {NULL, NULL, NULL, captureCacheValue, NULL, NULL, NULL};
+
+
+bool testDerivativeCache()
+{
+    char directory[] = "/tmp/diffuzor_cache_XXXXXX";
+    if (mkdtemp(directory) == NULL)
+        return false;
+
+    double expected[CACHE_TEST_ORDER + 1] = {};
+    OperationStatus status = computeAndStore(directory, CACHE_TEST_EXPRESSION, expected, NULL);
+
+// Запись должна найтись по ключу и дать те же значения, что и свежий расчет
+    Differentiator cached = {};
+    size_t cached_count = 0;
+    double actual[CACHE_TEST_ORDER + 1] = {};
+    if (status == STATUS_OK)
+        status = lookupExpression(&cached, directory, CACHE_TEST_EXPRESSION, &cached_count);
+    if (status == STATUS_OK && cached_count == CACHE_TEST_ORDER)
+        status = captureForestValues(&cached, actual);
+    if (cached.forest.trees != NULL)
+        diffContextDestructor(&cached);
+
+    bool is_passed = status == STATUS_OK && cached_count == CACHE_TEST_ORDER &&
+                     checkCachedValues(expected, actual);
+    if (status == STATUS_OK && cached_count != CACHE_TEST_ORDER)
+        fprintf(stderr, "cache: stored entry gave %zu derivatives, expected %zu\n", cached_count, CACHE_TEST_ORDER);
+
+// Под ключом записи лежит лес другого выражения, как при коллизии хеша: это должен быть промах
+    char entry_path[BUFFER_SIZE * 2] = "";
+    if (status == STATUS_OK && !findCacheEntry(directory, entry_path, sizeof(entry_path)))
+        status = STATUS_IO_FILE_OPEN_ERROR;
+    if (status == STATUS_OK)
+        status = computeAndStore(NULL, CACHE_FORGED_EXPRESSION, actual, entry_path);
+
+    Differentiator forged = {};
+    if (status == STATUS_OK)
+        status = lookupExpression(&forged, directory, CACHE_TEST_EXPRESSION, &cached_count);
+    if (status == STATUS_OK && (cached_count != 0 || forged.forest.count != 1)) {
+        fprintf(stderr, "cache: forged entry for \"%s\" was a hit\n", CACHE_FORGED_EXPRESSION);
+        is_passed = false;
+    }
+    if (forged.forest.trees != NULL)
+        diffContextDestructor(&forged);
+
+    if (status != STATUS_OK) {
+        fprintf(stderr, "cache: [%s] %s\n", ErrorTable[status].status_string, ErrorTable[status].error_message);
+        is_passed = false;
+    }
+    removeDirectory(directory);
+    return is_passed;
+}
+
+
+static OperationStatus computeAndStore(const char* directory, const char* expression,
+    double* values, const char* save_path)
+{
+    assert(expression); assert(values);
+
+    Differentiator diff = {};
+    size_t cached_count = 0;
+    OperationStatus status = lookupExpression(&diff, directory, expression, &cached_count);
+    if (status == STATUS_OK && cached_count != 0)
+        status = STATUS_IO_FILE_READ_ERROR;
+
+    for (size_t index = 1; status == STATUS_OK && index <= CACHE_TEST_ORDER; index++) {
+        status = diffCalculateDerivative(&diff, index - 1);
+        if (status == STATUS_OK)
+            optimizeTree(&diff, index);
+    }
+
+// Без каталога лес сохраняется по заданному пути в обход кэша
+    if (status == STATUS_OK)
+        status = directory != NULL ? diffCacheStore(&diff, cached_count) : diffSaveForest(&diff, save_path);
+    if (status == STATUS_OK)
+        status = captureForestValues(&diff, values);
+
+    if (diff.forest.trees != NULL)
+        diffContextDestructor(&diff);
+    return status;
+}
+
+
+static OperationStatus lookupExpression(Differentiator* diff, const char* directory, const char* expression,
+    size_t* cached_count)
+{
+    assert(diff); assert(expression); assert(cached_count);
+
+    *cached_count = 0;
+    OperationStatus status = testContextCreate(diff, true);
+    RETURN_IF_STATUS_NOT_OK(status);
+
+    diff->args.cache_info.directory = directory;
+    status = diffParseExpression(diff, expression, strlen(expression));
+    if (status == STATUS_OK && directory != NULL)
+        status = diffCacheLookup(diff, CACHE_TEST_ORDER, cached_count);
+
+    return status;
+}
+
+
+static OperationStatus captureForestValues(Differentiator* diff, double* values)
+{
+    assert(diff); assert(values); assert(diff->forest.count == CACHE_TEST_ORDER + 1);
+
+    for (size_t index = 0; index < sizeof(CACHE_VARIABLES) / sizeof(*CACHE_VARIABLES); index++) {
+        const char* name = CACHE_VARIABLES[index].name;
+        size_t var_idx = 0;
+        OperationStatus status = addVariable(diff, &var_idx, name, strlen(name));
+        RETURN_IF_STATUS_NOT_OK(status);
+        setVariableValue(diff, var_idx, CACHE_VARIABLES[index].value);
+    }
+
+    diff->output.backend = &CACHE_CAPTURE_BACKEND;
+    for (size_t index = 0; index <= CACHE_TEST_ORDER; index++) {
+        diffEvaluate(diff, index);
+        values[index] = CAPTURED_CACHE_VALUES[index];
+    }
+
+    return STATUS_OK;
+}
+
+
+static bool findCacheEntry(const char* directory, char* path, size_t size)
+{
+    assert(directory); assert(path);
+
+    DIR* dir = opendir(directory);
+    if (dir == NULL)
+        return false;
+
+    bool is_found = false;
+    for (struct dirent* item = readdir(dir); item != NULL && !is_found; item = readdir(dir)) {
+        const char* suffix = strrchr(item->d_name, '.');
+        if (suffix != NULL && strcmp(suffix, ".forest") == 0) {
+            int length = snprintf(path, size, "%s/%s", directory, item->d_name);
+            is_found = length > 0 && (size_t)length < size;
+        }
+    }
+
+    closedir(dir);
+    return is_found;
+}
+
+
+static bool checkCachedValues(const double* expected, const double* actual)
+{
+    assert(expected); assert(actual);
+
+// Деревья из записи те же, что были сохранены, поэтому значения совпадают побитово
+    bool is_passed = true;
+    for (size_t index = 0; index <= CACHE_TEST_ORDER; index++) {
+        if (memcmp(&expected[index], &actual[index], sizeof(double)) != 0) {
+            fprintf(stderr, "cache: order %zu evaluated to %.17g from cache, expected %.17g\n",
+                index, actual[index], expected[index]);
+            is_passed = false;
+        }
+    }
+
+    return is_passed;
+}
+
+
+static void captureCacheValue(Differentiator* diff, size_t tree_idx, double value)
+{
+    assert(diff); assert(tree_idx <= CACHE_TEST_ORDER);
+
+    CAPTURED_CACHE_VALUES[tree_idx] = value;
+}
@@ -0,0 +1,174 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <assert.h>
+
+#include "tests.h"
+
+#include "diff/diff.h"
+#include "diff/diff_evaluate.h"
+#include "diff/diff_optimize.h"
+#include "diff/diff_output.h"
+#include "diff/diff_var_table.h"
+
+#include "tree/tree_io.h"
+#include "tree/tree_binary.h"
+
+
+const size_t FOREST_TEST_ORDER = 3;
+
+
+typedef struct {
+    const char* name;
+    double value;
+} TestVariable;
+
+
+static const char* const FOREST_EXPRESSIONS[] = {
+    "x^3+x",
+    "sin(x*y)+x/y",
+    "log(2, x)*x^2-cosh(y)",
+    "atan(x)/(y+3)"
+};
+
+
+static const TestVariable FOREST_VARIABLES[] = {
+    {"x", 2},
+    {"y", 0.5}
+};
+
+
+static double CAPTURED_VALUES[FOREST_TEST_ORDER + 1] = {};
+
+
+static bool checkExpression(const char* expression, const char* forest_file);
+static OperationStatus buildForest(Differentiator* diff, const char* expression, const char* forest_file);
+static OperationStatus setTestVariables(Differentiator* diff);
+static bool compareValues(const char* expression, size_t order, double expected, double actual);
+static void captureValue(Differentiator* diff, size_t tree_idx, double value);
+
+
+// diffEvaluate сообщает значение только через выходной модуль, поэтому тест подменяет его
+static const OutputBackend CAPTURE_BACKEND = {NULL, NULL, NULL, captureValue, NULL, NULL, NULL};
+
+
+bool testForestEvaluate()
+{
+    char forest_file[] = "/tmp/diffuzor_forest_XXXXXX";
+    int fd = mkstemp(forest_file);
+    if (fd == -1) {
+        fprintf(stderr, "cannot create temporary forest file\n");
+        return false;
+    }
+    close(fd);
+
+    bool is_passed = true;
+    for (size_t index = 0; index < sizeof(FOREST_EXPRESSIONS) / sizeof(*FOREST_EXPRESSIONS); index++) {
+        if (!checkExpression(FOREST_EXPRESSIONS[index], forest_file))
+            is_passed = false;
+    }
+
+    unlink(forest_file);
+    return is_passed;
+}
+
+
+static bool checkExpression(const char* expression, const char* forest_file)
+{
+    assert(expression); assert(forest_file);
+
+// Ожидаемые значения считаются по дереву, построенному в этом же процессе
+    Differentiator source = {};
+    OperationStatus status = buildForest(&source, expression, forest_file);
+    double expected[FOREST_TEST_ORDER + 1] = {};
+    for (size_t index = 0; status == STATUS_OK && index <= FOREST_TEST_ORDER; index++)
+        expected[index] = evaluateNode(&source, source.forest.trees[index].root);
+    diffContextDestructor(&source);
+
+    Differentiator loaded = {};
+    if (status == STATUS_OK)
+        status = testContextCreate(&loaded, true);
+    if (status == STATUS_OK) {
+        status = diffLoadForest(&loaded, forest_file);
+        if (status == STATUS_OK && loaded.forest.count != FOREST_TEST_ORDER + 1)
+            status = STATUS_IO_FILE_READ_ERROR;
+        if (status == STATUS_OK)
+            status = setTestVariables(&loaded);
+    }
+
+    bool is_passed = status == STATUS_OK;
+    loaded.output.backend = &CAPTURE_BACKEND;
+    for (size_t index = 0; is_passed && index <= FOREST_TEST_ORDER; index++) {
+        diffEvaluate(&loaded, index);
+        if (!compareValues(expression, index, expected[index], CAPTURED_VALUES[index]))
+            is_passed = false;
+    }
+    if (loaded.forest.trees != NULL)
+        diffContextDestructor(&loaded);
+
+    if (status != STATUS_OK)
+        fprintf(stderr, "%s: [%s] %s\n", expression, ErrorTable[status].status_string,
+            ErrorTable[status].error_message);
+    return is_passed;
+}
+
+
+static OperationStatus buildForest(Differentiator* diff, const char* expression, const char* forest_file)
+{
+    assert(diff); assert(expression); assert(forest_file);
+
+    OperationStatus status = testContextCreate(diff, true);
+    RETURN_IF_STATUS_NOT_OK(status);
+
+    status = diffParseExpression(diff, expression, strlen(expression));
+    for (size_t index = 1; status == STATUS_OK && index <= FOREST_TEST_ORDER; index++) {
+        status = diffCalculateDerivative(diff, index - 1);
+        if (status == STATUS_OK)
+            optimizeTree(diff, index);
+    }
+
+    if (status == STATUS_OK)
+        status = diffSaveForest(diff, forest_file);
+    if (status == STATUS_OK)
+        status = setTestVariables(diff);
+
+    return status;
+}
+
+
+static OperationStatus setTestVariables(Differentiator* diff)
+{
+    assert(diff);
+
+    for (size_t index = 0; index < sizeof(FOREST_VARIABLES) / sizeof(*FOREST_VARIABLES); index++) {
+        const char* name = FOREST_VARIABLES[index].name;
+        size_t var_idx = 0;
+        OperationStatus status = addVariable(diff, &var_idx, name, strlen(name));
+        RETURN_IF_STATUS_NOT_OK(status);
+        setVariableValue(diff, var_idx, FOREST_VARIABLES[index].value);
+    }
+
+    return STATUS_OK;
+}
+
+
+static bool compareValues(const char* expression, size_t order, double expected, double actual)
+{
+    assert(expression);
+
+// Деревья те же, поэтому значения совпадают побитово
+    if (memcmp(&expected, &actual, sizeof(double)) == 0)
+        return true;
+
+    fprintf(stderr, "%s: order %zu evaluated to %.17g, expected %.17g\n", expression, order, actual, expected);
+    return false;
+}
+
+
+static void captureValue(Differentiator* diff, size_t tree_idx, double value)
+{
+    assert(diff); assert(tree_idx <= FOREST_TEST_ORDER);
+
+    CAPTURED_VALUES[tree_idx] = value;
+}
@@ -0,0 +1,80 @@
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+#include "tests.h"
+
+#include "diff/diff.h"
+#include "diff/diff_cmd_args.h"
+
+
+typedef struct {
+    const char* name;
+    bool (*run)();
+} TestCase;
+
+
+static const TestCase TEST_CASES[] = {
+    {"forest_evaluate", testForestEvaluate},
+    {"parse_infix", testParseInfix},
+    {"write_infix_round_trip", testWriteInfixRoundTrip},
+    {"write_prefix_round_trip", testWritePrefixRoundTrip},
+    {"server_requests", testServerRequests},
+    {"render_cache", testRenderCache},
+    {"shared_validation", testSharedValidation},
+    {"derivative_cache", testDerivativeCache},
+    {"parallel_optimize", testParallelOptimize},
+    {"batch_order", testBatchOrder}
+};
+
+
+int main()
+{
+    size_t failed_count = 0;
+    for (size_t index = 0; index < sizeof(TEST_CASES) / sizeof(*TEST_CASES); index++) {
+        bool is_passed = TEST_CASES[index].run();
+        printf("[%s] %s\n", is_passed ? "PASS" : "FAIL", TEST_CASES[index].name);
+        if (!is_passed)
+            failed_count++;
+    }
+
+    if (failed_count != 0) {
+        printf("%zu test(s) failed\n", failed_count);
+        return 1;
+    }
+    return 0;
+}
+
+
+OperationStatus testArgsCreate(CmdArgs* args, bool infix_input)
+{
+    assert(args);
+
+    const char* argv[] = {"diffuzor_test"};
+    Differentiator diff = {};
+    OperationStatus status = parseArgs(&diff, 1, argv);
+    RETURN_IF_STATUS_NOT_OK(status);
+
+    diff.args.infix_input = infix_input;
+    diff.args.diagnostics_info.level = DIAGNOSTICS_VERIFY;
+    diff.args.thread_count = 1;
+
+    *args = diff.args;
+    return STATUS_OK;
+}
+
+
+OperationStatus testContextCreate(Differentiator* diff, bool infix_input)
+{
+    assert(diff);
+
+    memset(diff, 0, sizeof(*diff));
+    OperationStatus status = testArgsCreate(&diff->args, infix_input);
+    RETURN_IF_STATUS_NOT_OK(status);
+
+    status = diffContextConstructor(diff);
+    RETURN_IF_STATUS_NOT_OK(status);
+
+    diff->tex_dump.print_steps = false;
+    return STATUS_OK;
+}
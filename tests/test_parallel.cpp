@@ -0,0 +1,111 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "tests.h"
+
+#include "diff/diff.h"
+#include "diff/diff_optimize.h"
+
+#include "tree/tree_io.h"
+#include "tree/tree_write.h"
+
+
+const size_t PARALLEL_TEST_ORDER = 2;
+const size_t PARALLEL_TEST_TERMS = 400;
+const size_t PARALLEL_TEST_THREADS = 4;
+
+
+static char* createLargeExpression();
+static OperationStatus writeDerivatives(const char* expression, size_t thread_count, char** texts);
+static OperationStatus writeTreePrefix(Differentiator* diff, size_t tree_idx, char** text);
+
+
+bool testParallelOptimize()
+{
+    char* expression = createLargeExpression();
+    char* serial[PARALLEL_TEST_ORDER + 1] = {};
+    char* parallel[PARALLEL_TEST_ORDER + 1] = {};
+
+// Выражение больше порогов распараллеливания дифференцирования и оптимизации
+    OperationStatus status = expression != NULL ? writeDerivatives(expression, 1, serial)
+                                                : STATUS_SYSTEM_OUT_OF_MEMORY;
+    if (status == STATUS_OK)
+        status = writeDerivatives(expression, PARALLEL_TEST_THREADS, parallel);
+
+    bool is_passed = status == STATUS_OK;
+    for (size_t index = 1; is_passed && index <= PARALLEL_TEST_ORDER; index++) {
+        if (strcmp(serial[index], parallel[index]) != 0) {
+            fprintf(stderr, "parallel: derivative %zu differs between 1 and %zu threads\n",
+                index, PARALLEL_TEST_THREADS);
+            is_passed = false;
+        }
+    }
+
+    if (status != STATUS_OK)
+        fprintf(stderr, "parallel: [%s] %s\n", ErrorTable[status].status_string, ErrorTable[status].error_message);
+    for (size_t index = 0; index <= PARALLEL_TEST_ORDER; index++) {
+        free(serial[index]);
+        free(parallel[index]);
+    }
+    free(expression);
+    return is_passed;
+}
+
+
+static char* createLargeExpression()
+{
+    char* text = NULL;
+    size_t length = 0;
+    FILE* output = open_memstream(&text, &length);
+    if (output == NULL)
+        return NULL;
+
+// Слагаемые различаются константами, чтобы свертка не сводила их друг к другу
+    for (size_t index = 1; index <= PARALLEL_TEST_TERMS; index++)
+        fprintf(output, "%s%zu*x^%zu*sin(x*y+%zu)", index == 1 ? "" : "+", index, index % 5 + 2, index);
+
+    fclose(output);
+    return text;
+}
+
+
+static OperationStatus writeDerivatives(const char* expression, size_t thread_count, char** texts)
+{
+    assert(expression); assert(texts);
+
+    Differentiator diff = {};
+    OperationStatus status = testContextCreate(&diff, true);
+    RETURN_IF_STATUS_NOT_OK(status);
+
+    diff.args.thread_count = thread_count;
+    status = diffParseExpression(&diff, expression, strlen(expression));
+    for (size_t index = 1; status == STATUS_OK && index <= PARALLEL_TEST_ORDER; index++) {
+        status = diffCalculateDerivative(&diff, index - 1);
+        if (status == STATUS_OK) {
+            optimizeTree(&diff, index);
+            status = writeTreePrefix(&diff, index, &texts[index]);
+        }
+    }
+
+    diffContextDestructor(&diff);
+    return status;
+}
+
+
+static OperationStatus writeTreePrefix(Differentiator* diff, size_t tree_idx, char** text)
+{
+    assert(diff); assert(text);
+
+    size_t length = 0;
+    FILE* output = open_memstream(text, &length);
+    if (output == NULL)
+        return STATUS_SYSTEM_OUT_OF_MEMORY;
+
+    OperationStatus status = treeWritePrefix(diff, diff->forest.trees[tree_idx].root, output);
+    if (fclose(output) != 0 && status == STATUS_OK)
+        status = STATUS_IO_FILE_WRITE_ERROR;
+
+    return status;
+}
@@ -0,0 +1,85 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "tests.h"
+
+#include "diff/diff.h"
+
+#include "tree/tree_io.h"
+#include "tree/tree_write.h"
+
+
+typedef struct {
+    const char* infix;
+    const char* prefix;
+} ParseCase;
+
+
+// NULL вместо префиксной записи означает, что выражение должно отклоняться
+static const ParseCase PARSE_CASES[] = {
+    {"x-2^2",     "( - ( x nil nil ) ( ^ ( 2 nil nil ) ( 2 nil nil ) ) )"},
+    {"(-2)^2",    "( ^ ( -2 nil nil ) ( 2 nil nil ) )"},
+    {"x*(-2.5)",  "( * ( x nil nil ) ( -2.5 nil nil ) )"},
+    {"2^3^x",     "( ^ ( ^ ( 2 nil nil ) ( 3 nil nil ) ) ( x nil nil ) )"},
+    {"log(2, x)", "( log ( 2 nil nil ) ( x nil nil ) )"},
+    {"x+inf",     "( + ( x nil nil ) ( inf nil nil ) )"},
+    {"(-inf)*nan","( * ( -inf nil nil ) ( nan nil nil ) )"},
+    {"infx+nanny","( + ( infx nil nil ) ( nanny nil nil ) )"},
+    {"-2^2",      NULL},
+    {"-2^2*x",    NULL},
+    {"x*-2^x",    NULL},
+    {"-x",        NULL},
+    {"(-x)",      NULL},
+    {"(-2+x)",    NULL},
+    {"x-",        NULL}
+};
+
+
+static bool checkParse(const ParseCase* parse_case);
+
+
+bool testParseInfix()
+{
+    bool is_passed = true;
+    for (size_t index = 0; index < sizeof(PARSE_CASES) / sizeof(*PARSE_CASES); index++) {
+        if (!checkParse(&PARSE_CASES[index]))
+            is_passed = false;
+    }
+
+    return is_passed;
+}
+
+
+static bool checkParse(const ParseCase* parse_case)
+{
+    assert(parse_case);
+
+    Differentiator diff = {};
+    if (testContextCreate(&diff, true) != STATUS_OK)
+        return false;
+
+    OperationStatus status = diffParseExpression(&diff, parse_case->infix, strlen(parse_case->infix));
+    bool is_parsed = status == STATUS_OK && diff.forest.trees[0].root != NULL;
+
+    char* text = NULL;
+    size_t length = 0;
+    if (is_parsed) {
+        FILE* output = open_memstream(&text, &length);
+        if (output != NULL) {
+            treeWritePrefix(&diff, diff.forest.trees[0].root, output);
+            fclose(output);
+        }
+    }
+
+    bool is_passed = parse_case->prefix == NULL ? !is_parsed :
+        is_parsed && text != NULL && strcmp(text, parse_case->prefix) == 0;
+    if (!is_passed)
+        fprintf(stderr, "%s: parsed as %s, expected %s\n", parse_case->infix,
+            is_parsed && text != NULL ? text : "error", parse_case->prefix != NULL ? parse_case->prefix : "error");
+
+    free(text);
+    diffContextDestructor(&diff);
+    return is_passed;
+}
@@ -0,0 +1,132 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <assert.h>
+
+#include "tests.h"
+
+#include "diff/diff_cache.h"
+
+#include "tex_dump/render_cache.h"
+#include "tex_dump/render_jobs.h"
+
+
+typedef struct {
+    const char* input;
+    const char* digest;
+} DigestCase;
+
+
+// Контрольные значения SHA-256 из FIPS 180-2: пустая строка, один блок и два блока
+static const DigestCase DIGEST_CASES[] = {
+    {"",    "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855"},
+    {"abc", "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad"},
+    {"abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq",
+            "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1"}
+};
+
+
+static const char ARTIFACT_TEXT[] = "rendered artifact";
+
+
+static bool checkDigest(const char* directory, const char* source, const DigestCase* digest_case);
+static bool checkFetch(const char* directory, const char* key_text, bool is_split, bool expect_hit);
+static bool writeTextFile(const char* path, const char* text);
+static bool isFileText(const char* path, const char* text);
+
+
+bool testRenderCache()
+{
+    char directory[] = "/tmp/diffuzor_render_XXXXXX";
+    if (mkdtemp(directory) == NULL)
+        return false;
+
+    renderCacheOpen(directory, DEFAULT_CACHE_SIZE_LIMIT);
+    char source[BUFFER_SIZE] = "";
+    snprintf(source, BUFFER_SIZE, "%s/source", directory);
+    bool is_passed = renderCacheIsEnabled() && writeTextFile(source, ARTIFACT_TEXT);
+
+// Имя файла в кэше - полный SHA-256 входа, поэтому оно сверяется с известными значениями
+    for (size_t index = 0; is_passed && index < sizeof(DIGEST_CASES) / sizeof(*DIGEST_CASES); index++)
+        is_passed = checkDigest(directory, source, &DIGEST_CASES[index]);
+
+    is_passed = is_passed && checkFetch(directory, "abc", false, true) &&
+        checkFetch(directory, "abc", true, true) && checkFetch(directory, "abd", false, false);
+
+    renderCacheOpen(NULL, 0);
+    removeDirectory(directory);
+    return is_passed;
+}
+
+
+static bool checkDigest(const char* directory, const char* source, const DigestCase* digest_case)
+{
+    assert(directory); assert(source); assert(digest_case);
+
+    RenderArtifact artifact = {};
+    renderCacheKeyInit(&artifact);
+    renderCacheKeyAdd(&artifact, digest_case->input, strlen(digest_case->input));
+    snprintf(artifact.path, sizeof(artifact.path), "%s", source);
+    renderCacheStore(&artifact);
+
+    char path[BUFFER_SIZE * 2] = "";
+    snprintf(path, sizeof(path), "%s/artifacts/%s.artifact", directory, digest_case->digest);
+    bool is_stored = isFileText(path, ARTIFACT_TEXT);
+    if (!is_stored)
+        fprintf(stderr, "render cache: no artifact %s for \"%s\"\n", path, digest_case->input);
+
+    return is_stored;
+}
+
+
+static bool checkFetch(const char* directory, const char* key_text, bool is_split, bool expect_hit)
+{
+    assert(directory); assert(key_text);
+
+// Ключ, дописанный по частям, должен совпасть с ключом, посчитанным за раз
+    RenderArtifact artifact = {};
+    renderCacheKeyInit(&artifact);
+    size_t length = strlen(key_text);
+    size_t first_part = is_split ? 1 : length;
+    renderCacheKeyAdd(&artifact, key_text, first_part);
+    renderCacheKeyAdd(&artifact, key_text + first_part, length - first_part);
+    snprintf(artifact.path, sizeof(artifact.path), "%s/fetched", directory);
+    unlink(artifact.path);
+
+    bool is_hit = renderCacheFetch(&artifact);
+    bool is_passed = is_hit == expect_hit && (!is_hit || isFileText(artifact.path, ARTIFACT_TEXT));
+    if (!is_passed)
+        fprintf(stderr, "render cache: key \"%s\" gave a %s\n", key_text, is_hit ? "hit" : "miss");
+
+    return is_passed;
+}
+
+
+static bool writeTextFile(const char* path, const char* text)
+{
+    assert(path); assert(text);
+
+    FILE* file = fopen(path, "w");
+    if (file == NULL)
+        return false;
+
+    bool is_written = fputs(text, file) >= 0;
+    return fclose(file) == 0 && is_written;
+}
+
+
+static bool isFileText(const char* path, const char* text)
+{
+    assert(path); assert(text);
+
+    FILE* file = fopen(path, "r");
+    if (file == NULL)
+        return false;
+
+    char buffer[BUFFER_SIZE] = "";
+    size_t length = fread(buffer, 1, BUFFER_SIZE - 1, file);
+    fclose(file);
+
+    return length == strlen(text) && memcmp(buffer, text, length) == 0;
+}
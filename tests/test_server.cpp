@@ -0,0 +1,172 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <arpa/inet.h>
+#include <assert.h>
+
+#include "tests.h"
+
+#include "server/diff_server.h"
+#include "server/server_protocol.h"
+
+
+const size_t SERVER_CONNECT_ATTEMPTS = 200;
+const useconds_t SERVER_CONNECT_DELAY = 10000;
+
+
+typedef struct {
+    CmdArgs args;
+    OperationStatus status;
+} ServerRun;
+
+
+typedef struct {
+    const char* request;
+    const char* expected;
+} ServerCase;
+
+
+// Ответ сравнивается по префиксу: в конце каждого ответа идет время обработки
+static const ServerCase SERVER_CASES[] = {
+    {"x^2\nx\n1\n",           "derivative 1: 2*x\n"},
+    {"x^3\nx\n2\n",           "derivative 1: 3*x^2\nderivative 2: 3*(2*x)\n"},
+    {"x^2\nx\n-1\n",          "error: [STATUS_IO_INVALID_USER_INPUT]"},
+    {"x^2\nx\n99999999999\n", "error: [STATUS_IO_INVALID_USER_INPUT]"},
+    {"x^2\nx\n+1\n",          "error: [STATUS_IO_INVALID_USER_INPUT]"},
+    {"x^2\nx\n65\n",          "error: [STATUS_IO_INVALID_USER_INPUT]"},
+    {"x^2\nx\n1\nx=3\n",      "derivative 1: 2*x\npoint 1: x=3\nvalue 0: 9\nvalue 1: 6\n"}
+};
+
+
+static void* runServer(void* argument);
+static int connectToServer(const char* socket_path);
+static bool checkRequest(int fd, const ServerCase* server_case);
+static bool checkOversizedFrame(const char* socket_path);
+
+
+bool testServerRequests()
+{
+    char socket_path[BUFFER_SIZE] = "";
+    snprintf(socket_path, BUFFER_SIZE, "/tmp/diffuzor_test_%d.sock", getpid());
+
+    ServerRun run = {};
+    if (testArgsCreate(&run.args, true) != STATUS_OK)
+        return false;
+    run.args.socket_path = socket_path;
+    run.args.thread_count = 2;
+
+    pthread_t server_thread = {};
+    if (pthread_create(&server_thread, NULL, runServer, &run) != 0)
+        return false;
+
+// Все запросы идут по одному соединению, поэтому заодно проверяется порядок кадров
+    bool is_passed = false;
+    int fd = connectToServer(socket_path);
+    if (fd != -1) {
+        is_passed = true;
+        for (size_t index = 0; index < sizeof(SERVER_CASES) / sizeof(*SERVER_CASES); index++) {
+            if (!checkRequest(fd, &SERVER_CASES[index]))
+                is_passed = false;
+        }
+        close(fd);
+        if (!checkOversizedFrame(socket_path))
+            is_passed = false;
+    } else {
+        fprintf(stderr, "cannot connect to %s\n", socket_path);
+    }
+
+// Сервер ждет сигнал в sigwait своего потока, поэтому сигнал адресуется ему
+    pthread_kill(server_thread, SIGTERM);
+    pthread_join(server_thread, NULL);
+    return is_passed && run.status == STATUS_OK;
+}
+
+
+static void* runServer(void* argument)
+{
+    assert(argument);
+
+    ServerRun* run = (ServerRun*)argument;
+    run->status = diffRunServer(&run->args);
+    return NULL;
+}
+
+
+static int connectToServer(const char* socket_path)
+{
+    assert(socket_path);
+
+    struct sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    snprintf(address.sun_path, sizeof(address.sun_path), "%s", socket_path);
+
+// Сокет появляется не сразу после запуска потока сервера
+    for (size_t attempt = 0; attempt < SERVER_CONNECT_ATTEMPTS; attempt++) {
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd == -1)
+            return -1;
+        if (connect(fd, (struct sockaddr*)&address, sizeof(address)) == 0)
+            return fd;
+
+        close(fd);
+        usleep(SERVER_CONNECT_DELAY);
+    }
+
+    return -1;
+}
+
+
+static bool checkRequest(int fd, const ServerCase* server_case)
+{
+    assert(server_case);
+
+    char* response = NULL;
+    size_t capacity = 0;
+    size_t length = 0;
+    bool is_closed = false;
+    OperationStatus status = serverWriteFrame(fd, server_case->request, strlen(server_case->request));
+    if (status == STATUS_OK)
+        status = serverReadFrame(fd, &response, &capacity, &length, &is_closed);
+
+    size_t expected_length = strlen(server_case->expected);
+    bool is_passed = status == STATUS_OK && !is_closed && length >= expected_length &&
+        memcmp(response, server_case->expected, expected_length) == 0;
+    if (!is_passed)
+        fprintf(stderr, "request %s: unexpected response %.*s\n", server_case->request,
+            (int)length, response != NULL ? response : "");
+
+    free(response);
+    return is_passed;
+}
+
+
+static bool checkOversizedFrame(const char* socket_path)
+{
+    assert(socket_path);
+
+// На кадр длиннее предела сервер закрывает соединение, не читая нагрузку
+    int fd = connectToServer(socket_path);
+    if (fd == -1)
+        return false;
+
+    uint32_t network_length = htonl(SERVER_MAX_FRAME_SIZE + 1);
+    bool is_passed = write(fd, &network_length, sizeof(network_length)) == sizeof(network_length);
+
+    char* response = NULL;
+    size_t capacity = 0;
+    size_t length = 0;
+    bool is_closed = false;
+    if (is_passed)
+        is_passed = serverReadFrame(fd, &response, &capacity, &length, &is_closed) == STATUS_OK && is_closed;
+    if (!is_passed)
+        fprintf(stderr, "oversized frame: connection was not closed\n");
+
+    free(response);
+    close(fd);
+    return is_passed;
+}
@@ -0,0 +1,200 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "tests.h"
+
+#include "diff/diff.h"
+#include "diff/diff_shared.h"
+
+#include "tree/tree_io.h"
+
+
+const size_t SHARED_TEST_REGION_SIZE = 1 << 16;
+const size_t SHARED_TEST_POINT_COUNT = 3;
+const size_t SHARED_TEST_ORDER = 2;
+
+
+typedef void (*HeaderCorruption)(SharedEvalHeader* header);
+
+
+typedef struct {
+    const char* name;
+    HeaderCorruption corrupt;
+} SharedCase;
+
+
+static void setBadMagic(SharedEvalHeader* header);
+static void setTooManyColumns(SharedEvalHeader* header);
+static void setMisalignedInput(SharedEvalHeader* header);
+static void setInputBeforeHeader(SharedEvalHeader* header);
+static void setOutputPastRegion(SharedEvalHeader* header);
+static void setHugePointCount(SharedEvalHeader* header);
+static void setOrderAboveMaximum(SharedEvalHeader* header);
+static void setLargeOrderWithoutPoints(SharedEvalHeader* header);
+
+
+// Каждый заголовок испорчен в одном поле, остальное совпадает с корректным запросом
+static const SharedCase SHARED_CASES[] = {
+    {"bad magic",                   setBadMagic},
+    {"too many columns",            setTooManyColumns},
+    {"misaligned input",            setMisalignedInput},
+    {"input inside header",         setInputBeforeHeader},
+    {"output past region",          setOutputPastRegion},
+    {"huge point count",            setHugePointCount},
+    {"order above maximum",         setOrderAboveMaximum},
+    {"large order without points",  setLargeOrderWithoutPoints}
+};
+
+
+static void fillHeader(SharedEvalHeader* header);
+static bool checkValidRegion(Differentiator* diff, double* region);
+static bool checkMalformedRegion(Differentiator* diff, double* region, const SharedCase* test_case);
+
+
+bool testSharedValidation()
+{
+    double* region = (double*)calloc(SHARED_TEST_REGION_SIZE / sizeof(double), sizeof(double));
+    Differentiator diff = {};
+    OperationStatus status = region != NULL ? testContextCreate(&diff, true) : STATUS_SYSTEM_OUT_OF_MEMORY;
+    if (status == STATUS_OK)
+        status = diffParseExpression(&diff, "x^3", strlen("x^3"));
+
+    bool is_passed = status == STATUS_OK && checkValidRegion(&diff, region);
+    for (size_t index = 0; status == STATUS_OK && index < sizeof(SHARED_CASES) / sizeof(*SHARED_CASES); index++) {
+        if (!checkMalformedRegion(&diff, region, &SHARED_CASES[index]))
+            is_passed = false;
+    }
+
+    if (status != STATUS_OK)
+        fprintf(stderr, "shared: [%s] %s\n", ErrorTable[status].status_string, ErrorTable[status].error_message);
+    if (diff.forest.trees != NULL)
+        diffContextDestructor(&diff);
+    free(region);
+    return is_passed;
+}
+
+
+static bool checkValidRegion(Differentiator* diff, double* region)
+{
+    assert(diff); assert(region);
+
+    SharedEvalHeader* header = (SharedEvalHeader*)region;
+    fillHeader(header);
+    double* input = region + header->input_offset / sizeof(double);
+    double* output = region + header->output_offset / sizeof(double);
+    for (size_t point = 0; point < SHARED_TEST_POINT_COUNT; point++)
+        input[point] = (double)point + 1;
+
+    OperationStatus status = diffEvaluateShared(diff, region, SHARED_TEST_REGION_SIZE);
+    if (status != STATUS_OK || header->state != SHARED_EVAL_DONE) {
+        fprintf(stderr, "shared: valid region failed with [%s]\n", ErrorTable[status].status_string);
+        return false;
+    }
+
+// Значения x^3, 3x^2 и 6x в точках 1, 2, 3 точны в double
+    bool is_passed = true;
+    for (size_t point = 0; point < SHARED_TEST_POINT_COUNT; point++) {
+        double x = input[point];
+        double expected[SHARED_TEST_ORDER + 1] = {x * x * x, 3 * x * x, 6 * x};
+        for (size_t order = 0; order <= SHARED_TEST_ORDER; order++) {
+            double actual = output[order * SHARED_TEST_POINT_COUNT + point];
+            if (memcmp(&actual, &expected[order], sizeof(double)) != 0) {
+                fprintf(stderr, "shared: order %zu at x = %g is %.17g, expected %.17g\n",
+                    order, x, actual, expected[order]);
+                is_passed = false;
+            }
+        }
+    }
+
+    return is_passed;
+}
+
+
+static bool checkMalformedRegion(Differentiator* diff, double* region, const SharedCase* test_case)
+{
+    assert(diff); assert(region); assert(test_case);
+
+    SharedEvalHeader* header = (SharedEvalHeader*)region;
+    fillHeader(header);
+    test_case->corrupt(header);
+    size_t tree_count = diff->forest.count;
+
+    OperationStatus status = diffEvaluateShared(diff, region, SHARED_TEST_REGION_SIZE);
+    bool is_passed = status == STATUS_IO_INVALID_USER_INPUT &&
+                     header->state == SHARED_EVAL_FAILED &&
+                     header->status == STATUS_IO_INVALID_USER_INPUT &&
+                     diff->forest.count == tree_count;
+    if (!is_passed)
+        fprintf(stderr, "shared: %s: expected rejection, got [%s] with %zu trees\n",
+            test_case->name, ErrorTable[status].status_string, diff->forest.count);
+
+    return is_passed;
+}
+
+
+static void fillHeader(SharedEvalHeader* header)
+{
+    assert(header);
+
+    memset(header, 0, sizeof(*header));
+    header->magic = SHARED_EVAL_MAGIC;
+    header->state = SHARED_EVAL_PENDING;
+    header->column_count = 1;
+    header->point_count = SHARED_TEST_POINT_COUNT;
+    header->order = SHARED_TEST_ORDER;
+    header->input_offset = sizeof(SharedEvalHeader);
+    header->output_offset = header->input_offset + SHARED_TEST_POINT_COUNT * sizeof(double);
+    strcpy(header->column_names[0], "x");
+}
+
+
+static void setBadMagic(SharedEvalHeader* header)
+{
+    header->magic = ~SHARED_EVAL_MAGIC;
+}
+
+
+static void setTooManyColumns(SharedEvalHeader* header)
+{
+    header->column_count = SHARED_EVAL_MAX_COLUMNS + 1;
+}
+
+
+static void setMisalignedInput(SharedEvalHeader* header)
+{
+    header->input_offset += 1;
+}
+
+
+static void setInputBeforeHeader(SharedEvalHeader* header)
+{
+    header->input_offset = 0;
+}
+
+
+static void setOutputPastRegion(SharedEvalHeader* header)
+{
+    header->output_offset = SHARED_TEST_REGION_SIZE - sizeof(double);
+}
+
+
+static void setHugePointCount(SharedEvalHeader* header)
+{
+    header->point_count = UINT64_MAX / sizeof(double);
+}
+
+
+static void setOrderAboveMaximum(SharedEvalHeader* header)
+{
+    header->order = SHARED_EVAL_MAX_ORDER + 1;
+}
+
+
+// Без точек область не ограничивает порядок, поэтому проверяется отдельный предел
+static void setLargeOrderWithoutPoints(SharedEvalHeader* header)
+{
+    header->point_count = 0;
+    header->order = SHARED_TEST_REGION_SIZE / sizeof(double) - 1;
+}
@@ -0,0 +1,225 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <assert.h>
+
+#include "tests.h"
+
+#include "diff/diff.h"
+#include "diff/diff_create.h"
+#include "diff/diff_var_table.h"
+
+#include "tree/tree.h"
+#include "tree/tree_io.h"
+#include "tree/tree_write.h"
+
+
+const size_t ROUND_TRIP_TREE_COUNT = 2000;
+const size_t ROUND_TRIP_MAX_DEPTH = 8;
+
+
+static const char* const ROUND_TRIP_VARIABLES[] = {"x", "y", "z", "t2"};
+const size_t ROUND_TRIP_VARIABLE_COUNT = sizeof(ROUND_TRIP_VARIABLES) / sizeof(*ROUND_TRIP_VARIABLES);
+
+
+static bool runRoundTrips(bool infix_input, uint64_t seed);
+static bool checkRoundTrip(Differentiator* source, const TreeNode* root, bool infix_input);
+static OperationStatus writeTree(Differentiator* diff, const TreeNode* root, bool infix_input,
+                                 char** text, size_t* length);
+static bool compareTrees(const Differentiator* expected_diff, const TreeNode* expected,
+                         const Differentiator* actual_diff, const TreeNode* actual);
+static bool isSameNumber(double expected, double actual);
+static TreeNode* createRandomTree(uint64_t* seed, size_t depth);
+static double createRandomNumber(uint64_t* seed);
+static uint64_t nextRandom(uint64_t* seed);
+
+
+bool testWriteInfixRoundTrip()
+{
+    return runRoundTrips(true, 0x9E3779B97F4A7C15);
+}
+
+
+bool testWritePrefixRoundTrip()
+{
+    return runRoundTrips(false, 0xD1B54A32D192ED03);
+}
+
+
+static bool runRoundTrips(bool infix_input, uint64_t seed)
+{
+// Имена заводятся заранее, чтобы случайные узлы ссылались на существующие индексы
+    Differentiator source = {};
+    OperationStatus status = testContextCreate(&source, infix_input);
+    for (size_t index = 0; status == STATUS_OK && index < ROUND_TRIP_VARIABLE_COUNT; index++) {
+        size_t var_idx = 0;
+        const char* name = ROUND_TRIP_VARIABLES[index];
+        status = addVariable(&source, &var_idx, name, strlen(name));
+    }
+
+    bool is_passed = status == STATUS_OK;
+    for (size_t index = 0; is_passed && index < ROUND_TRIP_TREE_COUNT; index++) {
+        TreeNode* root = createRandomTree(&seed, 0);
+        is_passed = root != NULL && checkRoundTrip(&source, root, infix_input);
+        deleteBranch(root);
+    }
+
+    if (source.forest.trees != NULL)
+        diffContextDestructor(&source);
+    return is_passed;
+}
+
+
+static bool checkRoundTrip(Differentiator* source, const TreeNode* root, bool infix_input)
+{
+    assert(source); assert(root);
+
+    char* text = NULL;
+    size_t length = 0;
+    OperationStatus status = writeTree(source, root, infix_input, &text, &length);
+
+// Разбор идет тем же путем, что и у запросов: getTree для инфиксной записи, readNode для префиксной
+    Differentiator parsed = {};
+    if (status == STATUS_OK)
+        status = testContextCreate(&parsed, infix_input);
+    if (status == STATUS_OK)
+        status = diffParseExpression(&parsed, text, length);
+
+    bool is_passed = status == STATUS_OK &&
+        compareTrees(source, root, &parsed, parsed.forest.trees[0].root);
+    if (!is_passed)
+        fprintf(stderr, "round trip failed for: %.*s\n", (int)length, text != NULL ? text : "");
+
+    if (parsed.forest.trees != NULL)
+        diffContextDestructor(&parsed);
+    free(text);
+    return is_passed;
+}
+
+
+static OperationStatus writeTree(Differentiator* diff, const TreeNode* root, bool infix_input,
+                                 char** text, size_t* length)
+{
+    assert(diff); assert(root); assert(text); assert(length);
+
+    FILE* output = open_memstream(text, length);
+    if (output == NULL)
+        return STATUS_SYSTEM_OUT_OF_MEMORY;
+
+    OperationStatus status = infix_input ? treeWriteInfix(diff, root, output) : treeWritePrefix(diff, root, output);
+    if (fclose(output) != 0 && status == STATUS_OK)
+        status = STATUS_IO_FILE_CLOSE_ERROR;
+
+    return status;
+}
+
+
+static bool compareTrees(const Differentiator* expected_diff, const TreeNode* expected,
+                         const Differentiator* actual_diff, const TreeNode* actual)
+{
+    assert(expected_diff); assert(actual_diff);
+
+    if (expected == NULL || actual == NULL)
+        return expected == actual;
+    if (expected->type != actual->type)
+        return false;
+
+// Числа сравниваются побитово, переменные - по именам, потому что индексы в таблицах разные
+    switch (expected->type) {
+        case NODE_NUM:
+            return isSameNumber(expected->value.num_val, actual->value.num_val);
+        case NODE_VAR:
+            return strcmp(expected_diff->var_table.variables[expected->value.var_idx].name,
+                actual_diff->var_table.variables[actual->value.var_idx].name) == 0;
+        case NODE_OP:
+            return expected->value.op == actual->value.op &&
+                compareTrees(expected_diff, expected->left, actual_diff, actual->left) &&
+                compareTrees(expected_diff, expected->right, actual_diff, actual->right);
+        default:
+            return false;
+    }
+}
+
+
+static bool isSameNumber(double expected, double actual)
+{
+// Запись nan не хранит содержимое мантиссы, поэтому у nan сравнивается только знак
+    if (isnan(expected))
+        return isnan(actual) && signbit(expected) == signbit(actual);
+
+    return memcmp(&expected, &actual, sizeof(double)) == 0;
+}
+
+
+static TreeNode* createRandomTree(uint64_t* seed, size_t depth)
+{
+    assert(seed);
+
+    uint64_t choice = nextRandom(seed);
+    if (depth == ROUND_TRIP_MAX_DEPTH || (depth > 0 && choice % 3 == 0)) {
+        if ((choice >> 8) % 2 == 0)
+            return createVar((choice >> 16) % ROUND_TRIP_VARIABLE_COUNT);
+        return createNum(createRandomNumber(seed));
+    }
+
+    OpType op = (OpType)((choice >> 8) % OP_NONE);
+    TreeNode* left = op <= OP_LOG ? createRandomTree(seed, depth + 1) : NULL;
+    TreeNode* right = createRandomTree(seed, depth + 1);
+
+    TreeNode* node = createOp(op, left, right);
+    if (node == NULL) {
+        deleteBranch(left);
+        deleteBranch(right);
+        return NULL;
+    }
+    if ((op <= OP_LOG && left == NULL) || right == NULL) {
+        deleteBranch(node);
+        return NULL;
+    }
+
+    return node;
+}
+
+
+static double createRandomNumber(uint64_t* seed)
+{
+    assert(seed);
+
+// Короткие целые и десятичные дроби чередуются с произвольными значениями, включая inf и nan
+    uint64_t bits = nextRandom(seed);
+    double number = 0;
+    switch (bits % 5) {
+        case 0:
+            number = (double)((bits >> 8) % 100);
+            break;
+        case 1:
+            number = (double)((bits >> 8) % 100000) / pow(10, (double)((bits >> 32) % 6));
+            break;
+        case 2:
+            number = ldexp((double)(bits >> 11) / 9007199254740992.0, (int)((bits >> 3) % 161) - 80);
+            break;
+        case 3:
+            number = (bits >> 8) % 2 == 0 ? INFINITY : NAN;
+            break;
+        default:
+            bits = nextRandom(seed);
+            memcpy(&number, &bits, sizeof(double));
+            return number;
+    }
+
+    return (bits >> 2) % 3 == 0 ? -number : number;
+}
+
+
+static uint64_t nextRandom(uint64_t* seed)
+{
+    assert(seed);
+
+// xorshift64*: тест детерминирован и не зависит от rand()
+    *seed ^= *seed >> 12;
+    *seed ^= *seed << 25;
+    *seed ^= *seed >> 27;
+    return *seed * 0x2545F4914F6CDD1D;
+}
@@ -0,0 +1,48 @@
+#ifndef TESTS_H_
+#define TESTS_H_
+
+
+#include "diff/diff_defs.h"
+
+#include "status.h"
+
+
+// Настройки по умолчанию без дампов и с одним потоком
+OperationStatus testArgsCreate(CmdArgs* args, bool infix_input);
+
+
+// Контекст без отчета и дампов, как у запросов пакетного режима
+OperationStatus testContextCreate(Differentiator* diff, bool infix_input);
+
+
+bool testForestEvaluate();
+
+
+bool testWriteInfixRoundTrip();
+
+
+bool testWritePrefixRoundTrip();
+
+
+bool testServerRequests();
+
+
+bool testParseInfix();
+
+
+bool testRenderCache();
+
+
+bool testSharedValidation();
+
+
+bool testDerivativeCache();
+
+
+bool testParallelOptimize();
+
+
+bool testBatchOrder();
+
+
+#endif // TESTS_H_